@@ -49,6 +49,7 @@ enum umqtt_err_code
     UMQTT_RECONNECT_FAILED      = -14,                  /* reconnect failed  */
     UMQTT_SOCK_CONNECT_FAILED   = -15,
     UMQTT_DISCONNECT            = -16,
+    UMQTT_WOULD_BLOCK           = -17,                  /* outbound backlog over the high watermark */
 };
 
 enum umqtt_evt
@@ -65,6 +66,26 @@ enum umqtt_cmd
     UMQTT_CMD_EVT_CB            = 0x01,
     UMQTT_CMD_SET_HB            = 0x02,                 /* set heartbeat time interval */
     UMQTT_CMD_GET_CLIENT_STA    = 0x03,                 /* get client status*/
+    UMQTT_CMD_SET_SOCKOPT       = 0x04,                 /* set socket options, applied on every (re)connect */
+    UMQTT_CMD_GET_TFO_STA       = 0x05,                 /* get TCP Fast Open status of the current link */
+#ifdef PKG_UMQTT_USING_STATS
+    UMQTT_CMD_GET_STATS         = 0x06,                 /* get client statistics, params: struct umqtt_stats */
+    UMQTT_CMD_CLR_STATS         = 0x07,                 /* clear client statistics */
+#endif
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+    UMQTT_CMD_SET_TOPIC_DEPTH   = 0x08,                 /* set topic statistics prefix depth, params: int *, clears the table */
+#endif
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+    UMQTT_CMD_SET_SUB_QUEUE     = 0x09,                 /* set a subscription delivery queue, params: struct umqtt_sub_queue_cfg * */
+#endif
+    UMQTT_CMD_GET_KP_INTERVAL   = 0x0A,                 /* get the idle time before a PINGREQ, params: rt_uint32_t *, uint:Sec */
+#ifdef PKG_UMQTT_USING_MEM_STATS
+    UMQTT_CMD_GET_MEM           = 0x0B,                 /* get client memory usage, params: struct umqtt_mem_usage * */
+    UMQTT_CMD_CLR_MEM_PEAK      = 0x0C,                 /* restart the peaks from the current usage */
+#endif
+#ifdef PKG_UMQTT_USING_PUB_RING
+    UMQTT_CMD_GET_RING_DROPS    = 0x0D,                 /* get publishes dropped by the publish ring, params: rt_uint32_t * */
+#endif
 
     UMQTT_CMD_DISCONNECT        = 0x7E,                 /* close socket & mqtt disconnect */
     UMQTT_CMD_DEL_HANDLE        = 0x7F,
@@ -75,10 +96,258 @@ enum umqtt_cmd
 
 enum umqtt_qos { UMQTT_QOS0 = 0, UMQTT_QOS1 = 1, UMQTT_QOS2 = 2, UMQTT_SUBFAIL = 0x80 };
 
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+enum umqtt_prio                                         /* outbound class, a lower value goes out first */
+{
+    UMQTT_PRIO_CONTROL          = 0,                    /* acks, PINGREQ, CONNECT / DISCONNECT, internal */
+    UMQTT_PRIO_HIGH             = 1,                    /* subscribe / unsubscribe, umqtt_publish / umqtt_publish_async */
+    UMQTT_PRIO_BULK             = 2,                    /* large or background publishes */
+};
+#define UMQTT_PRIO_NUM                  3
+#endif
+
+enum umqtt_trans_evt
+{
+    UMQTT_TRANS_POLLIN          = 0x01,                 /* transport readable */
+    UMQTT_TRANS_POLLOUT         = 0x02,                 /* transport writable */
+};
+
+enum umqtt_tfo_sta
+{
+    UMQTT_TFO_OFF               = 0x00,                 /* not requested or not supported by the stack */
+    UMQTT_TFO_FALLBACK          = 0x01,                 /* requested, the broker took a normal handshake */
+    UMQTT_TFO_USED              = 0x02,                 /* CONNECT was carried in the SYN */
+};
+
+#define UMQTT_TRANS_IOV_MAX             8                   /* most segments of one sendv */
+
+struct umqtt_iovec
+{
+    const void *iov_base;                               /* segment start address */
+    rt_size_t iov_len;                                  /* segment length */
+};
+
+struct umqtt_sockopt                                    /* 0: keep the stack default */
+{
+    rt_uint8_t nodelay;                                 /* 1: disable Nagle, TCP_NODELAY */
+    rt_uint8_t keepalive;                               /* 1: enable TCP keepalive, SO_KEEPALIVE */
+    rt_uint8_t fastopen;                                /* 1: carry CONNECT in the SYN, TCP_FASTOPEN_CONNECT (linux host) */
+    rt_uint16_t keepidle;                               /* keepalive idle time before probing, uint:Sec */
+    rt_uint16_t keepintvl;                              /* keepalive probe interval, uint:Sec */
+    rt_uint16_t keepcnt;                                /* keepalive probe count */
+    rt_uint32_t sndbuf;                                 /* socket send buffer size, SO_SNDBUF */
+    rt_uint32_t rcvbuf;                                 /* socket receive buffer size, SO_RCVBUF */
+    rt_uint32_t busy_poll;                              /* busy poll time, uint:uSec, SO_BUSY_POLL (linux host) */
+};
+
+#ifdef PKG_UMQTT_USING_STATS
+#define UMQTT_STATS_PKT_TYPES           16              /* indexed by packet type, 1: CONNECT ... 14: DISCONNECT */
+#define UMQTT_STATS_RTT_BUCKETS         16              /* 0: <1 mSec, n: [2^(n-1), 2^n) mSec, last: and above */
+
+struct umqtt_stats
+{
+    rt_uint32_t tx_pkts[UMQTT_STATS_PKT_TYPES];         /* packets sent, by type */
+    rt_uint32_t tx_bytes[UMQTT_STATS_PKT_TYPES];        /* bytes sent, by type */
+    rt_uint32_t rx_pkts[UMQTT_STATS_PKT_TYPES];         /* packets received, by type */
+    rt_uint32_t rx_bytes[UMQTT_STATS_PKT_TYPES];        /* bytes received, by type */
+    rt_uint32_t retransmits;                            /* publish / pubrel / pubrec sent again */
+    rt_uint32_t rx_drops;                               /* packets dropped, longer than the receive buffer */
+    rt_uint32_t reconnects;                             /* links established again after losing one */
+    rt_uint32_t offline_ms;                             /* time spent offline after losing a link, uint:mSec */
+    rt_uint32_t pub_rtt[UMQTT_STATS_RTT_BUCKETS];       /* publish to PUBACK / PUBREC round trip histogram */
+    rt_uint32_t ping_rtt[UMQTT_STATS_RTT_BUCKETS];      /* PINGREQ to PINGRESP round trip histogram */
+};
+#endif
+
+#ifdef PKG_UMQTT_USING_TRACE
+enum umqtt_trace_id
+{
+    UMQTT_TRACE_READ_HEADER     = 0x01,                 /* fixed header byte read */
+    UMQTT_TRACE_READ_BODY       = 0x02,                 /* whole packet read */
+    UMQTT_TRACE_DECODE          = 0x03,                 /* packet decoded */
+    UMQTT_TRACE_DISPATCH        = 0x04,                 /* publish handed to the subscription callback */
+    UMQTT_TRACE_ACK_SENT        = 0x05,                 /* puback / pubrec / pubcomp sent */
+    UMQTT_TRACE_PUB_ENCODED     = 0x06,                 /* publish encoded */
+    UMQTT_TRACE_SEND_DONE       = 0x07,                 /* publish handed to the transport */
+};
+
+struct umqtt_trace_evt                                  /* 16 bytes per event */
+{
+    rt_uint32_t seq;                                    /* event sequence + 1, 0: being written */
+    rt_uint32_t stamp;                                  /* PKG_UMQTT_TRACE_CLOCK() */
+    rt_uint32_t len;                                    /* packet length */
+    rt_uint16_t packet_id;                              /* packet id, 0: none */
+    rt_uint8_t evt;                                     /* enum umqtt_trace_id */
+    rt_uint8_t type;                                    /* mqtt packet type */
+};
+
+struct umqtt_trace_file                                 /* dump file header */
+{
+    rt_uint32_t magic;                                  /* "UMQT" */
+    rt_uint16_t version;                                /* file layout version */
+    rt_uint16_t evt_size;                               /* sizeof(struct umqtt_trace_evt) */
+    rt_uint32_t clock_hz;                               /* stamp counts per second */
+    rt_uint32_t count;                                  /* events following the header */
+};
+#endif
+
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+#ifndef PKG_UMQTT_TOPIC_STATS_PREFIX_LEN
+#define PKG_UMQTT_TOPIC_STATS_PREFIX_LEN    48
+#endif
+
+struct umqtt_topic_stat                                 /* traffic of the topics sharing one prefix */
+{
+    char prefix[PKG_UMQTT_TOPIC_STATS_PREFIX_LEN];      /* first levels of the topic name */
+    rt_uint32_t rx_msgs;                                /* messages received from the broker */
+    rt_uint32_t rx_bytes;                               /* payload bytes received from the broker */
+    rt_uint32_t tx_msgs;                                /* messages published by the client */
+    rt_uint32_t tx_bytes;                               /* payload bytes published by the client */
+};
+#endif
+
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+enum umqtt_sub_policy                                   /* subscription queue overflow policy */
+{
+    UMQTT_SUB_BLOCK             = 0,                    /* wait for the callback, stops reading the socket */
+    UMQTT_SUB_DROP_OLDEST       = 1,                    /* drop the oldest queued message */
+    UMQTT_SUB_DROP_NEWEST       = 2,                    /* drop the incoming message */
+    UMQTT_SUB_CONFLATE          = 3,                    /* keep only the latest message of each topic */
+};
+
+struct umqtt_sub_queue_cfg
+{
+    const char *topicfilter;                            /* subscribed topic filter */
+    rt_uint16_t depth;                                  /* queued messages, 0: deliver on the receive thread */
+    rt_uint8_t policy;                                  /* enum umqtt_sub_policy */
+};
+#endif
+
+#if defined(PKG_UMQTT_USING_TOPIC_STATS) || defined(PKG_UMQTT_USING_CB_WATCHDOG) || defined(PKG_UMQTT_USING_SUB_QUEUE)
+#define UMQTT_USING_SUB_STATS
+#ifndef PKG_UMQTT_SUB_STATS_FILTER_LEN
+#define PKG_UMQTT_SUB_STATS_FILTER_LEN      64
+#endif
+
+struct umqtt_sub_stat                                   /* one subscription */
+{
+    char topicfilter[PKG_UMQTT_SUB_STATS_FILTER_LEN];   /* subscribed topic filter, cut to fit */
+    rt_uint32_t deliver_cnt;                            /* messages delivered to the callback */
+#ifdef PKG_UMQTT_USING_CB_WATCHDOG
+    rt_uint32_t cb_max_us;                              /* longest callback run, uint:uSec */
+    rt_uint32_t cb_avg_us;                              /* average callback run, uint:uSec */
+    rt_uint32_t cb_overruns;                            /* callback runs over the budget */
+#endif
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+    rt_uint32_t drops;                                  /* messages dropped or conflated by the queue */
+#endif
+};
+#endif
+
+#ifdef PKG_UMQTT_USING_TLS_SESSION_CACHE
+struct umqtt_tls_stats                                  /* TLS handshakes of every client, ssl:// */
+{
+    rt_uint32_t full_cnt;                               /* full handshakes */
+    rt_uint32_t resume_cnt;                             /* resumed handshakes */
+    rt_uint32_t resume_miss;                            /* cached session offered, the broker refused it */
+    rt_uint32_t full_ms;                                /* accumulated full handshake time, uint:mSec */
+    rt_uint32_t resume_ms;                              /* accumulated resumed handshake time, uint:mSec */
+    rt_uint32_t last_ms;                                /* last handshake time, uint:mSec */
+};
+#endif
+
+#if defined(PKG_UMQTT_USING_ALLOCATOR) || defined(PKG_UMQTT_USING_MEM_STATS)
+enum umqtt_mem_tag                                      /* what an allocation is for */
+{
+    UMQTT_MEM_TAG_CLIENT        = 0x00,                 /* client structure, the whole storage in static mode */
+    UMQTT_MEM_TAG_SEND_BUF      = 0x01,                 /* send buffer */
+    UMQTT_MEM_TAG_RECV_BUF      = 0x02,                 /* receive buffer */
+    UMQTT_MEM_TAG_SUBSCRIBE     = 0x03,                 /* subscription with its topic filter */
+    UMQTT_MEM_TAG_QOS2          = 0x04,                 /* qos2 message waiting for PUBREL */
+    UMQTT_MEM_TAG_HEALTH        = 0x05,                 /* health report frame */
+    UMQTT_MEM_TAG_URI           = 0x06,                 /* host name while resolving the URI */
+    UMQTT_MEM_TAG_QUEUE         = 0x07,                 /* ack message queue, from the kernel heap */
+    UMQTT_MEM_TAG_PUB_RING      = 0x08,                 /* qos0 publish ring */
+    UMQTT_MEM_TAG_LANE          = 0x09,                 /* outbound lane arbiter with its control frames */
+    UMQTT_MEM_TAG_DISPATCH      = 0x0A,                 /* subscribe callback worker pool */
+    UMQTT_MEM_TAG_SUB_QUEUE     = 0x0B,                 /* subscription queue with its ring */
+    UMQTT_MEM_TAG_TOPIC_STATS   = 0x0C,                 /* topic statistics table */
+    UMQTT_MEM_TAG_NUM,
+};
+#endif
+
+#ifdef PKG_UMQTT_USING_MEM_STATS
+struct umqtt_mem_usage                                  /* heap bytes of one client, indexed by enum umqtt_mem_tag */
+{
+    rt_uint32_t cur[UMQTT_MEM_TAG_NUM];                 /* held now */
+    rt_uint32_t peak[UMQTT_MEM_TAG_NUM];                /* most held at once since create or UMQTT_CMD_CLR_MEM_PEAK */
+    rt_uint32_t total;                                  /* held now, all tags */
+    rt_uint32_t total_peak;                             /* most held at once, all tags */
+    rt_uint32_t stack_size;                             /* receive thread stack size */
+    rt_uint32_t stack_peak;                             /* receive thread stack high-water mark */
+};
+#endif
+
+#ifdef PKG_UMQTT_USING_ALLOCATOR
+struct umqtt_allocator                                  /* RT_NULL alloc: rt_malloc / rt_free */
+{
+    void *(*alloc)(void *ctx, rt_size_t size, enum umqtt_mem_tag tag);
+    void (*free)(void *ctx, void *ptr, rt_size_t size, enum umqtt_mem_tag tag);
+    void *ctx;                                          /* passed back to alloc and free */
+};
+#endif
+
+struct umqtt_trans;
+
+struct umqtt_trans_ops
+{
+    const char *scheme;                                 /* URI scheme served by this backend, e.g. "tcp://" */
+    int (*connect)(struct umqtt_trans *trans, const char *uri);
+    int (*close)(struct umqtt_trans *trans);
+    int (*send)(struct umqtt_trans *trans, const rt_uint8_t *buf, rt_uint32_t len, int timeout);
+    int (*sendv)(struct umqtt_trans *trans, const struct umqtt_iovec *iov, int iovcnt, int timeout);  /* optional, up to UMQTT_TRANS_IOV_MAX */
+    int (*recv)(struct umqtt_trans *trans, rt_uint8_t *buf, rt_uint32_t len);
+    int (*poll)(struct umqtt_trans *trans, int events, int timeout);                                 /* optional */
+    int (*pending)(struct umqtt_trans *trans);                                                       /* optional, bytes not yet sent */
+    int (*wake)(struct umqtt_trans *trans);                                                          /* optional, ends a poll blocked on another thread */
+    rt_list_t list;                                     /* registered backend list */
+};
+
+struct umqtt_trans
+{
+    const struct umqtt_trans_ops *ops;                  /* backend selected by URI scheme */
+    int sock;                                           /* socket or backend descriptor, -1: closed */
+    void *user_data;                                    /* backend private datas */
+    const struct umqtt_sockopt *sockopt;                /* socket options applied on connect */
+    void *addr_cache;                                   /* resolved server address, reused on reconnect */
+#ifdef PKG_UMQTT_USING_ALLOCATOR
+    const struct umqtt_allocator *allocator;            /* client allocator, used while resolving the URI */
+#endif
+    rt_uint8_t tfo_sta;                                 /* enum umqtt_tfo_sta of the current link */
+#ifdef PKG_UMQTT_USING_PUB_RING
+    int wake_fd[2];                                     /* socket backends wake pipe, read end polled with the socket, -1: none */
+#endif
+};
+
 struct umqtt_client;
+struct umqtt_sub_queue;
 typedef struct umqtt_client *umqtt_client_t;
 typedef int (*umqtt_user_callback)(struct umqtt_client *client, enum umqtt_evt event);
 typedef void (*umqtt_subscribe_cb)(struct umqtt_client *client, void *msg);
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+typedef void (*umqtt_writable_cb)(struct umqtt_client *client);
+typedef void (*umqtt_pub_expired_cb)(struct umqtt_client *client, rt_uint16_t packet_id);
+#endif
+#ifdef PKG_UMQTT_USING_CB_WATCHDOG
+typedef void (*umqtt_cb_overrun_hook)(struct umqtt_client *client, const char *topicfilter, rt_uint32_t elapsed_us);
+#endif
+
+/* word sized counter updated from several threads, use the umqtt_atomic_* operations */
+#if defined(RT_VERSION_CHECK) && (RTTHREAD_VERSION >= RT_VERSION_CHECK(5, 0, 0))
+typedef rt_atomic_t umqtt_atomic_t;
+#else
+typedef rt_base_t umqtt_atomic_t;
+#endif
 
 struct subtop_recv_handler
 {
@@ -86,6 +355,19 @@ struct subtop_recv_handler
     void (*callback)(void *client, void *message);
     enum umqtt_qos qos;
     rt_list_t next_list;
+    rt_uint16_t busy;                                   /* deliveries using it outside the client lock */
+    rt_uint8_t removed;                                 /* unsubscribed while busy, the last delivery frees it */
+#ifdef UMQTT_USING_SUB_STATS
+    umqtt_atomic_t deliver_cnt;                         /* messages delivered to the callback */
+#endif
+#ifdef PKG_UMQTT_USING_CB_WATCHDOG
+    rt_uint64_t cb_total_us;                            /* callback run time, uint:uSec, interrupt lock held */
+    umqtt_atomic_t cb_max_us;                           /* longest callback run, uint:uSec */
+    umqtt_atomic_t cb_overruns;                         /* callback runs over the budget */
+#endif
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+    struct umqtt_sub_queue *queue;                      /* delivery queue, RT_NULL: deliver on the receive thread */
+#endif
 };
 
 struct umqtt_info
@@ -108,9 +390,34 @@ struct umqtt_info
     rt_uint32_t send_timeout;                           /* uplink_timeout  publish/subscribe/unsubscribe */
     rt_uint32_t thread_stack_size;                      /* thread task stack size */
     rt_uint8_t thread_priority;                         /* thread priority */
+    struct umqtt_sockopt sockopt;                       /* socket options: latency-first or throughput-first */
 #ifdef PKG_UMQTT_TEST_SHORT_KEEPALIVE_TIME
     rt_uint16_t connect_keepalive_sec;                  /* connect information, keepalive second */
 #endif
+#ifdef PKG_UMQTT_USING_HEALTH
+    const char *health_topic;                           /* health report topic, RT_NULL: PKG_UMQTT_HEALTH_DEF_TOPIC + client id */
+    rt_uint32_t health_interval;                        /* health report interval, uint:Sec, 0: default */
+#endif
+#ifdef PKG_UMQTT_USING_DISPATCH
+    rt_uint8_t dispatch_workers;                        /* subscribe callback worker threads, 0: default */
+#endif
+#ifdef PKG_UMQTT_USING_CB_WATCHDOG
+    rt_uint32_t cb_budget_ms;                           /* subscribe callback time budget, uint:mSec, 0: default */
+    umqtt_cb_overrun_hook cb_overrun_hook;              /* called after a callback ran over the budget, RT_NULL: log only */
+#endif
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+    rt_uint32_t wm_high_bytes, wm_low_bytes;            /* outbound backlog bytes watermarks, 0: default */
+    rt_uint16_t wm_high_msgs, wm_low_msgs;              /* unacknowledged qos1/qos2 async publishes watermarks, 0: default */
+    umqtt_writable_cb on_writable;                      /* called once the backlog drained to the low watermarks after UMQTT_WOULD_BLOCK */
+    rt_uint32_t inflight_expire_ms;                     /* unacknowledged qos1/qos2 async publish slot expiry, uint:mSec, 0: default */
+    umqtt_pub_expired_cb on_pub_expired;                /* called with the packet id of an async publish that expired, RT_NULL: log only */
+#endif
+#ifdef PKG_UMQTT_USING_BUF_POOL
+    rt_uint32_t buf_reserve;                            /* shared buffer pool bytes guaranteed to this client, 0: default */
+#endif
+#ifdef PKG_UMQTT_USING_ALLOCATOR
+    struct umqtt_allocator allocator;                   /* client memory, alloc RT_NULL: the system heap */
+#endif
 };
 
 
@@ -118,6 +425,19 @@ struct umqtt_info
 /* create umqtt client according to user information */
 umqtt_client_t umqtt_create(const struct umqtt_info *info);
 
+#ifdef PKG_UMQTT_USING_BUF_POOL
+/* change the budget of the buffer pool shared by all clients */
+int umqtt_buf_pool_set_budget(rt_uint32_t budget);
+#endif
+
+#ifdef PKG_UMQTT_USING_STATIC
+/* storage bytes a client with this information needs */
+rt_size_t umqtt_static_size(const struct umqtt_info *info);
+
+/* create umqtt client in caller provided storage, no heap is used */
+umqtt_client_t umqtt_create_static(const struct umqtt_info *info, void *storage, rt_size_t size);
+#endif
+
 /* delete umqtt client */
 int umqtt_delete(struct umqtt_client *client);
 
@@ -139,9 +459,55 @@ int umqtt_unsubscribe(struct umqtt_client *client, const char *topic);
 /* umqtt client publish nonblocking datas */
 int umqtt_publish_async(struct umqtt_client *client, enum umqtt_qos qos, const char *topic, void *payload, size_t length);
 
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+/* publish on the chosen outbound class, UMQTT_PRIO_HIGH or UMQTT_PRIO_BULK */
+int umqtt_publish_prio(struct umqtt_client *client, enum umqtt_prio prio, enum umqtt_qos qos, const char *topic,
+                       void *payload, size_t length, int timeout);
+int umqtt_publish_async_prio(struct umqtt_client *client, enum umqtt_prio prio, enum umqtt_qos qos, const char *topic,
+                             void *payload, size_t length);
+#endif
+
+#ifdef PKG_UMQTT_USING_PUB_RING
+/* queue a qos0 publish from one producer thread, never blocks */
+int umqtt_publish_enqueue(struct umqtt_client *client, const char *topic, const void *payload, size_t length);
+
+/* build a queued qos0 publish in place: reserve a ring slot, write the payload, commit it */
+rt_uint8_t *umqtt_publish_reserve(struct umqtt_client *client, const char *topic, size_t *size);
+int umqtt_publish_commit(struct umqtt_client *client, size_t length);
+#endif
+
 /* set some config datas in umqtt client */
 int umqtt_control(struct umqtt_client *client, enum umqtt_cmd cmd, void *params);
 
+/* register a transport backend for the URI scheme it serves */
+int umqtt_trans_register(struct umqtt_trans_ops *ops);
+
+#ifdef PKG_UMQTT_USING_MSG_RETAIN
+/* keep a message passed to a subscribe callback valid after it returns, without copying */
+void *umqtt_msg_retain(void *msg);
+void umqtt_msg_release(void *msg);
+#endif
+
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+/* per topic prefix traffic, return the copied entries count */
+int umqtt_topic_stats(struct umqtt_client *client, struct umqtt_topic_stat *stats, int max);
+#endif
+#ifdef UMQTT_USING_SUB_STATS
+/* per subscription deliveries and callback run time, return the copied entries count */
+int umqtt_sub_stats(struct umqtt_client *client, struct umqtt_sub_stat *stats, int max);
+#endif
+
+#ifdef PKG_UMQTT_USING_TRACE
+/* dump the binary trace ring, oldest event first */
+int umqtt_trace_dump(const char *path);
+#endif
+
+#ifdef PKG_UMQTT_USING_TLS_SESSION_CACHE
+/* TLS handshake counters and session cache of the ssl:// backend */
+int umqtt_tls_get_stats(struct umqtt_tls_stats *stats);
+void umqtt_tls_session_flush(const char *uri);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
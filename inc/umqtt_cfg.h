@@ -11,6 +11,8 @@
 #ifndef _UMQTT_CFG_H__
 #define _UMQTT_CFG_H__
 
+#include <rtconfig.h>
+
 #define PKG_UMQTT_PROTOCOL_NAME                         ("MQTC")
 #define PKG_UMQTT_PROTOCOL_NAME_LEN                     (rt_strlen(PKG_UMQTT_PROTOCOL_NAME))
 #define PKG_UMQTT_PROTOCOL_LEVEL                        (4)             /* MQTT3.1.1 ver_lvl:4;  MQTT3.1 ver_lvl:3 */
@@ -38,5 +40,170 @@
 #define PKG_UMQTT_QOS2_QUE_MAX                          1
 #endif
 #define PKG_UMQTT_RECPUBREC_INTERVAL_TIME               (2 * UMQTT_INFO_DEF_UPLINK_TIMER_TICK)
+#ifndef PKG_UMQTT_PKGS_FILTER_MAX
+#define PKG_UMQTT_PKGS_FILTER_MAX                       1               /* topic filters per SUBSCRIBE/UNSUBSCRIBE, the client sends one */
+#endif
+
+#ifndef PKG_UMQTT_TRANS_MEM_PIPE_SIZE
+#define PKG_UMQTT_TRANS_MEM_PIPE_SIZE                   4096
+#endif
+
+#ifndef PKG_UMQTT_TRACE_RING_SIZE
+#define PKG_UMQTT_TRACE_RING_SIZE                       1024            /* trace events kept, power of 2 */
+#endif
+#ifndef PKG_UMQTT_TRACE_CLOCK                                           /* e.g. a cycle counter for sub-tick resolution */
+#define PKG_UMQTT_TRACE_CLOCK()                         rt_tick_get()
+#define PKG_UMQTT_TRACE_CLOCK_HZ                        RT_TICK_PER_SECOND
+#define UMQTT_TRACE_CLOCK_IS_TICK                                       /* one system tick resolution */
+#endif
+
+#ifndef PKG_UMQTT_CB_CLOCK                                              /* subscribe callback timing, shares a sub-tick trace clock */
+#if defined(PKG_UMQTT_USING_CB_WATCHDOG) && defined(UMQTT_TRACE_CLOCK_IS_TICK)
+#error "PKG_UMQTT_USING_CB_WATCHDOG reports uSec, define a sub-tick PKG_UMQTT_CB_CLOCK() and PKG_UMQTT_CB_CLOCK_HZ (or PKG_UMQTT_TRACE_CLOCK)"
+#endif
+#define PKG_UMQTT_CB_CLOCK()                            PKG_UMQTT_TRACE_CLOCK()
+#define PKG_UMQTT_CB_CLOCK_HZ                           PKG_UMQTT_TRACE_CLOCK_HZ
+#endif
+#ifndef PKG_UMQTT_CB_BUDGET_DEF_MS
+#define PKG_UMQTT_CB_BUDGET_DEF_MS                      50              /* uint:mSec */
+#endif
+
+#ifndef PKG_UMQTT_DISPATCH_WORKERS
+#define PKG_UMQTT_DISPATCH_WORKERS                      2               /* subscribe callback worker threads */
+#endif
+#ifndef PKG_UMQTT_DISPATCH_QUEUE_SIZE
+#define PKG_UMQTT_DISPATCH_QUEUE_SIZE                   16              /* messages queued per worker, power of 2 */
+#endif
+#ifndef PKG_UMQTT_DISPATCH_STACK_SIZE
+#define PKG_UMQTT_DISPATCH_STACK_SIZE                   2048
+#endif
+
+#ifndef PKG_UMQTT_RECV_POOL_NUM
+#define PKG_UMQTT_RECV_POOL_NUM                         2               /* released receive buffers kept for reuse */
+#endif
+
+#ifndef PKG_UMQTT_SUB_QUEUE_STACK_SIZE
+#define PKG_UMQTT_SUB_QUEUE_STACK_SIZE                  2048            /* subscription queue consumer thread */
+#endif
+
+#ifndef PKG_UMQTT_KP_ADAPT_MAX
+#define PKG_UMQTT_KP_ADAPT_MAX                          1800            /* adaptive keepalive upper bound, uint:Sec */
+#endif
+#ifndef PKG_UMQTT_KP_ADAPT_STEP
+#define PKG_UMQTT_KP_ADAPT_STEP                         30              /* growth after each answered idle probe, uint:Sec */
+#endif
+#ifndef PKG_UMQTT_KP_ADAPT_MARGIN
+#define PKG_UMQTT_KP_ADAPT_MARGIN                       10              /* settle this far below the path limit, uint:% */
+#endif
+
+#ifndef PKG_UMQTT_LANE_CTRL_SIZE
+#define PKG_UMQTT_LANE_CTRL_SIZE                        64              /* control frames queued behind a user frame, uint:Byte */
+#endif
+
+#ifndef PKG_UMQTT_INFLIGHT_MAX
+#define PKG_UMQTT_INFLIGHT_MAX                          16              /* unacknowledged qos1/qos2 async publishes tracked */
+#endif
+#ifndef PKG_UMQTT_INFLIGHT_EXPIRE_MS
+#define PKG_UMQTT_INFLIGHT_EXPIRE_MS                    30000           /* an unacknowledged async publish gives up its slot, uint:mSec */
+#endif
+#ifndef PKG_UMQTT_WM_HIGH_BYTES
+#define PKG_UMQTT_WM_HIGH_BYTES                         8192            /* async publish would block at this backlog */
+#endif
+#ifndef PKG_UMQTT_WM_LOW_BYTES
+#define PKG_UMQTT_WM_LOW_BYTES                          2048            /* writable again at this backlog */
+#endif
+#ifndef PKG_UMQTT_WM_HIGH_MSGS
+#define PKG_UMQTT_WM_HIGH_MSGS                          PKG_UMQTT_INFLIGHT_MAX
+#endif
+#ifndef PKG_UMQTT_WM_LOW_MSGS
+#define PKG_UMQTT_WM_LOW_MSGS                           (PKG_UMQTT_INFLIGHT_MAX / 4)
+#endif
+
+#ifndef PKG_UMQTT_TOPIC_STATS_NUM
+#define PKG_UMQTT_TOPIC_STATS_NUM                       64              /* topic prefixes tracked, power of 2 */
+#endif
+#ifndef PKG_UMQTT_TOPIC_STATS_DEPTH
+#define PKG_UMQTT_TOPIC_STATS_DEPTH                     2               /* topic levels kept in a prefix */
+#endif
+#ifndef PKG_UMQTT_TOPIC_STATS_PROBE
+#define PKG_UMQTT_TOPIC_STATS_PROBE                     4               /* slots probed per message */
+#endif
+
+#ifdef PKG_UMQTT_USING_HEALTH
+#ifndef PKG_UMQTT_USING_STATS
+#error "PKG_UMQTT_USING_HEALTH depends on PKG_UMQTT_USING_STATS"
+#endif
+#endif
+#ifndef PKG_UMQTT_HEALTH_DEF_TOPIC
+#define PKG_UMQTT_HEALTH_DEF_TOPIC                      "umqtt/health/" /* followed by the client id */
+#endif
+#ifndef PKG_UMQTT_HEALTH_DEF_INTERVAL
+#define PKG_UMQTT_HEALTH_DEF_INTERVAL                   60              /* uint:Sec */
+#endif
+#ifndef PKG_UMQTT_HEALTH_PAYLOAD_SIZE
+#define PKG_UMQTT_HEALTH_PAYLOAD_SIZE                   256
+#endif
+
+#ifdef PKG_UMQTT_USING_STATIC
+#if defined(PKG_UMQTT_USING_MSG_RETAIN) || defined(PKG_UMQTT_USING_DISPATCH) || defined(PKG_UMQTT_USING_SUB_QUEUE)
+#error "PKG_UMQTT_USING_STATIC excludes MSG_RETAIN, DISPATCH and SUB_QUEUE, they allocate per message"
+#endif
+#endif
+#ifndef PKG_UMQTT_STATIC_TOPIC_SIZE
+#define PKG_UMQTT_STATIC_TOPIC_SIZE                     64              /* topic filter bytes of a subscription, with '\0' */
+#endif
+#ifndef PKG_UMQTT_STATIC_QOS2_MSG_SIZE
+#define PKG_UMQTT_STATIC_QOS2_MSG_SIZE                  256             /* topic name and payload bytes of a held qos2 message */
+#endif
+
+#ifdef PKG_UMQTT_USING_BUF_POOL
+#if defined(PKG_UMQTT_USING_STATIC) || defined(PKG_UMQTT_USING_MSG_RETAIN)
+#error "PKG_UMQTT_USING_BUF_POOL excludes STATIC and MSG_RETAIN, they own the client buffers"
+#endif
+#endif
+#ifndef PKG_UMQTT_BUF_POOL_BUDGET
+#define PKG_UMQTT_BUF_POOL_BUDGET                       (16 * 1024)     /* buffer bytes shared by all clients */
+#endif
+#ifndef PKG_UMQTT_BUF_POOL_MIN_SIZE
+#define PKG_UMQTT_BUF_POOL_MIN_SIZE                     128             /* smallest size class, each class doubles it */
+#endif
+#ifndef PKG_UMQTT_BUF_POOL_CLASSES
+#define PKG_UMQTT_BUF_POOL_CLASSES                      6               /* size classes, larger frames are allocated exactly */
+#endif
+#ifndef PKG_UMQTT_BUF_POOL_RESERVE
+#define PKG_UMQTT_BUF_POOL_RESERVE                      256             /* default bytes guaranteed to each client */
+#endif
+
+#ifdef PKG_UMQTT_USING_PUB_RING
+#ifndef PKG_UMQTT_USING_PRIO_LANES
+#error "PKG_UMQTT_USING_PUB_RING depends on PKG_UMQTT_USING_PRIO_LANES, the bulk lane orders its writes with user packets"
+#endif
+#endif
+#ifndef PKG_UMQTT_PUB_RING_SLOTS
+#define PKG_UMQTT_PUB_RING_SLOTS                        32              /* queued qos0 publishes, power of 2 */
+#endif
+#ifndef PKG_UMQTT_PUB_RING_SLOT_SIZE
+#define PKG_UMQTT_PUB_RING_SLOT_SIZE                    128             /* topic name and payload bytes of a queued publish */
+#endif
+#ifndef PKG_UMQTT_PUB_RING_BATCH_SIZE
+#define PKG_UMQTT_PUB_RING_BATCH_SIZE                   1024            /* queued frames bytes written to the transport at once */
+#endif
+#ifndef PKG_UMQTT_PUB_RING_FLUSH_MS
+#define PKG_UMQTT_PUB_RING_FLUSH_MS                     10              /* longest wait of a queued publish without a transport wake, uint:mSec */
+#endif
+
+#ifndef PKG_UMQTT_TLS_SESSION_CACHE_NUM
+#define PKG_UMQTT_TLS_SESSION_CACHE_NUM                 4               /* brokers with a resumable session */
+#endif
+
+#ifndef PKG_UMQTT_TRANS_URING_ENTRIES
+#define PKG_UMQTT_TRANS_URING_ENTRIES                   8
+#endif
+#ifndef PKG_UMQTT_TRANS_URING_RXBUF_NUM
+#define PKG_UMQTT_TRANS_URING_RXBUF_NUM                 16              /* power of 2 */
+#endif
+#ifndef PKG_UMQTT_TRANS_URING_RXBUF_SIZE
+#define PKG_UMQTT_TRANS_URING_RXBUF_SIZE                2048
+#endif
 
 #endif
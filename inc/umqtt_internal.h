@@ -13,6 +13,7 @@
 
 #include <string.h>
 #include <rtdef.h>
+#include <rtthread.h>
 
 #include "umqtt_cfg.h"
 #include "umqtt.h"
@@ -170,7 +171,7 @@ struct umqtt_pkgs_subscribe                         /* subscribe topic */
     /* variable header */
     rt_uint16_t packet_id;                          /* packet id */
     /* payload */
-    struct sub_topic_filter topic_filter[PKG_UMQTT_SUBRECV_DEF_LENGTH];          /* topic name filter arrays */
+    struct sub_topic_filter topic_filter[PKG_UMQTT_PKGS_FILTER_MAX];             /* topic name filter arrays */
     /* not payload datas */
     rt_uint8_t topic_count;                         /* topic filter count */
 };
@@ -179,7 +180,7 @@ struct umqtt_pkgs_suback                            /* subscribe ack */
     /* variable header */
     rt_uint16_t packet_id;                          /* packet id */
     /* payload */
-    rt_uint8_t ret_qos[PKG_UMQTT_SUBRECV_DEF_LENGTH];   /* return code - enum Qos - 0/1/2 */
+    rt_uint8_t ret_qos[PKG_UMQTT_PKGS_FILTER_MAX];  /* return code - enum Qos - 0/1/2 */
     /* not payload datas */
     rt_uint8_t topic_count;                         /* topic name count */
 };
@@ -188,7 +189,7 @@ struct umqtt_pkgs_unsubscribe                       /* unsubscribe */
     /* variable header */
     rt_uint16_t packet_id;                          /* packet id */
     /* payload */
-    struct unsub_topic_filter topic_filter[PKG_UMQTT_SUBRECV_DEF_LENGTH];      /* topic name filter arrays */
+    struct unsub_topic_filter topic_filter[PKG_UMQTT_PKGS_FILTER_MAX];         /* topic name filter arrays */
     /* not payload datas */
     rt_uint8_t topic_count;                         /* topic name count */
 };
@@ -224,16 +225,245 @@ struct umqtt_msg
     union umqtt_pkgs_msg msg;                       /* retain payload message */
 };
 
+/* operations on the umqtt_atomic_t counters shared between the receive thread, the timer and user threads */
+#if defined(RT_VERSION_CHECK) && (RTTHREAD_VERSION >= RT_VERSION_CHECK(5, 0, 0))
+#define umqtt_atomic_load(ptr)                  rt_atomic_load(ptr)
+#define umqtt_atomic_store(ptr, val)            rt_atomic_store(ptr, val)
+#define umqtt_atomic_add(ptr, val)              rt_atomic_add(ptr, val)
+#define umqtt_atomic_exchange(ptr, val)         rt_atomic_exchange(ptr, val)
+#define umqtt_atomic_cas(ptr, old, val)         rt_atomic_compare_exchange_strong(ptr, old, val)
+#else
+#define umqtt_atomic_load(ptr)                  (*(volatile umqtt_atomic_t *)(ptr))
+#define umqtt_atomic_store(ptr, val)            (*(volatile umqtt_atomic_t *)(ptr) = (val))
+rt_inline umqtt_atomic_t umqtt_atomic_add(volatile umqtt_atomic_t *ptr, umqtt_atomic_t val)
+{
+    umqtt_atomic_t old;
+    rt_base_t level = rt_hw_interrupt_disable();
+    old = *ptr;
+    *ptr = old + val;
+    rt_hw_interrupt_enable(level);
+    return old;
+}
+rt_inline umqtt_atomic_t umqtt_atomic_exchange(volatile umqtt_atomic_t *ptr, umqtt_atomic_t val)
+{
+    umqtt_atomic_t old;
+    rt_base_t level = rt_hw_interrupt_disable();
+    old = *ptr;
+    *ptr = val;
+    rt_hw_interrupt_enable(level);
+    return old;
+}
+rt_inline int umqtt_atomic_cas(volatile umqtt_atomic_t *ptr, umqtt_atomic_t *old, umqtt_atomic_t val)
+{
+    int _ret = 0;
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (*ptr == *old)
+    {
+        *ptr = val;
+        _ret = 1;
+    }
+    else
+        *old = *ptr;
+    rt_hw_interrupt_enable(level);
+    return _ret;
+}
+#endif
+
+/* full memory barrier, orders plain stores around a published sequence number */
+#if defined(__GNUC__) || defined(__clang__)
+#define umqtt_atomic_fence()                    __sync_synchronize()
+#else
+#define umqtt_atomic_fence()                    rt_hw_interrupt_enable(rt_hw_interrupt_disable())
+#endif
+
+/* raise *ptr to val, a concurrent larger value wins */
+rt_inline void umqtt_atomic_max(volatile umqtt_atomic_t *ptr, umqtt_atomic_t val)
+{
+    umqtt_atomic_t old = umqtt_atomic_load(ptr);
+
+    while (((rt_ubase_t)val > (rt_ubase_t)old) && !umqtt_atomic_cas(ptr, &old, val))
+        old = umqtt_atomic_load(ptr);
+}
+
+/* hot path trace points, compiled out without PKG_UMQTT_USING_TRACE */
+#ifdef PKG_UMQTT_USING_TRACE
+void umqtt_trace_record(rt_uint8_t evt, rt_uint8_t type, rt_uint16_t packet_id, rt_uint32_t len);
+#define UMQTT_TRACE(EVT, TYPE, ID, LEN)         umqtt_trace_record((EVT), (TYPE), (ID), (LEN))
+#else
+#define UMQTT_TRACE(EVT, TYPE, ID, LEN)
+#endif
+
+/* per client modules take their memory from the client allocator */
+struct umqtt_allocator;
+
+/* bounded per topic prefix traffic table */
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+struct umqtt_topic_table;
+rt_uint32_t umqtt_topic_table_size(void);
+struct umqtt_topic_table *umqtt_topic_table_create(const struct umqtt_allocator *allocator);
+void umqtt_topic_table_delete(struct umqtt_topic_table *table, const struct umqtt_allocator *allocator);
+void umqtt_topic_table_account(struct umqtt_topic_table *table, const char *topic, int len,
+                               rt_uint32_t bytes, int is_tx);
+int umqtt_topic_table_query(struct umqtt_topic_table *table, struct umqtt_topic_stat *stats, int max);
+void umqtt_topic_table_set_depth(struct umqtt_topic_table *table, int depth);
+#endif
+
+/* subscribe callback worker pool, sharded by topic */
+#ifdef PKG_UMQTT_USING_DISPATCH
+struct umqtt_dispatch;
+typedef void (*umqtt_dispatch_deliver)(void *ctx, struct umqtt_pkgs_publish *msg);
+struct umqtt_dispatch *umqtt_dispatch_create(int workers, rt_uint32_t stack_size, rt_uint8_t priority,
+                                             umqtt_dispatch_deliver deliver, void *ctx,
+                                             const struct umqtt_allocator *allocator);
+rt_uint32_t umqtt_dispatch_size(struct umqtt_dispatch *dispatch);
+void umqtt_dispatch_delete(struct umqtt_dispatch *dispatch, const struct umqtt_allocator *allocator);
+int umqtt_dispatch_post(struct umqtt_dispatch *dispatch, const struct umqtt_pkgs_publish *msg);
+#endif
+
+/* ref-counted messages, pooled receive buffers; from the system heap, a
+   retained message and the pool behind it may outlive the client */
+#ifdef PKG_UMQTT_USING_MSG_RETAIN
+struct umqtt_msg_pool;
+struct umqtt_msg_pool *umqtt_msg_pool_create(rt_uint32_t size, rt_uint16_t max);
+void umqtt_msg_pool_delete(struct umqtt_msg_pool *pool);
+struct umqtt_pkgs_publish *umqtt_msg_pool_get(struct umqtt_msg_pool *pool);
+struct umqtt_pkgs_publish *umqtt_msg_alloc(rt_uint32_t size);
+int umqtt_msg_is_shared(struct umqtt_pkgs_publish *msg);
+/* every delivered message is ref-counted, keeping one needs no copy */
+#define umqtt_publish_hold(msg)                 ((struct umqtt_pkgs_publish *)umqtt_msg_retain((void *)(msg)))
+#define umqtt_publish_free(msg)                 umqtt_msg_release(msg)
+#else
+#define umqtt_publish_hold(msg)                 umqtt_publish_dup(msg)
+#define umqtt_publish_free(msg)                 rt_free(msg)
+#endif
+
+/* bounded per subscription delivery queue with its own consumer thread */
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+typedef void (*umqtt_sub_queue_deliver)(void *client, void *sub, struct umqtt_pkgs_publish *msg);
+struct umqtt_sub_queue *umqtt_sub_queue_create(void *client, void *sub, const struct umqtt_sub_queue_cfg *cfg,
+                                               rt_uint32_t stack_size, rt_uint8_t priority,
+                                               umqtt_sub_queue_deliver deliver,
+                                               const struct umqtt_allocator *allocator);
+rt_uint32_t umqtt_sub_queue_size(struct umqtt_sub_queue *queue);
+void umqtt_sub_queue_delete(struct umqtt_sub_queue *queue, const struct umqtt_allocator *allocator);
+int umqtt_sub_queue_post(struct umqtt_sub_queue *queue, const struct umqtt_pkgs_publish *msg);
+rt_uint32_t umqtt_sub_queue_drops(struct umqtt_sub_queue *queue);
+#endif
+
+/* outbound arbiter, control frames first, then user frames by class */
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+struct umqtt_lane;
+rt_uint32_t umqtt_lane_size(void);
+struct umqtt_lane *umqtt_lane_create(struct umqtt_trans *trans, int timeout, const struct umqtt_allocator *allocator);
+void umqtt_lane_delete(struct umqtt_lane *lane, const struct umqtt_allocator *allocator);
+int umqtt_lane_take(struct umqtt_lane *lane, int prio, int timeout);
+int umqtt_lane_release(struct umqtt_lane *lane);
+int umqtt_lane_control(struct umqtt_lane *lane, const rt_uint8_t *buf, rt_uint32_t len);
+void umqtt_lane_discard(struct umqtt_lane *lane);
+#endif
+
+/* process wide size-classed buffer pool, clients borrow per frame */
+#ifdef PKG_UMQTT_USING_BUF_POOL
+struct umqtt_buf_user                                           /* one client's account in the pool */
+{
+    rt_uint32_t reserve;                                        /* bytes this client may always borrow */
+    rt_uint32_t used;                                           /* bytes borrowed now */
+};
+int umqtt_buf_attach(struct umqtt_buf_user *user, rt_uint32_t reserve);
+void umqtt_buf_detach(struct umqtt_buf_user *user);
+rt_uint8_t *umqtt_buf_get(struct umqtt_buf_user *user, rt_uint32_t size, int timeout);
+void umqtt_buf_put(struct umqtt_buf_user *user, rt_uint8_t *buf);
+#endif
+
+/* wait-free qos0 publish ring, one producer thread, drained by the receive thread */
+#ifdef PKG_UMQTT_USING_PUB_RING
+struct umqtt_pub_ring;
+rt_uint32_t umqtt_pub_ring_size(void);
+struct umqtt_pub_ring *umqtt_pub_ring_create(const struct umqtt_allocator *allocator);
+void umqtt_pub_ring_delete(struct umqtt_pub_ring *ring, const struct umqtt_allocator *allocator);
+int umqtt_pub_ring_empty(struct umqtt_pub_ring *ring);
+int umqtt_pub_ring_reserve(struct umqtt_pub_ring *ring, const char *topic, rt_uint8_t **payload, rt_size_t *size);
+int umqtt_pub_ring_commit(struct umqtt_pub_ring *ring, rt_size_t length);
+int umqtt_pub_ring_batch(struct umqtt_pub_ring *ring, const rt_uint8_t **buf, int *frames);
+int umqtt_pub_ring_gather(struct umqtt_pub_ring *ring, struct umqtt_iovec *iov, int *frames);
+void umqtt_pub_ring_consume(struct umqtt_pub_ring *ring, int sent);
+rt_uint32_t umqtt_pub_ring_drops(struct umqtt_pub_ring *ring);
+#endif
+
+/* client memory through the user allocator, zeroed like rt_calloc */
+#ifdef PKG_UMQTT_USING_ALLOCATOR
+void *umqtt_mem_alloc(const struct umqtt_allocator *allocator, rt_size_t size, enum umqtt_mem_tag tag);
+void umqtt_mem_free(const struct umqtt_allocator *allocator, void *ptr, rt_size_t size, enum umqtt_mem_tag tag);
+#define UMQTT_MEM_ALLOC(ALLOCATOR, SIZE, TAG)       umqtt_mem_alloc((ALLOCATOR), (SIZE), (TAG))
+#define UMQTT_MEM_FREE(ALLOCATOR, PTR, SIZE, TAG)   umqtt_mem_free((ALLOCATOR), (PTR), (SIZE), (TAG))
+#else
+#define UMQTT_MEM_ALLOC(ALLOCATOR, SIZE, TAG)       rt_calloc(1, (SIZE))
+#define UMQTT_MEM_FREE(ALLOCATOR, PTR, SIZE, TAG)   rt_free(PTR)
+#endif
+
 /* umqtt package datas */
+int umqtt_encode_len(enum umqtt_type type, struct umqtt_msg *message);
 int umqtt_encode(enum umqtt_type type, rt_uint8_t *send_buf, size_t send_len, struct umqtt_msg *message);
+int umqtt_encode_ack(enum umqtt_type type, rt_uint16_t packet_id, rt_uint8_t *send_buf, size_t send_len);
+int umqtt_encode_publish_head(rt_uint8_t *send_buf, size_t send_len, struct umqtt_msg *message);
 /* umqtt unpackage datas */
 int umqtt_decode(rt_uint8_t *recv_buf, size_t recv_buf_len, struct umqtt_msg *message);
 
-/* tcp/tls connect/disconnect/send/recv functions */
-int umqtt_trans_connect(const char *uri, int *sock);
-int umqtt_trans_disconnect(int sock);
-int umqtt_trans_send(int sock, const rt_uint8_t *send_buf, rt_uint32_t buf_len, int timeout);
-int umqtt_trans_recv(int sock, rt_uint8_t *recv_buf, rt_uint32_t buf_len);
+/* transport connect/disconnect/send/recv functions, dispatched by URI scheme */
+int umqtt_trans_connect(struct umqtt_trans *trans, const char *uri);
+int umqtt_trans_disconnect(struct umqtt_trans *trans);
+int umqtt_trans_send(struct umqtt_trans *trans, const rt_uint8_t *send_buf, rt_uint32_t buf_len, int timeout);
+int umqtt_trans_sendv(struct umqtt_trans *trans, const struct umqtt_iovec *iov, int iovcnt, int timeout);
+int umqtt_trans_gathers(struct umqtt_trans *trans);
+int umqtt_trans_recv(struct umqtt_trans *trans, rt_uint8_t *recv_buf, rt_uint32_t buf_len);
+int umqtt_trans_poll(struct umqtt_trans *trans, int events, int timeout);
+int umqtt_trans_pending(struct umqtt_trans *trans);
+int umqtt_trans_wake(struct umqtt_trans *trans);
+int umqtt_trans_wakeable(struct umqtt_trans *trans);
+int umqtt_trans_time_left(rt_tick_t start_tick, int timeout);
+/* UMQTT_SEND_TIMEOUT only when nothing went out, a frame cut short leaves the stream torn */
+#define UMQTT_SEND_TORN(SENT, RET)      ((((RET) == UMQTT_SEND_TIMEOUT) && ((SENT) > 0)) ? UMQTT_SEND_FAILED : (RET))
+
+/* blocking stream socket connected to the host:port part of uri */
+int umqtt_trans_sock_connect(struct umqtt_trans *trans, const char *uri, int protocol);
+/* apply the user socket options, is_tcp: also apply the TCP level options */
+void umqtt_trans_sock_setopt(int sock, const struct umqtt_sockopt *opt, int is_tcp);
+/* bytes queued in the socket send buffer, 0 when the stack does not report it */
+int umqtt_trans_sock_pending(struct umqtt_trans *trans);
+/* poll the socket, and the wake pipe when there is one */
+int umqtt_trans_sock_poll(struct umqtt_trans *trans, int events, int timeout);
+/* the wake pipe lives as long as the client, a producer may write it during a reconnect */
+#if defined(PKG_UMQTT_USING_PUB_RING) && defined(RT_USING_POSIX_PIPE)
+#define UMQTT_TRANS_USING_WAKE_PIPE
+int umqtt_trans_sock_wake(struct umqtt_trans *trans);
+#define UMQTT_TRANS_SOCK_WAKE           umqtt_trans_sock_wake
+#else
+#define UMQTT_TRANS_SOCK_WAKE           RT_NULL
+#endif
+#ifdef PKG_UMQTT_USING_PUB_RING
+int umqtt_trans_wake_open(struct umqtt_trans *trans);
+void umqtt_trans_wake_close(struct umqtt_trans *trans);
+#endif
+/* settle tfo_sta once the broker answered the first packet */
+void umqtt_trans_fastopen_check(struct umqtt_trans *trans);
+/* drop the cached server address */
+void umqtt_trans_release(struct umqtt_trans *trans);
+
+/* built-in transport backends */
+#ifdef PKG_UMQTT_USING_TLS_SESSION_CACHE
+extern struct umqtt_trans_ops umqtt_trans_tls_cache_ops;
+#endif
+#ifdef PKG_UMQTT_USING_TRANS_UNIX
+extern struct umqtt_trans_ops umqtt_trans_unix_ops;
+#endif
+#ifdef PKG_UMQTT_USING_TRANS_MEM
+extern struct umqtt_trans_ops umqtt_trans_mem_ops;
+/* in-memory loopback, accept the peer end of a "mem://<name>" connection */
+int umqtt_trans_mem_accept(const char *name, struct umqtt_trans *peer, int timeout);
+#endif
+#ifdef PKG_UMQTT_USING_TRANS_URING
+extern struct umqtt_trans_ops umqtt_trans_uring_ops;
+#endif
 
 /* compatible with paho MQTT embedded c needed to do processing */
 typedef union umqtt_pkgs_fix_header MQTTHeader;
@@ -251,6 +481,7 @@ int umqtt_readlenstring(int *str_len, char **p_string, unsigned char **pptr, uns
 int umqtt_pkgs_encode(unsigned char* buf, int length);
 int umqtt_pkgs_decode(int (*getcharfn)(unsigned char*, int), int* value);
 int umqtt_pkgs_len(int rem_len);
+struct umqtt_pkgs_publish *umqtt_publish_dup(const struct umqtt_pkgs_publish *msg);
 
 #ifdef __cplusplus
 }
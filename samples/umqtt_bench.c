@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <rtthread.h>
+
+#define DBG_TAG             "umqtt.bench"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#include "umqtt.h"
+#include "umqtt_internal.h"
+
+/*
+ * Transport throughput benchmark: every client subscribes to its own topic and
+ * publishes QoS0 messages to it, so both the send and the receive path of the
+ * selected transport are exercised. Compare backends by running it with the
+ * same broker address under different schemes, e.g.
+ *
+ * msh />umqtt_bench tcp://192.168.12.83:1883 100 1000
+ * msh />umqtt_bench tcp+uring://192.168.12.83:1883 100 1000
+ * msh />umqtt_bench_all 192.168.12.83:1883 1000
+ */
+
+#define UMQTT_BENCH_TOPIC_LEN           32
+#define UMQTT_BENCH_PAYLOAD_LEN         64
+#define UMQTT_BENCH_WAIT_MS             10000
+
+static volatile rt_uint32_t bench_recv_cnt = 0;
+
+static void umqtt_bench_recv_callback(struct umqtt_client *client, void *msg_data)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    bench_recv_cnt++;
+    rt_hw_interrupt_enable(level);
+}
+
+static int umqtt_bench_run(const char *uri, int clients, int messages)
+{
+    int _ret = 0, _cnt = 0, _msg = 0, _started = 0;
+    umqtt_client_t *client = RT_NULL;
+    struct umqtt_info info = { 0 };
+    char topic[UMQTT_BENCH_TOPIC_LEN];
+    char (*client_id)[UMQTT_BENCH_TOPIC_LEN] = RT_NULL;        /* umqtt_create keeps the pointer, one per client */
+    rt_uint8_t payload[UMQTT_BENCH_PAYLOAD_LEN];
+    rt_uint32_t expect = 0, failed = 0, elapsed = 0;
+    rt_tick_t start_tick = 0, end_tick = 0;
+
+    client = (umqtt_client_t *)rt_calloc(clients, sizeof(umqtt_client_t));
+    client_id = rt_calloc(clients, sizeof(client_id[0]));
+    if ((client == RT_NULL) || (client_id == RT_NULL))
+    {
+        LOG_E(" bench calloc clients failed!");
+        rt_free(client);
+        rt_free(client_id);
+        return UMQTT_MEM_FULL;
+    }
+    rt_memset(payload, 'u', sizeof(payload));
+
+    for (_cnt = 0; _cnt < clients; _cnt++)
+    {
+        rt_memset(&info, 0, sizeof(info));
+        rt_snprintf(client_id[_cnt], sizeof(client_id[_cnt]), "umqtt_bench_%d", _cnt);
+        info.uri = uri;
+        info.client_id = client_id[_cnt];
+        client[_cnt] = umqtt_create(&info);
+        if ((client[_cnt] == RT_NULL) || (umqtt_start(client[_cnt]) < 0))
+        {
+            LOG_E(" bench client(%d) start failed!", _cnt);
+            _ret = UMQTT_FAILED;
+            goto exit;
+        }
+        _started++;
+
+        rt_snprintf(topic, sizeof(topic), "/umqtt/bench/%d", _cnt);
+        if (umqtt_subscribe(client[_cnt], topic, UMQTT_QOS0, umqtt_bench_recv_callback) < 0)
+        {
+            LOG_E(" bench client(%d) subscribe failed!", _cnt);
+            _ret = UMQTT_FAILED;
+            goto exit;
+        }
+    }
+
+    bench_recv_cnt = 0;
+    start_tick = rt_tick_get();
+    for (_msg = 0; _msg < messages; _msg++)
+    {
+        for (_cnt = 0; _cnt < clients; _cnt++)
+        {
+            rt_snprintf(topic, sizeof(topic), "/umqtt/bench/%d", _cnt);
+            if (umqtt_publish_async(client[_cnt], UMQTT_QOS0, topic, payload, sizeof(payload)) < 0)
+                failed++;                                       /* never sent, not waited for */
+            else
+                expect++;
+        }
+    }
+    while ((bench_recv_cnt < expect) && ((rt_tick_get() - start_tick) < rt_tick_from_millisecond(UMQTT_BENCH_WAIT_MS)))
+    {
+        rt_thread_mdelay(1);
+    }
+    end_tick = rt_tick_get();
+
+    elapsed = (end_tick - start_tick) * 1000 / RT_TICK_PER_SECOND;
+    rt_kprintf("%-40s clients: %4d, sent: %7d, failed: %7d, recv: %7d, time: %6d ms, %8d msg/s\n",
+               uri, clients, expect, failed, bench_recv_cnt, elapsed,
+               (elapsed == 0) ? 0 : (int)((rt_uint64_t)bench_recv_cnt * 1000 / elapsed));
+
+exit:
+    for (_cnt = 0; _cnt < clients; _cnt++)
+    {
+        if (client[_cnt])
+        {
+            if (_cnt < _started)
+                umqtt_stop(client[_cnt]);
+            umqtt_delete(client[_cnt]);
+        }
+    }
+    rt_free(client);
+    rt_free(client_id);
+    return _ret;
+}
+
+static int umqtt_bench(int argc, char **argv)
+{
+    if (argc != 4)
+    {
+        LOG_E("umqtt_bench <uri> <clients> <messages per client>  --publish/receive throughput of one transport.");
+        return -1;
+    }
+
+    return umqtt_bench_run(argv[1], atoi(argv[2]), atoi(argv[3]));
+}
+
+static int umqtt_bench_all(int argc, char **argv)
+{
+    static const char *schemes[] = { "tcp://",
+#ifdef PKG_UMQTT_USING_TRANS_URING
+                                     "tcp+uring://",
+#endif
+                                   };
+    static const int clients[] = { 1, 100, 1000 };
+    char uri[64];
+    int _scheme = 0, _cnt = 0;
+
+    if (argc != 3)
+    {
+        LOG_E("umqtt_bench_all <host:port> <messages per client>  --compare transports at 1, 100 and 1000 clients.");
+        return -1;
+    }
+
+    for (_cnt = 0; _cnt < sizeof(clients) / sizeof(clients[0]); _cnt++)
+    {
+        for (_scheme = 0; _scheme < sizeof(schemes) / sizeof(schemes[0]); _scheme++)
+        {
+            rt_snprintf(uri, sizeof(uri), "%s%s", schemes[_scheme], argv[1]);
+            umqtt_bench_run(uri, clients[_cnt], atoi(argv[2]));
+        }
+    }
+    return 0;
+}
+
+#ifdef FINSH_USING_MSH
+MSH_CMD_EXPORT(umqtt_bench, umqtt transport throughput benchmark);
+MSH_CMD_EXPORT(umqtt_bench_all, umqtt compare transports at 1/100/1000 clients);
+#endif
@@ -0,0 +1,1063 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include <rtthread.h>
+
+#define DBG_TAG             "umqtt.test"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#include "umqtt.h"
+#include "umqtt_internal.h"
+
+#ifdef PKG_UMQTT_USING_TRANS_MEM
+
+/*
+ * Self tests over the in-memory transport: a broker stand-in thread serves
+ * "mem://umqtt_test", so no network and no broker are needed. Run every test
+ * of the enabled options, or one of them by name; run them with no other
+ * umqtt client alive, some of them check process wide budgets.
+ *
+ * msh />umqtt_test
+ * msh />umqtt_test backpressure
+ * msh />umqtt_test lanes
+ * msh />umqtt_test mem_close
+ */
+
+#define UMQTT_TEST_LINK                 "umqtt_test"
+#define UMQTT_TEST_URI                  "mem://umqtt_test"
+#define UMQTT_TEST_TOPIC                "/umqtt/test/self"
+#define UMQTT_TEST_FRAME_MAX            1024                    /* largest frame the broker stand-in takes */
+#define UMQTT_TEST_PAYLOAD_LEN          16
+#define UMQTT_TEST_POLL_MS              10
+#define UMQTT_TEST_SETTLE_MS            50                      /* time for a frame that must not come */
+#define UMQTT_TEST_WAIT_MS              2000
+
+/* log the failed condition and leave the test through _exit */
+#define UMQTT_TEST_CHECK(COND)                                                      \
+    do                                                                              \
+    {                                                                               \
+        if (!(COND))                                                                \
+        {                                                                           \
+            LOG_E(" check failed: %s, line %d!", #COND, __LINE__);                  \
+            _ret = UMQTT_FAILED;                                                    \
+            goto _exit;                                                             \
+        }                                                                           \
+    } while (0)
+
+struct umqtt_test_broker                                        /* peer end of mem://umqtt_test */
+{
+    struct umqtt_trans trans;
+    struct rt_semaphore done;                                   /* released when the thread ends */
+    volatile rt_uint8_t stop;
+    volatile rt_uint8_t hold_acks;                              /* keep the PUBACK / PUBREC of qos1/qos2 publishes */
+    volatile rt_uint8_t release_acks;                           /* send the kept acks */
+    rt_uint8_t held_type[PKG_UMQTT_INFLIGHT_MAX];
+    rt_uint16_t held_id[PKG_UMQTT_INFLIGHT_MAX];
+    int held_cnt;
+    volatile rt_uint32_t publish_cnt;                           /* publishes on UMQTT_TEST_TOPIC */
+    volatile rt_uint32_t pubrel_cnt;
+    volatile rt_uint32_t qos0_seq;                              /* next sequence number of a qos0 publish */
+    volatile rt_uint32_t errors;                                /* malformed or out of order frames */
+    rt_uint8_t frame[UMQTT_TEST_FRAME_MAX];
+};
+
+static struct umqtt_test_broker test_broker;
+
+/* send a two byte packet id frame: CONNACK, PUBACK, PUBREC, PUBCOMP, UNSUBACK */
+static int umqtt_test_broker_reply(struct umqtt_test_broker *broker, enum umqtt_type type, rt_uint16_t packet_id)
+{
+    rt_uint8_t _buf[4];
+
+    _buf[0] = (rt_uint8_t)(type << 4);
+    _buf[1] = 2;
+    _buf[2] = (rt_uint8_t)(packet_id >> 8);
+    _buf[3] = (rt_uint8_t)(packet_id & 0xFF);
+    return (umqtt_trans_send(&(broker->trans), _buf, sizeof(_buf), UMQTT_TEST_WAIT_MS) < 0) ? UMQTT_FAILED : UMQTT_OK;
+}
+
+/* send the acks kept while hold_acks was set */
+static void umqtt_test_broker_release(struct umqtt_test_broker *broker)
+{
+    int _cnt = 0;
+
+    broker->release_acks = 0;
+    for (_cnt = 0; _cnt < broker->held_cnt; _cnt++)
+        umqtt_test_broker_reply(broker, (enum umqtt_type)broker->held_type[_cnt], broker->held_id[_cnt]);
+    broker->held_cnt = 0;
+}
+
+/* read exactly len bytes, the kept acks go out while waiting; <0: closed or stopped */
+static int umqtt_test_broker_read(struct umqtt_test_broker *broker, rt_uint8_t *buf, int len)
+{
+    int _ret = 0, _off = 0;
+
+    while (_off < len)
+    {
+        _ret = umqtt_trans_poll(&(broker->trans), UMQTT_TRANS_POLLIN, UMQTT_TEST_POLL_MS);
+        if (broker->release_acks)
+            umqtt_test_broker_release(broker);
+        if ((broker->stop) || (_ret < 0))
+            return UMQTT_FAILED;
+        if (_ret == 0)
+            continue;
+
+        _ret = umqtt_trans_recv(&(broker->trans), buf + _off, len - _off);
+        if (_ret <= 0)
+            return UMQTT_FAILED;                                /* peer closed */
+        _off += _ret;
+    }
+    return _off;
+}
+
+/* read one frame into broker->frame, return its remaining length, <0: closed or stopped */
+static int umqtt_test_broker_frame(struct umqtt_test_broker *broker, rt_uint8_t *hdr)
+{
+    rt_uint8_t _byte = 0;
+    int _len = 0, _shift = 0;
+
+    if (umqtt_test_broker_read(broker, hdr, 1) < 0)
+        return UMQTT_FAILED;
+    do
+    {
+        if ((_shift > 21) || (umqtt_test_broker_read(broker, &_byte, 1) < 0))
+            return UMQTT_FAILED;
+        _len |= (_byte & 0x7F) << _shift;
+        _shift += 7;
+    } while (_byte & 0x80);
+
+    if (_len > UMQTT_TEST_FRAME_MAX)
+    {
+        LOG_E(" test broker frame too long! (%d bytes)", _len);
+        broker->errors++;
+        return UMQTT_FAILED;
+    }
+    if ((_len > 0) && (umqtt_test_broker_read(broker, broker->frame, _len) < 0))
+        return UMQTT_FAILED;
+    return _len;
+}
+
+/* count a publish on the test topic and check the sequence of a qos0 one; ack it or keep the ack */
+static int umqtt_test_broker_publish(struct umqtt_test_broker *broker, rt_uint8_t hdr, int len)
+{
+    int _qos = (hdr >> 1) & 0x03;
+    int _off = 0, _topic_len = 0;
+    rt_uint16_t _id = 0;
+    rt_uint32_t _seq = 0;
+
+    _topic_len = (broker->frame[0] << 8) | broker->frame[1];
+    _off = 2 + _topic_len + ((_qos > 0) ? 2 : 0);
+    if (_off > len)
+    {
+        LOG_E(" test broker publish is malformed!");
+        broker->errors++;
+        return UMQTT_FAILED;
+    }
+    if (_qos > 0)
+        _id = (broker->frame[_off - 2] << 8) | broker->frame[_off - 1];
+
+    if ((_topic_len == (int)rt_strlen(UMQTT_TEST_TOPIC))
+     && (rt_memcmp(broker->frame + 2, UMQTT_TEST_TOPIC, _topic_len) == 0))
+    {
+        broker->publish_cnt++;
+        if ((_qos == 0) && (len - _off >= (int)sizeof(_seq)))
+        {
+            rt_memcpy(&_seq, broker->frame + _off, sizeof(_seq));
+            if (_seq != broker->qos0_seq)
+            {
+                LOG_E(" test broker got publish %d, expected %d!", _seq, broker->qos0_seq);
+                broker->errors++;
+            }
+            broker->qos0_seq = _seq + 1;
+        }
+    }
+
+    if (_qos == 0)
+        return UMQTT_OK;
+    if (broker->hold_acks && (broker->held_cnt < PKG_UMQTT_INFLIGHT_MAX))
+    {
+        broker->held_type[broker->held_cnt] = (_qos == 1) ? UMQTT_TYPE_PUBACK : UMQTT_TYPE_PUBREC;
+        broker->held_id[broker->held_cnt] = _id;
+        broker->held_cnt++;
+        return UMQTT_OK;
+    }
+    return umqtt_test_broker_reply(broker, (_qos == 1) ? UMQTT_TYPE_PUBACK : UMQTT_TYPE_PUBREC, _id);
+}
+
+static int umqtt_test_broker_handle(struct umqtt_test_broker *broker, rt_uint8_t hdr, int len)
+{
+    rt_uint8_t _buf[5];
+    rt_uint16_t _id = (len >= 2) ? ((broker->frame[0] << 8) | broker->frame[1]) : 0;
+
+    switch (hdr >> 4)
+    {
+    case UMQTT_TYPE_CONNECT:
+        return umqtt_test_broker_reply(broker, UMQTT_TYPE_CONNACK, 0);        /* accepted, no session */
+    case UMQTT_TYPE_PUBLISH:
+        return umqtt_test_broker_publish(broker, hdr, len);
+    case UMQTT_TYPE_PUBREL:
+        broker->pubrel_cnt++;
+        return umqtt_test_broker_reply(broker, UMQTT_TYPE_PUBCOMP, _id);
+    case UMQTT_TYPE_SUBSCRIBE:
+        _buf[0] = UMQTT_TYPE_SUBACK << 4;
+        _buf[1] = 3;
+        _buf[2] = (rt_uint8_t)(_id >> 8);
+        _buf[3] = (rt_uint8_t)(_id & 0xFF);
+        _buf[4] = broker->frame[len - 1];                       /* granted qos, one filter per SUBSCRIBE */
+        return (umqtt_trans_send(&(broker->trans), _buf, 5, UMQTT_TEST_WAIT_MS) < 0) ? UMQTT_FAILED : UMQTT_OK;
+    case UMQTT_TYPE_UNSUBSCRIBE:
+        return umqtt_test_broker_reply(broker, UMQTT_TYPE_UNSUBACK, _id);
+    case UMQTT_TYPE_PINGREQ:
+        _buf[0] = UMQTT_TYPE_PINGRESP << 4;
+        _buf[1] = 0;
+        return (umqtt_trans_send(&(broker->trans), _buf, 2, UMQTT_TEST_WAIT_MS) < 0) ? UMQTT_FAILED : UMQTT_OK;
+    case UMQTT_TYPE_DISCONNECT:
+        return UMQTT_FAILED;
+    default:
+        return UMQTT_OK;
+    }
+}
+
+static void umqtt_test_broker_entry(void *param)
+{
+    struct umqtt_test_broker *broker = (struct umqtt_test_broker *)param;
+    rt_uint8_t _hdr = 0;
+    int _len = 0;
+
+    if (umqtt_trans_mem_accept(UMQTT_TEST_LINK, &(broker->trans), UMQTT_TEST_WAIT_MS) < 0)
+    {
+        LOG_E(" test broker accept failed!");
+        broker->errors++;
+        goto _exit;
+    }
+    while ((_len = umqtt_test_broker_frame(broker, &_hdr)) >= 0)
+    {
+        if (umqtt_test_broker_handle(broker, _hdr, _len) != UMQTT_OK)
+            break;
+    }
+    umqtt_trans_disconnect(&(broker->trans));
+
+_exit:
+    rt_sem_release(&(broker->done));
+}
+
+static int umqtt_test_broker_start(struct umqtt_test_broker *broker)
+{
+    rt_thread_t thread = RT_NULL;
+
+    rt_memset(broker, 0, sizeof(struct umqtt_test_broker));
+    broker->trans.sock = -1;
+    rt_sem_init(&(broker->done), "umqtt_tb", 0, RT_IPC_FLAG_FIFO);
+    thread = rt_thread_create("umqtt_tb", umqtt_test_broker_entry, broker, 2048,
+                              PKG_UMQTT_INFO_DEF_THREAD_PRIORITY, UMQTT_INFO_DEF_THREAD_TICK);
+    if (thread == RT_NULL)
+    {
+        LOG_E(" test broker thread create failed!");
+        rt_sem_detach(&(broker->done));
+        return UMQTT_MEM_FULL;
+    }
+    rt_thread_startup(thread);
+    return UMQTT_OK;
+}
+
+/* stop the broker stand-in, return the frames it found wrong, <0: it did not end */
+static int umqtt_test_broker_stop(struct umqtt_test_broker *broker)
+{
+    broker->stop = 1;
+    if (rt_sem_take(&(broker->done), rt_tick_from_millisecond(2 * UMQTT_TEST_WAIT_MS)) != RT_EOK)
+    {
+        LOG_E(" test broker does not stop!");
+        return UMQTT_FAILED;                                    /* the thread still uses it, keep the semaphore */
+    }
+    rt_sem_detach(&(broker->done));
+    return (int)broker->errors;
+}
+
+/* wait until a broker counter reaches expect */
+static int umqtt_test_wait(volatile rt_uint32_t *value, rt_uint32_t expect)
+{
+    rt_tick_t _start = rt_tick_get();
+
+    while (*value < expect)
+    {
+        if ((rt_tick_get() - _start) >= rt_tick_from_millisecond(UMQTT_TEST_WAIT_MS))
+            return UMQTT_TIMEOUT;
+        rt_thread_mdelay(1);
+    }
+    return UMQTT_OK;
+}
+
+/* start the broker stand-in and create a client of it, umqtt_start is left to the test */
+static umqtt_client_t umqtt_test_open(struct umqtt_info *info)
+{
+    umqtt_client_t client = RT_NULL;
+
+    info->uri = UMQTT_TEST_URI;
+    info->client_id = "umqtt_test";
+    if (umqtt_test_broker_start(&test_broker) != UMQTT_OK)
+        return RT_NULL;
+
+    client = umqtt_create(info);
+    if (client == RT_NULL)
+    {
+        LOG_E(" test client create failed!");
+        umqtt_test_broker_stop(&test_broker);
+    }
+    return client;
+}
+
+/* delete the client and stop the broker stand-in, <0: the broker found a wrong frame */
+static int umqtt_test_close(umqtt_client_t client, int started)
+{
+    if (client == RT_NULL)
+        return UMQTT_OK;
+
+    if (started)
+        umqtt_stop(client);
+    umqtt_delete(client);
+    return (umqtt_test_broker_stop(&test_broker) != 0) ? UMQTT_FAILED : UMQTT_OK;
+}
+
+#define UMQTT_TEST_CLOSE_LINK           "umqtt_test_close"
+
+struct umqtt_test_mem_waiter                                    /* a caller blocked on one end */
+{
+    struct umqtt_trans *trans;
+    int poll;                                                   /* 1: in poll, 0: in recv */
+    int result;
+    struct rt_semaphore done;
+};
+
+static void umqtt_test_mem_entry(void *param)
+{
+    struct umqtt_test_mem_waiter *waiter = (struct umqtt_test_mem_waiter *)param;
+    rt_uint8_t _byte = 0;
+
+    if (waiter->poll)
+        waiter->result = umqtt_trans_poll(waiter->trans, UMQTT_TRANS_POLLIN, -1);
+    else
+        waiter->result = umqtt_trans_recv(waiter->trans, &_byte, 1);
+    rt_sem_release(&(waiter->done));
+}
+
+/* closing an end wakes its own blocked recv and poll, the peer then writes into a closed pipe */
+static int umqtt_test_mem_close(void)
+{
+    struct umqtt_test_mem_waiter waiter[2];
+    struct umqtt_trans trans = { 0 }, peer = { 0 };
+    rt_thread_t thread = RT_NULL;
+    rt_uint8_t _byte = 'x';
+    int _ret = UMQTT_OK, _cnt = 0, _started = 0, _ended = 0;
+
+    trans.sock = -1;
+    peer.sock = -1;
+    UMQTT_TEST_CHECK(umqtt_trans_connect(&trans, "mem://" UMQTT_TEST_CLOSE_LINK) == UMQTT_OK);
+    UMQTT_TEST_CHECK(umqtt_trans_mem_accept(UMQTT_TEST_CLOSE_LINK, &peer, UMQTT_TEST_WAIT_MS) == UMQTT_OK);
+
+    for (_started = 0; _started < 2; _started++)
+    {
+        waiter[_started].trans = &trans;
+        waiter[_started].poll = _started;
+        waiter[_started].result = 0;
+        rt_sem_init(&(waiter[_started].done), "umqtt_tc", 0, RT_IPC_FLAG_FIFO);
+        thread = rt_thread_create("umqtt_tc", umqtt_test_mem_entry, &waiter[_started], 1024,
+                                  PKG_UMQTT_INFO_DEF_THREAD_PRIORITY, UMQTT_INFO_DEF_THREAD_TICK);
+        if (thread == RT_NULL)
+        {
+            rt_sem_detach(&(waiter[_started].done));
+            break;
+        }
+        rt_thread_startup(thread);
+    }
+    UMQTT_TEST_CHECK(_started == 2);
+    rt_thread_mdelay(UMQTT_TEST_SETTLE_MS);                     /* both are blocked now */
+
+    umqtt_trans_disconnect(&trans);
+    for (_ended = 0; _ended < _started; _ended++)
+        UMQTT_TEST_CHECK(rt_sem_take(&(waiter[_ended].done), rt_tick_from_millisecond(UMQTT_TEST_WAIT_MS)) == RT_EOK);
+    UMQTT_TEST_CHECK(waiter[0].result == 0);                   /* recv: closed */
+    UMQTT_TEST_CHECK(waiter[1].result != 0);                   /* poll: closed readable, or not connected */
+    UMQTT_TEST_CHECK(umqtt_trans_send(&peer, &_byte, 1, UMQTT_TEST_WAIT_MS) < 0);
+
+_exit:
+    umqtt_trans_disconnect(&trans);                             /* wakes the waiters a failed check left behind */
+    for (_cnt = _ended; _cnt < _started; _cnt++)
+    {
+        if (rt_sem_take(&(waiter[_cnt].done), rt_tick_from_millisecond(UMQTT_TEST_WAIT_MS)) != RT_EOK)
+        {
+            LOG_E(" mem waiter(%d) does not end!", _cnt);
+            return UMQTT_FAILED;                                /* still uses the transport, keep it */
+        }
+    }
+    for (_cnt = 0; _cnt < _started; _cnt++)
+        rt_sem_detach(&(waiter[_cnt].done));
+    umqtt_trans_disconnect(&peer);
+    return _ret;
+}
+
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+#define UMQTT_TEST_WM_HIGH              4
+#define UMQTT_TEST_WM_LOW               1
+
+static struct rt_semaphore test_writable;
+
+static void umqtt_test_writable_cb(struct umqtt_client *client)
+{
+    rt_sem_release(&test_writable);
+}
+
+/* fill the async window of one qos with the acks held, release them, expect on_writable once */
+static int umqtt_test_backpressure_qos(umqtt_client_t client, enum umqtt_qos qos)
+{
+    struct umqtt_test_broker *broker = &test_broker;
+    rt_uint32_t _publish = broker->publish_cnt, _pubrel = broker->pubrel_cnt;
+    rt_uint8_t payload[UMQTT_TEST_PAYLOAD_LEN];
+    int _ret = UMQTT_OK, _cnt = 0, _pub = 0;
+
+    rt_memset(payload, 'w', sizeof(payload));
+    broker->hold_acks = 1;
+    for (_cnt = 0; _cnt <= UMQTT_TEST_WM_HIGH; _cnt++)
+    {
+        _pub = umqtt_publish_async(client, qos, UMQTT_TEST_TOPIC, payload, sizeof(payload));
+        if (_pub < 0)
+            break;
+    }
+    UMQTT_TEST_CHECK((_cnt == UMQTT_TEST_WM_HIGH) && (_pub == UMQTT_WOULD_BLOCK));
+    UMQTT_TEST_CHECK(umqtt_test_wait(&(broker->publish_cnt), _publish + UMQTT_TEST_WM_HIGH) == UMQTT_OK);
+    rt_thread_mdelay(UMQTT_TEST_SETTLE_MS);
+    UMQTT_TEST_CHECK(rt_sem_take(&test_writable, 0) != RT_EOK);                 /* nothing acknowledged yet */
+
+    /* qos2: each PUBREC is answered by a PUBREL, the window opens at PUBCOMP */
+    broker->hold_acks = 0;
+    broker->release_acks = 1;
+    UMQTT_TEST_CHECK(rt_sem_take(&test_writable, rt_tick_from_millisecond(UMQTT_TEST_WAIT_MS)) == RT_EOK);
+    if (qos == UMQTT_QOS2)
+        UMQTT_TEST_CHECK(broker->pubrel_cnt >= _pubrel + UMQTT_TEST_WM_HIGH - UMQTT_TEST_WM_LOW);
+
+    UMQTT_TEST_CHECK(umqtt_publish_async(client, qos, UMQTT_TEST_TOPIC, payload, sizeof(payload)) > 0);
+    if (qos == UMQTT_QOS2)
+        UMQTT_TEST_CHECK(umqtt_test_wait(&(broker->pubrel_cnt), _pubrel + UMQTT_TEST_WM_HIGH + 1) == UMQTT_OK);
+    else
+        UMQTT_TEST_CHECK(umqtt_test_wait(&(broker->publish_cnt), _publish + UMQTT_TEST_WM_HIGH + 1) == UMQTT_OK);
+    rt_thread_mdelay(UMQTT_TEST_SETTLE_MS);
+    UMQTT_TEST_CHECK(rt_sem_take(&test_writable, 0) != RT_EOK);                 /* once per UMQTT_WOULD_BLOCK */
+
+_exit:
+    broker->hold_acks = 0;
+    broker->release_acks = 1;
+    return _ret;
+}
+
+/* the qos1/qos2 async window closes at the high watermark and opens again at the low one */
+static int umqtt_test_backpressure(void)
+{
+    umqtt_client_t client = RT_NULL;
+    struct umqtt_info info = { 0 };
+    int _ret = UMQTT_OK, _started = 0;
+
+    rt_sem_init(&test_writable, "umqtt_tw", 0, RT_IPC_FLAG_FIFO);
+    info.wm_high_msgs = UMQTT_TEST_WM_HIGH;
+    info.wm_low_msgs = UMQTT_TEST_WM_LOW;
+    info.on_writable = umqtt_test_writable_cb;
+    client = umqtt_test_open(&info);
+    UMQTT_TEST_CHECK(client != RT_NULL);
+    UMQTT_TEST_CHECK(umqtt_start(client) >= 0);
+    _started = 1;
+
+    UMQTT_TEST_CHECK(umqtt_test_backpressure_qos(client, UMQTT_QOS1) == UMQTT_OK);
+    UMQTT_TEST_CHECK(umqtt_test_backpressure_qos(client, UMQTT_QOS2) == UMQTT_OK);
+
+_exit:
+    if (umqtt_test_close(client, _started) < 0)
+        _ret = UMQTT_FAILED;
+    rt_sem_detach(&test_writable);
+    return _ret;
+}
+
+#define UMQTT_TEST_EXPIRE_MS            200
+
+static struct rt_semaphore test_expired;
+static volatile rt_uint16_t test_expired_id = 0;
+
+static void umqtt_test_expired_cb(struct umqtt_client *client, rt_uint16_t packet_id)
+{
+    test_expired_id = packet_id;
+    rt_sem_release(&test_expired);
+}
+
+/* a publish the broker never acknowledges gives its slot back and is reported */
+static int umqtt_test_backlog_expire(void)
+{
+    struct umqtt_test_broker *broker = &test_broker;
+    umqtt_client_t client = RT_NULL;
+    struct umqtt_info info = { 0 };
+    rt_uint8_t payload[UMQTT_TEST_PAYLOAD_LEN];
+    int _ret = UMQTT_OK, _started = 0, _pub = 0;
+
+    rt_sem_init(&test_writable, "umqtt_tw", 0, RT_IPC_FLAG_FIFO);
+    rt_sem_init(&test_expired, "umqtt_te", 0, RT_IPC_FLAG_FIFO);
+    rt_memset(payload, 'e', sizeof(payload));
+    info.wm_high_msgs = 1;
+    info.inflight_expire_ms = UMQTT_TEST_EXPIRE_MS;
+    info.on_writable = umqtt_test_writable_cb;
+    info.on_pub_expired = umqtt_test_expired_cb;
+    client = umqtt_test_open(&info);
+    UMQTT_TEST_CHECK(client != RT_NULL);
+    UMQTT_TEST_CHECK(umqtt_start(client) >= 0);
+    _started = 1;
+
+    broker->hold_acks = 1;
+    _pub = umqtt_publish_async(client, UMQTT_QOS1, UMQTT_TEST_TOPIC, payload, sizeof(payload));
+    UMQTT_TEST_CHECK(_pub > 0);
+    UMQTT_TEST_CHECK(umqtt_publish_async(client, UMQTT_QOS1, UMQTT_TEST_TOPIC, payload, sizeof(payload)) == UMQTT_WOULD_BLOCK);
+
+    UMQTT_TEST_CHECK(rt_sem_take(&test_expired, rt_tick_from_millisecond(UMQTT_TEST_WAIT_MS)) == RT_EOK);
+    UMQTT_TEST_CHECK(test_expired_id == _pub);
+    UMQTT_TEST_CHECK(rt_sem_take(&test_writable, rt_tick_from_millisecond(UMQTT_TEST_WAIT_MS)) == RT_EOK);
+    UMQTT_TEST_CHECK(umqtt_publish_async(client, UMQTT_QOS1, UMQTT_TEST_TOPIC, payload, sizeof(payload)) > 0);
+
+_exit:
+    broker->hold_acks = 0;
+    broker->release_acks = 1;
+    if (umqtt_test_close(client, _started) < 0)
+        _ret = UMQTT_FAILED;
+    rt_sem_detach(&test_expired);
+    rt_sem_detach(&test_writable);
+    return _ret;
+}
+#endif /* PKG_UMQTT_USING_BACKPRESSURE */
+
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+#define UMQTT_TEST_LANE_LINK            "umqtt_test_lane"
+#define UMQTT_TEST_LANE_FRAME_LEN       8
+#define UMQTT_TEST_LANE_CTRL_LEN        4
+#define UMQTT_TEST_LANE_CTRL_CNT        (PKG_UMQTT_LANE_CTRL_SIZE / UMQTT_TEST_LANE_CTRL_LEN + 1)   /* the last one finds the queue full */
+#define UMQTT_TEST_LANE_WRITERS         3
+
+struct umqtt_test_lane_writer                                   /* one thread writing through the lanes */
+{
+    struct umqtt_lane *lane;
+    struct umqtt_trans *trans;
+    int prio;
+    char fill;
+    int result;
+    struct rt_semaphore done;
+};
+
+static void umqtt_test_lane_entry(void *param)
+{
+    struct umqtt_test_lane_writer *writer = (struct umqtt_test_lane_writer *)param;
+    rt_uint8_t _buf[UMQTT_TEST_LANE_FRAME_LEN];
+    int _cnt = 0;
+
+    rt_memset(_buf, writer->fill, sizeof(_buf));
+    if (writer->prio == UMQTT_PRIO_CONTROL)
+    {
+        for (_cnt = 0; (_cnt < UMQTT_TEST_LANE_CTRL_CNT) && (writer->result == UMQTT_OK); _cnt++)
+            writer->result = umqtt_lane_control(writer->lane, _buf, UMQTT_TEST_LANE_CTRL_LEN);
+    }
+    else
+    {
+        writer->result = umqtt_lane_take(writer->lane, writer->prio, UMQTT_TEST_WAIT_MS);
+        if (writer->result == UMQTT_OK)
+        {
+            if (umqtt_trans_send(writer->trans, _buf, sizeof(_buf), UMQTT_TEST_WAIT_MS) < 0)
+                writer->result = UMQTT_SEND_FAILED;
+            umqtt_lane_release(writer->lane);
+        }
+    }
+    rt_sem_release(&(writer->done));
+}
+
+/* byte pos of the stream: the bulk frame, the control frames, then the high and the bulk writers */
+static char umqtt_test_lane_expect(int pos)
+{
+    if (pos < 2 * UMQTT_TEST_LANE_FRAME_LEN)
+        return 'A';
+    pos -= 2 * UMQTT_TEST_LANE_FRAME_LEN;
+    if (pos < UMQTT_TEST_LANE_CTRL_CNT * UMQTT_TEST_LANE_CTRL_LEN)
+        return 'C';
+    pos -= UMQTT_TEST_LANE_CTRL_CNT * UMQTT_TEST_LANE_CTRL_LEN;
+    return (pos < UMQTT_TEST_LANE_FRAME_LEN) ? 'H' : 'B';
+}
+
+/* writers queued behind a frame go out by class, the control frames first and none inside the frame */
+static int umqtt_test_lanes(void)
+{
+    static const int prios[UMQTT_TEST_LANE_WRITERS] = { UMQTT_PRIO_BULK, UMQTT_PRIO_HIGH, UMQTT_PRIO_CONTROL };
+    static const char fills[UMQTT_TEST_LANE_WRITERS] = { 'B', 'H', 'C' };
+    struct umqtt_test_lane_writer writer[UMQTT_TEST_LANE_WRITERS];
+    struct umqtt_trans trans = { 0 }, peer = { 0 };
+    struct umqtt_lane *lane = RT_NULL;
+    rt_thread_t thread = RT_NULL;
+    rt_uint8_t _buf[UMQTT_TEST_LANE_FRAME_LEN];
+    int _ret = UMQTT_OK, _cnt = 0, _started = 0, _owned = 0, _len = 0, _pos = 0;
+    int _total = 4 * UMQTT_TEST_LANE_FRAME_LEN + UMQTT_TEST_LANE_CTRL_CNT * UMQTT_TEST_LANE_CTRL_LEN;
+
+    trans.sock = -1;
+    peer.sock = -1;
+    UMQTT_TEST_CHECK(umqtt_trans_connect(&trans, "mem://" UMQTT_TEST_LANE_LINK) == UMQTT_OK);
+    UMQTT_TEST_CHECK(umqtt_trans_mem_accept(UMQTT_TEST_LANE_LINK, &peer, UMQTT_TEST_WAIT_MS) == UMQTT_OK);
+    lane = umqtt_lane_create(&trans, UMQTT_TEST_WAIT_MS, RT_NULL);
+    UMQTT_TEST_CHECK(lane != RT_NULL);
+
+    /* the bulk frame goes out in two writes, the other writers queue up in between */
+    rt_memset(_buf, 'A', sizeof(_buf));
+    UMQTT_TEST_CHECK(umqtt_lane_take(lane, UMQTT_PRIO_BULK, 0) == UMQTT_OK);
+    _owned = 1;
+    UMQTT_TEST_CHECK(umqtt_trans_send(&trans, _buf, sizeof(_buf), UMQTT_TEST_WAIT_MS) >= 0);
+
+    for (_started = 0; _started < UMQTT_TEST_LANE_WRITERS; _started++)
+    {
+        writer[_started].lane = lane;
+        writer[_started].trans = &trans;
+        writer[_started].prio = prios[_started];
+        writer[_started].fill = fills[_started];
+        writer[_started].result = UMQTT_OK;
+        rt_sem_init(&(writer[_started].done), "umqtt_tl", 0, RT_IPC_FLAG_FIFO);
+        thread = rt_thread_create("umqtt_tl", umqtt_test_lane_entry, &writer[_started], 1024,
+                                  PKG_UMQTT_INFO_DEF_THREAD_PRIORITY, UMQTT_INFO_DEF_THREAD_TICK);
+        if (thread == RT_NULL)
+        {
+            rt_sem_detach(&(writer[_started].done));
+            break;
+        }
+        rt_thread_startup(thread);
+    }
+    UMQTT_TEST_CHECK(_started == UMQTT_TEST_LANE_WRITERS);
+    rt_thread_mdelay(UMQTT_TEST_SETTLE_MS);
+
+    UMQTT_TEST_CHECK(umqtt_trans_send(&trans, _buf, sizeof(_buf), UMQTT_TEST_WAIT_MS) >= 0);
+    _owned = 0;
+    UMQTT_TEST_CHECK(umqtt_lane_release(lane) == UMQTT_OK);
+
+    while (_pos < _total)
+    {
+        UMQTT_TEST_CHECK(umqtt_trans_poll(&peer, UMQTT_TRANS_POLLIN, UMQTT_TEST_WAIT_MS) > 0);
+        _len = (_total - _pos < (int)sizeof(_buf)) ? (_total - _pos) : (int)sizeof(_buf);
+        _len = umqtt_trans_recv(&peer, _buf, _len);
+        UMQTT_TEST_CHECK(_len > 0);
+        for (_cnt = 0; _cnt < _len; _cnt++, _pos++)
+        {
+            if (_buf[_cnt] != umqtt_test_lane_expect(_pos))
+            {
+                LOG_E(" lane stream byte %d is '%c', expected '%c'!", _pos, _buf[_cnt], umqtt_test_lane_expect(_pos));
+                _ret = UMQTT_FAILED;
+                goto _exit;
+            }
+        }
+    }
+
+_exit:
+    if (_owned)
+        umqtt_lane_release(lane);
+    for (_cnt = 0; _cnt < _started; _cnt++)
+    {
+        if (rt_sem_take(&(writer[_cnt].done), rt_tick_from_millisecond(2 * UMQTT_TEST_WAIT_MS)) != RT_EOK)
+        {
+            LOG_E(" lane writer(%d) does not end!", _cnt);
+            return UMQTT_FAILED;                                /* still uses the lane, keep it */
+        }
+        rt_sem_detach(&(writer[_cnt].done));
+        if (writer[_cnt].result != UMQTT_OK)
+        {
+            LOG_E(" lane writer(%d) failed! (%d)", _cnt, writer[_cnt].result);
+            _ret = UMQTT_FAILED;
+        }
+    }
+    umqtt_lane_delete(lane, RT_NULL);
+    umqtt_trans_disconnect(&peer);
+    umqtt_trans_disconnect(&trans);
+    return _ret;
+}
+#endif /* PKG_UMQTT_USING_PRIO_LANES */
+
+#ifdef PKG_UMQTT_USING_BUF_POOL
+#define UMQTT_TEST_POOL_BUDGET          2048
+
+/* reservations are always served, borrowing beyond them shares what they leave of the budget */
+static int umqtt_test_buf_pool(void)
+{
+    struct umqtt_buf_user user_a = { 0 }, user_b = { 0 }, user_c = { 0 };
+    rt_uint8_t *buf_a = RT_NULL, *buf_b = RT_NULL, *buf_over = RT_NULL, *buf_small = RT_NULL;
+    int _ret = UMQTT_OK, _attached = 0;
+
+    UMQTT_TEST_CHECK(umqtt_buf_pool_set_budget(UMQTT_TEST_POOL_BUDGET) == UMQTT_OK);
+    UMQTT_TEST_CHECK(umqtt_buf_attach(&user_a, UMQTT_TEST_POOL_BUDGET / 2) == UMQTT_OK);
+    _attached = 1;
+    UMQTT_TEST_CHECK(umqtt_buf_attach(&user_b, UMQTT_TEST_POOL_BUDGET / 4) == UMQTT_OK);
+    _attached = 2;
+    UMQTT_TEST_CHECK(umqtt_buf_attach(&user_c, UMQTT_TEST_POOL_BUDGET / 2) == UMQTT_MEM_FULL);
+
+    /* b borrows the quarter no reservation holds, then a is at its reservation and the pool is spent */
+    buf_a = umqtt_buf_get(&user_a, UMQTT_TEST_POOL_BUDGET / 2, 0);
+    UMQTT_TEST_CHECK(buf_a != RT_NULL);
+    buf_b = umqtt_buf_get(&user_b, UMQTT_TEST_POOL_BUDGET / 4, 0);
+    UMQTT_TEST_CHECK(buf_b != RT_NULL);
+    buf_over = umqtt_buf_get(&user_b, UMQTT_TEST_POOL_BUDGET / 4, 0);
+    UMQTT_TEST_CHECK(buf_over != RT_NULL);
+    buf_small = umqtt_buf_get(&user_a, PKG_UMQTT_BUF_POOL_MIN_SIZE, 0);
+    UMQTT_TEST_CHECK(buf_small == RT_NULL);
+    UMQTT_TEST_CHECK(umqtt_buf_pool_set_budget(UMQTT_TEST_POOL_BUDGET / 2) == UMQTT_FAILED);
+
+    /* the returned overflow is free for any client again */
+    umqtt_buf_put(&user_b, buf_over);
+    buf_over = RT_NULL;
+    buf_small = umqtt_buf_get(&user_a, PKG_UMQTT_BUF_POOL_MIN_SIZE, 0);
+    UMQTT_TEST_CHECK(buf_small != RT_NULL);
+    UMQTT_TEST_CHECK(user_a.used == UMQTT_TEST_POOL_BUDGET / 2 + PKG_UMQTT_BUF_POOL_MIN_SIZE);
+
+_exit:
+    umqtt_buf_put(&user_a, buf_small);
+    umqtt_buf_put(&user_b, buf_over);
+    umqtt_buf_put(&user_b, buf_b);
+    umqtt_buf_put(&user_a, buf_a);
+    if (_attached > 1)
+        umqtt_buf_detach(&user_b);
+    if (_attached > 0)
+        umqtt_buf_detach(&user_a);
+    umqtt_buf_pool_set_budget(PKG_UMQTT_BUF_POOL_BUDGET);
+    return _ret;
+}
+#endif /* PKG_UMQTT_USING_BUF_POOL */
+
+#ifdef PKG_UMQTT_USING_ALLOCATOR
+struct umqtt_test_heap                                          /* bytes the client holds from the test allocator */
+{
+    rt_uint32_t cur[UMQTT_MEM_TAG_NUM];
+    rt_uint32_t allocs;
+    rt_uint32_t errors;                                         /* frees of more than was allocated under a tag */
+};
+
+static struct umqtt_test_heap test_heap;
+
+static void *umqtt_test_heap_alloc(void *ctx, rt_size_t size, enum umqtt_mem_tag tag)
+{
+    struct umqtt_test_heap *heap = (struct umqtt_test_heap *)ctx;
+    void *ptr = rt_malloc(size);
+    rt_base_t level;
+
+    if (ptr != RT_NULL)
+    {
+        level = rt_hw_interrupt_disable();
+        heap->cur[tag] += size;
+        heap->allocs++;
+        rt_hw_interrupt_enable(level);
+    }
+    return ptr;
+}
+
+static void umqtt_test_heap_free(void *ctx, void *ptr, rt_size_t size, enum umqtt_mem_tag tag)
+{
+    struct umqtt_test_heap *heap = (struct umqtt_test_heap *)ctx;
+    rt_base_t level;
+
+    level = rt_hw_interrupt_disable();
+    if (heap->cur[tag] < size)
+        heap->errors++;
+    else
+        heap->cur[tag] -= size;
+    rt_hw_interrupt_enable(level);
+    rt_free(ptr);
+}
+
+static void umqtt_test_heap_cb(struct umqtt_client *client, void *msg_data)
+{
+}
+
+#ifdef PKG_UMQTT_USING_MEM_STATS
+/* the client account matches what its allocator handed out, tag by tag */
+static int umqtt_test_mem_match(umqtt_client_t client)
+{
+    struct umqtt_mem_usage usage;
+    rt_uint32_t _sum = 0;
+    int _ret = UMQTT_OK, _tag = 0;
+
+    UMQTT_TEST_CHECK(umqtt_control(client, UMQTT_CMD_GET_MEM, &usage) >= 0);
+    for (_tag = 0; _tag < UMQTT_MEM_TAG_NUM; _tag++)
+    {
+        _sum += usage.cur[_tag];
+        if (_tag == UMQTT_MEM_TAG_QUEUE)
+            continue;                                           /* kernel heap, accounted only */
+#ifdef PKG_UMQTT_USING_BUF_POOL
+        if ((_tag == UMQTT_MEM_TAG_SEND_BUF) || (_tag == UMQTT_MEM_TAG_RECV_BUF))
+            continue;                                           /* borrowed from the shared pool */
+#endif
+        if (usage.cur[_tag] != test_heap.cur[_tag])
+        {
+            LOG_E(" mem tag(%d) accounts %d bytes, the allocator holds %d!", _tag, usage.cur[_tag], test_heap.cur[_tag]);
+            _ret = UMQTT_FAILED;
+        }
+        UMQTT_TEST_CHECK(usage.peak[_tag] >= usage.cur[_tag]);
+    }
+    UMQTT_TEST_CHECK(usage.total == _sum);
+    UMQTT_TEST_CHECK(usage.total_peak >= usage.total);
+
+_exit:
+    return _ret;
+}
+#endif
+
+/* every allocation of a client life goes through its allocator and comes back with the size and tag it had */
+static int umqtt_test_allocator(void)
+{
+    umqtt_client_t client = RT_NULL;
+    struct umqtt_info info = { 0 };
+    rt_uint8_t payload[UMQTT_TEST_PAYLOAD_LEN];
+    int _ret = UMQTT_OK, _started = 0, _tag = 0;
+
+    rt_memset(&test_heap, 0, sizeof(test_heap));
+    rt_memset(payload, 'm', sizeof(payload));
+    info.allocator.alloc = umqtt_test_heap_alloc;
+    info.allocator.free = umqtt_test_heap_free;
+    info.allocator.ctx = &test_heap;
+    client = umqtt_test_open(&info);
+    UMQTT_TEST_CHECK(client != RT_NULL);
+    UMQTT_TEST_CHECK(umqtt_start(client) >= 0);
+    _started = 1;
+
+    UMQTT_TEST_CHECK(umqtt_subscribe(client, UMQTT_TEST_TOPIC, UMQTT_QOS1, umqtt_test_heap_cb) >= 0);
+    UMQTT_TEST_CHECK(umqtt_publish(client, UMQTT_QOS1, UMQTT_TEST_TOPIC, payload, sizeof(payload), UMQTT_TEST_WAIT_MS) >= 0);
+    UMQTT_TEST_CHECK(umqtt_publish(client, UMQTT_QOS2, UMQTT_TEST_TOPIC, payload, sizeof(payload), UMQTT_TEST_WAIT_MS) >= 0);
+    UMQTT_TEST_CHECK(test_heap.cur[UMQTT_MEM_TAG_CLIENT] > 0);
+    UMQTT_TEST_CHECK(test_heap.cur[UMQTT_MEM_TAG_SUBSCRIBE] > 0);
+#ifdef PKG_UMQTT_USING_MEM_STATS
+    UMQTT_TEST_CHECK(umqtt_test_mem_match(client) == UMQTT_OK);
+#endif
+    UMQTT_TEST_CHECK(umqtt_unsubscribe(client, UMQTT_TEST_TOPIC) >= 0);
+    UMQTT_TEST_CHECK(test_heap.cur[UMQTT_MEM_TAG_SUBSCRIBE] == 0);
+#ifdef PKG_UMQTT_USING_MEM_STATS
+    UMQTT_TEST_CHECK(umqtt_test_mem_match(client) == UMQTT_OK);
+#endif
+
+_exit:
+    if (umqtt_test_close(client, _started) < 0)
+        _ret = UMQTT_FAILED;
+    for (_tag = 0; _tag < UMQTT_MEM_TAG_NUM; _tag++)
+    {
+        if (test_heap.cur[_tag] != 0)
+        {
+            LOG_E(" allocator tag(%d) still holds %d bytes!", _tag, test_heap.cur[_tag]);
+            _ret = UMQTT_FAILED;
+        }
+    }
+    if ((test_heap.allocs == 0) || (test_heap.errors != 0))
+    {
+        LOG_E(" allocator saw %d allocations, %d bad frees!", test_heap.allocs, test_heap.errors);
+        _ret = UMQTT_FAILED;
+    }
+    return _ret;
+}
+#endif /* PKG_UMQTT_USING_ALLOCATOR */
+
+#ifdef PKG_UMQTT_USING_PUB_RING
+#define UMQTT_TEST_RING_LAPS            4                       /* times the client test wraps the ring */
+
+/* check one batched qos0 frame on UMQTT_TEST_TOPIC, return its length, <0: malformed */
+static int umqtt_test_ring_frame(const rt_uint8_t *buf, int len, rt_uint32_t *seq)
+{
+    int _rem = 0, _shift = 0, _off = 1;
+    int _topic_len = (int)rt_strlen(UMQTT_TEST_TOPIC);
+
+    if ((len < 2) || (buf[0] != (UMQTT_TYPE_PUBLISH << 4)))
+        return UMQTT_FAILED;
+    do
+    {
+        if ((_off >= len) || (_shift > 21))
+            return UMQTT_FAILED;
+        _rem |= (buf[_off] & 0x7F) << _shift;
+        _shift += 7;
+    } while (buf[_off++] & 0x80);
+
+    if ((_off + _rem > len) || (_rem < 2 + _topic_len + (int)sizeof(*seq))
+     || (((buf[_off] << 8) | buf[_off + 1]) != _topic_len)
+     || (rt_memcmp(buf + _off + 2, UMQTT_TEST_TOPIC, _topic_len) != 0))
+        return UMQTT_FAILED;
+    rt_memcpy(seq, buf + _off + 2 + _topic_len, sizeof(*seq));
+    return _off + _rem;
+}
+
+/* frames are built in place, batched whole and in order, a full ring or a failed write counts drops */
+static int umqtt_test_ring_frames(void)
+{
+    struct umqtt_pub_ring *ring = RT_NULL;
+    const rt_uint8_t *buf = RT_NULL;
+    rt_uint8_t *payload = RT_NULL;
+    rt_size_t _size = 0;
+    rt_uint32_t _seq = 0, _got = 0;
+    int _ret = UMQTT_OK, _cnt = 0, _len = 0, _frames = 0, _off = 0, _flen = 0;
+
+    ring = umqtt_pub_ring_create(RT_NULL);
+    UMQTT_TEST_CHECK(ring != RT_NULL);
+
+    /* an oversize commit gives the slot up */
+    UMQTT_TEST_CHECK(umqtt_pub_ring_reserve(ring, UMQTT_TEST_TOPIC, &payload, &_size) == UMQTT_OK);
+    UMQTT_TEST_CHECK(_size == PKG_UMQTT_PUB_RING_SLOT_SIZE - rt_strlen(UMQTT_TEST_TOPIC));
+    UMQTT_TEST_CHECK(umqtt_pub_ring_commit(ring, _size + 1) == UMQTT_BUFFER_TOO_SHORT);
+    UMQTT_TEST_CHECK(umqtt_pub_ring_commit(ring, sizeof(_seq)) == UMQTT_FAILED);
+    UMQTT_TEST_CHECK(umqtt_pub_ring_empty(ring));
+
+    /* full slots, the frames are long enough to need several batches */
+    for (_cnt = 0; _cnt < PKG_UMQTT_PUB_RING_SLOTS; _cnt++, _seq++)
+    {
+        UMQTT_TEST_CHECK(umqtt_pub_ring_reserve(ring, UMQTT_TEST_TOPIC, &payload, &_size) == UMQTT_OK);
+        rt_memcpy(payload, &_seq, sizeof(_seq));
+        UMQTT_TEST_CHECK(umqtt_pub_ring_commit(ring, _size) == UMQTT_OK);
+    }
+    UMQTT_TEST_CHECK(umqtt_pub_ring_reserve(ring, UMQTT_TEST_TOPIC, &payload, &_size) == UMQTT_MEM_FULL);
+    UMQTT_TEST_CHECK(umqtt_pub_ring_drops(ring) == 1);
+
+    /* a batch stops only before a frame that does not fit */
+    _seq = 0;
+    while ((_len = umqtt_pub_ring_batch(ring, &buf, &_frames)) > 0)
+    {
+        UMQTT_TEST_CHECK(_len <= PKG_UMQTT_PUB_RING_BATCH_SIZE);
+        for (_off = 0, _cnt = 0; _off < _len; _off += _flen, _cnt++, _seq++)
+        {
+            _flen = umqtt_test_ring_frame(buf + _off, _len - _off, &_got);
+            UMQTT_TEST_CHECK((_flen > 0) && (_got == _seq));
+        }
+        UMQTT_TEST_CHECK(_cnt == _frames);
+        umqtt_pub_ring_consume(ring, 1);
+        UMQTT_TEST_CHECK(umqtt_pub_ring_empty(ring) || (_len + _flen > PKG_UMQTT_PUB_RING_BATCH_SIZE));
+    }
+    UMQTT_TEST_CHECK(_seq == PKG_UMQTT_PUB_RING_SLOTS);
+
+    /* a failed write drops its batch */
+    UMQTT_TEST_CHECK(umqtt_pub_ring_reserve(ring, UMQTT_TEST_TOPIC, &payload, &_size) == UMQTT_OK);
+    rt_memcpy(payload, &_seq, sizeof(_seq));
+    UMQTT_TEST_CHECK(umqtt_pub_ring_commit(ring, sizeof(_seq)) == UMQTT_OK);
+    UMQTT_TEST_CHECK((umqtt_pub_ring_batch(ring, &buf, &_frames) > 0) && (_frames == 1));
+    umqtt_pub_ring_consume(ring, 0);
+    UMQTT_TEST_CHECK(umqtt_pub_ring_empty(ring) && (umqtt_pub_ring_drops(ring) == 2));
+
+_exit:
+    umqtt_pub_ring_delete(ring, RT_NULL);
+    return _ret;
+}
+
+/* a ring filled before the link goes out in order once linked, then wraps without a drop */
+static int umqtt_test_pub_ring(void)
+{
+    umqtt_client_t client = RT_NULL;
+    struct umqtt_info info = { 0 };
+    rt_uint8_t *payload = RT_NULL;
+    size_t _size = 0;
+    rt_uint32_t _seq = 0, _drops = 0;
+    int _ret = UMQTT_OK, _cnt = 0, _started = 0;
+
+    client = umqtt_test_open(&info);
+    UMQTT_TEST_CHECK(client != RT_NULL);
+
+    for (_cnt = 0; _cnt < PKG_UMQTT_PUB_RING_SLOTS; _cnt++, _seq++)
+        UMQTT_TEST_CHECK(umqtt_publish_enqueue(client, UMQTT_TEST_TOPIC, &_seq, sizeof(_seq)) == UMQTT_OK);
+    UMQTT_TEST_CHECK(umqtt_publish_enqueue(client, UMQTT_TEST_TOPIC, &_seq, sizeof(_seq)) == UMQTT_MEM_FULL);
+    UMQTT_TEST_CHECK((umqtt_control(client, UMQTT_CMD_GET_RING_DROPS, &_drops) >= 0) && (_drops == 1));
+
+    UMQTT_TEST_CHECK(umqtt_start(client) >= 0);
+    _started = 1;
+    UMQTT_TEST_CHECK(umqtt_test_wait(&(test_broker.publish_cnt), _seq) == UMQTT_OK);
+
+    /* paced on the broker so a slot is always free, every other publish built in place */
+    for (_cnt = 0; _cnt < UMQTT_TEST_RING_LAPS * PKG_UMQTT_PUB_RING_SLOTS; _cnt++, _seq++)
+    {
+        UMQTT_TEST_CHECK(umqtt_test_wait(&(test_broker.publish_cnt), _seq - PKG_UMQTT_PUB_RING_SLOTS + 1) == UMQTT_OK);
+        if (_cnt & 1)
+        {
+            payload = umqtt_publish_reserve(client, UMQTT_TEST_TOPIC, &_size);
+            UMQTT_TEST_CHECK((payload != RT_NULL) && (_size >= sizeof(_seq)));
+            rt_memcpy(payload, &_seq, sizeof(_seq));
+            UMQTT_TEST_CHECK(umqtt_publish_commit(client, sizeof(_seq)) == UMQTT_OK);
+        }
+        else
+        {
+            UMQTT_TEST_CHECK(umqtt_publish_enqueue(client, UMQTT_TEST_TOPIC, &_seq, sizeof(_seq)) == UMQTT_OK);
+        }
+    }
+    UMQTT_TEST_CHECK(umqtt_test_wait(&(test_broker.publish_cnt), _seq) == UMQTT_OK);
+    UMQTT_TEST_CHECK((umqtt_control(client, UMQTT_CMD_GET_RING_DROPS, &_drops) >= 0) && (_drops == 1));
+
+_exit:
+    if (umqtt_test_close(client, _started) < 0)               /* the broker checks the sequence */
+        _ret = UMQTT_FAILED;
+    return _ret;
+}
+#endif /* PKG_UMQTT_USING_PUB_RING */
+
+struct umqtt_test_case
+{
+    const char *name;
+    int (*run)(void);
+};
+
+static const struct umqtt_test_case test_cases[] =
+{
+    { "mem_close",      umqtt_test_mem_close },
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+    { "backpressure",   umqtt_test_backpressure },
+    { "backlog_expire", umqtt_test_backlog_expire },
+#endif
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+    { "lanes",          umqtt_test_lanes },
+#endif
+#ifdef PKG_UMQTT_USING_BUF_POOL
+    { "buf_pool",       umqtt_test_buf_pool },
+#endif
+#ifdef PKG_UMQTT_USING_ALLOCATOR
+    { "allocator",      umqtt_test_allocator },
+#endif
+#ifdef PKG_UMQTT_USING_PUB_RING
+    { "ring_frames",    umqtt_test_ring_frames },
+    { "pub_ring",       umqtt_test_pub_ring },
+#endif
+    { RT_NULL,          RT_NULL },
+};
+
+static int umqtt_test(int argc, char **argv)
+{
+    int _cnt = 0, _run = 0, _failed = 0;
+
+    for (_cnt = 0; test_cases[_cnt].name != RT_NULL; _cnt++)
+    {
+        if ((argc > 1) && (rt_strcmp(argv[1], test_cases[_cnt].name) != 0))
+            continue;
+
+        _run++;
+        if (test_cases[_cnt].run() < 0)
+        {
+            rt_kprintf("umqtt test %-16s FAIL\n", test_cases[_cnt].name);
+            _failed++;
+        }
+        else
+        {
+            rt_kprintf("umqtt test %-16s PASS\n", test_cases[_cnt].name);
+        }
+    }
+    if (_run == 0)
+    {
+        LOG_E("umqtt_test [name]  --no test of that name is enabled.");
+        return -1;
+    }
+    rt_kprintf("umqtt test: %d run, %d failed\n", _run, _failed);
+    return (_failed > 0) ? -1 : 0;
+}
+
+#ifdef FINSH_USING_MSH
+MSH_CMD_EXPORT(umqtt_test, umqtt self tests over the in-memory transport);
+#endif
+
+#endif /* PKG_UMQTT_USING_TRANS_MEM */
@@ -140,3 +140,29 @@ int umqtt_pkgs_len(int rem_len)
 
     return rem_len;
 }
+
+/* copy a decoded publish out of the receive buffer into one block, release with umqtt_publish_free;
+   from the system heap, not the client allocator, the application may hold the copy past the client */
+struct umqtt_pkgs_publish *umqtt_publish_dup(const struct umqtt_pkgs_publish *msg)
+{
+    struct umqtt_pkgs_publish *dup = RT_NULL;
+    char *ptr = RT_NULL;
+
+#ifdef PKG_UMQTT_USING_MSG_RETAIN
+    dup = umqtt_msg_alloc(msg->topic_name_len + 1 + msg->payload_len);
+#else
+    dup = (struct umqtt_pkgs_publish *)rt_malloc(sizeof(struct umqtt_pkgs_publish)
+                                                 + msg->topic_name_len + 1 + msg->payload_len);
+#endif
+    if (dup == RT_NULL)
+        return RT_NULL;
+
+    ptr = (char *)(dup + 1);
+    rt_memcpy(ptr, msg->topic_name, msg->topic_name_len);
+    ptr[msg->topic_name_len] = '\0';
+    rt_memcpy(ptr + msg->topic_name_len + 1, msg->payload, msg->payload_len);
+    *dup = *msg;
+    dup->topic_name = ptr;
+    dup->payload = ptr + msg->topic_name_len + 1;
+    return dup;
+}
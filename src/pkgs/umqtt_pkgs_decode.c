@@ -197,7 +197,7 @@ static int umqtt_suback_decode(struct umqtt_pkgs_suback *suback_msg, rt_uint8_t
     suback_msg->topic_count = 0;
     while (curdata < enddata)
     {
-        if (suback_msg->topic_count > PKG_UMQTT_SUBRECV_DEF_LENGTH)
+        if (suback_msg->topic_count >= PKG_UMQTT_PKGS_FILTER_MAX)
         {
             rc = UMQTT_FAILED;
             goto exit;
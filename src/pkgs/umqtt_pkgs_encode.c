@@ -219,14 +219,15 @@ exit:
     return rc;
 }
 
-static int MQTTSerialize_publish(unsigned char* buf, int buflen, int dup, int qos, struct umqtt_pkgs_publish *message)
+/* fixed header, topic name and packet id of a publish; the remaining length counts the payload that follows */
+static int MQTTSerialize_publishHead(unsigned char* buf, int buflen, int dup, int qos, struct umqtt_pkgs_publish *message)
 {
     unsigned char *ptr = buf;
     MQTTHeader header = { 0 };
     int rem_len = 0;
     int rc = 0;
 
-    if (umqtt_pkgs_len(rem_len = MQTTSerialize_publishLength(qos, message)) > buflen)
+    if (umqtt_pkgs_len(rem_len = MQTTSerialize_publishLength(qos, message)) - (int)message->payload_len > buflen)
     {
         rc = UMQTT_BUFFER_TOO_SHORT;
         goto exit;
@@ -243,14 +244,28 @@ static int MQTTSerialize_publish(unsigned char* buf, int buflen, int dup, int qo
     if (qos > 0)
         umqtt_writeInt(&ptr, message->packet_id);
 
-    memcpy(ptr, message->payload, message->payload_len);
-    ptr += message->payload_len;
-
     rc = ptr - buf;
 exit:
     return rc;
 }
 
+static int MQTTSerialize_publish(unsigned char* buf, int buflen, int dup, int qos, struct umqtt_pkgs_publish *message)
+{
+    int rc = 0;
+
+    if (umqtt_pkgs_len(MQTTSerialize_publishLength(qos, message)) > buflen)
+    {
+        rc = UMQTT_BUFFER_TOO_SHORT;
+        goto exit;
+    }
+
+    rc = MQTTSerialize_publishHead(buf, buflen, dup, qos, message);
+    memcpy(buf + rc, message->payload, message->payload_len);
+    rc += message->payload_len;
+exit:
+    return rc;
+}
+
 static int MQTTSerialize_ack(unsigned char *buf, int buflen, unsigned char packettype, unsigned char dup, unsigned short packetid)
 {
     MQTTHeader header = { 0 };
@@ -346,7 +361,6 @@ static int umqtt_puback_encode(unsigned char *buf, int buflen, unsigned short pa
 {
     return MQTTSerialize_ack(buf, buflen, UMQTT_TYPE_PUBACK, 0, packetid);
 }
-// static int umqtt_pubrec_encode();
 
 /**
  * packaging the pubcomp data
@@ -435,7 +449,7 @@ int umqtt_encode(enum umqtt_type type, rt_uint8_t *send_buf, size_t send_len, st
         _ret = umqtt_puback_encode(send_buf, send_len, message->msg.puback.packet_id);
         break;
     case UMQTT_TYPE_PUBREC:
-        // _ret = umqtt_pubrec_encode();
+        _ret = MQTTSerialize_ack(send_buf, send_len, UMQTT_TYPE_PUBREC, 0, message->msg.pubrec.packet_id);
         break;
     case UMQTT_TYPE_PUBREL:
         _ret = umqtt_pubrel_encode(send_buf, send_len, message->header.bits.dup, message->msg.pubrel.packet_id);
@@ -461,3 +475,89 @@ int umqtt_encode(enum umqtt_type type, rt_uint8_t *send_buf, size_t send_len, st
     return _ret;
 }
 
+/**
+ * packaging a publish without its payload, the payload is sent from the
+ * caller's buffer right after it (umqtt_trans_sendv)
+ *
+ * @param send_buf the output send buf, result of the package
+ * @param send_len the output send buffer length
+ * @param message the input message, UMQTT_TYPE_PUBLISH
+ *
+ * @return <=0: failed or other error
+ *         >0: package head length
+ */
+int umqtt_encode_publish_head(rt_uint8_t *send_buf, size_t send_len, struct umqtt_msg *message)
+{
+    return MQTTSerialize_publishHead(send_buf, send_len, message->header.bits.dup, message->header.bits.qos,
+                                     &(message->msg.publish));
+}
+
+/**
+ * length of the packet umqtt_encode builds for this message
+ *
+ * @param type the input packaging type
+ * @param message the input message
+ *
+ * @return <=0: unknown type
+ *         >0: package data length
+ */
+int umqtt_encode_len(enum umqtt_type type, struct umqtt_msg *message)
+{
+    int _rem_len = 0;
+    switch (type)
+    {
+    case UMQTT_TYPE_CONNECT:
+        _rem_len = MQTTSerialize_connectLength(&(message->msg.connect));
+        break;
+    case UMQTT_TYPE_PUBLISH:
+        _rem_len = MQTTSerialize_publishLength(message->header.bits.qos, &(message->msg.publish));
+        break;
+    case UMQTT_TYPE_PUBACK:
+    case UMQTT_TYPE_PUBREC:
+    case UMQTT_TYPE_PUBREL:
+    case UMQTT_TYPE_PUBCOMP:
+        _rem_len = 2;
+        break;
+    case UMQTT_TYPE_SUBSCRIBE:
+        _rem_len = MQTTSerialize_subscribeLength(&(message->msg.subscribe));
+        break;
+    case UMQTT_TYPE_UNSUBSCRIBE:
+        _rem_len = MQTTSerialize_unsubscribeLength(&(message->msg.unsubscribe));
+        break;
+    case UMQTT_TYPE_PINGREQ:
+    case UMQTT_TYPE_DISCONNECT:
+        _rem_len = 0;
+        break;
+    default:
+        return 0;
+    }
+    return umqtt_pkgs_len(_rem_len);
+}
+
+/**
+ * packaging a control packet carrying at most a packet id, without building
+ * a struct umqtt_msg
+ *
+ * @param type the input, PUBACK / PUBREC / PUBREL / PUBCOMP / PINGREQ
+ * @param packet_id the input packet id, unused by PINGREQ
+ * @param send_buf the output send buf, result of the package
+ * @param send_len the output send buffer length
+ *
+ * @return <=0: failed or other error
+ *         >0: package data length
+ */
+int umqtt_encode_ack(enum umqtt_type type, rt_uint16_t packet_id, rt_uint8_t *send_buf, size_t send_len)
+{
+    switch (type)
+    {
+    case UMQTT_TYPE_PUBACK:
+    case UMQTT_TYPE_PUBREC:
+    case UMQTT_TYPE_PUBREL:
+    case UMQTT_TYPE_PUBCOMP:
+        return MQTTSerialize_ack(send_buf, send_len, type, 0, packet_id);
+    case UMQTT_TYPE_PINGREQ:
+        return umqtt_pingreq_encode(send_buf, send_len);
+    default:
+        return 0;
+    }
+}
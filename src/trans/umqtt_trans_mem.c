@@ -0,0 +1,493 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_TRANS_MEM
+
+#include <sys/errno.h>
+
+#define DBG_TAG             "umqtt.mem"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#define UMQTT_MEM_SCHEME                "mem://"
+#define UMQTT_MEM_POLL_WAKE             0x80            /* umqtt_mem_wait from a poll, umqtt_mem_wake ends it */
+
+struct umqtt_mem_pipe                                           /* one direction of the loopback */
+{
+    rt_uint8_t buf[PKG_UMQTT_TRANS_MEM_PIPE_SIZE];              /* ring buffer */
+    rt_uint32_t read_pos, write_pos;                            /* free running read/write counters */
+    rt_uint8_t closed;                                          /* writer side closed */
+    struct rt_semaphore *data_sem;                              /* the reader end's wake, released when datas are written */
+    struct rt_semaphore *space_sem;                             /* the writer end's wake, released when datas are read */
+};
+
+struct umqtt_mem_link
+{
+    char name[RT_NAME_MAX * 2];                                 /* link name, from "mem://<name>" */
+    struct umqtt_mem_pipe c2s, s2c;                             /* client to server, server to client */
+    struct rt_semaphore wake[2];                                /* client end, server end: any change the end may wait for */
+    struct rt_mutex lock;                                       /* pipes lock */
+    rt_uint8_t accepted;                                        /* peer end taken */
+    rt_uint8_t refs;                                            /* open ends */
+    rt_list_t list;
+};
+
+/* every call takes a reference to its end first; close only drops the end's own one,
+   the last caller to leave frees the end and lets go of the link */
+struct umqtt_mem_end
+{
+    struct umqtt_mem_link *link;
+    struct umqtt_mem_pipe *rx, *tx;
+    struct rt_semaphore *wake;                                  /* readable or writable again, one wait for both */
+    rt_uint32_t refs;                                           /* the open end and the calls inside, under the interrupt lock */
+    volatile rt_uint8_t closed;                                 /* closed by this end, its waiters pass the wake on */
+    volatile rt_uint8_t woken;                                  /* umqtt_mem_wake not yet seen by a poll */
+};
+
+struct umqtt_mem_acceptor                                       /* an umqtt_trans_mem_accept waiting for its name */
+{
+    const char *name;
+    struct rt_semaphore sem;                                    /* released by a connect to this name only */
+    rt_list_t list;
+};
+
+static rt_list_t umqtt_mem_link_list = RT_LIST_OBJECT_INIT(umqtt_mem_link_list);
+static rt_list_t umqtt_mem_acceptor_list = RT_LIST_OBJECT_INIT(umqtt_mem_acceptor_list);
+
+static void umqtt_mem_pipe_init(struct umqtt_mem_pipe *pipe, struct rt_semaphore *reader, struct rt_semaphore *writer)
+{
+    pipe->read_pos = pipe->write_pos = 0;
+    pipe->closed = 0;
+    pipe->data_sem = reader;
+    pipe->space_sem = writer;
+}
+
+static void umqtt_mem_link_put(struct umqtt_mem_link *link)
+{
+    int _free = 0;
+    rt_base_t level;
+
+    level = rt_hw_interrupt_disable();
+    _free = (--link->refs == 0);
+    if (_free)
+        rt_list_remove(&link->list);
+    rt_hw_interrupt_enable(level);
+
+    if (_free)
+    {
+        rt_sem_detach(&link->wake[0]);
+        rt_sem_detach(&link->wake[1]);
+        rt_mutex_detach(&link->lock);
+        rt_free(link);
+    }
+}
+
+/* the end of this transport for one call, RT_NULL once closed */
+static struct umqtt_mem_end *umqtt_mem_get(struct umqtt_trans *trans)
+{
+    struct umqtt_mem_end *end = RT_NULL;
+    rt_base_t level = rt_hw_interrupt_disable();
+
+    end = (struct umqtt_mem_end *)trans->user_data;
+    if (end != RT_NULL)
+        end->refs++;
+    rt_hw_interrupt_enable(level);
+    return end;
+}
+
+/* leave the end, the last one out frees it */
+static void umqtt_mem_put(struct umqtt_mem_end *end)
+{
+    rt_uint32_t _refs = 0;
+    rt_base_t level = rt_hw_interrupt_disable();
+
+    _refs = --end->refs;
+    rt_hw_interrupt_enable(level);
+    if (_refs == 0)
+    {
+        umqtt_mem_link_put(end->link);
+        rt_free(end);
+    }
+}
+
+static int umqtt_mem_connect(struct umqtt_trans *trans, const char *uri)
+{
+    struct umqtt_mem_link *link = RT_NULL;
+    struct umqtt_mem_end *end = RT_NULL;
+    struct umqtt_mem_acceptor *acceptor = RT_NULL;
+    const char *name = uri + strlen(UMQTT_MEM_SCHEME);
+    rt_list_t *node = RT_NULL;
+    rt_base_t level;
+
+    trans->sock = -1;
+    if ((name[0] == '\0') || (strlen(name) >= sizeof(link->name)))
+    {
+        LOG_E(" mem link name is invalid: %s", uri);
+        return UMQTT_INPARAMS_NULL;
+    }
+
+    link = (struct umqtt_mem_link *)rt_calloc(1, sizeof(struct umqtt_mem_link));
+    end = (struct umqtt_mem_end *)rt_calloc(1, sizeof(struct umqtt_mem_end));
+    if ((link == RT_NULL) || (end == RT_NULL))
+    {
+        LOG_E(" calloc mem link failed! memory full! ");
+        if (link) { rt_free(link); }
+        if (end) { rt_free(end); }
+        return UMQTT_MEM_FULL;
+    }
+
+    rt_strncpy(link->name, name, sizeof(link->name) - 1);
+    rt_sem_init(&link->wake[0], "umqtt_mc", 0, RT_IPC_FLAG_FIFO);
+    rt_sem_init(&link->wake[1], "umqtt_ms", 0, RT_IPC_FLAG_FIFO);
+    umqtt_mem_pipe_init(&link->c2s, &link->wake[1], &link->wake[0]);
+    umqtt_mem_pipe_init(&link->s2c, &link->wake[0], &link->wake[1]);
+    rt_mutex_init(&link->lock, "umqtt_ml", RT_IPC_FLAG_FIFO);
+    link->refs = 1;
+
+    end->link = link;
+    end->rx = &link->s2c;
+    end->tx = &link->c2s;
+    end->wake = &link->wake[0];
+    end->refs = 1;                                              /* the end's own, dropped by close */
+    trans->user_data = end;
+    trans->sock = 0;
+
+    /* only the acceptors of this name wake up */
+    level = rt_hw_interrupt_disable();
+    rt_list_insert_before(&umqtt_mem_link_list, &link->list);
+    rt_list_for_each(node, &umqtt_mem_acceptor_list)
+    {
+        acceptor = rt_list_entry(node, struct umqtt_mem_acceptor, list);
+        if (rt_strcmp(acceptor->name, link->name) == 0)
+            rt_sem_release(&acceptor->sem);
+    }
+    rt_hw_interrupt_enable(level);
+
+    return UMQTT_OK;
+}
+
+static int umqtt_mem_close(struct umqtt_trans *trans)
+{
+    struct umqtt_mem_end *end = RT_NULL;
+    rt_base_t level = rt_hw_interrupt_disable();
+
+    end = (struct umqtt_mem_end *)trans->user_data;
+    trans->user_data = RT_NULL;                                 /* no new call gets in */
+    rt_hw_interrupt_enable(level);
+    if (end == RT_NULL)
+        return 0;
+
+    rt_mutex_take(&end->link->lock, RT_WAITING_FOREVER);
+    end->tx->closed = 1;
+    end->rx->closed = 1;
+    end->closed = 1;
+    rt_mutex_release(&end->link->lock);
+
+    /* wake up the peer and this end's own callers blocked in recv/send/poll, each then leaves */
+    rt_sem_release(end->tx->data_sem);
+    rt_sem_release(end->wake);
+    umqtt_mem_put(end);
+    return 0;
+}
+
+static int umqtt_mem_wait(struct umqtt_mem_end *end, int events, rt_int32_t timeout)
+{
+    int revents = 0;
+
+    while (1)
+    {
+        rt_mutex_take(&end->link->lock, RT_WAITING_FOREVER);
+        if ((events & UMQTT_TRANS_POLLIN)
+         && ((end->rx->write_pos != end->rx->read_pos) || end->rx->closed))
+            revents |= UMQTT_TRANS_POLLIN;
+        if ((events & UMQTT_TRANS_POLLOUT)
+         && (((end->tx->write_pos - end->tx->read_pos) < PKG_UMQTT_TRANS_MEM_PIPE_SIZE) || end->tx->closed))
+            revents |= UMQTT_TRANS_POLLOUT;
+        rt_mutex_release(&end->link->lock);
+
+        if (end->closed)
+        {
+            rt_sem_release(end->wake);                          /* closed under a waiter, the next one wakes too */
+            break;
+        }
+        if (revents != 0)
+            break;
+        if ((events & UMQTT_MEM_POLL_WAKE) && end->woken)
+        {
+            end->woken = 0;
+            break;
+        }
+
+        /* new datas and freed space both release the end's wake, either event ends the wait */
+        if (rt_sem_take(end->wake, timeout) != RT_EOK)
+            break;
+    }
+    return revents;
+}
+
+/* copy the segments into the peer's pipe in order, one deadline for all of them */
+static int umqtt_mem_sendv(struct umqtt_trans *trans, const struct umqtt_iovec *iov, int iovcnt, int timeout)
+{
+    struct umqtt_mem_end *end = umqtt_mem_get(trans);
+    struct umqtt_mem_pipe *pipe = RT_NULL;
+    rt_uint32_t offset = 0U, sent = 0U, room = 0U, chunk = 0U, pos = 0U;
+    rt_tick_t start_tick = rt_tick_get();
+    int _left = 0, _ret = 0, _cnt = 0;
+    const rt_uint8_t *seg = RT_NULL;
+
+    if (end == RT_NULL)
+        return UMQTT_SEND_FAILED;
+
+    pipe = end->tx;
+    while (_cnt < iovcnt)
+    {
+        if (offset >= iov[_cnt].iov_len)
+        {
+            _cnt++;
+            offset = 0U;
+            continue;
+        }
+
+        /* the pipe is full until the peer reads, bound the wait by the send deadline */
+        _left = umqtt_trans_time_left(start_tick, timeout);
+        if (umqtt_mem_wait(end, UMQTT_TRANS_POLLOUT,
+                           (_left < 0) ? RT_WAITING_FOREVER : rt_tick_from_millisecond(_left)) == 0)
+        {
+            _ret = UMQTT_SEND_TORN(sent, UMQTT_SEND_TIMEOUT);
+            goto _exit;
+        }
+
+        rt_mutex_take(&end->link->lock, RT_WAITING_FOREVER);
+        if (pipe->closed)
+        {
+            rt_mutex_release(&end->link->lock);
+            _ret = -EPIPE;
+            goto _exit;
+        }
+        room = PKG_UMQTT_TRANS_MEM_PIPE_SIZE - (pipe->write_pos - pipe->read_pos);
+        while ((room > 0) && (_cnt < iovcnt))
+        {
+            seg = (const rt_uint8_t *)iov[_cnt].iov_base;
+            if (offset >= iov[_cnt].iov_len)
+            {
+                _cnt++;
+                offset = 0U;
+                continue;
+            }
+            pos = pipe->write_pos % PKG_UMQTT_TRANS_MEM_PIPE_SIZE;
+            chunk = PKG_UMQTT_TRANS_MEM_PIPE_SIZE - pos;
+            if (chunk > room) chunk = room;
+            if (chunk > iov[_cnt].iov_len - offset) chunk = iov[_cnt].iov_len - offset;
+            rt_memcpy(&pipe->buf[pos], seg + offset, chunk);
+            pipe->write_pos += chunk;
+            offset += chunk;
+            sent += chunk;
+            room -= chunk;
+        }
+        rt_mutex_release(&end->link->lock);
+        rt_sem_release(pipe->data_sem);
+    }
+    _ret = sent;
+
+_exit:
+    umqtt_mem_put(end);
+    return _ret;
+}
+
+static int umqtt_mem_send(struct umqtt_trans *trans, const rt_uint8_t *send_buf, rt_uint32_t buf_len, int timeout)
+{
+    struct umqtt_iovec iov;
+
+    iov.iov_base = send_buf;
+    iov.iov_len = buf_len;
+    return umqtt_mem_sendv(trans, &iov, 1, timeout);
+}
+
+static int umqtt_mem_recv(struct umqtt_trans *trans, rt_uint8_t *recv_buf, rt_uint32_t buf_len)
+{
+    struct umqtt_mem_end *end = umqtt_mem_get(trans);
+    struct umqtt_mem_pipe *pipe = RT_NULL;
+    rt_uint32_t offset = 0U, avail = 0U, chunk = 0U, pos = 0U;
+
+    if (end == RT_NULL)
+        return 0;
+
+    pipe = end->rx;
+    umqtt_mem_wait(end, UMQTT_TRANS_POLLIN, RT_WAITING_FOREVER);
+
+    rt_mutex_take(&end->link->lock, RT_WAITING_FOREVER);
+    avail = pipe->write_pos - pipe->read_pos;
+    while ((avail > 0) && (offset < buf_len))
+    {
+        pos = pipe->read_pos % PKG_UMQTT_TRANS_MEM_PIPE_SIZE;
+        chunk = PKG_UMQTT_TRANS_MEM_PIPE_SIZE - pos;
+        if (chunk > avail) chunk = avail;
+        if (chunk > buf_len - offset) chunk = buf_len - offset;
+        rt_memcpy(recv_buf + offset, &pipe->buf[pos], chunk);
+        pipe->read_pos += chunk;
+        offset += chunk;
+        avail -= chunk;
+    }
+    rt_mutex_release(&end->link->lock);
+
+    if (offset > 0)
+        rt_sem_release(pipe->space_sem);
+
+    umqtt_mem_put(end);
+    return offset;                      /* 0: closed */
+}
+
+static int umqtt_mem_poll(struct umqtt_trans *trans, int events, int timeout)
+{
+    struct umqtt_mem_end *end = umqtt_mem_get(trans);
+    int _ret = 0;
+
+    if (end == RT_NULL)
+        return -ENOTCONN;
+
+    _ret = umqtt_mem_wait(end, events | UMQTT_MEM_POLL_WAKE,
+                          (timeout < 0) ? RT_WAITING_FOREVER : rt_tick_from_millisecond(timeout));
+    umqtt_mem_put(end);
+    return _ret;
+}
+
+/* end a poll of this end, or the next one; recv and send waits carry on */
+static int umqtt_mem_wake(struct umqtt_trans *trans)
+{
+    struct umqtt_mem_end *end = umqtt_mem_get(trans);
+
+    if (end == RT_NULL)
+        return -ENOTCONN;
+
+    end->woken = 1;
+    rt_sem_release(end->wake);
+    umqtt_mem_put(end);
+    return 0;
+}
+
+/* bytes written to the pipe and not yet read by the peer */
+static int umqtt_mem_pending(struct umqtt_trans *trans)
+{
+    struct umqtt_mem_end *end = umqtt_mem_get(trans);
+    int _len = 0;
+
+    if (end == RT_NULL)
+        return 0;
+
+    rt_mutex_take(&end->link->lock, RT_WAITING_FOREVER);
+    _len = end->tx->write_pos - end->tx->read_pos;
+    rt_mutex_release(&end->link->lock);
+    umqtt_mem_put(end);
+    return _len;
+}
+
+struct umqtt_trans_ops umqtt_trans_mem_ops =
+{
+    UMQTT_MEM_SCHEME,
+    umqtt_mem_connect,
+    umqtt_mem_close,
+    umqtt_mem_send,
+    umqtt_mem_sendv,
+    umqtt_mem_recv,
+    umqtt_mem_poll,
+    umqtt_mem_pending,
+    umqtt_mem_wake,
+};
+
+/**
+ * accept the peer end of an in-memory loopback connection, used by benchmarks
+ * and local broker stand-ins.
+ *
+ * @param name the input link name, the part after "mem://" in the client URI
+ * @param peer the output transport, use it with umqtt_trans_send/recv/disconnect
+ * @param timeout the input, wait timeout, uint:mSec, <0: wait forever
+ *
+ * @return <0: failed or other error
+ *         =0: success
+ */
+int umqtt_trans_mem_accept(const char *name, struct umqtt_trans *peer, int timeout)
+{
+    rt_list_t *node = RT_NULL;
+    struct umqtt_mem_link *link = RT_NULL, *found = RT_NULL;
+    struct umqtt_mem_end *end = RT_NULL;
+    struct umqtt_mem_acceptor acceptor;
+    rt_base_t level;
+
+    RT_ASSERT(name);
+    RT_ASSERT(peer);
+
+    end = (struct umqtt_mem_end *)rt_calloc(1, sizeof(struct umqtt_mem_end));
+    if (end == RT_NULL)
+        return UMQTT_MEM_FULL;
+
+    /* listed before the first lookup, a connect in between still releases it */
+    acceptor.name = name;
+    rt_sem_init(&acceptor.sem, "umqtt_ma", 0, RT_IPC_FLAG_FIFO);
+    level = rt_hw_interrupt_disable();
+    rt_list_insert_before(&umqtt_mem_acceptor_list, &acceptor.list);
+    rt_hw_interrupt_enable(level);
+
+    while (found == RT_NULL)
+    {
+        level = rt_hw_interrupt_disable();
+        rt_list_for_each(node, &umqtt_mem_link_list)
+        {
+            link = rt_list_entry(node, struct umqtt_mem_link, list);
+            if ((link->accepted == 0) && (rt_strcmp(link->name, name) == 0))
+            {
+                link->accepted = 1;
+                link->refs++;
+                found = link;
+                break;
+            }
+        }
+        rt_hw_interrupt_enable(level);
+
+        if ((found == RT_NULL)
+         && (rt_sem_take(&acceptor.sem,
+                         (timeout < 0) ? RT_WAITING_FOREVER : rt_tick_from_millisecond(timeout)) != RT_EOK))
+            break;
+    }
+
+    level = rt_hw_interrupt_disable();
+    rt_list_remove(&acceptor.list);
+    rt_hw_interrupt_enable(level);
+    rt_sem_detach(&acceptor.sem);
+    if (found == RT_NULL)
+    {
+        rt_free(end);
+        return UMQTT_TIMEOUT;
+    }
+
+    end->link = found;
+    end->rx = &found->c2s;
+    end->tx = &found->s2c;
+    end->wake = &found->wake[1];
+    end->refs = 1;
+    peer->ops = &umqtt_trans_mem_ops;
+    peer->user_data = end;
+    peer->sock = 0;
+    return UMQTT_OK;
+}
+
+#endif /* PKG_UMQTT_USING_TRANS_MEM */
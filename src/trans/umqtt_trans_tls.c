@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_TLS_SESSION_CACHE
+
+#include <sys/socket.h>
+#include <sys/errno.h>
+#include <tls_client.h>
+
+#define DBG_TAG             "umqtt.tls"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#define UMQTT_TLS_SCHEME                "ssl://"
+#define UMQTT_TLS_PERS                  "umqtt"
+
+struct umqtt_tls_cache                                          /* one resumable session per broker */
+{
+    char *uri;                                                  /* broker URI, RT_NULL: free entry */
+    mbedtls_ssl_session session;                                /* session id / ticket of the last handshake */
+    rt_tick_t last_tick;                                        /* last use, the oldest entry is evicted */
+};
+
+static struct umqtt_tls_cache umqtt_tls_cache[PKG_UMQTT_TLS_SESSION_CACHE_NUM];
+static struct umqtt_tls_stats umqtt_tls_stats;
+static struct rt_mutex umqtt_tls_lock;
+static rt_uint8_t umqtt_tls_inited = 0;
+
+static void umqtt_tls_global_init(void)
+{
+    int _cnt = 0;
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (umqtt_tls_inited == 0)
+    {
+        rt_mutex_init(&umqtt_tls_lock, "umqtt_tls", RT_IPC_FLAG_PRIO);
+        for (_cnt = 0; _cnt < PKG_UMQTT_TLS_SESSION_CACHE_NUM; _cnt++)
+            mbedtls_ssl_session_init(&umqtt_tls_cache[_cnt].session);
+        umqtt_tls_inited = 1;
+    }
+    rt_hw_interrupt_enable(level);
+}
+
+/* call with umqtt_tls_lock held */
+static struct umqtt_tls_cache *umqtt_tls_cache_find(const char *uri)
+{
+    int _cnt = 0;
+    for (_cnt = 0; _cnt < PKG_UMQTT_TLS_SESSION_CACHE_NUM; _cnt++)
+    {
+        if ((umqtt_tls_cache[_cnt].uri != RT_NULL) && (rt_strcmp(umqtt_tls_cache[_cnt].uri, uri) == 0))
+            return &umqtt_tls_cache[_cnt];
+    }
+    return RT_NULL;
+}
+
+/* call with umqtt_tls_lock held */
+static void umqtt_tls_cache_drop(struct umqtt_tls_cache *entry)
+{
+    rt_free(entry->uri);
+    entry->uri = RT_NULL;
+    mbedtls_ssl_session_free(&entry->session);
+    mbedtls_ssl_session_init(&entry->session);
+}
+
+/**
+ * keep the session of the finished handshake, evicting the least recently used broker
+ *
+ * @param uri the input, broker URI
+ * @param session the input, connected TLS session
+ * @param offer the input, master secret of the session offered in the ClientHello, RT_NULL: none
+ *
+ * @return 1: the broker resumed the offered session
+ *         0: full handshake
+ */
+static int umqtt_tls_cache_save(const char *uri, MbedTLSSession *session, const unsigned char *offer)
+{
+    int _cnt = 0, _resumed = 0;
+    struct umqtt_tls_cache *entry = RT_NULL;
+
+    rt_mutex_take(&umqtt_tls_lock, RT_WAITING_FOREVER);
+    entry = umqtt_tls_cache_find(uri);
+    if (entry == RT_NULL)
+    {
+        entry = &umqtt_tls_cache[0];
+        for (_cnt = 0; _cnt < PKG_UMQTT_TLS_SESSION_CACHE_NUM; _cnt++)
+        {
+            if (umqtt_tls_cache[_cnt].uri == RT_NULL)
+            {
+                entry = &umqtt_tls_cache[_cnt];
+                break;
+            }
+            if ((umqtt_tls_cache[_cnt].last_tick - entry->last_tick) > (RT_TICK_MAX >> 1))
+                entry = &umqtt_tls_cache[_cnt];
+        }
+        if (entry->uri != RT_NULL)
+            umqtt_tls_cache_drop(entry);
+        entry->uri = rt_strdup(uri);
+        if (entry->uri == RT_NULL)
+            goto exit;
+    }
+
+    mbedtls_ssl_session_free(&entry->session);
+    mbedtls_ssl_session_init(&entry->session);
+    if (mbedtls_ssl_get_session(&session->ssl, &entry->session) != 0)
+    {
+        LOG_W(" save tls session failed!");
+        umqtt_tls_cache_drop(entry);
+        goto exit;
+    }
+    entry->last_tick = rt_tick_get();
+
+    /* a resumed session keeps its master secret, session id and ticket alike */
+    if ((offer != RT_NULL)
+     && (rt_memcmp(offer, entry->session.master, sizeof(entry->session.master)) == 0))
+        _resumed = 1;
+
+exit:
+    rt_mutex_release(&umqtt_tls_lock);
+    return _resumed;
+}
+
+/* split "ssl://host:port" or "ssl://[v6addr]:port" into tls_malloc'ed strings */
+static int umqtt_tls_parse_uri(const char *uri, MbedTLSSession *session)
+{
+    const char *host = uri + strlen(UMQTT_TLS_SCHEME);
+    const char *port = RT_NULL;
+    int host_len = 0;
+
+    if (host[0] == '[')
+    {
+        host += 1;
+        port = strstr(host, "]:");
+        if (port == RT_NULL)
+            return UMQTT_INPARAMS_NULL;
+        host_len = port - host;
+        port += 2;
+    }
+    else
+    {
+        port = strrchr(host, ':');
+        if (port == RT_NULL)
+            return UMQTT_INPARAMS_NULL;
+        host_len = port - host;
+        port += 1;
+    }
+    if ((host_len < 1) || (port[0] == '\0'))
+        return UMQTT_INPARAMS_NULL;
+
+    session->host = tls_malloc(host_len + 1);
+    session->port = tls_malloc(strlen(port) + 1);
+    if ((session->host == RT_NULL) || (session->port == RT_NULL))
+        return UMQTT_MEM_FULL;
+
+    rt_memcpy(session->host, host, host_len);
+    session->host[host_len] = '\0';
+    rt_memcpy(session->port, port, strlen(port) + 1);
+    return UMQTT_OK;
+}
+
+/**
+ * TLS connection through mbedtls, resuming the session cached for this URI
+ *
+ * A resumed handshake skips the certificate chain and the key exchange, which
+ * is most of the handshake cost on a small MCU.
+ *
+ * @param trans the output transport
+ * @param uri the input URI, ssl://host:port
+ *
+ * @return <0: failed or other error
+ *         =0: success
+ */
+static int umqtt_tls_connect(struct umqtt_trans *trans, const char *uri)
+{
+    int _ret = 0, _offered = 0, _resumed = 0;
+    rt_uint32_t _ms = 0;
+    rt_tick_t start_tick = 0;
+    MbedTLSSession *session = RT_NULL;
+    struct umqtt_tls_cache *entry = RT_NULL;
+    unsigned char offer[sizeof(entry->session.master)];
+
+    umqtt_tls_global_init();
+    trans->sock = -1;
+    trans->user_data = RT_NULL;
+
+    session = (MbedTLSSession *)tls_malloc(sizeof(MbedTLSSession));
+    if (session == RT_NULL)
+    {
+        LOG_E(" tls session malloc failed!");
+        _ret = UMQTT_MEM_FULL;
+        goto exit;
+    }
+    rt_memset(session, 0, sizeof(MbedTLSSession));
+
+    if ((_ret = umqtt_tls_parse_uri(uri, session)) < 0)
+    {
+        LOG_E(" tls uri is invalid: %s", uri);
+        goto exit;
+    }
+
+    if (((_ret = mbedtls_client_init(session, (void *)UMQTT_TLS_PERS, strlen(UMQTT_TLS_PERS))) != 0)
+     || ((_ret = mbedtls_client_context(session)) != 0))
+    {
+        LOG_E(" tls client context failed! (-0x%x)", -_ret);
+        _ret = UMQTT_FAILED;
+        goto exit;
+    }
+
+    rt_mutex_take(&umqtt_tls_lock, RT_WAITING_FOREVER);
+    entry = umqtt_tls_cache_find(uri);
+    if (entry != RT_NULL)
+    {
+        entry->last_tick = rt_tick_get();
+        if (mbedtls_ssl_set_session(&session->ssl, &entry->session) == 0)
+        {
+            rt_memcpy(offer, entry->session.master, sizeof(offer));
+            _offered = 1;
+        }
+    }
+    rt_mutex_release(&umqtt_tls_lock);
+
+    start_tick = rt_tick_get();
+    if ((_ret = mbedtls_client_connect(session)) != 0)
+    {
+        LOG_E(" tls handshake failed! (-0x%x)", -_ret);
+        if (_offered)
+        {
+            /* a stale session must not poison the next attempt */
+            rt_mutex_take(&umqtt_tls_lock, RT_WAITING_FOREVER);
+            if ((entry = umqtt_tls_cache_find(uri)) != RT_NULL)
+                umqtt_tls_cache_drop(entry);
+            rt_mutex_release(&umqtt_tls_lock);
+        }
+        _ret = UMQTT_FAILED;
+        goto exit;
+    }
+    _ms = (rt_tick_get() - start_tick) * 1000 / RT_TICK_PER_SECOND;
+
+    trans->sock = session->server_fd.fd;
+    trans->user_data = session;
+    /* mbedtls creates the socket inside connect, options apply from here on */
+    umqtt_trans_sock_setopt(trans->sock, trans->sockopt, 1);
+
+    _resumed = umqtt_tls_cache_save(uri, session, _offered ? offer : RT_NULL);
+
+    rt_mutex_take(&umqtt_tls_lock, RT_WAITING_FOREVER);
+    umqtt_tls_stats.last_ms = _ms;
+    if (_resumed)
+    {
+        umqtt_tls_stats.resume_cnt++;
+        umqtt_tls_stats.resume_ms += _ms;
+    }
+    else
+    {
+        if (_offered)
+            umqtt_tls_stats.resume_miss++;
+        umqtt_tls_stats.full_cnt++;
+        umqtt_tls_stats.full_ms += _ms;
+    }
+    rt_mutex_release(&umqtt_tls_lock);
+    LOG_D(" tls handshake %s, %d ms", _resumed ? "resumed" : "full", _ms);
+
+    _ret = UMQTT_OK;
+
+exit:
+    if ((_ret < 0) && (session != RT_NULL))
+    {
+        mbedtls_client_close(session);
+        trans->sock = -1;
+        trans->user_data = RT_NULL;
+    }
+    return _ret;
+}
+
+static int umqtt_tls_close(struct umqtt_trans *trans)
+{
+    MbedTLSSession *session = (MbedTLSSession *)trans->user_data;
+
+    trans->user_data = RT_NULL;
+    if (session != RT_NULL)
+        mbedtls_client_close(session);
+    return 0;
+}
+
+static int umqtt_tls_poll(struct umqtt_trans *trans, int events, int timeout)
+{
+    MbedTLSSession *session = (MbedTLSSession *)trans->user_data;
+
+    /* records already decrypted by mbedtls are invisible to poll */
+    if ((events & UMQTT_TRANS_POLLIN) && (mbedtls_ssl_get_bytes_avail(&session->ssl) > 0))
+        return UMQTT_TRANS_POLLIN;
+
+    return umqtt_trans_sock_poll(trans, events, timeout);
+}
+
+static int umqtt_tls_send(struct umqtt_trans *trans, const rt_uint8_t *send_buf, rt_uint32_t buf_len, int timeout)
+{
+    int _ret = 0, _left = 0;
+    rt_uint32_t offset = 0U;
+    rt_tick_t start_tick = rt_tick_get();
+    MbedTLSSession *session = (MbedTLSSession *)trans->user_data;
+
+    while (offset < buf_len)
+    {
+        /* the record layer writes blocking, only start a record once the socket has room */
+        _left = umqtt_trans_time_left(start_tick, timeout);
+        _ret = umqtt_tls_poll(trans, UMQTT_TRANS_POLLOUT, _left);
+        if (_ret < 0)
+            return _ret;
+        if (_ret == 0)
+            return UMQTT_SEND_TORN(offset, UMQTT_SEND_TIMEOUT);
+
+        _ret = mbedtls_client_write(session, send_buf + offset, buf_len - offset);
+        if ((_ret == MBEDTLS_ERR_SSL_WANT_WRITE) || (_ret == MBEDTLS_ERR_SSL_WANT_READ))
+            continue;
+        if (_ret < 0)
+        {
+            LOG_E(" tls write failed! (-0x%x)", -_ret);
+            return -EIO;
+        }
+        offset += _ret;
+    }
+
+    return offset;
+}
+
+static int umqtt_tls_recv(struct umqtt_trans *trans, rt_uint8_t *recv_buf, rt_uint32_t buf_len)
+{
+    int _ret = 0;
+    MbedTLSSession *session = (MbedTLSSession *)trans->user_data;
+
+    _ret = mbedtls_client_read(session, recv_buf, buf_len);
+    if ((_ret == MBEDTLS_ERR_SSL_WANT_READ) || (_ret == MBEDTLS_ERR_SSL_WANT_WRITE))
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (_ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+        return 0;
+    if (_ret < 0)
+    {
+        LOG_E(" tls read failed! (-0x%x)", -_ret);
+        errno = EIO;
+        return -1;
+    }
+    return _ret;
+}
+
+struct umqtt_trans_ops umqtt_trans_tls_cache_ops =
+{
+    UMQTT_TLS_SCHEME,
+    umqtt_tls_connect,
+    umqtt_tls_close,
+    umqtt_tls_send,
+    RT_NULL,
+    umqtt_tls_recv,
+    umqtt_tls_poll,
+    umqtt_trans_sock_pending,
+    UMQTT_TRANS_SOCK_WAKE,
+};
+
+/**
+ * read the TLS handshake counters of all clients
+ *
+ * @param stats the output, handshake counters
+ *
+ * @return <0: failed or other error
+ *         =0: success
+ */
+int umqtt_tls_get_stats(struct umqtt_tls_stats *stats)
+{
+    if (stats == RT_NULL)
+        return UMQTT_INPARAMS_NULL;
+
+    umqtt_tls_global_init();
+    rt_mutex_take(&umqtt_tls_lock, RT_WAITING_FOREVER);
+    rt_memcpy(stats, &umqtt_tls_stats, sizeof(struct umqtt_tls_stats));
+    rt_mutex_release(&umqtt_tls_lock);
+    return UMQTT_OK;
+}
+
+/**
+ * forget the cached TLS session, the next connect does a full handshake
+ *
+ * @param uri the input, broker URI, RT_NULL: every broker
+ */
+void umqtt_tls_session_flush(const char *uri)
+{
+    int _cnt = 0;
+
+    umqtt_tls_global_init();
+    rt_mutex_take(&umqtt_tls_lock, RT_WAITING_FOREVER);
+    for (_cnt = 0; _cnt < PKG_UMQTT_TLS_SESSION_CACHE_NUM; _cnt++)
+    {
+        if ((umqtt_tls_cache[_cnt].uri != RT_NULL)
+         && ((uri == RT_NULL) || (rt_strcmp(umqtt_tls_cache[_cnt].uri, uri) == 0)))
+            umqtt_tls_cache_drop(&umqtt_tls_cache[_cnt]);
+    }
+    rt_mutex_release(&umqtt_tls_lock);
+}
+
+#endif /* PKG_UMQTT_USING_TLS_SESSION_CACHE */
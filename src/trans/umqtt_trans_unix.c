@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_TRANS_UNIX
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/errno.h>
+#include <unistd.h>
+
+#define DBG_TAG             "umqtt.unix"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#define UMQTT_UNIX_SCHEME               "unix://"
+
+/**
+ * unix-domain stream connection for an on-box broker
+ *
+ * @param trans the output transport
+ * @param uri the input URI, the socket path follows the scheme
+ *
+ * URI example:
+ * unix:///var/run/mosquitto.sock
+ *
+ * @return <0: failed or other error
+ *         =0: success
+ */
+static int umqtt_unix_connect(struct umqtt_trans *trans, const char *uri)
+{
+    int _ret = 0;
+    const char *path = uri + strlen(UMQTT_UNIX_SCHEME);
+    struct sockaddr_un addr;
+
+    trans->sock = -1;
+    if ((path[0] == '\0') || (strlen(path) >= sizeof(addr.sun_path)))
+    {
+        LOG_E(" unix socket path is invalid: %s", uri);
+        _ret = UMQTT_INPARAMS_NULL;
+        goto exit;
+    }
+
+    rt_memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    rt_strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if ((trans->sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        LOG_E(" create unix socket error!");
+        _ret = UMQTT_FAILED;
+        goto exit;
+    }
+
+    umqtt_trans_sock_setopt(trans->sock, trans->sockopt, 0);
+
+    if (connect(trans->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        LOG_E(" unix connect err! errno(%d)", errno);
+        close(trans->sock);
+        trans->sock = -1;
+        _ret = UMQTT_FAILED;
+        goto exit;
+    }
+
+exit:
+    return _ret;
+}
+
+static int umqtt_unix_close(struct umqtt_trans *trans)
+{
+    if (close(trans->sock) < 0)
+        return -errno;
+    return 0;
+}
+
+/* wait until the peer drains its receive buffer, bounded by the send deadline */
+static int umqtt_unix_wait_writable(struct umqtt_trans *trans, rt_tick_t start_tick, int timeout)
+{
+    int _left = 0, _ret = 0;
+
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+        return -errno;
+
+    _left = umqtt_trans_time_left(start_tick, timeout);
+    if (_left == 0)
+        return UMQTT_SEND_TIMEOUT;
+
+    _ret = umqtt_trans_sock_poll(trans, UMQTT_TRANS_POLLOUT, _left);
+    return (_ret < 0) ? _ret : 0;
+}
+
+static int umqtt_unix_send(struct umqtt_trans *trans, const rt_uint8_t *send_buf, rt_uint32_t buf_len, int timeout)
+{
+    int _ret = 0;
+    rt_uint32_t offset = 0U;
+    rt_tick_t start_tick = rt_tick_get();
+
+    while (offset < buf_len)
+    {
+        _ret = send(trans->sock, send_buf + offset, buf_len - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (_ret < 0)
+        {
+            _ret = umqtt_unix_wait_writable(trans, start_tick, timeout);
+            if (_ret < 0)
+                return UMQTT_SEND_TORN(offset, _ret);
+            continue;
+        }
+        offset += _ret;
+    }
+
+    return offset;
+}
+
+static int umqtt_unix_sendv(struct umqtt_trans *trans, const struct umqtt_iovec *iov, int iovcnt, int timeout)
+{
+    int _ret = 0, _cnt = 0, _first = 0;
+    rt_uint32_t _sent = 0U;
+    struct iovec vec[UMQTT_TRANS_IOV_MAX];
+    struct msghdr msg;
+    rt_tick_t start_tick = rt_tick_get();
+
+    if (iovcnt > UMQTT_TRANS_IOV_MAX)
+        return -EINVAL;
+
+    for (_cnt = 0; _cnt < iovcnt; _cnt++)
+    {
+        vec[_cnt].iov_base = (void *)iov[_cnt].iov_base;
+        vec[_cnt].iov_len = iov[_cnt].iov_len;
+    }
+
+    /* gather the whole frame in one syscall, resume on short writes */
+    while (_first < iovcnt)
+    {
+        rt_memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &vec[_first];
+        msg.msg_iovlen = iovcnt - _first;
+        _ret = sendmsg(trans->sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (_ret < 0)
+        {
+            _ret = umqtt_unix_wait_writable(trans, start_tick, timeout);
+            if (_ret < 0)
+                return UMQTT_SEND_TORN(_sent, _ret);
+            continue;
+        }
+        _sent += _ret;
+
+        while ((_first < iovcnt) && (_ret >= (int)vec[_first].iov_len))
+        {
+            _ret -= vec[_first].iov_len;
+            _first++;
+        }
+        if (_first < iovcnt)
+        {
+            vec[_first].iov_base = (rt_uint8_t *)vec[_first].iov_base + _ret;
+            vec[_first].iov_len -= _ret;
+        }
+    }
+
+    return 0;
+}
+
+static int umqtt_unix_recv(struct umqtt_trans *trans, rt_uint8_t *recv_buf, rt_uint32_t buf_len)
+{
+    return recv(trans->sock, recv_buf, buf_len, 0);
+}
+
+struct umqtt_trans_ops umqtt_trans_unix_ops =
+{
+    UMQTT_UNIX_SCHEME,
+    umqtt_unix_connect,
+    umqtt_unix_close,
+    umqtt_unix_send,
+    umqtt_unix_sendv,
+    umqtt_unix_recv,
+    umqtt_trans_sock_poll,
+    umqtt_trans_sock_pending,
+    UMQTT_TRANS_SOCK_WAKE,
+};
+
+#endif /* PKG_UMQTT_USING_TRANS_UNIX */
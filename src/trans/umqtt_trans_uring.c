@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_TRANS_URING
+
+#include <sys/socket.h>
+#include <sys/errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <liburing.h>
+
+#define DBG_TAG             "umqtt.uring"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#define UMQTT_URING_SCHEME              "tcp+uring://"
+#define UMQTT_URING_BGID                0                       /* provided buffer group id */
+
+/*
+ * io_uring transport for the Linux host build.
+ *
+ * The receive side arms one multishot recv on its own ring and consumes
+ * kernel-filled buffers from a registered buffer ring, so a burst of packets
+ * costs a single io_uring_enter instead of one recv() per read. Sends go
+ * through a second ring, shared by the publishing threads under tx_lock, and
+ * scattered frames are submitted as one sendmsg.
+ *
+ * Every call takes a reference before touching the rings; close only drops
+ * the link's own one, the last caller to leave releases the rings.
+ */
+struct umqtt_uring
+{
+    struct io_uring tx_ring;                                    /* send ring, publishing threads */
+    struct io_uring rx_ring;                                    /* receive ring, receive thread only */
+    struct io_uring_buf_ring *buf_ring;                         /* registered receive buffers */
+    rt_uint8_t *rx_bufs;                                        /* receive buffers memory */
+    int cur_bid;                                                /* buffer being consumed, -1: none */
+    rt_uint32_t cur_off, cur_len;                               /* consumed / filled bytes of cur_bid */
+    rt_uint8_t rx_armed;                                        /* multishot recv is armed */
+    rt_uint32_t refs;                                           /* the link and the calls inside, under the interrupt lock */
+    struct rt_mutex tx_lock;                                    /* send ring lock */
+    int sock;
+};
+
+static void umqtt_uring_free(struct umqtt_uring *ur)
+{
+    if (ur->buf_ring)
+        io_uring_free_buf_ring(&ur->rx_ring, ur->buf_ring, PKG_UMQTT_TRANS_URING_RXBUF_NUM, UMQTT_URING_BGID);
+    io_uring_queue_exit(&ur->rx_ring);
+    io_uring_queue_exit(&ur->tx_ring);
+    if (ur->rx_bufs)
+        rt_free(ur->rx_bufs);
+    rt_mutex_detach(&ur->tx_lock);
+    close(ur->sock);
+    rt_free(ur);
+}
+
+/* the transport of this link for one call, RT_NULL once closed */
+static struct umqtt_uring *umqtt_uring_get(struct umqtt_trans *trans)
+{
+    struct umqtt_uring *ur = RT_NULL;
+    rt_base_t level = rt_hw_interrupt_disable();
+
+    ur = (struct umqtt_uring *)trans->user_data;
+    if (ur != RT_NULL)
+        ur->refs++;
+    rt_hw_interrupt_enable(level);
+    return ur;
+}
+
+/* leave the transport, the last one out releases the rings */
+static void umqtt_uring_put(struct umqtt_uring *ur)
+{
+    rt_uint32_t _refs = 0;
+    rt_base_t level = rt_hw_interrupt_disable();
+
+    _refs = --ur->refs;
+    rt_hw_interrupt_enable(level);
+    if (_refs == 0)
+        umqtt_uring_free(ur);
+}
+
+static void umqtt_uring_recycle(struct umqtt_uring *ur, int bid)
+{
+    io_uring_buf_ring_add(ur->buf_ring, ur->rx_bufs + bid * PKG_UMQTT_TRANS_URING_RXBUF_SIZE,
+                          PKG_UMQTT_TRANS_URING_RXBUF_SIZE, bid,
+                          io_uring_buf_ring_mask(PKG_UMQTT_TRANS_URING_RXBUF_NUM), 0);
+    io_uring_buf_ring_advance(ur->buf_ring, 1);
+}
+
+static int umqtt_uring_arm(struct umqtt_uring *ur)
+{
+    struct io_uring_sqe *sqe = RT_NULL;
+
+    if (ur->rx_armed)
+        return 0;
+
+    sqe = io_uring_get_sqe(&ur->rx_ring);
+    if (sqe == RT_NULL)
+        return -EBUSY;
+    io_uring_prep_recv_multishot(sqe, ur->sock, RT_NULL, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = UMQTT_URING_BGID;
+    ur->rx_armed = 1;
+    return io_uring_submit(&ur->rx_ring);
+}
+
+static int umqtt_uring_connect(struct umqtt_trans *trans, const char *uri)
+{
+    int _ret = 0, _cnt = 0;
+    struct umqtt_uring *ur = RT_NULL;
+
+    _ret = umqtt_trans_sock_connect(trans, uri, 0);
+    if (_ret < 0)
+        return _ret;
+
+    ur = (struct umqtt_uring *)rt_calloc(1, sizeof(struct umqtt_uring));
+    if (ur == RT_NULL)
+    {
+        LOG_E(" calloc uring transport failed! memory full! ");
+        close(trans->sock);
+        trans->sock = -1;
+        return UMQTT_MEM_FULL;
+    }
+    ur->sock = trans->sock;
+    ur->cur_bid = -1;
+    ur->refs = 1;                                               /* the link's own, dropped by close */
+    rt_mutex_init(&ur->tx_lock, "umqtt_ut", RT_IPC_FLAG_FIFO);
+
+    if ((_ret = io_uring_queue_init(PKG_UMQTT_TRANS_URING_ENTRIES, &ur->tx_ring, 0)) < 0)
+    {
+        LOG_E(" uring tx ring init failed! (%d)", _ret);
+        goto _fail_tx;
+    }
+    if ((_ret = io_uring_queue_init(PKG_UMQTT_TRANS_URING_ENTRIES, &ur->rx_ring, 0)) < 0)
+    {
+        LOG_E(" uring rx ring init failed! (%d)", _ret);
+        goto _fail_rx;
+    }
+
+    ur->rx_bufs = rt_malloc(PKG_UMQTT_TRANS_URING_RXBUF_NUM * PKG_UMQTT_TRANS_URING_RXBUF_SIZE);
+    if (ur->rx_bufs == RT_NULL)
+    {
+        _ret = UMQTT_MEM_FULL;
+        goto _fail_buf;
+    }
+
+    ur->buf_ring = io_uring_setup_buf_ring(&ur->rx_ring, PKG_UMQTT_TRANS_URING_RXBUF_NUM,
+                                           UMQTT_URING_BGID, 0, &_ret);
+    if (ur->buf_ring == RT_NULL)
+    {
+        LOG_E(" uring buffer ring setup failed! (%d)", _ret);
+        goto _fail_buf;
+    }
+    for (_cnt = 0; _cnt < PKG_UMQTT_TRANS_URING_RXBUF_NUM; _cnt++)
+    {
+        io_uring_buf_ring_add(ur->buf_ring, ur->rx_bufs + _cnt * PKG_UMQTT_TRANS_URING_RXBUF_SIZE,
+                              PKG_UMQTT_TRANS_URING_RXBUF_SIZE, _cnt,
+                              io_uring_buf_ring_mask(PKG_UMQTT_TRANS_URING_RXBUF_NUM), _cnt);
+    }
+    io_uring_buf_ring_advance(ur->buf_ring, PKG_UMQTT_TRANS_URING_RXBUF_NUM);
+
+    trans->user_data = ur;
+    return UMQTT_OK;
+
+_fail_buf:
+    if (ur->rx_bufs)
+        rt_free(ur->rx_bufs);
+    io_uring_queue_exit(&ur->rx_ring);
+_fail_rx:
+    io_uring_queue_exit(&ur->tx_ring);
+_fail_tx:
+    rt_mutex_detach(&ur->tx_lock);
+    close(trans->sock);
+    trans->sock = -1;
+    rt_free(ur);
+    return UMQTT_FAILED;
+}
+
+static int umqtt_uring_close(struct umqtt_trans *trans)
+{
+    struct umqtt_uring *ur = RT_NULL;
+    rt_base_t level = rt_hw_interrupt_disable();
+
+    ur = (struct umqtt_uring *)trans->user_data;
+    trans->user_data = RT_NULL;                                 /* no new call gets in */
+    rt_hw_interrupt_enable(level);
+    if (ur == RT_NULL)
+        return 0;
+
+    /* completes the armed recv with 0 and fails a send in flight, each caller then leaves */
+    shutdown(ur->sock, SHUT_RDWR);
+    umqtt_uring_put(ur);
+    return 0;
+}
+
+/**
+ * submit one send operation and reap its completion.
+ *
+ * The send is linked to a timeout holding the remaining send deadline, so the
+ * kernel cancels it when the socket does not drain in time. An expired deadline
+ * degrades into a single non-blocking attempt.
+ *
+ * @return UMQTT_SEND_TIMEOUT: the send was cancelled or would block
+ *         <0: failed or other error
+ *         >=0: sent datas length
+ */
+static int umqtt_uring_submit_tx(struct umqtt_uring *ur, struct io_uring_sqe *sqe, int timeout)
+{
+    int _ret = 0, _res = 0, _wait = 1;
+    struct io_uring_cqe *cqe = RT_NULL;
+    struct io_uring_sqe *tsqe = RT_NULL;
+    struct __kernel_timespec ts;
+
+    io_uring_sqe_set_data(sqe, ur);
+    if (timeout > 0)
+    {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+        sqe->flags |= IOSQE_IO_LINK;
+        tsqe = io_uring_get_sqe(&ur->tx_ring);
+        io_uring_prep_link_timeout(tsqe, &ts, 0);
+        io_uring_sqe_set_data(tsqe, RT_NULL);
+        _wait = 2;
+    }
+
+    _ret = io_uring_submit_and_wait(&ur->tx_ring, _wait);
+    if (_ret < 0)
+        return _ret;
+
+    /* the linked timeout always posts its own completion, reap both */
+    while (_wait-- > 0)
+    {
+        _ret = io_uring_wait_cqe(&ur->tx_ring, &cqe);
+        if (_ret < 0)
+            return _ret;
+        if (io_uring_cqe_get_data(cqe) == ur)
+            _res = cqe->res;
+        io_uring_cqe_seen(&ur->tx_ring, cqe);
+    }
+
+    if ((_res == -ECANCELED) || (_res == -EAGAIN) || (_res == -EINTR))
+        return UMQTT_SEND_TIMEOUT;
+    return _res;
+}
+
+static int umqtt_uring_send(struct umqtt_trans *trans, const rt_uint8_t *send_buf, rt_uint32_t buf_len, int timeout)
+{
+    struct umqtt_uring *ur = umqtt_uring_get(trans);
+    struct io_uring_sqe *sqe = RT_NULL;
+    rt_uint32_t offset = 0U;
+    rt_tick_t start_tick = rt_tick_get();
+    int _ret = 0, _left = 0;
+
+    if (ur == RT_NULL)
+        return UMQTT_SEND_FAILED;
+
+    rt_mutex_take(&ur->tx_lock, RT_WAITING_FOREVER);
+    while (offset < buf_len)
+    {
+        _left = umqtt_trans_time_left(start_tick, timeout);
+        sqe = io_uring_get_sqe(&ur->tx_ring);
+        io_uring_prep_send(sqe, ur->sock, send_buf + offset, buf_len - offset,
+                           MSG_NOSIGNAL | ((_left == 0) ? MSG_DONTWAIT : 0));
+        _ret = umqtt_uring_submit_tx(ur, sqe, _left);
+        if (_ret < 0)
+            break;
+        offset += _ret;
+    }
+    rt_mutex_release(&ur->tx_lock);
+    umqtt_uring_put(ur);
+
+    return (_ret < 0) ? UMQTT_SEND_TORN(offset, _ret) : (int)offset;
+}
+
+static int umqtt_uring_sendv(struct umqtt_trans *trans, const struct umqtt_iovec *iov, int iovcnt, int timeout)
+{
+    struct umqtt_uring *ur = RT_NULL;
+    struct io_uring_sqe *sqe = RT_NULL;
+    struct iovec vec[UMQTT_TRANS_IOV_MAX];
+    struct msghdr msg;
+    int _ret = 0, _cnt = 0, _first = 0, _left = 0;
+    rt_uint32_t _sent = 0U;
+    rt_tick_t start_tick = rt_tick_get();
+
+    if (iovcnt > UMQTT_TRANS_IOV_MAX)
+        return -EINVAL;
+
+    for (_cnt = 0; _cnt < iovcnt; _cnt++)
+    {
+        vec[_cnt].iov_base = (void *)iov[_cnt].iov_base;
+        vec[_cnt].iov_len = iov[_cnt].iov_len;
+    }
+
+    ur = umqtt_uring_get(trans);
+    if (ur == RT_NULL)
+        return UMQTT_SEND_FAILED;
+
+    rt_mutex_take(&ur->tx_lock, RT_WAITING_FOREVER);
+    while (_first < iovcnt)
+    {
+        rt_memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &vec[_first];
+        msg.msg_iovlen = iovcnt - _first;
+        _left = umqtt_trans_time_left(start_tick, timeout);
+        sqe = io_uring_get_sqe(&ur->tx_ring);
+        io_uring_prep_sendmsg(sqe, ur->sock, &msg, MSG_NOSIGNAL | ((_left == 0) ? MSG_DONTWAIT : 0));
+        _ret = umqtt_uring_submit_tx(ur, sqe, _left);
+        if (_ret < 0)
+            break;
+        _sent += _ret;
+
+        while ((_first < iovcnt) && (_ret >= (int)vec[_first].iov_len))
+        {
+            _ret -= vec[_first].iov_len;
+            _first++;
+        }
+        if (_first < iovcnt)
+        {
+            vec[_first].iov_base = (rt_uint8_t *)vec[_first].iov_base + _ret;
+            vec[_first].iov_len -= _ret;
+        }
+        _ret = 0;
+    }
+    rt_mutex_release(&ur->tx_lock);
+    umqtt_uring_put(ur);
+
+    return UMQTT_SEND_TORN(_sent, _ret);
+}
+
+/* copy out of the buffer being consumed, give it back to the kernel once drained */
+static int umqtt_uring_copy(struct umqtt_uring *ur, rt_uint8_t *recv_buf, rt_uint32_t buf_len)
+{
+    rt_uint32_t chunk = ur->cur_len - ur->cur_off;
+
+    if (chunk > buf_len)
+        chunk = buf_len;
+    rt_memcpy(recv_buf, ur->rx_bufs + ur->cur_bid * PKG_UMQTT_TRANS_URING_RXBUF_SIZE + ur->cur_off, chunk);
+    ur->cur_off += chunk;
+    if (ur->cur_off >= ur->cur_len)
+    {
+        umqtt_uring_recycle(ur, ur->cur_bid);
+        ur->cur_bid = -1;
+    }
+    return chunk;
+}
+
+static int umqtt_uring_recv(struct umqtt_trans *trans, rt_uint8_t *recv_buf, rt_uint32_t buf_len)
+{
+    struct umqtt_uring *ur = umqtt_uring_get(trans);
+    struct io_uring_cqe *cqe = RT_NULL;
+    int _ret = 0;
+    unsigned int _flags = 0;
+
+    if (ur == RT_NULL)
+        return 0;
+
+    if (ur->cur_bid >= 0)
+    {
+        _ret = umqtt_uring_copy(ur, recv_buf, buf_len);
+        umqtt_uring_put(ur);
+        return _ret;
+    }
+
+    while (1)
+    {
+        if ((_ret = umqtt_uring_arm(ur)) < 0)
+            break;
+
+        _ret = io_uring_wait_cqe(&ur->rx_ring, &cqe);
+        if (_ret < 0)
+        {
+            if (_ret == -EINTR)
+                continue;
+            break;
+        }
+        _ret = cqe->res;
+        _flags = cqe->flags;
+        io_uring_cqe_seen(&ur->rx_ring, cqe);
+
+        if ((_flags & IORING_CQE_F_MORE) == 0)
+            ur->rx_armed = 0;
+        if (_ret == -ENOBUFS)                                   /* all buffers held, re-arm */
+            continue;
+        if (_ret <= 0)
+            break;
+
+        ur->cur_bid = _flags >> IORING_CQE_BUFFER_SHIFT;
+        ur->cur_off = 0;
+        ur->cur_len = _ret;
+        _ret = umqtt_uring_copy(ur, recv_buf, buf_len);
+        break;
+    }
+
+    umqtt_uring_put(ur);
+
+    if (_ret < 0)
+    {
+        errno = -_ret;
+        return -1;
+    }
+    return _ret;
+}
+
+static int umqtt_uring_wait(struct umqtt_uring *ur, int events, int timeout)
+{
+    struct io_uring_cqe *cqe = RT_NULL;
+    struct __kernel_timespec ts;
+    struct pollfd pfd;
+    int _ret = 0;
+
+    if (events & UMQTT_TRANS_POLLOUT)
+    {
+        pfd.fd = ur->sock;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        /* the receive side is served by the ring, do not sleep here for both */
+        _ret = poll(&pfd, 1, (events & UMQTT_TRANS_POLLIN) ? 0 : timeout);
+        if (_ret < 0)
+            return -errno;
+        if (pfd.revents & (POLLOUT | POLLHUP | POLLERR))
+            return UMQTT_TRANS_POLLOUT;
+        if ((events & UMQTT_TRANS_POLLIN) == 0)
+            return 0;
+    }
+
+    /* datas are consumed by the armed multishot recv, wait on its completions */
+    if ((ur->cur_bid >= 0) || (io_uring_cq_ready(&ur->rx_ring) > 0))
+        return UMQTT_TRANS_POLLIN;
+
+    if ((_ret = umqtt_uring_arm(ur)) < 0)
+        return _ret;
+
+    if (timeout < 0)
+    {
+        _ret = io_uring_wait_cqe_timeout(&ur->rx_ring, &cqe, RT_NULL);
+    }
+    else
+    {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+        _ret = io_uring_wait_cqe_timeout(&ur->rx_ring, &cqe, &ts);
+    }
+    if (_ret == -ETIME)
+        return 0;
+    if (_ret < 0)
+        return _ret;
+    return UMQTT_TRANS_POLLIN;              /* the completion is left for recv */
+}
+
+static int umqtt_uring_poll(struct umqtt_trans *trans, int events, int timeout)
+{
+    struct umqtt_uring *ur = umqtt_uring_get(trans);
+    int _ret = 0;
+
+    if (ur == RT_NULL)
+        return -ENOTCONN;
+
+    _ret = umqtt_uring_wait(ur, events, timeout);
+    umqtt_uring_put(ur);
+    return _ret;
+}
+
+struct umqtt_trans_ops umqtt_trans_uring_ops =
+{
+    UMQTT_URING_SCHEME,
+    umqtt_uring_connect,
+    umqtt_uring_close,
+    umqtt_uring_send,
+    umqtt_uring_sendv,
+    umqtt_uring_recv,
+    umqtt_uring_poll,
+    umqtt_trans_sock_pending,
+    RT_NULL,
+};
+
+#endif /* PKG_UMQTT_USING_TRANS_URING */
@@ -16,10 +16,16 @@
 
 #include <rtthread.h>
 #include <sys/socket.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/errno.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <sal_tls.h>
+#ifdef UMQTT_TRANS_USING_WAKE_PIPE
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 #define DBG_TAG             "umqtt.transport"
 
@@ -30,14 +36,23 @@
 #endif                      /* MQTT_DEBUG */
 #include <rtdbg.h>
 
+#ifndef MSG_DONTWAIT                                            /* a blocking send would outlive the send timeout */
+#error "umqtt tcp/ssl transport needs MSG_DONTWAIT from the socket layer (SAL, lwIP or POSIX)"
+#endif
+
 #ifdef UMQTT_USING_TLS
 #define UMQTT_SOCKET_PROTOCOL           PROTOCOL_TLS
+#define UMQTT_TLS_SOCKET_PROTOCOL       PROTOCOL_TLS
 #else
 #define UMQTT_SOCKET_PROTOCOL           0
+#define UMQTT_TLS_SOCKET_PROTOCOL       0
 #endif
 
+static rt_list_t umqtt_trans_list = RT_LIST_OBJECT_INIT(umqtt_trans_list);
+
 /*
  * resolve server address
+ * @param trans the input transport, the host name copy comes from its allocator
  * @param server the server sockaddress
  * @param url the input URL address.
  * @param host_addr the buffer pointer to save server host address
@@ -52,7 +67,7 @@
  * tls://[fe80::20c:29ff:fe9a:a07e]:61614
  * ws://echo.websocket.org:80 websocket
  */
-static int umqtt_resolve_uri(const char *umqtt_uri, struct addrinfo **res)
+static int umqtt_resolve_uri(struct umqtt_trans *trans, const char *umqtt_uri, struct addrinfo **res)
 {
     int rc = 0;
     int uri_len = 0, host_addr_len = 0, port_len = 0;
@@ -65,23 +80,16 @@ static int umqtt_resolve_uri(const char *umqtt_uri, struct addrinfo **res)
     const char *host_addr = 0;
     char *host_addr_new = RT_NULL;
     const char *uri = umqtt_uri;
-    uri_len = strlen(uri);
 
-    /* strip protocol(tcp or ssl) */
-    if (strncmp(uri, "tcp://", 6) == 0)
-    {
-        host_addr = uri + 6;
-    }
-    else if (strncmp(uri, "ssl://", 6) == 0)
-    {
-        host_addr = uri + 6;
-    // } else if (strncmp(uri, "ws://", 5) == 0) {
-    }
-    else
+    /* strip protocol(tcp, ssl, ...), the backend is already selected by scheme */
+    ptr = strstr(uri, "://");
+    if (!ptr)
     {
         rc = UMQTT_INPARAMS_NULL;
         goto exit;
     }
+    host_addr = ptr + 3;
+    uri_len = strlen(host_addr);
 
     if (host_addr[0] == '[')    /* ipv6 address */
     {
@@ -97,7 +105,7 @@ static int umqtt_resolve_uri(const char *umqtt_uri, struct addrinfo **res)
             goto exit;
         }
 
-        port_len = uri_len - 6 - host_addr_len - 3;
+        port_len = uri_len - host_addr_len - 3;
         if ((port_len >= 6) || (port_len < 1)) {
             rc = UMQTT_INPARAMS_NULL;
             goto exit;
@@ -121,7 +129,7 @@ static int umqtt_resolve_uri(const char *umqtt_uri, struct addrinfo **res)
             rc = UMQTT_INPARAMS_NULL;
             goto exit;
         }
-        port_len = uri_len - 6 - host_addr_len - 1;
+        port_len = uri_len - host_addr_len - 1;
         if ((port_len >= 6) || (port_len < 1))
         {
             rc = UMQTT_INPARAMS_NULL;
@@ -136,7 +144,7 @@ static int umqtt_resolve_uri(const char *umqtt_uri, struct addrinfo **res)
     /* get host addr ok. */
     {
         /* resolve the host name. */
-        host_addr_new = rt_malloc(host_addr_len + 1);
+        host_addr_new = UMQTT_MEM_ALLOC(trans->allocator, host_addr_len + 1, UMQTT_MEM_TAG_URI);
 
         if (!host_addr_new)
         {
@@ -161,122 +169,762 @@ static int umqtt_resolve_uri(const char *umqtt_uri, struct addrinfo **res)
 exit:
     if (host_addr_new != RT_NULL)
     {
-        rt_free(host_addr_new);
+        UMQTT_MEM_FREE(trans->allocator, host_addr_new, host_addr_len + 1, UMQTT_MEM_TAG_URI);
         host_addr_new = RT_NULL;
     }
     return rc;
 }
 
 /**
- * TCP/TLS Connection Complete for configured transport
+ * apply the user socket options, failures are reported and ignored so that
+ * a stack without one option still connects.
  *
+ * @param sock the input socket
+ * @param opt the input socket options, RT_NULL: keep all defaults
+ * @param is_tcp the input, 1: also apply the TCP level options
+ */
+void umqtt_trans_sock_setopt(int sock, const struct umqtt_sockopt *opt, int is_tcp)
+{
+    int _val = 0;
+
+    if (opt == RT_NULL)
+        return;
+
+    if (opt->sndbuf)
+    {
+        _val = opt->sndbuf;
+        if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &_val, sizeof(_val)) < 0)
+            LOG_W(" set SO_SNDBUF(%d) failed! errno(%d)", _val, errno);
+    }
+    if (opt->rcvbuf)
+    {
+        _val = opt->rcvbuf;
+        if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &_val, sizeof(_val)) < 0)
+            LOG_W(" set SO_RCVBUF(%d) failed! errno(%d)", _val, errno);
+    }
+#ifdef SO_BUSY_POLL
+    if (opt->busy_poll)
+    {
+        _val = opt->busy_poll;
+        if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &_val, sizeof(_val)) < 0)
+            LOG_W(" set SO_BUSY_POLL(%d) failed! errno(%d)", _val, errno);
+    }
+#endif
+
+    if (is_tcp == 0)
+        return;
+
+    if (opt->nodelay)
+    {
+        _val = 1;
+        if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &_val, sizeof(_val)) < 0)
+            LOG_W(" set TCP_NODELAY failed! errno(%d)", errno);
+    }
+    if (opt->keepalive)
+    {
+        _val = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &_val, sizeof(_val)) < 0)
+            LOG_W(" set SO_KEEPALIVE failed! errno(%d)", errno);
+#ifdef TCP_KEEPIDLE
+        if (opt->keepidle)
+        {
+            _val = opt->keepidle;
+            if (setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &_val, sizeof(_val)) < 0)
+                LOG_W(" set TCP_KEEPIDLE(%d) failed! errno(%d)", _val, errno);
+        }
+#endif
+#ifdef TCP_KEEPINTVL
+        if (opt->keepintvl)
+        {
+            _val = opt->keepintvl;
+            if (setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &_val, sizeof(_val)) < 0)
+                LOG_W(" set TCP_KEEPINTVL(%d) failed! errno(%d)", _val, errno);
+        }
+#endif
+#ifdef TCP_KEEPCNT
+        if (opt->keepcnt)
+        {
+            _val = opt->keepcnt;
+            if (setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &_val, sizeof(_val)) < 0)
+                LOG_W(" set TCP_KEEPCNT(%d) failed! errno(%d)", _val, errno);
+        }
+#endif
+    }
+}
+
+/* request TCP Fast Open, the kernel holds the SYN back until the first send */
+static void umqtt_trans_sock_fastopen(struct umqtt_trans *trans)
+{
+    trans->tfo_sta = UMQTT_TFO_OFF;
+    if ((trans->sockopt == RT_NULL) || (trans->sockopt->fastopen == 0))
+        return;
+
+#ifdef TCP_FASTOPEN_CONNECT
+    {
+        int _val = 1;
+        if (setsockopt(trans->sock, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &_val, sizeof(_val)) < 0)
+        {
+            LOG_W(" set TCP_FASTOPEN_CONNECT failed, use normal connect! errno(%d)", errno);
+            return;
+        }
+        trans->tfo_sta = UMQTT_TFO_FALLBACK;
+    }
+#else
+    LOG_D(" tcp fast open is not supported by the stack, use normal connect!");
+#endif
+}
+
+/**
+ * TCP/TLS socket connection, shared by the socket based backends
+ *
+ * The resolved server address is kept in the transport, so a reconnect goes
+ * straight to the SYN instead of waiting on DNS again; it is dropped when the
+ * connect fails in case the broker moved.
+ *
+ * @param trans the input transport
  * @param uri the input server URI address
- * @param sock the output socket
+ * @param protocol the input socket protocol, 0 or PROTOCOL_TLS
  *
  * @return <0: failed or other error
  *         =0: success
  */
-int umqtt_trans_connect(const char *uri, int *sock)
+int umqtt_trans_sock_connect(struct umqtt_trans *trans, const char *uri, int protocol)
 {
     int _ret = 0;
-    struct addrinfo *addr_res = RT_NULL;
+    struct addrinfo *addr_res = (struct addrinfo *)trans->addr_cache;
 
-    *sock = -1;
-    _ret = umqtt_resolve_uri(uri, &addr_res);
-    if ((_ret < 0) || (addr_res == RT_NULL))
+    trans->sock = -1;
+    if (addr_res == RT_NULL)
     {
-        LOG_E("resolve uri err");
-        _ret = UMQTT_FAILED;
-        goto exit;
+        _ret = umqtt_resolve_uri(trans, uri, &addr_res);
+        if ((_ret < 0) || (addr_res == RT_NULL))
+        {
+            LOG_E("resolve uri err");
+            _ret = UMQTT_FAILED;
+            goto exit;
+        }
+        trans->addr_cache = addr_res;
     }
 
-    if ((*sock = socket(addr_res->ai_family, SOCK_STREAM, UMQTT_SOCKET_PROTOCOL)) < 0)
+    if ((trans->sock = socket(addr_res->ai_family, SOCK_STREAM, protocol)) < 0)
     {
         LOG_E("create socket error!");
         _ret = UMQTT_FAILED;
         goto exit;
     }
 
-    _ret = ioctlsocket(*sock, FIONBIO, 0);
+    _ret = ioctlsocket(trans->sock, FIONBIO, 0);
     if (_ret < 0)
     {
         LOG_E(" iocontrol socket error!");
+        closesocket(trans->sock);
+        trans->sock = -1;
         _ret = UMQTT_FAILED;
         goto exit;
     }
 
-    if ((_ret = connect(*sock, addr_res->ai_addr, addr_res->ai_addrlen)) < 0)
+    /* buffer sizes must be set before connect to take part in window scaling */
+    umqtt_trans_sock_setopt(trans->sock, trans->sockopt, 1);
+    umqtt_trans_sock_fastopen(trans);
+
+    if ((_ret = connect(trans->sock, addr_res->ai_addr, addr_res->ai_addrlen)) < 0)
     {
         LOG_E(" connect err!");
-        closesocket(*sock);
-        *sock = -1;
+        closesocket(trans->sock);
+        trans->sock = -1;
         _ret = UMQTT_FAILED;
         goto exit;
     }
 
 exit:
-    if (addr_res) {
-        freeaddrinfo(addr_res);
-        addr_res = RT_NULL;
+    if ((_ret < 0) && (trans->addr_cache != RT_NULL))
+    {
+        umqtt_trans_release(trans);
     }
     return _ret;
 }
 
 /**
- * TCP/TLS transport disconnection requests on configured transport.
+ * settle the TCP Fast Open status once the broker answered, the SYN-ACK tells
+ * whether the data carried in the SYN was accepted.
  *
- * @param sock the input socket
+ * @param trans the input transport
+ */
+void umqtt_trans_fastopen_check(struct umqtt_trans *trans)
+{
+    if (trans->tfo_sta != UMQTT_TFO_FALLBACK)
+        return;
+
+#if defined(TCP_INFO) && defined(TCPI_OPT_SYN_DATA)
+    {
+        struct tcp_info info;
+        socklen_t info_len = sizeof(info);
+
+        rt_memset(&info, 0, sizeof(info));
+        if ((getsockopt(trans->sock, IPPROTO_TCP, TCP_INFO, &info, &info_len) == 0)
+         && (info.tcpi_options & TCPI_OPT_SYN_DATA))
+        {
+            trans->tfo_sta = UMQTT_TFO_USED;
+        }
+    }
+#endif
+    LOG_D(" tcp fast open %s!", (trans->tfo_sta == UMQTT_TFO_USED) ? "used" : "fallback");
+}
+
+/**
+ * drop the cached server address, the next connect resolves the URI again.
+ *
+ * @param trans the input transport
+ */
+void umqtt_trans_release(struct umqtt_trans *trans)
+{
+    if (trans->addr_cache != RT_NULL)
+    {
+        freeaddrinfo((struct addrinfo *)trans->addr_cache);
+        trans->addr_cache = RT_NULL;
+    }
+}
+
+static int umqtt_tcp_connect(struct umqtt_trans *trans, const char *uri)
+{
+    return umqtt_trans_sock_connect(trans, uri, UMQTT_SOCKET_PROTOCOL);
+}
+
+static int umqtt_tls_connect(struct umqtt_trans *trans, const char *uri)
+{
+    return umqtt_trans_sock_connect(trans, uri, UMQTT_TLS_SOCKET_PROTOCOL);
+}
+
+static int umqtt_sock_close(struct umqtt_trans *trans)
+{
+    int _ret = 0;
+    _ret = closesocket(trans->sock);
+    if (_ret < 0)
+        return -errno;
+    return _ret;
+}
+
+static int umqtt_sock_send(struct umqtt_trans *trans, const rt_uint8_t *send_buf, rt_uint32_t buf_len, int timeout)
+{
+    int _ret = 0, _left = 0;
+    rt_uint32_t offset = 0U;
+    rt_tick_t start_tick = rt_tick_get();
+
+    while (offset < buf_len)
+    {
+        _ret = send(trans->sock, send_buf + offset, buf_len - offset, MSG_DONTWAIT);
+        if (_ret >= 0)
+        {
+            offset += _ret;
+            continue;
+        }
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            return -errno;
+
+        /* socket buffer is full, resume once it drains or the deadline hits */
+        _left = umqtt_trans_time_left(start_tick, timeout);
+        if (_left == 0)
+            return UMQTT_SEND_TORN(offset, UMQTT_SEND_TIMEOUT);
+        _ret = umqtt_trans_sock_poll(trans, UMQTT_TRANS_POLLOUT, _left);
+        if (_ret < 0)
+            return _ret;
+    }
+
+    return offset;
+}
+
+static int umqtt_sock_recv(struct umqtt_trans *trans, rt_uint8_t *recv_buf, rt_uint32_t buf_len)
+{
+    return recv(trans->sock, recv_buf, buf_len, 0);
+}
+
+/**
+ * wait for the socket to become readable or writable; with a wake pipe its
+ * read end is polled too, a umqtt_trans_sock_wake ends the wait early.
+ *
+ * @param trans the input transport
+ * @param events the input, UMQTT_TRANS_POLLIN / UMQTT_TRANS_POLLOUT
+ * @param timeout the input, wait timeout, uint:mSec, <0: wait forever
+ *
+ * @return <0: failed or other error
+ *         =0: timeout or woken
+ *         >0: ready events
+ */
+int umqtt_trans_sock_poll(struct umqtt_trans *trans, int events, int timeout)
+{
+    int _ret = 0, revents = 0, _nfds = 1;
+    struct pollfd pfd[2];
+#ifdef UMQTT_TRANS_USING_WAKE_PIPE
+    char _drain[8];
+#endif
+
+    /* poll, not select: a descriptor at or over FD_SETSIZE is valid on a host */
+    pfd[0].fd = trans->sock;
+    pfd[0].events = ((events & UMQTT_TRANS_POLLIN) ? POLLIN : 0) | ((events & UMQTT_TRANS_POLLOUT) ? POLLOUT : 0);
+    pfd[0].revents = 0;
+#ifdef UMQTT_TRANS_USING_WAKE_PIPE
+    if (trans->wake_fd[0] >= 0)
+    {
+        pfd[1].fd = trans->wake_fd[0];
+        pfd[1].events = POLLIN;
+        pfd[1].revents = 0;
+        _nfds = 2;
+    }
+#endif
+
+    _ret = poll(pfd, _nfds, (timeout < 0) ? -1 : timeout);
+    if (_ret < 0)
+        return -errno;
+    if (_ret == 0)
+        return 0;
+
+#ifdef UMQTT_TRANS_USING_WAKE_PIPE
+    if ((_nfds == 2) && (pfd[1].revents & POLLIN))
+        read(trans->wake_fd[0], _drain, sizeof(_drain));     /* a wake left over drains on a later poll */
+#endif
+
+    /* an error or hang up wakes the waiting side, its next call reports it */
+    if ((events & UMQTT_TRANS_POLLIN) && (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)))
+        revents |= UMQTT_TRANS_POLLIN;
+    if ((events & UMQTT_TRANS_POLLOUT) && (pfd[0].revents & (POLLOUT | POLLHUP | POLLERR)))
+        revents |= UMQTT_TRANS_POLLOUT;
+    return revents;
+}
+
+#ifdef UMQTT_TRANS_USING_WAKE_PIPE
+/**
+ * end a umqtt_trans_sock_poll blocked on another thread, or the next one;
+ * never blocks, a full pipe already holds a wake.
+ *
+ * @param trans the input transport
+ *
+ * @return <0: no wake pipe
+ *         =0: success
+ */
+int umqtt_trans_sock_wake(struct umqtt_trans *trans)
+{
+    char _byte = 0;
+
+    if (trans->wake_fd[1] < 0)
+        return -ENOSYS;
+
+    write(trans->wake_fd[1], &_byte, 1);
+    return 0;
+}
+#endif
+
+#ifdef PKG_UMQTT_USING_PUB_RING
+/**
+ * open the wake pipe of the socket backends, once per client; both ends are
+ * non-blocking. Without RT_USING_POSIX_PIPE there is none and the socket
+ * backends cannot be woken.
+ *
+ * @param trans the input transport
+ *
+ * @return <0: failed or other error
+ *         =0: success
+ */
+int umqtt_trans_wake_open(struct umqtt_trans *trans)
+{
+    trans->wake_fd[0] = trans->wake_fd[1] = -1;
+#ifdef UMQTT_TRANS_USING_WAKE_PIPE
+    if (pipe(trans->wake_fd) < 0)
+    {
+        trans->wake_fd[0] = trans->wake_fd[1] = -1;
+        return -errno;
+    }
+    fcntl(trans->wake_fd[0], F_SETFL, fcntl(trans->wake_fd[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(trans->wake_fd[1], F_SETFL, fcntl(trans->wake_fd[1], F_GETFL, 0) | O_NONBLOCK);
+#endif
+    return 0;
+}
+
+/**
+ * close the wake pipe opened by umqtt_trans_wake_open
+ *
+ * @param trans the input transport
+ */
+void umqtt_trans_wake_close(struct umqtt_trans *trans)
+{
+#ifdef UMQTT_TRANS_USING_WAKE_PIPE
+    if (trans->wake_fd[0] >= 0)
+        close(trans->wake_fd[0]);
+    if (trans->wake_fd[1] >= 0)
+        close(trans->wake_fd[1]);
+#endif
+    trans->wake_fd[0] = trans->wake_fd[1] = -1;
+}
+#endif
+
+/**
+ * bytes written to the socket and not yet acknowledged by the peer
+ *
+ * @param trans the input transport
+ *
+ * @return queued bytes, 0 when the stack does not report them
+ */
+int umqtt_trans_sock_pending(struct umqtt_trans *trans)
+{
+#ifdef TIOCOUTQ
+    int _len = 0;
+
+    if (ioctl(trans->sock, TIOCOUTQ, &_len) == 0)
+        return _len;
+#endif
+    return 0;
+}
+
+static struct umqtt_trans_ops umqtt_trans_tcp_ops =
+{
+    "tcp://",
+    umqtt_tcp_connect,
+    umqtt_sock_close,
+    umqtt_sock_send,
+    RT_NULL,
+    umqtt_sock_recv,
+    umqtt_trans_sock_poll,
+    umqtt_trans_sock_pending,
+    UMQTT_TRANS_SOCK_WAKE,
+};
+
+static struct umqtt_trans_ops umqtt_trans_tls_ops =
+{
+    "ssl://",
+    umqtt_tls_connect,
+    umqtt_sock_close,
+    umqtt_sock_send,
+    RT_NULL,
+    umqtt_sock_recv,
+    umqtt_trans_sock_poll,
+    umqtt_trans_sock_pending,
+    UMQTT_TRANS_SOCK_WAKE,
+};
+
+static const struct umqtt_trans_ops *umqtt_trans_builtin[] =
+{
+    &umqtt_trans_tcp_ops,
+#ifdef PKG_UMQTT_USING_TLS_SESSION_CACHE
+    &umqtt_trans_tls_cache_ops,                         /* takes ssl:// over the SAL TLS socket */
+#endif
+    &umqtt_trans_tls_ops,
+#ifdef PKG_UMQTT_USING_TRANS_UNIX
+    &umqtt_trans_unix_ops,
+#endif
+#ifdef PKG_UMQTT_USING_TRANS_MEM
+    &umqtt_trans_mem_ops,
+#endif
+#ifdef PKG_UMQTT_USING_TRANS_URING
+    &umqtt_trans_uring_ops,
+#endif
+};
+
+/* registered backends take precedence over the built-in ones */
+static const struct umqtt_trans_ops *umqtt_trans_find(const char *uri)
+{
+    int _cnt = 0;
+    rt_list_t *node = RT_NULL;
+    struct umqtt_trans_ops *ops = RT_NULL, *found = RT_NULL;
+
+    rt_enter_critical();
+    rt_list_for_each(node, &umqtt_trans_list)
+    {
+        ops = rt_list_entry(node, struct umqtt_trans_ops, list);
+        if (strncmp(uri, ops->scheme, strlen(ops->scheme)) == 0)
+        {
+            found = ops;
+            break;
+        }
+    }
+    rt_exit_critical();
+    if (found)
+        return found;
+
+    for (_cnt = 0; _cnt < sizeof(umqtt_trans_builtin) / sizeof(umqtt_trans_builtin[0]); _cnt++)
+    {
+        if (strncmp(uri, umqtt_trans_builtin[_cnt]->scheme, strlen(umqtt_trans_builtin[_cnt]->scheme)) == 0)
+            return umqtt_trans_builtin[_cnt];
+    }
+
+    return RT_NULL;
+}
+
+/**
+ * register a transport backend, it serves every URI starting with ops->scheme.
+ * safe against concurrent registers and connects; a scheme registers once.
+ *
+ * @param ops the input backend operations, must stay valid while registered
+ *
+ * @return UMQTT_FAILED: the scheme is already registered
+ *         <0: failed or other error
+ *         =0: success
+ */
+int umqtt_trans_register(struct umqtt_trans_ops *ops)
+{
+    rt_list_t *node = RT_NULL;
+    struct umqtt_trans_ops *_ops = RT_NULL;
+
+    if ((ops == RT_NULL) || (ops->scheme == RT_NULL)
+     || (ops->connect == RT_NULL) || (ops->close == RT_NULL)
+     || (ops->send == RT_NULL) || (ops->recv == RT_NULL))
+    {
+        LOG_E(" register transport failed! input params is valid! ");
+        return UMQTT_INPARAMS_NULL;
+    }
+
+    rt_enter_critical();
+    rt_list_for_each(node, &umqtt_trans_list)
+    {
+        _ops = rt_list_entry(node, struct umqtt_trans_ops, list);
+        if (rt_strcmp(_ops->scheme, ops->scheme) == 0)
+        {
+            rt_exit_critical();
+            LOG_E(" transport scheme %s is already registered!", ops->scheme);
+            return UMQTT_FAILED;
+        }
+    }
+    rt_list_insert_after(&umqtt_trans_list, &ops->list);
+    rt_exit_critical();
+    return UMQTT_OK;
+}
+
+/**
+ * Connection Complete for the transport selected by the URI scheme
+ *
+ * @param trans the output transport
+ * @param uri the input server URI address
  *
  * @return <0: failed or other error
  *         =0: success
  */
-int umqtt_trans_disconnect(int sock)
+int umqtt_trans_connect(struct umqtt_trans *trans, const char *uri)
 {
     int _ret = 0;
-    _ret = closesocket(sock);
+
+    trans->sock = -1;
+    trans->tfo_sta = UMQTT_TFO_OFF;
+    trans->ops = umqtt_trans_find(uri);
+    if (trans->ops == RT_NULL)
+    {
+        LOG_E(" no transport for uri: %s", uri);
+        return UMQTT_INPARAMS_NULL;
+    }
+
+    _ret = trans->ops->connect(trans, uri);
     if (_ret < 0)
-        return -errno;
+    {
+        trans->sock = -1;
+        _ret = UMQTT_FAILED;
+    }
     return _ret;
 }
 
 /**
- * TCP/TLS send datas on configured transport.
+ * transport disconnection requests on configured transport.
  *
- * @param sock the input socket
- * @param send_buf the input， transport datas buffer
- * @param buf_len the input, transport datas buffer length
- * @param timeout the input, tcp/tls transport timeout
+ * @param trans the input transport
  *
  * @return <0: failed or other error
  *         =0: success
  */
-int umqtt_trans_send(int sock, const rt_uint8_t *send_buf, rt_uint32_t buf_len, int timeout)
+int umqtt_trans_disconnect(struct umqtt_trans *trans)
 {
     int _ret = 0;
-    rt_uint32_t offset = 0U;
-    while (offset < buf_len)
+    if ((trans->ops == RT_NULL) || (trans->sock < 0))
+        return _ret;
+
+    _ret = trans->ops->close(trans);
+    trans->sock = -1;
+    return _ret;
+}
+
+/**
+ * remaining time of a transport operation started at start_tick
+ *
+ * @param start_tick the input, operation start tick
+ * @param timeout the input, operation timeout, uint:mSec, <0: wait forever
+ *
+ * @return <0: wait forever
+ *         =0: expired
+ *         >0: remaining time, uint:mSec
+ */
+int umqtt_trans_time_left(rt_tick_t start_tick, int timeout)
+{
+    rt_tick_t used = 0;
+
+    if (timeout < 0)
+        return -1;
+
+    used = rt_tick_get() - start_tick;
+    if (used >= rt_tick_from_millisecond(timeout))
+        return 0;
+
+    timeout -= (int)(used * 1000 / RT_TICK_PER_SECOND);
+    return (timeout > 0) ? timeout : 1;
+}
+
+/**
+ * send datas on configured transport.
+ *
+ * @param trans the input transport
+ * @param send_buf the input， transport datas buffer
+ * @param buf_len the input, transport datas buffer length
+ * @param timeout the input, transport timeout, uint:mSec, <0: wait forever
+ *
+ * @return UMQTT_SEND_TIMEOUT: nothing was sent before timeout, the link is intact
+ *         UMQTT_SEND_FAILED: the timeout hit after part of the datas went out
+ *         <0: failed or other error, the link must be dropped
+ *         >=0: success
+ */
+int umqtt_trans_send(struct umqtt_trans *trans, const rt_uint8_t *send_buf, rt_uint32_t buf_len, int timeout)
+{
+    if ((trans->ops == RT_NULL) || (trans->sock < 0))
+        return -ENOTCONN;
+
+    return trans->ops->send(trans, send_buf, buf_len, timeout);
+}
+
+/**
+ * send scattered datas on configured transport, falls back to one send per
+ * segment when the backend has no vectored send; at most UMQTT_TRANS_IOV_MAX
+ * segments.
+ *
+ * @param trans the input transport
+ * @param iov the input， datas segments
+ * @param iovcnt the input, datas segments count
+ * @param timeout the input, transport timeout, uint:mSec, <0: wait forever
+ *
+ * @return UMQTT_SEND_TIMEOUT: nothing was sent before timeout, the link is intact
+ *         UMQTT_SEND_FAILED: the timeout hit after part of the datas went out
+ *         <0: failed or other error, the link must be dropped
+ *         >=0: success
+ */
+int umqtt_trans_sendv(struct umqtt_trans *trans, const struct umqtt_iovec *iov, int iovcnt, int timeout)
+{
+    int _ret = 0, _cnt = 0, _left = timeout;
+    rt_uint32_t _sent = 0U;
+    rt_tick_t start_tick = rt_tick_get();
+
+    if ((trans->ops == RT_NULL) || (trans->sock < 0))
+        return -ENOTCONN;
+
+    if (trans->ops->sendv)
+        return trans->ops->sendv(trans, iov, iovcnt, timeout);
+
+    for (_cnt = 0; _cnt < iovcnt; _cnt++)
     {
-        _ret = send(sock, send_buf + offset, buf_len - offset, 0);
+        if (iov[_cnt].iov_len == 0)
+            continue;
+        _ret = trans->ops->send(trans, iov[_cnt].iov_base, iov[_cnt].iov_len, _left);
         if (_ret < 0)
-            return -errno;
-        offset += _ret;
+            break;
+        _sent += _ret;
+        _left = umqtt_trans_time_left(start_tick, timeout);
+        if ((_left == 0) && (_cnt + 1 < iovcnt))
+        {
+            _ret = UMQTT_SEND_TIMEOUT;
+            break;
+        }
     }
+    return UMQTT_SEND_TORN(_sent, _ret);
+}
 
-    return _ret;
+/**
+ * whether the backend writes a umqtt_trans_sendv in one gather, rather than
+ * one send per segment
+ *
+ * @param trans the input transport
+ *
+ * @return 0: segments go out one send each, copy small ones together first
+ *         1: vectored send
+ */
+int umqtt_trans_gathers(struct umqtt_trans *trans)
+{
+    return (trans->ops != RT_NULL) && (trans->ops->sendv != RT_NULL);
 }
 
 /**
- * TCP/TLS receive datas on configured transport.
+ * receive datas on configured transport.
  *
- * @param sock the input socket
+ * @param trans the input transport
  * @param recv_buf the output， receive datas buffer
  * @param buf_len the input, receive datas buffer length
  *
  * @return <=0: failed or other error
  *         >0: receive datas length
  */
-int umqtt_trans_recv(int sock, rt_uint8_t *recv_buf, rt_uint32_t buf_len)
+int umqtt_trans_recv(struct umqtt_trans *trans, rt_uint8_t *recv_buf, rt_uint32_t buf_len)
+{
+    if ((trans->ops == RT_NULL) || (trans->sock < 0))
+        return 0;
+
+    return trans->ops->recv(trans, recv_buf, buf_len);
+}
+
+/**
+ * wait for the transport to become readable or writable
+ *
+ * @param trans the input transport
+ * @param events the input, UMQTT_TRANS_POLLIN / UMQTT_TRANS_POLLOUT
+ * @param timeout the input, wait timeout, uint:mSec, <0: wait forever
+ *
+ * @return <0: failed or other error
+ *         =0: timeout
+ *         >0: ready events
+ */
+int umqtt_trans_poll(struct umqtt_trans *trans, int events, int timeout)
 {
-    return recv(sock, recv_buf, buf_len, 0);
-    // return read(sock, recv_buf, buf_len);
+    if ((trans->ops == RT_NULL) || (trans->sock < 0))
+        return -ENOTCONN;
+
+    if (trans->ops->poll == RT_NULL)
+        return events;                  /* no readiness report, always ready */
+
+    return trans->ops->poll(trans, events, timeout);
+}
+
+/**
+ * end a umqtt_trans_poll blocked on another thread; a wake with no poll in
+ * progress ends the next one. Never blocks.
+ *
+ * @param trans the input transport
+ *
+ * @return <0: the backend cannot be woken
+ *         =0: success
+ */
+int umqtt_trans_wake(struct umqtt_trans *trans)
+{
+    const struct umqtt_trans_ops *ops = trans->ops;
+
+    if ((ops == RT_NULL) || (ops->wake == RT_NULL))
+        return -ENOSYS;
+
+    return ops->wake(trans);
+}
+
+/**
+ * whether umqtt_trans_wake can end a poll of the connected backend
+ *
+ * @param trans the input transport
+ *
+ * @return 0: a poll only ends on its events or timeout
+ *         1: it can be woken
+ */
+int umqtt_trans_wakeable(struct umqtt_trans *trans)
+{
+    return (trans->ops != RT_NULL) && (trans->ops->wake != RT_NULL);
+}
+
+/**
+ * outbound bytes accepted by the transport and still waiting to leave
+ *
+ * @param trans the input transport
+ *
+ * @return queued bytes, 0 when closed or the backend does not report them
+ */
+int umqtt_trans_pending(struct umqtt_trans *trans)
+{
+    if ((trans->ops == RT_NULL) || (trans->sock < 0) || (trans->ops->pending == RT_NULL))
+        return 0;
+
+    return trans->ops->pending(trans);
 }
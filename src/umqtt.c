@@ -31,6 +31,27 @@
 #define UMQTT_CLIENT_LOCK(CLIENT)                           rt_mutex_take(CLIENT->lock_client, RT_WAITING_FOREVER)
 #define UMQTT_CLIENT_UNLOCK(CLIENT)                         rt_mutex_release(CLIENT->lock_client)
 
+/* connect_state, the tick words and the keepalive words are atomics, written without lock_client */
+#define UMQTT_CLIENT_STA(CLIENT)                            ((enum umqtt_client_state)umqtt_atomic_load(&((CLIENT)->connect_state)))
+#define UMQTT_TICK_GET(CLIENT, ITEM)                        ((rt_tick_t)umqtt_atomic_load(&((CLIENT)->ITEM)))
+#define UMQTT_TICK_SET(CLIENT, ITEM, TICK)                  umqtt_atomic_store(&((CLIENT)->ITEM), (umqtt_atomic_t)(TICK))
+#define UMQTT_KP_INTERVAL(CLIENT)                           ((rt_uint32_t)umqtt_atomic_load(&((CLIENT)->kp_interval)))
+
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+#define UMQTT_LANE_TAKE(CLIENT, PRIO)                       umqtt_lane_enter((CLIENT), (PRIO), (CLIENT)->mqtt_info.send_timeout * 1000)
+#define UMQTT_LANE_TRY(CLIENT, PRIO)                        umqtt_lane_enter((CLIENT), (PRIO), 0)
+#define UMQTT_LANE_RELEASE(CLIENT)                          umqtt_lane_leave(CLIENT)
+#else
+#define UMQTT_PRIO_CONTROL                                  0
+#define UMQTT_PRIO_HIGH                                     1
+#define UMQTT_PRIO_BULK                                     2
+#define UMQTT_LANE_TAKE(CLIENT, PRIO)                       UMQTT_OK
+#define UMQTT_LANE_TRY(CLIENT, PRIO)                        UMQTT_OK
+#define UMQTT_LANE_RELEASE(CLIENT)
+#endif
+#define UMQTT_CTRL_FRAME_MAX                                4           /* puback / pubrec / pubrel / pubcomp / pingreq */
+#define UMQTT_RECV_INLINE_LEN                               4           /* remaining length of the acks read into recv_hdr */
+
 #define UMQTT_SET_CONNECT_FLAGS(user_name_flag, password_flag, will_retain, will_qos, will_flag, clean_session, reserved)    \
     (((user_name_flag & 0x01) << 7) |    \
     ((password_flag & 0x01) << 6) |  \
@@ -57,6 +78,42 @@ struct umqtt_qos2_msg
     rt_list_t next_list;
 };
 
+#ifdef PKG_UMQTT_USING_STATIC
+struct umqtt_sub_slot                                           /* subscription with its topic filter, static mode */
+{
+    struct subtop_recv_handler sub;                             /* sub.topicfilter == RT_NULL: free slot */
+    char topic[PKG_UMQTT_STATIC_TOPIC_SIZE];
+};
+
+struct umqtt_qos2_slot                                          /* held qos2 message with its data, static mode */
+{
+    struct umqtt_qos2_msg msg;
+    rt_uint8_t used;
+    char data[PKG_UMQTT_STATIC_QOS2_MSG_SIZE];                  /* topic name, '\0', payload */
+};
+
+#define UMQTT_STATIC_ALIGN(SIZE)                            RT_ALIGN((SIZE), RT_ALIGN_SIZE)
+/* the kernel message header is private, reserve a generous one per ack */
+#define UMQTT_STATIC_MQ_POOL_SIZE                           (PKG_UMQTT_MSG_QUEUE_ACK_DEF_SIZE * (UMQTT_STATIC_ALIGN(sizeof(struct umqtt_msg_ack)) + 4 * sizeof(void *)))
+#ifdef PKG_UMQTT_USING_BUF_POOL
+#define UMQTT_STATIC_BUF_SIZE(INFO)                         0           /* frames borrow from the shared pool */
+#else
+#define UMQTT_STATIC_BUF_SIZE(INFO)                         (UMQTT_STATIC_ALIGN((INFO)->send_size) + UMQTT_STATIC_ALIGN((INFO)->recv_size))
+#endif
+#define UMQTT_OBJ_DELETE(TYPE, OBJ)                         rt_##TYPE##_detach(OBJ)
+#define UMQTT_BUF_FREE(CLIENT, BUF, SIZE, TAG)
+#else
+#define UMQTT_OBJ_DELETE(TYPE, OBJ)                         rt_##TYPE##_delete(OBJ)
+#define UMQTT_BUF_FREE(CLIENT, BUF, SIZE, TAG)              UMQTT_MEM_FREE(UMQTT_ALLOCATOR(CLIENT), (BUF), (SIZE), (TAG))
+#endif
+#ifdef PKG_UMQTT_USING_ALLOCATOR
+#define UMQTT_ALLOCATOR(CLIENT)                             (&((CLIENT)->mqtt_info.allocator))
+#else
+#define UMQTT_ALLOCATOR(CLIENT)                             RT_NULL
+#endif
+#define UMQTT_QOS2_MSG_SIZE(MSG)                            (sizeof(struct umqtt_qos2_msg) + (MSG)->topic_name_len + 1 + (MSG)->payload_len)
+#define UMQTT_SUB_SIZE(SUB)                                 (sizeof(struct subtop_recv_handler) + rt_strlen((SUB)->topicfilter) + 1)
+
 struct umqtt_pubrec_msg
 {
     int cnt;
@@ -64,21 +121,91 @@ struct umqtt_pubrec_msg
     int next_tick;                                              /* next tick*/
 };
 
+#ifdef PKG_UMQTT_USING_STATS
+struct umqtt_client_stats                                       /* struct umqtt_stats, updated lock free */
+{
+    umqtt_atomic_t tx_pkts[UMQTT_STATS_PKT_TYPES];
+    umqtt_atomic_t tx_bytes[UMQTT_STATS_PKT_TYPES];
+    umqtt_atomic_t rx_pkts[UMQTT_STATS_PKT_TYPES];
+    umqtt_atomic_t rx_bytes[UMQTT_STATS_PKT_TYPES];
+    umqtt_atomic_t retransmits;
+    umqtt_atomic_t rx_drops;
+    umqtt_atomic_t reconnects;
+    umqtt_atomic_t offline_ms;                                  /* finished offline periods */
+    umqtt_atomic_t offline_tick;                                /* current offline period start, 0: online */
+    umqtt_atomic_t ping_tick;                                   /* outstanding PINGREQ send tick, 0: none */
+    umqtt_atomic_t pub_rtt[UMQTT_STATS_RTT_BUCKETS];
+    umqtt_atomic_t ping_rtt[UMQTT_STATS_RTT_BUCKETS];
+};
+#define UMQTT_STATS_INC(CLIENT, FIELD)                      umqtt_atomic_add(&((CLIENT)->stats.FIELD), 1)
+#define UMQTT_STATS_ADD(CLIENT, FIELD, VAL)                 umqtt_atomic_add(&((CLIENT)->stats.FIELD), (VAL))
+#else
+#define UMQTT_STATS_INC(CLIENT, FIELD)
+#define UMQTT_STATS_ADD(CLIENT, FIELD, VAL)
+#endif
+
+#ifdef PKG_UMQTT_USING_HEALTH
+#define UMQTT_HEALTH_HDR_MAX                                5           /* fixed header byte, remaining length */
+#define UMQTT_HEALTH_BUF_SIZE(TOPIC_LEN)                    (UMQTT_HEALTH_HDR_MAX + 2 + (TOPIC_LEN) + PKG_UMQTT_HEALTH_PAYLOAD_SIZE)
+
+struct umqtt_health                                             /* self published health report */
+{
+    rt_uint8_t *buf;                                            /* header room, topic, payload; allocated once */
+    rt_uint16_t topic_len;
+    rt_tick_t next_tick;                                        /* next report tick */
+    rt_tick_t last_tick;                                        /* last report tick, throughput window start */
+    rt_uint32_t last_tx, last_rx;                               /* byte totals at last_tick */
+    struct umqtt_stats snap;                                    /* kept off the timer thread stack */
+};
+#endif
+
+#ifdef PKG_UMQTT_USING_KP_ADAPT
+struct umqtt_kp_adapt                                           /* longest idle time the path (NAT, firewall) keeps */
+{
+    rt_uint32_t good;                                           /* longest idle interval answered, uint:Sec */
+    rt_uint8_t probe;                                           /* the pending PINGREQ followed a kp_interval long idle */
+    rt_uint8_t settled;                                         /* the path limit was found, kp_interval stays */
+};
+#endif
+
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+struct umqtt_backlog                                            /* qos1/qos2 async publishes waiting for the broker */
+{
+    rt_uint16_t packet_id[PKG_UMQTT_INFLIGHT_MAX];              /* 0: free slot */
+    rt_uint32_t len[PKG_UMQTT_INFLIGHT_MAX];                    /* encoded publish length */
+    rt_uint16_t msgs;                                           /* used slots */
+    rt_uint32_t bytes;                                          /* encoded length of the used slots */
+    rt_uint8_t released[PKG_UMQTT_INFLIGHT_MAX];                /* qos2: PUBREC received, PUBREL sent, waiting for PUBCOMP */
+    rt_tick_t expire_tick[PKG_UMQTT_INFLIGHT_MAX];              /* the slot is given up unacknowledged at this tick */
+    volatile rt_uint8_t blocked;                                /* UMQTT_WOULD_BLOCK returned, on_writable pending */
+};
+#endif
+
 struct umqtt_client
 {
-    int sock;                                                   /* socket sock */
-    enum umqtt_client_state connect_state;                      /* mqtt client status */
+    struct umqtt_trans trans;                                   /* transport, selected by uri scheme */
+    umqtt_atomic_t connect_state;                               /* mqtt client status, enum umqtt_client_state */
 
     struct umqtt_info mqtt_info;                                /* user mqtt config information */
     rt_uint8_t reconnect_count;                                 /* mqtt client reconnect count */
-    rt_uint8_t keepalive_count;                                 /* mqtt keepalive count */
-    rt_uint32_t pingreq_last_tick;                              /* mqtt ping request message */
-    rt_uint32_t uplink_next_tick;                               /* uplink (include: publish/subscribe/unsub/connect/ping/... client->broker) next tick(ping) */
-    rt_uint32_t uplink_last_tick;                               /* uplink (include: publish/subscribe/unsub/connect/ping/... client->broker) next tick(ping) */
-    rt_uint32_t reconnect_next_tick;                            /* client unlink, reconnect next tick */
-    rt_uint32_t reconnect_last_tick;                            /* client unlink, reconnect last tick */
+    umqtt_atomic_t keepalive_count;                             /* mqtt keepalive count */
+    umqtt_atomic_t pingreq_last_tick;                           /* mqtt ping request message */
+    umqtt_atomic_t ping_pending;                                /* PINGREQ sent, PINGRESP not yet received */
+    umqtt_atomic_t kp_interval;                                 /* both directions idle this long before a PINGREQ, uint:Sec */
+    umqtt_atomic_t tx_last_tick;                                /* last packet handed to the transport */
+#ifdef PKG_UMQTT_USING_KP_ADAPT
+    struct umqtt_kp_adapt kp_adapt;                             /* adaptive keepalive interval */
+#endif
+    umqtt_atomic_t uplink_next_tick;                            /* uplink (include: publish/subscribe/unsub/connect/ping/... client->broker) next tick(ping) */
+    umqtt_atomic_t uplink_last_tick;                            /* uplink (include: publish/subscribe/unsub/connect/ping/... client->broker) next tick(ping) */
+    umqtt_atomic_t reconnect_next_tick;                         /* client unlink, reconnect next tick */
+    umqtt_atomic_t reconnect_last_tick;                         /* client unlink, reconnect last tick */
 
     rt_uint8_t *send_buf, *recv_buf;                            /* send data buffer, receive data buffer */
+#ifdef PKG_UMQTT_USING_MSG_RETAIN
+    struct umqtt_msg_pool *recv_pool;                           /* receive buffers, recycled once released */
+    struct umqtt_pkgs_publish *recv_msg;                        /* owns recv_buf, which follows it */
+#endif
     rt_size_t send_len, recv_len;                               /* send datas length, receive datas length */
 
     rt_uint16_t packet_id;                                      /* mqtt packages id */
@@ -99,6 +226,45 @@ struct umqtt_client
     void *user_data;                                            /* user data */
     rt_thread_t task_handle;                                    /* task thread */
 
+#ifdef PKG_UMQTT_USING_STATS
+    struct umqtt_client_stats stats;                            /* client statistics */
+#endif
+#ifdef PKG_UMQTT_USING_MEM_STATS
+    struct umqtt_mem_usage mem;                                 /* heap bytes by use, the stack fields are filled on query */
+#endif
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+    struct umqtt_topic_table *topic_stats;                      /* per topic prefix traffic */
+#endif
+#ifdef PKG_UMQTT_USING_HEALTH
+    struct umqtt_health health;                                 /* health report */
+#endif
+#ifdef PKG_UMQTT_USING_DISPATCH
+    struct umqtt_dispatch *dispatch;                            /* subscribe callback worker pool */
+#endif
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+    struct umqtt_backlog backlog;                               /* outbound backlog watermarks */
+#endif
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+    struct umqtt_lane *lane;                                    /* outbound arbiter, control frames first */
+#endif
+#ifdef PKG_UMQTT_USING_PUB_RING
+    struct umqtt_pub_ring *pub_ring;                            /* queued qos0 publishes, sent by the receive thread */
+    umqtt_atomic_t ring_idle;                                   /* the receive thread waits on the drained ring, a commit wakes it */
+#endif
+#ifdef PKG_UMQTT_USING_BUF_POOL
+    struct umqtt_buf_user buf_user;                             /* shared buffer pool account */
+    rt_uint8_t recv_hdr[1 + MAX_NO_OF_REMAINING_LENGTH_BYTES + UMQTT_RECV_INLINE_LEN];   /* recv_buf between frames and for acks */
+#endif
+#ifdef PKG_UMQTT_USING_STATIC
+    rt_uint8_t heap_storage;                                    /* storage came from umqtt_create, freed on delete */
+    struct rt_mutex lock_obj;                                   /* lock_client */
+    struct rt_messagequeue queue_obj;                           /* msg_queue */
+    struct rt_timer timer_obj;                                  /* uplink_timer */
+    struct rt_thread thread_obj;                                /* task_handle */
+    struct umqtt_sub_slot sub_slot[PKG_UMQTT_SUBRECV_DEF_LENGTH + 1];  /* subscriptions and the will topic */
+    struct umqtt_qos2_slot qos2_slot[PKG_UMQTT_QOS2_QUE_MAX];   /* held qos2 messages */
+#endif
+
     rt_list_t list;                                             /* list header */
 };
 
@@ -111,6 +277,34 @@ enum tick_item
 };
 
 static int umqtt_handle_readpacket(struct umqtt_client *client);
+static int umqtt_send_packet(struct umqtt_client *client, const rt_uint8_t *buf, rt_uint32_t len);
+static int umqtt_send_msg(struct umqtt_client *client, int prio, enum umqtt_type type, struct umqtt_msg *msg);
+static int umqtt_send_control(struct umqtt_client *client, enum umqtt_type type, rt_uint16_t packet_id, int timeout);
+static void set_connect_status(struct umqtt_client *client, enum umqtt_client_state status);
+#ifdef PKG_UMQTT_USING_KP_ADAPT
+static void umqtt_kp_adapt_update(struct umqtt_client *client, int answered);
+#endif
+#ifdef PKG_UMQTT_USING_TICKLESS
+static void umqtt_uplink_schedule(struct umqtt_client *client);
+#define UMQTT_UPLINK_SCHEDULE(CLIENT)                       umqtt_uplink_schedule(CLIENT)
+#define UMQTT_UPLINK_TIMER_FLAG                             (RT_TIMER_FLAG_SOFT_TIMER | RT_TIMER_FLAG_ONE_SHOT)
+#else
+#define UMQTT_UPLINK_SCHEDULE(CLIENT)
+#define UMQTT_UPLINK_TIMER_FLAG                             (RT_TIMER_FLAG_SOFT_TIMER | RT_TIMER_FLAG_PERIODIC)
+#endif
+#ifdef PKG_UMQTT_USING_MEM_STATS
+static void umqtt_mem_account(struct umqtt_client *client, int tag, int size);
+#define UMQTT_MEM_ACCOUNT(CLIENT, TAG, SIZE)                umqtt_mem_account((CLIENT), (TAG), (SIZE))
+#else
+#define UMQTT_MEM_ACCOUNT(CLIENT, TAG, SIZE)
+#endif
+#ifdef PKG_UMQTT_USING_STATS
+static void umqtt_stats_count(struct umqtt_client *client, int is_tx, rt_uint8_t header, rt_uint32_t len);
+static void umqtt_stats_rtt(umqtt_atomic_t *hist, rt_tick_t start_tick);
+#else
+#define umqtt_stats_count(client, is_tx, header, len)
+#define umqtt_stats_rtt(hist, start_tick)
+#endif
 static void umqtt_deliver_message(struct umqtt_client *client,
                                 const char *topic_name, int len,
                                 struct umqtt_pkgs_publish *msg);
@@ -120,6 +314,75 @@ static int get_next_packetID(struct umqtt_client *client)
     return client->packet_id = (client->packet_id == UMQTT_MAX_PACKET_ID) ? 1 : (client->packet_id + 1);
 }
 
+/**
+ * hold a copy of a qos2 message until its PUBREL; topic name and payload
+ * share one block, a heap allocation or a client slot in static mode.
+ *
+ * @param client the input, umqtt client
+ * @param pdata the input, received publish message
+ *
+ * @return RT_NULL: out of memory
+ *         not RT_NULL: held message, release it with umqtt_qos2_free
+ */
+static struct umqtt_qos2_msg *umqtt_qos2_alloc(struct umqtt_client *client, const struct umqtt_pkgs_publish *pdata)
+{
+    struct umqtt_qos2_msg *msg = RT_NULL;
+    rt_size_t _size = pdata->topic_name_len + 1 + pdata->payload_len;
+    char *data = RT_NULL;
+#ifdef PKG_UMQTT_USING_STATIC
+    int _cnt = 0;
+
+    if (_size > PKG_UMQTT_STATIC_QOS2_MSG_SIZE)
+    {
+        LOG_E(" qos2 message size(%d) is over %d!", _size, PKG_UMQTT_STATIC_QOS2_MSG_SIZE);
+        return RT_NULL;
+    }
+    for (_cnt = 0; _cnt < PKG_UMQTT_QOS2_QUE_MAX; _cnt++)
+    {
+        if (client->qos2_slot[_cnt].used == 0)
+        {
+            client->qos2_slot[_cnt].used = 1;
+            msg = &(client->qos2_slot[_cnt].msg);
+            data = client->qos2_slot[_cnt].data;
+            break;
+        }
+    }
+    if (msg == RT_NULL)
+        return RT_NULL;
+    rt_memset(msg, 0, sizeof(struct umqtt_qos2_msg));
+#else
+    msg = (struct umqtt_qos2_msg *)UMQTT_MEM_ALLOC(UMQTT_ALLOCATOR(client), sizeof(struct umqtt_qos2_msg) + _size, UMQTT_MEM_TAG_QOS2);
+    if (msg == RT_NULL)
+        return RT_NULL;
+    UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_QOS2, sizeof(struct umqtt_qos2_msg) + _size);
+    data = (char *)(msg + 1);
+#endif
+
+    msg->topic_name_len = pdata->topic_name_len;
+    msg->packet_id = pdata->packet_id;
+    msg->payload_len = pdata->payload_len;
+    msg->topic_name = data;
+    if (pdata->topic_name_len != 0)
+        rt_memcpy(msg->topic_name, pdata->topic_name, pdata->topic_name_len);
+    msg->topic_name[pdata->topic_name_len] = '\0';
+    if (pdata->payload_len != 0)
+    {
+        msg->payload = data + pdata->topic_name_len + 1;
+        rt_memcpy(msg->payload, pdata->payload, pdata->payload_len);
+    }
+    return msg;
+}
+
+static void umqtt_qos2_free(struct umqtt_client *client, struct umqtt_qos2_msg *msg)
+{
+#ifdef PKG_UMQTT_USING_STATIC
+    rt_container_of(msg, struct umqtt_qos2_slot, msg)->used = 0;
+#else
+    UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_QOS2, -(int)UMQTT_QOS2_MSG_SIZE(msg));
+    UMQTT_MEM_FREE(UMQTT_ALLOCATOR(client), msg, UMQTT_QOS2_MSG_SIZE(msg), UMQTT_MEM_TAG_QOS2);
+#endif
+}
+
 static int add_one_qos2_msg(struct umqtt_client *client, struct umqtt_pkgs_publish *pdata)
 {
     int _ret = UMQTT_OK;
@@ -132,38 +395,10 @@ static int add_one_qos2_msg(struct umqtt_client *client, struct umqtt_pkgs_publi
         }
         else
         {
-            msg = (struct umqtt_qos2_msg *)rt_calloc(1, sizeof(struct umqtt_qos2_msg));
+            msg = umqtt_qos2_alloc(client, pdata);
             if (msg)
             {
-                msg->topic_name_len = pdata->topic_name_len;
-                msg->packet_id = pdata->packet_id;
-                msg->payload_len = pdata->payload_len;
-                if ((pdata->topic_name != RT_NULL) && (pdata->topic_name_len != 0))
-                {
-                    msg->topic_name = (char *)rt_calloc(1, sizeof(char) * pdata->topic_name_len);
-                    if (msg->topic_name)
-                    {
-                        rt_strncpy(msg->topic_name, pdata->topic_name, msg->topic_name_len);
-                    }
-                    else
-                    {
-                        _ret = UMQTT_MEM_FULL;
-                        LOG_E(" calloc umqtt qos2 message topic name failed! memory full! ");
-                    }
-                }
-                if ((pdata->payload != RT_NULL) && (pdata->payload_len != 0))
-                {
-                    msg->payload = (char *)rt_calloc(1, sizeof(char) * pdata->payload_len);
-                    if (msg->payload)
-                    {
-                        rt_strncpy(msg->payload, pdata->payload, msg->payload_len);
-                    }
-                    else
-                    {
-                        _ret = UMQTT_MEM_FULL;
-                        LOG_E(" calloc umqtt qos2 message payload failed! memory full! ");
-                    }
-                }
+                rt_list_insert_after(&client->qos2_msg_list, &msg->next_list);
             }
             else
             {
@@ -178,23 +413,129 @@ static int add_one_qos2_msg(struct umqtt_client *client, struct umqtt_pkgs_publi
         LOG_E(" add qos2 message failed! input params is valid! ");
     }
 
-    if (_ret == UMQTT_OK)
+    return _ret;
+}
+
+/**
+ * take a subscription entry holding a copy of topic, a heap allocation or a
+ * client slot in static mode
+ *
+ * @param client the input, umqtt client
+ * @param topic the input, topic filter
+ *
+ * @return RT_NULL: out of memory
+ *         not RT_NULL: subscription entry, release it with umqtt_sub_free
+ */
+static struct subtop_recv_handler *umqtt_sub_alloc(struct umqtt_client *client, const char *topic)
+{
+    struct subtop_recv_handler *p_subtop = RT_NULL;
+    rt_size_t _length = rt_strlen(topic) + 1;
+#ifdef PKG_UMQTT_USING_STATIC
+    rt_base_t level;
+    int _cnt = 0;
+
+    if (_length > PKG_UMQTT_STATIC_TOPIC_SIZE)
     {
-        rt_list_insert_after(&client->qos2_msg_list, &msg->next_list);
+        LOG_E(" topic length(%d) is over %d!", _length, PKG_UMQTT_STATIC_TOPIC_SIZE);
+        return RT_NULL;
     }
-
-//_exit:
-    if (_ret == UMQTT_MEM_FULL)
+    level = rt_hw_interrupt_disable();
+    for (_cnt = 0; _cnt < sizeof(client->sub_slot) / sizeof(client->sub_slot[0]); _cnt++)
     {
-        if (msg)
+        if (client->sub_slot[_cnt].sub.topicfilter == RT_NULL)
         {
-            if (msg->topic_name) { rt_free(msg->topic_name); msg->topic_name = RT_NULL; }
-            if (msg->payload) { rt_free(msg->payload); msg->payload = RT_NULL; }
-            rt_free(msg); msg = RT_NULL;
+            p_subtop = &(client->sub_slot[_cnt].sub);
+            p_subtop->topicfilter = client->sub_slot[_cnt].topic;
+            break;
         }
     }
+    rt_hw_interrupt_enable(level);
+#else
+    p_subtop = (struct subtop_recv_handler *)UMQTT_MEM_ALLOC(UMQTT_ALLOCATOR(client), sizeof(struct subtop_recv_handler) + _length,
+                                                             UMQTT_MEM_TAG_SUBSCRIBE);
+    if (p_subtop != RT_NULL)
+    {
+        p_subtop->topicfilter = (char *)(p_subtop + 1);
+        UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_SUBSCRIBE, sizeof(struct subtop_recv_handler) + _length);
+    }
+#endif
+    if (p_subtop != RT_NULL)
+        rt_memcpy(p_subtop->topicfilter, topic, _length);
+    return p_subtop;
+}
 
-    return _ret;
+/* live subscription with this topic filter, lock_client held; prefix: compare strlen(topic) bytes only */
+static struct subtop_recv_handler *umqtt_sub_find(struct umqtt_client *client, const char *topic, int prefix)
+{
+    struct subtop_recv_handler *p_subtop = RT_NULL;
+    rt_list_t *node = RT_NULL;
+
+    rt_list_for_each(node, &client->sub_recv_list)
+    {
+        p_subtop = rt_list_entry(node, struct subtop_recv_handler, next_list);
+        if ((p_subtop->removed == 0) && (p_subtop->topicfilter != RT_NULL)
+         && ((prefix ? rt_strncmp(p_subtop->topicfilter, topic, rt_strlen(topic)) : rt_strcmp(p_subtop->topicfilter, topic)) == 0))
+            return p_subtop;
+    }
+    return RT_NULL;
+}
+
+/* take a subscription off the list, lock_client held; 1: free it once unlocked, 0: a delivery still uses it and frees it */
+static int umqtt_sub_unlink(struct subtop_recv_handler *p_subtop)
+{
+    p_subtop->removed = 1;
+    if (p_subtop->busy != 0)
+        return 0;
+    rt_list_remove(&(p_subtop->next_list));
+    return 1;
+}
+
+/* drop a use taken under lock_client, lock_client held; 1: it was unsubscribed meanwhile, free it once unlocked */
+static int umqtt_sub_unpin(struct subtop_recv_handler *p_subtop)
+{
+    if ((--p_subtop->busy != 0) || (p_subtop->removed == 0))
+        return 0;
+    rt_list_remove(&(p_subtop->next_list));
+    return 1;
+}
+
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+/* stop a subscription queue and give its memory back to the client allocator */
+static void umqtt_sub_queue_release(struct umqtt_client *client, struct umqtt_sub_queue *queue)
+{
+    if (queue == RT_NULL)
+        return;
+
+    UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_SUB_QUEUE, -(int)umqtt_sub_queue_size(queue));
+    umqtt_sub_queue_delete(queue, UMQTT_ALLOCATOR(client));
+}
+#endif
+
+/* release a subscription entry, it must already be off the list */
+static void umqtt_sub_free(struct umqtt_client *client, struct subtop_recv_handler *p_subtop)
+{
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+    umqtt_sub_queue_release(client, p_subtop->queue);
+#endif
+#ifdef PKG_UMQTT_USING_STATIC
+    rt_memset(p_subtop, 0, sizeof(struct subtop_recv_handler));          /* topicfilter RT_NULL frees the slot */
+#else
+    UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_SUBSCRIBE, -(int)UMQTT_SUB_SIZE(p_subtop));
+    UMQTT_MEM_FREE(UMQTT_ALLOCATOR(client), p_subtop, UMQTT_SUB_SIZE(p_subtop), UMQTT_MEM_TAG_SUBSCRIBE);
+#endif
+}
+
+/* release the entries a walk took off the list, after lock_client is given back */
+static void umqtt_sub_free_list(struct umqtt_client *client, rt_list_t *dead)
+{
+    struct subtop_recv_handler *p_subtop = RT_NULL;
+
+    while (!rt_list_isempty(dead))
+    {
+        p_subtop = rt_list_entry(dead->next, struct subtop_recv_handler, next_list);
+        rt_list_remove(&(p_subtop->next_list));
+        umqtt_sub_free(client, p_subtop);
+    }
 }
 
 static int qos2_publish_delete(struct umqtt_client *client, int packet_id)
@@ -218,11 +559,20 @@ static int qos2_publish_delete(struct umqtt_client *client, int packet_id)
                 publish_msg.packet_id = p_msg->packet_id;
                 publish_msg.topic_name = p_msg->topic_name;
                 publish_msg.payload = p_msg->payload;
+#ifdef PKG_UMQTT_USING_MSG_RETAIN
+                {
+                    struct umqtt_pkgs_publish *p_hold = umqtt_publish_dup(&publish_msg);   /* retainable */
+                    if (p_hold != RT_NULL)
+                    {
+                        umqtt_deliver_message(client, p_hold->topic_name, p_hold->topic_name_len, p_hold);
+                        umqtt_publish_free(p_hold);
+                    }
+                }
+#else
                 umqtt_deliver_message(client, p_msg->topic_name, p_msg->topic_name_len, &publish_msg);
-                if (p_msg->topic_name) { rt_free(p_msg->topic_name); p_msg->topic_name = RT_NULL; }
-                if (p_msg->payload) { rt_free(p_msg->payload); p_msg->payload = RT_NULL; }
+#endif
                 rt_list_remove(&(p_msg->next_list));
-                rt_free(p_msg); p_msg = RT_NULL;
+                umqtt_qos2_free(client, p_msg); p_msg = RT_NULL;
                 goto _exit;
             }
         }
@@ -244,6 +594,7 @@ static int add_one_pubrec_msg(struct umqtt_client *client, int packet_id)
             client->pubrec_msg[_cnt].packet_id = packet_id;
             client->pubrec_msg[_cnt].next_tick = rt_tick_get() + PKG_UMQTT_RECPUBREC_INTERVAL_TIME;
             UMQTT_CLIENT_UNLOCK(client);
+            UMQTT_UPLINK_SCHEDULE(client);
             break;
         }
     }
@@ -278,7 +629,6 @@ static int clear_one_pubrec_msg(struct umqtt_client *client, int packet_id)
 static int pubrec_cycle_callback(struct umqtt_client *client)
 {
     int _ret = UMQTT_OK, _cnt = 0;
-    struct umqtt_msg encode_msg = { 0 };
 
     /* search pubrec packet id, encode, transport, change next tick time */
     for (_cnt = 0; _cnt < PKG_UMQTT_QOS2_QUE_MAX; _cnt++)
@@ -306,30 +656,19 @@ static int pubrec_cycle_callback(struct umqtt_client *client)
                 }
                 else
                 {
-                    rt_memset(&encode_msg, 0, sizeof(struct umqtt_msg));
-                    encode_msg.header.bits.qos = UMQTT_QOS2;
-                    encode_msg.header.bits.dup = 0;
-                    encode_msg.header.bits.type = UMQTT_TYPE_PUBREC;
-                    encode_msg.msg.pubrec.packet_id = client->pubrec_msg[_cnt].packet_id;
-
-                    _ret = umqtt_encode(encode_msg.header.bits.type, client->send_buf, client->mqtt_info.send_size,
-                                       &encode_msg);
-                    if (_ret < 0)
+                    _ret = umqtt_send_control(client, UMQTT_TYPE_PUBREC, client->pubrec_msg[_cnt].packet_id,
+                                              client->mqtt_info.send_timeout * 1000);
+                    if (_ret == UMQTT_ENCODE_ERROR)
                     {
-                        _ret = UMQTT_ENCODE_ERROR;
                         LOG_E(" pubrec failed!");
                         goto _exit;
                     }
-                    client->send_len = _ret;
-
-                    _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len,
-                                            client->mqtt_info.send_timeout);
-                    if (_ret < 0)
+                    else if (_ret < 0)
                     {
-                        _ret = UMQTT_SEND_FAILED;
                         LOG_E(" trans send failed!");
                         goto _exit;
                     }
+                    UMQTT_STATS_INC(client, retransmits);
                 }
             }
 
@@ -340,104 +679,617 @@ _exit:
     return _ret;
 }
 
-static void set_connect_status(struct umqtt_client *client, enum umqtt_client_state status)
+/* a write failed or stopped mid frame, the peer would parse garbage: drop the link and reconnect */
+static void umqtt_send_broken(struct umqtt_client *client)
 {
-    UMQTT_CLIENT_LOCK(client);
-    client->connect_state = status;
-    UMQTT_CLIENT_UNLOCK(client);
+    if (UMQTT_CLIENT_STA(client) != UMQTT_CS_LINKED)
+        return;
+
+    LOG_W(" trans send broke the stream, reconnect!");
+    set_connect_status(client, UMQTT_CS_UNLINK);
 }
 
-static void set_uplink_recon_tick(struct umqtt_client *client, enum tick_item item)
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+/* take the outbound lane, a control write that failed while flushing the queue drops the link */
+static int umqtt_lane_enter(struct umqtt_client *client, int prio, int timeout)
 {
-    RT_ASSERT(client);
-    switch (item)
+    int _ret = umqtt_lane_take(client->lane, prio, timeout);
+
+    if (_ret == UMQTT_SEND_FAILED)
+        umqtt_send_broken(client);
+    return _ret;
+}
+
+static void umqtt_lane_leave(struct umqtt_client *client)
+{
+    if (umqtt_lane_release(client->lane) == UMQTT_SEND_FAILED)
+        umqtt_send_broken(client);
+}
+#endif
+
+/**
+ * send one encoded packet, bounded by the send timeout
+ *
+ * @param client the input, umqtt client
+ * @param buf the input, encoded packet
+ * @param len the input, packet length
+ *
+ * @return UMQTT_SEND_TIMEOUT: the link did not drain in time, nothing was sent
+ *         UMQTT_SEND_FAILED: transport error or a frame cut short, the link is dropped
+ *         UMQTT_OK: success
+ */
+static int umqtt_send_packet(struct umqtt_client *client, const rt_uint8_t *buf, rt_uint32_t len)
+{
+    int _ret = 0;
+
+    _ret = umqtt_trans_send(&(client->trans), buf, len, client->mqtt_info.send_timeout * 1000);
+    if (_ret == UMQTT_SEND_TIMEOUT)
     {
-    case UPLINK_LAST_TICK:
-        UMQTT_CLIENT_LOCK(client);
-        client->uplink_last_tick = rt_tick_get();
-        UMQTT_CLIENT_UNLOCK(client);
-        break;
-    case UPLINK_NEXT_TICK:
-        UMQTT_CLIENT_LOCK(client);
-        client->uplink_next_tick = client->mqtt_info.keepalive_interval * 1000 + rt_tick_get();
-        UMQTT_CLIENT_UNLOCK(client);
-        break;
-    case RECON_LAST_TICK:
-        UMQTT_CLIENT_LOCK(client);
-        client->reconnect_last_tick = rt_tick_get();
-        UMQTT_CLIENT_UNLOCK(client);
-        break;
-    case RECON_NEXT_TICK:
-        UMQTT_CLIENT_LOCK(client);
-        client->reconnect_next_tick = client->mqtt_info.reconnect_interval * 1000 + rt_tick_get();
-        UMQTT_CLIENT_UNLOCK(client);
-        break;
-    default:
-        LOG_W(" set tick item outof set! value: %d", item);
-        break;
+        LOG_W(" trans send timeout! (%d Sec)", client->mqtt_info.send_timeout);
+        return UMQTT_SEND_TIMEOUT;
     }
-};
+    else if (_ret < 0)
+    {
+        umqtt_send_broken(client);
+        return UMQTT_SEND_FAILED;
+    }
+    UMQTT_TICK_SET(client, tx_last_tick, rt_tick_get());
+    umqtt_stats_count(client, 1, buf[0], len);
+    return UMQTT_OK;
+}
 
-static int umqtt_connect(struct umqtt_client *client, int block)
+/**
+ * send one packet gathered from segments, see umqtt_send_packet
+ *
+ * @param client the input, umqtt client
+ * @param iov the input, packet segments, the fixed header first
+ * @param iovcnt the input, segments count
+ * @param len the input, packet length
+ *
+ * @return see umqtt_send_packet
+ */
+static int umqtt_send_packetv(struct umqtt_client *client, const struct umqtt_iovec *iov, int iovcnt, rt_uint32_t len)
 {
-    int _ret = 0, _length = 0, _cnt = 0;
-    struct umqtt_msg encode_msg = { 0 };
-    //struct umqtt_msg_ack msg_ack = { 0 };
-    RT_ASSERT(client);
+    int _ret = 0;
 
-_reconnect:
-    client->reconnect_count++;
-    if (client->reconnect_count > client->mqtt_info.reconnect_max_num)
+    _ret = umqtt_trans_sendv(&(client->trans), iov, iovcnt, client->mqtt_info.send_timeout * 1000);
+    if (_ret == UMQTT_SEND_TIMEOUT)
     {
-        _ret = UMQTT_RECONNECT_FAILED;
-        client->reconnect_count = 0;
-        LOG_E(" reconnect failed!");
-        goto exit;
+        LOG_W(" trans send timeout! (%d Sec)", client->mqtt_info.send_timeout);
+        return UMQTT_SEND_TIMEOUT;
     }
-    _ret = umqtt_trans_connect(client->mqtt_info.uri, &(client->sock));
-    if (_ret < 0)
+    else if (_ret < 0)
     {
-        _ret = UMQTT_SOCK_CONNECT_FAILED;
-        LOG_E(" umqtt connect, transport connect failed!");
-        goto disconnect;
+        umqtt_send_broken(client);
+        return UMQTT_SEND_FAILED;
     }
+    UMQTT_TICK_SET(client, tx_last_tick, rt_tick_get());
+    umqtt_stats_count(client, 1, ((const rt_uint8_t *)iov[0].iov_base)[0], len);
+    return UMQTT_OK;
+}
 
-    encode_msg.msg.connect.protocol_name_len = PKG_UMQTT_PROTOCOL_NAME_LEN;
-    encode_msg.msg.connect.protocol_name = PKG_UMQTT_PROTOCOL_NAME;
-    encode_msg.msg.connect.protocol_level = PKG_UMQTT_PROTOCOL_LEVEL;
-    encode_msg.msg.connect.connect_flags.connect_sign = UMQTT_DEF_CONNECT_FLAGS;
-#ifdef PKG_UMQTT_TEST_SHORT_KEEPALIVE_TIME
-    encode_msg.msg.connect.keepalive_interval_sec = ((client->mqtt_info.connect_keepalive_sec == 0) ? PKG_UMQTT_CONNECT_KEEPALIVE_DEF_TIME : client->mqtt_info.connect_keepalive_sec);
-#else
-    encode_msg.msg.connect.keepalive_interval_sec = PKG_UMQTT_CONNECT_KEEPALIVE_DEF_TIME;
+/**
+ * encode one packet in client send buffer and send it; the transport is held
+ * for the packet class from encode to send, the buffer is not shared meanwhile.
+ * With PKG_UMQTT_USING_BUF_POOL the packet is encoded into a buffer borrowed
+ * for this packet only, before the transport is taken. On a backend with a
+ * vectored send a publish payload is not copied: the head is encoded alone
+ * and the payload goes out from the caller's buffer in the same write.
+ *
+ * @param client the input, umqtt client
+ * @param prio the input, enum umqtt_prio, ignored without PKG_UMQTT_USING_PRIO_LANES
+ * @param type the input, packet type
+ * @param msg the input, packet to encode
+ *
+ * @return UMQTT_ENCODE_ERROR: the packet does not fit the send buffer
+ *         UMQTT_SEND_TIMEOUT / UMQTT_SEND_FAILED: see umqtt_send_packet
+ *         UMQTT_OK: success
+ */
+static int umqtt_send_msg(struct umqtt_client *client, int prio, enum umqtt_type type, struct umqtt_msg *msg)
+{
+    int _ret = 0, _len = 0, _full = 0, _gather = 0;
+    rt_uint8_t *buf = RT_NULL;
+    struct umqtt_iovec iov[2];
+#ifdef PKG_UMQTT_USING_BUF_POOL
+    int _cap = 0;
 #endif
-    encode_msg.msg.connect.client_id = client->mqtt_info.client_id;
-    encode_msg.msg.connect.will_topic = client->mqtt_info.lwt_topic;
-    encode_msg.msg.connect.will_message = client->mqtt_info.lwt_message;
-    encode_msg.msg.connect.user_name = client->mqtt_info.user_name;
-    if (client->mqtt_info.user_name)
+
+    /* the whole packet must fit the send buffer, copied or not */
+    _full = umqtt_encode_len(type, msg);
+    if ((_full <= 0) || (_full > client->mqtt_info.send_size))
+        return UMQTT_ENCODE_ERROR;
+    _gather = (type == UMQTT_TYPE_PUBLISH) && (msg->msg.publish.payload_len > 0)
+           && umqtt_trans_gathers(&(client->trans));
+
+#ifdef PKG_UMQTT_USING_BUF_POOL
+    _cap = _gather ? (_full - (int)msg->msg.publish.payload_len) : _full;
+    buf = umqtt_buf_get(&(client->buf_user), _cap, client->mqtt_info.send_timeout * 1000);
+    if (buf == RT_NULL)
     {
-        encode_msg.msg.connect.connect_flags.bits.username_flag = 1;
+        LOG_W(" send buffer is over the pool budget!");
+        return UMQTT_MEM_FULL;
     }
-    encode_msg.msg.connect.password = client->mqtt_info.password;
-    if (client->mqtt_info.password) {
-        encode_msg.msg.connect.connect_flags.bits.password_flag = 1;
-        encode_msg.msg.connect.password_len = rt_strlen(client->mqtt_info.password);
-    }
-
-    _length = umqtt_encode(UMQTT_TYPE_CONNECT, client->send_buf, client->mqtt_info.send_size, &encode_msg);
-    if (_length <= 0)
+    UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_SEND_BUF, _cap);
+    _len = _gather ? umqtt_encode_publish_head(buf, _cap, msg) : umqtt_encode(type, buf, _cap, msg);
+    if (_len <= 0)
     {
         _ret = UMQTT_ENCODE_ERROR;
-        LOG_E(" connect encode failed!");
-        goto exit;
+        goto _put;
     }
-    client->send_len = _length;
+    _ret = UMQTT_LANE_TAKE(client, prio);
+    if (_ret < 0)
+        goto _put;
+#else
+    _ret = UMQTT_LANE_TAKE(client, prio);
+    if (_ret < 0)
+        return _ret;
+
+    buf = client->send_buf;
+    _len = _gather ? umqtt_encode_publish_head(buf, client->mqtt_info.send_size, msg)
+                   : umqtt_encode(type, buf, client->mqtt_info.send_size, msg);
+    if (_len <= 0)
+    {
+        _ret = UMQTT_ENCODE_ERROR;
+        goto _exit;
+    }
+#endif
+    client->send_len = _full;
+    if (type == UMQTT_TYPE_PUBLISH)
+        UMQTT_TRACE(UMQTT_TRACE_PUB_ENCODED, UMQTT_TYPE_PUBLISH, msg->msg.publish.packet_id, _full);
+
+    if (_gather)
+    {
+        iov[0].iov_base = buf;
+        iov[0].iov_len = _len;
+        iov[1].iov_base = msg->msg.publish.payload;
+        iov[1].iov_len = msg->msg.publish.payload_len;
+        _ret = umqtt_send_packetv(client, iov, 2, _full);
+    }
+    else
+        _ret = umqtt_send_packet(client, buf, _len);
+
+#ifndef PKG_UMQTT_USING_BUF_POOL
+_exit:
+#endif
+    UMQTT_LANE_RELEASE(client);
+#ifdef PKG_UMQTT_USING_BUF_POOL
+_put:
+    UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_SEND_BUF, -_cap);
+    umqtt_buf_put(&(client->buf_user), buf);
+#endif
+    return _ret;
+}
+
+/**
+ * send one control packet (puback, pubrec, pubrel, pubcomp, pingreq), encoded
+ * on the stack; with priority lanes it never waits behind a user packet, unless
+ * the control queue is full
+ *
+ * @param client the input, umqtt client
+ * @param type the input, control packet type
+ * @param packet_id the input, packet id, unused by PINGREQ
+ * @param timeout the input, send timeout without priority lanes, uint:mSec
+ *
+ * @return UMQTT_ENCODE_ERROR / UMQTT_SEND_TIMEOUT / UMQTT_SEND_FAILED, UMQTT_OK: sent or queued
+ */
+static int umqtt_send_control(struct umqtt_client *client, enum umqtt_type type, rt_uint16_t packet_id, int timeout)
+{
+    rt_uint8_t _buf[UMQTT_CTRL_FRAME_MAX];
+    int _ret = 0, _len = 0;
+
+    _len = umqtt_encode_ack(type, packet_id, _buf, sizeof(_buf));
+    if (_len <= 0)
+        return UMQTT_ENCODE_ERROR;
+
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+    _ret = umqtt_lane_control(client->lane, _buf, _len);
+#else
+    _ret = umqtt_trans_send(&(client->trans), _buf, _len, timeout);
+#endif
+    if (_ret == UMQTT_SEND_TIMEOUT)
+        return UMQTT_SEND_TIMEOUT;
+    else if (_ret < 0)
+    {
+        umqtt_send_broken(client);
+        return UMQTT_SEND_FAILED;
+    }
+
+    UMQTT_TICK_SET(client, tx_last_tick, rt_tick_get());
+    umqtt_stats_count(client, 1, _buf[0], _len);
+    return UMQTT_OK;
+}
+
+#ifdef PKG_UMQTT_USING_STATS
+/* packet and byte counters, header: the fixed header byte carrying the type */
+static void umqtt_stats_count(struct umqtt_client *client, int is_tx, rt_uint8_t header, rt_uint32_t len)
+{
+    int _type = (header >> 4) & 0x0F;
+
+    if (is_tx)
+    {
+        UMQTT_STATS_INC(client, tx_pkts[_type]);
+        UMQTT_STATS_ADD(client, tx_bytes[_type], len);
+    }
+    else
+    {
+        UMQTT_STATS_INC(client, rx_pkts[_type]);
+        UMQTT_STATS_ADD(client, rx_bytes[_type], len);
+    }
+}
+
+/* log2 bucket of the round trip since start_tick */
+static void umqtt_stats_rtt(umqtt_atomic_t *hist, rt_tick_t start_tick)
+{
+    rt_uint32_t _ms = (rt_tick_get() - start_tick) * 1000 / RT_TICK_PER_SECOND;
+    int _bucket = 0;
+
+    while ((_ms != 0) && (_bucket < UMQTT_STATS_RTT_BUCKETS - 1))
+    {
+        _ms >>= 1;
+        _bucket++;
+    }
+    umqtt_atomic_add(&hist[_bucket], 1);
+}
+
+/* offline time runs from losing a link until the next CONNACK */
+static void umqtt_stats_link(struct umqtt_client *client, enum umqtt_client_state old_sta, enum umqtt_client_state new_sta)
+{
+    rt_tick_t _tick = rt_tick_get();
+    rt_tick_t _start = 0;
+
+    if ((old_sta == UMQTT_CS_LINKED) && (new_sta != UMQTT_CS_LINKED))
+    {
+        umqtt_atomic_store(&(client->stats.offline_tick), (_tick == 0) ? 1 : _tick);
+    }
+    else if ((old_sta != UMQTT_CS_LINKED) && (new_sta == UMQTT_CS_LINKED))
+    {
+        _start = umqtt_atomic_load(&(client->stats.offline_tick));
+        if (_start != 0)
+        {
+            UMQTT_STATS_ADD(client, offline_ms, (_tick - _start) * 1000 / RT_TICK_PER_SECOND);
+            UMQTT_STATS_INC(client, reconnects);
+            umqtt_atomic_store(&(client->stats.offline_tick), 0);
+        }
+    }
+}
+
+/* copy the counters out, the open offline period is included */
+static void umqtt_stats_snapshot(struct umqtt_client *client, struct umqtt_stats *stats)
+{
+    int _cnt = 0;
+    rt_tick_t _start = 0;
+
+    for (_cnt = 0; _cnt < UMQTT_STATS_PKT_TYPES; _cnt++)
+    {
+        stats->tx_pkts[_cnt] = umqtt_atomic_load(&(client->stats.tx_pkts[_cnt]));
+        stats->tx_bytes[_cnt] = umqtt_atomic_load(&(client->stats.tx_bytes[_cnt]));
+        stats->rx_pkts[_cnt] = umqtt_atomic_load(&(client->stats.rx_pkts[_cnt]));
+        stats->rx_bytes[_cnt] = umqtt_atomic_load(&(client->stats.rx_bytes[_cnt]));
+    }
+    for (_cnt = 0; _cnt < UMQTT_STATS_RTT_BUCKETS; _cnt++)
+    {
+        stats->pub_rtt[_cnt] = umqtt_atomic_load(&(client->stats.pub_rtt[_cnt]));
+        stats->ping_rtt[_cnt] = umqtt_atomic_load(&(client->stats.ping_rtt[_cnt]));
+    }
+    stats->retransmits = umqtt_atomic_load(&(client->stats.retransmits));
+    stats->rx_drops = umqtt_atomic_load(&(client->stats.rx_drops));
+    stats->reconnects = umqtt_atomic_load(&(client->stats.reconnects));
+    stats->offline_ms = umqtt_atomic_load(&(client->stats.offline_ms));
+    _start = umqtt_atomic_load(&(client->stats.offline_tick));
+    if (_start != 0)
+        stats->offline_ms += (rt_tick_get() - _start) * 1000 / RT_TICK_PER_SECOND;
+}
+#endif /* PKG_UMQTT_USING_STATS */
+
+#ifdef PKG_UMQTT_USING_MEM_STATS
+/* size: bytes taken, negative when given back */
+static void umqtt_mem_account(struct umqtt_client *client, int tag, int size)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+
+    client->mem.cur[tag] += size;
+    if (client->mem.cur[tag] > client->mem.peak[tag])
+        client->mem.peak[tag] = client->mem.cur[tag];
+    client->mem.total += size;
+    if (client->mem.total > client->mem.total_peak)
+        client->mem.total_peak = client->mem.total;
+    rt_hw_interrupt_enable(level);
+}
+
+/* deepest use of the receive thread stack, read from the fill pattern the kernel leaves unused */
+static rt_uint32_t umqtt_mem_stack_peak(rt_thread_t thread)
+{
+    rt_uint8_t *ptr = RT_NULL;
+
+    if (thread == RT_NULL)
+        return 0;
+
+#ifdef ARCH_CPU_STACK_GROWS_UPWARD
+    ptr = (rt_uint8_t *)thread->stack_addr + thread->stack_size - 1;
+    while ((ptr > (rt_uint8_t *)thread->stack_addr) && (*ptr == '#'))
+        ptr--;
+    return (rt_uint32_t)(ptr - (rt_uint8_t *)thread->stack_addr) + 1;
+#else
+    ptr = (rt_uint8_t *)thread->stack_addr;
+    while ((ptr < (rt_uint8_t *)thread->stack_addr + thread->stack_size) && (*ptr == '#'))
+        ptr++;
+    return thread->stack_size - (rt_uint32_t)(ptr - (rt_uint8_t *)thread->stack_addr);
+#endif
+}
+#endif /* PKG_UMQTT_USING_MEM_STATS */
+
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+/**
+ * check the high watermarks and, for a qos1/qos2 publish, take its tracking
+ * slot in the same critical section, so two publishers cannot both pass the
+ * check; the slot is held until PUBACK / PUBCOMP or info.inflight_expire_ms.
+ *
+ * @param client the input, umqtt client
+ * @param packet_id the input, publish packet id, 0: qos0, nothing tracked
+ * @param len the input, encoded publish length
+ *
+ * @return UMQTT_WOULD_BLOCK: a high watermark is reached
+ *         UMQTT_MEM_FULL: no free tracking slot
+ *         UMQTT_OK: success
+ */
+static int umqtt_backlog_reserve(struct umqtt_client *client, rt_uint16_t packet_id, rt_uint32_t len)
+{
+    struct umqtt_backlog *backlog = &(client->backlog);
+    rt_uint32_t _pending = umqtt_trans_pending(&(client->trans));
+    rt_base_t level;
+    int _cnt = 0, _ret = UMQTT_OK;
+
+    level = rt_hw_interrupt_disable();
+    if ((backlog->msgs >= client->mqtt_info.wm_high_msgs)
+     || (backlog->bytes + _pending >= client->mqtt_info.wm_high_bytes))
+    {
+        backlog->blocked = 1;
+        _ret = UMQTT_WOULD_BLOCK;
+    }
+    else if (packet_id != 0)
+    {
+        for (_cnt = 0; _cnt < PKG_UMQTT_INFLIGHT_MAX; _cnt++)
+        {
+            if (backlog->packet_id[_cnt] == 0)
+                break;
+        }
+        if (_cnt < PKG_UMQTT_INFLIGHT_MAX)
+        {
+            backlog->packet_id[_cnt] = packet_id;
+            backlog->len[_cnt] = len;
+            backlog->released[_cnt] = 0;
+            backlog->expire_tick[_cnt] = rt_tick_get() + rt_tick_from_millisecond(client->mqtt_info.inflight_expire_ms);
+            backlog->msgs++;
+            backlog->bytes += len;
+        }
+        else
+        {
+            _ret = UMQTT_MEM_FULL;
+        }
+    }
+    rt_hw_interrupt_enable(level);
+
+    if (_ret == UMQTT_WOULD_BLOCK)
+        UMQTT_UPLINK_SCHEDULE(client);                          /* qos0 drain is polled */
+    return _ret;
+}
+
+/**
+ * PUBREC of a tracked qos2 async publish: the broker holds the message, only
+ * the PUBREL is still in flight, the slot stays until PUBCOMP
+ *
+ * @return 1: it is tracked, send PUBREL
+ *         0: not an async publish
+ */
+static int umqtt_backlog_rec(struct umqtt_client *client, rt_uint16_t packet_id)
+{
+    struct umqtt_backlog *backlog = &(client->backlog);
+    rt_base_t level;
+    int _cnt = 0, _ret = 0;
+
+    level = rt_hw_interrupt_disable();
+    for (_cnt = 0; (_cnt < PKG_UMQTT_INFLIGHT_MAX) && (backlog->msgs > 0); _cnt++)
+    {
+        if (backlog->packet_id[_cnt] == packet_id)
+        {
+            if (backlog->released[_cnt] == 0)
+            {
+                backlog->released[_cnt] = 1;
+                backlog->bytes -= backlog->len[_cnt] - UMQTT_CTRL_FRAME_MAX;
+                backlog->len[_cnt] = UMQTT_CTRL_FRAME_MAX;
+            }
+            _ret = 1;                                           /* a resent PUBREC gets its PUBREL again */
+            break;
+        }
+    }
+    rt_hw_interrupt_enable(level);
+    return _ret;
+}
+
+/* forget an acknowledged async publish, return 1: it was tracked */
+static int umqtt_backlog_ack(struct umqtt_client *client, rt_uint16_t packet_id)
+{
+    struct umqtt_backlog *backlog = &(client->backlog);
+    rt_base_t level;
+    int _cnt = 0, _ret = 0;
+
+    level = rt_hw_interrupt_disable();
+    for (_cnt = 0; (_cnt < PKG_UMQTT_INFLIGHT_MAX) && (backlog->msgs > 0); _cnt++)
+    {
+        if (backlog->packet_id[_cnt] == packet_id)
+        {
+            backlog->packet_id[_cnt] = 0;
+            backlog->msgs--;
+            backlog->bytes -= backlog->len[_cnt];
+            _ret = 1;
+            break;
+        }
+    }
+    rt_hw_interrupt_enable(level);
+    return _ret;
+}
+
+/* clean session: the publishes of the lost link will never be acknowledged */
+static void umqtt_backlog_reset(struct umqtt_client *client)
+{
+    rt_base_t level;
+
+    level = rt_hw_interrupt_disable();
+    rt_memset(client->backlog.packet_id, 0, sizeof(client->backlog.packet_id));
+    client->backlog.msgs = 0;
+    client->backlog.bytes = 0;
+    rt_hw_interrupt_enable(level);
+}
+
+/* free the slots the broker never acknowledged in time, each one is reported to the publisher */
+static void umqtt_backlog_expire(struct umqtt_client *client)
+{
+    struct umqtt_backlog *backlog = &(client->backlog);
+    rt_tick_t _now = rt_tick_get();
+    rt_uint16_t packet_id = 0;
+    rt_base_t level;
+    int _cnt = 0;
+
+    for (_cnt = 0; (_cnt < PKG_UMQTT_INFLIGHT_MAX) && (backlog->msgs > 0); _cnt++)
+    {
+        level = rt_hw_interrupt_disable();
+        packet_id = backlog->packet_id[_cnt];
+        if ((packet_id != 0) && ((rt_int32_t)(_now - backlog->expire_tick[_cnt]) >= 0))
+        {
+            backlog->packet_id[_cnt] = 0;
+            backlog->msgs--;
+            backlog->bytes -= backlog->len[_cnt];
+        }
+        else
+        {
+            packet_id = 0;
+        }
+        rt_hw_interrupt_enable(level);
 
-    _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len, client->mqtt_info.send_timeout);
+        if (packet_id == 0)
+            continue;
+        LOG_W(" async publish(%d) not acknowledged in %d mSec! give up its slot!", packet_id, client->mqtt_info.inflight_expire_ms);
+        if (client->mqtt_info.on_pub_expired)
+            client->mqtt_info.on_pub_expired(client, packet_id);
+    }
+}
+
+/* call on_writable once a blocked backlog drained to the low watermarks */
+static void umqtt_backlog_check(struct umqtt_client *client)
+{
+    struct umqtt_backlog *backlog = &(client->backlog);
+
+    if ((backlog->blocked == 0)
+     || (backlog->msgs > client->mqtt_info.wm_low_msgs)
+     || (backlog->bytes + umqtt_trans_pending(&(client->trans)) > client->mqtt_info.wm_low_bytes))
+        return;
+
+    backlog->blocked = 0;
+    if (client->mqtt_info.on_writable)
+        client->mqtt_info.on_writable(client);
+}
+#endif /* PKG_UMQTT_USING_BACKPRESSURE */
+
+/* the exchange hands each transition to exactly one caller, readers see the new state once stored */
+static void set_connect_status(struct umqtt_client *client, enum umqtt_client_state status)
+{
+    enum umqtt_client_state _old = (enum umqtt_client_state)umqtt_atomic_exchange(&(client->connect_state), status);
+
+#ifdef PKG_UMQTT_USING_STATS
+    umqtt_stats_link(client, _old, status);
+#else
+    (void)_old;
+#endif
+    UMQTT_UPLINK_SCHEDULE(client);
+}
+
+static void set_uplink_recon_tick(struct umqtt_client *client, enum tick_item item)
+{
+    RT_ASSERT(client);
+    switch (item)
+    {
+    case UPLINK_LAST_TICK:
+        UMQTT_TICK_SET(client, uplink_last_tick, rt_tick_get());
+        break;
+    case UPLINK_NEXT_TICK:
+        UMQTT_TICK_SET(client, uplink_next_tick, UMQTT_KP_INTERVAL(client) * 1000 + rt_tick_get());
+        break;
+    case RECON_LAST_TICK:
+        UMQTT_TICK_SET(client, reconnect_last_tick, rt_tick_get());
+        break;
+    case RECON_NEXT_TICK:
+        UMQTT_TICK_SET(client, reconnect_next_tick, client->mqtt_info.reconnect_interval * 1000 + rt_tick_get());
+        break;
+    default:
+        LOG_W(" set tick item outof set! value: %d", item);
+        break;
+    }
+};
+
+static int umqtt_connect(struct umqtt_client *client, int block)
+{
+    int _ret = 0, _cnt = 0;
+    struct umqtt_msg encode_msg = { 0 };
+    RT_ASSERT(client);
+
+_reconnect:
+    client->reconnect_count++;
+    if (client->reconnect_count > client->mqtt_info.reconnect_max_num)
+    {
+        _ret = UMQTT_RECONNECT_FAILED;
+        client->reconnect_count = 0;
+        LOG_E(" reconnect failed!");
+        goto exit;
+    }
+    _ret = umqtt_trans_connect(&(client->trans), client->mqtt_info.uri);
     if (_ret < 0)
     {
-        _ret = UMQTT_SEND_FAILED;
+        _ret = UMQTT_SOCK_CONNECT_FAILED;
+        LOG_E(" umqtt connect, transport connect failed!");
+        goto disconnect;
+    }
+
+    encode_msg.msg.connect.protocol_name_len = PKG_UMQTT_PROTOCOL_NAME_LEN;
+    encode_msg.msg.connect.protocol_name = PKG_UMQTT_PROTOCOL_NAME;
+    encode_msg.msg.connect.protocol_level = PKG_UMQTT_PROTOCOL_LEVEL;
+    encode_msg.msg.connect.connect_flags.connect_sign = UMQTT_DEF_CONNECT_FLAGS;
+#ifdef PKG_UMQTT_TEST_SHORT_KEEPALIVE_TIME
+    encode_msg.msg.connect.keepalive_interval_sec = ((client->mqtt_info.connect_keepalive_sec == 0) ? PKG_UMQTT_CONNECT_KEEPALIVE_DEF_TIME : client->mqtt_info.connect_keepalive_sec);
+#else
+    encode_msg.msg.connect.keepalive_interval_sec = PKG_UMQTT_CONNECT_KEEPALIVE_DEF_TIME;
+#endif
+    encode_msg.msg.connect.client_id = client->mqtt_info.client_id;
+    encode_msg.msg.connect.will_topic = client->mqtt_info.lwt_topic;
+    encode_msg.msg.connect.will_message = client->mqtt_info.lwt_message;
+    encode_msg.msg.connect.user_name = client->mqtt_info.user_name;
+    if (client->mqtt_info.user_name)
+    {
+        encode_msg.msg.connect.connect_flags.bits.username_flag = 1;
+    }
+    encode_msg.msg.connect.password = client->mqtt_info.password;
+    if (client->mqtt_info.password) {
+        encode_msg.msg.connect.connect_flags.bits.password_flag = 1;
+        encode_msg.msg.connect.password_len = rt_strlen(client->mqtt_info.password);
+    }
+
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+    umqtt_lane_discard(client->lane);                           /* acks of the lost link */
+#endif
+    _ret = umqtt_send_msg(client, UMQTT_PRIO_CONTROL, UMQTT_TYPE_CONNECT, &encode_msg);
+    if (_ret == UMQTT_ENCODE_ERROR)
+    {
+        LOG_E(" connect encode failed!");
+        goto exit;
+    }
+    else if ((_ret < 0) && (client->trans.tfo_sta != UMQTT_TFO_OFF))
+    {
+        /* with fast open the SYN leaves on this send, a refused connect shows up here */
+        _ret = UMQTT_SOCK_CONNECT_FAILED;
+        LOG_E(" connect trans send failed, fast open connect failed!");
+        goto disconnect;
+    }
+    else if (_ret < 0)
+    {
         LOG_E(" connect trans send failed! errno:0x%04x", errno);
         goto exit;
     }
@@ -469,7 +1321,7 @@ _reconnect:
             }
             else
             {
-                if (client->connect_state == UMQTT_CS_LINKED)
+                if (UMQTT_CLIENT_STA(client) == UMQTT_CS_LINKED)
                 {
                     _cnt = 0;
                     _ret = UMQTT_OK;
@@ -487,8 +1339,7 @@ disconnect:
     if ((_ret == UMQTT_FIN_ACK) || (_ret == UMQTT_SOCK_CONNECT_FAILED))
     {
         _ret = UMQTT_FIN_ACK;
-        umqtt_trans_disconnect(client->sock);
-        client->sock = -1;
+        umqtt_trans_disconnect(&(client->trans));
         rt_thread_delay(RT_TICK_PER_SECOND * 5);
         LOG_E(" server send fin ack, need to reconnect!");
         goto _reconnect;
@@ -505,23 +1356,17 @@ exit:
 
 static int umqtt_disconnect(struct umqtt_client *client)
 {
-    int _ret = 0, _length = 0;
+    int _ret = 0;
     RT_ASSERT(client);
 
-    _length = umqtt_encode(UMQTT_TYPE_DISCONNECT, client->send_buf, client->mqtt_info.send_size, RT_NULL);
-    if (_length < 0)
+    _ret = umqtt_send_msg(client, UMQTT_PRIO_CONTROL, UMQTT_TYPE_DISCONNECT, RT_NULL);
+    if (_ret == UMQTT_ENCODE_ERROR)
     {
-        _ret = UMQTT_ENCODE_ERROR;
         LOG_E(" disconnect encode failed!");
         goto exit;
     }
-    client->send_len = _length;
-
-    _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len,
-                            client->mqtt_info.send_timeout);
-    if (_ret < 0)
+    else if (_ret < 0)
     {
-        _ret = UMQTT_SEND_FAILED;
         LOG_E(" disconnect trans send failed!");
         goto exit;
     }
@@ -559,8 +1404,154 @@ static rt_uint8_t topicname_is_matched(char *topic_filter, char *topic_name, int
         cur_n++;
     };
 
-    return ((cur_n == cur_n_end) && (*cur_f == '\0'));
+    return ((cur_n == cur_n_end) && (*cur_f == '\0'));
+}
+
+#ifdef PKG_UMQTT_USING_CB_WATCHDOG
+/**
+ * account one subscribe callback run; callbacks run on the receive thread,
+ * so a run over the budget delays reading, acks and keepalive.
+ *
+ * @param client the input, umqtt client
+ * @param p_subtop the input, subscription whose callback just returned
+ * @param start the input, PKG_UMQTT_CB_CLOCK() before the callback
+ */
+static void umqtt_cb_watchdog(struct umqtt_client *client, struct subtop_recv_handler *p_subtop, rt_uint32_t start)
+{
+    rt_uint32_t _us = (rt_uint32_t)(((rt_uint64_t)(rt_uint32_t)(PKG_UMQTT_CB_CLOCK() - start) * 1000000)
+                                    / PKG_UMQTT_CB_CLOCK_HZ);
+    rt_uint32_t _budget = client->mqtt_info.cb_budget_ms;
+    rt_base_t level;
+
+    /* dispatch workers and queue consumers run callbacks of one subscription concurrently */
+    level = rt_hw_interrupt_disable();
+    p_subtop->cb_total_us += _us;
+    rt_hw_interrupt_enable(level);
+    umqtt_atomic_max(&(p_subtop->cb_max_us), _us);
+
+    if (_budget == 0)
+        _budget = PKG_UMQTT_CB_BUDGET_DEF_MS;
+    if (_us > _budget * 1000)
+    {
+        umqtt_atomic_add(&(p_subtop->cb_overruns), 1);
+        LOG_W(" subscribe callback of %s ran %d uSec, over budget %d mSec!", p_subtop->topicfilter, _us, _budget);
+        if (client->mqtt_info.cb_overrun_hook)
+            client->mqtt_info.cb_overrun_hook(client, p_subtop->topicfilter, _us);
+    }
+}
+#endif /* PKG_UMQTT_USING_CB_WATCHDOG */
+
+/* run one subscription callback, accounting its deliveries and run time */
+static void umqtt_run_callback(struct umqtt_client *client, struct subtop_recv_handler *p_subtop,
+                               struct umqtt_pkgs_publish *msg)
+{
+#ifdef PKG_UMQTT_USING_CB_WATCHDOG
+    rt_uint32_t _start = 0;
+#endif
+
+    if (p_subtop->callback == RT_NULL)
+        return;
+
+#ifdef UMQTT_USING_SUB_STATS
+    umqtt_atomic_add(&(p_subtop->deliver_cnt), 1);
+#endif
+#ifdef PKG_UMQTT_USING_CB_WATCHDOG
+    _start = PKG_UMQTT_CB_CLOCK();
+    p_subtop->callback(client, msg);
+    umqtt_cb_watchdog(client, p_subtop, _start);
+#else
+    p_subtop->callback(client, msg);
+#endif
+}
+
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+/*
+ * subscription queue consumer side of umqtt_deliver_subscribers, the callback
+ * runs with the subscription marked busy like the walk does; a callback that
+ * unsubscribes its own topic leaves the free to this thread, which stops the
+ * queue and lets it release itself once this returns
+ */
+static void umqtt_sub_queue_deliver_cb(void *client, void *sub, struct umqtt_pkgs_publish *msg)
+{
+    struct umqtt_client *mqtt_client = (struct umqtt_client *)client;
+    struct subtop_recv_handler *p_subtop = (struct subtop_recv_handler *)sub;
+    int _dead = 0;
+
+    UMQTT_CLIENT_LOCK(mqtt_client);
+    if (p_subtop->removed)                                      /* unsubscribed with messages still queued */
+    {
+        UMQTT_CLIENT_UNLOCK(mqtt_client);
+        return;
+    }
+    p_subtop->busy++;
+    UMQTT_CLIENT_UNLOCK(mqtt_client);
+
+    umqtt_run_callback(mqtt_client, p_subtop, msg);
+
+    UMQTT_CLIENT_LOCK(mqtt_client);
+    _dead = umqtt_sub_unpin(p_subtop);
+    UMQTT_CLIENT_UNLOCK(mqtt_client);
+    if (_dead)
+        umqtt_sub_free(mqtt_client, p_subtop);
+}
+#endif
+
+/**
+ * run or queue the callbacks of the subscriptions matching the topic; the
+ * list is walked under lock_client, each callback runs unlocked with its
+ * subscription marked busy, so an unsubscribe meanwhile leaves it to this
+ * walk to free.
+ */
+static void umqtt_deliver_subscribers(struct umqtt_client *client,
+                                const char *topic_name, int len,
+                                struct umqtt_pkgs_publish *msg)
+{
+    struct subtop_recv_handler *p_subtop = RT_NULL;
+    rt_list_t *node = RT_NULL, *next = RT_NULL;
+    rt_list_t dead;
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+    struct umqtt_sub_queue *queue = RT_NULL;
+#endif
+
+    rt_list_init(&dead);
+    UMQTT_CLIENT_LOCK(client);
+    for (node = client->sub_recv_list.next; node != &(client->sub_recv_list); node = next)
+    {
+        p_subtop = rt_list_entry(node, struct subtop_recv_handler, next_list);
+        next = node->next;
+        if ((p_subtop->removed) || (p_subtop->topicfilter == RT_NULL)
+         || (!topicname_is_matched(p_subtop->topicfilter, (char *)topic_name, len)))
+            continue;
+
+        p_subtop->busy++;
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+        queue = p_subtop->queue;
+#endif
+        UMQTT_CLIENT_UNLOCK(client);
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+        if (queue != RT_NULL)
+            umqtt_sub_queue_post(queue, msg);
+        else
+            umqtt_run_callback(client, p_subtop, msg);
+#else
+        umqtt_run_callback(client, p_subtop, msg);
+#endif
+        UMQTT_CLIENT_LOCK(client);
+        next = node->next;                                      /* busy kept the node linked, its neighbours may have changed */
+        if (umqtt_sub_unpin(p_subtop))
+            rt_list_insert_after(&dead, node);
+    }
+    UMQTT_CLIENT_UNLOCK(client);
+    umqtt_sub_free_list(client, &dead);
+}
+
+#ifdef PKG_UMQTT_USING_DISPATCH
+/* worker pool side of umqtt_deliver_message */
+static void umqtt_dispatch_deliver_cb(void *ctx, struct umqtt_pkgs_publish *msg)
+{
+    umqtt_deliver_subscribers((struct umqtt_client *)ctx, msg->topic_name, msg->topic_name_len, msg);
 }
+#endif
 
 static void umqtt_deliver_message(struct umqtt_client *client,
                                 const char *topic_name, int len,
@@ -570,20 +1561,17 @@ static void umqtt_deliver_message(struct umqtt_client *client,
     RT_ASSERT(topic_name);
     RT_ASSERT(msg);
 
-    struct subtop_recv_handler *p_subtop = RT_NULL;
-    rt_list_t *node = RT_NULL;
-    rt_list_for_each(node, &client->sub_recv_list)
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+    umqtt_topic_table_account(client->topic_stats, topic_name, len, msg->payload_len, 0);
+#endif
+#ifdef PKG_UMQTT_USING_DISPATCH
+    if (client->dispatch != RT_NULL)
     {
-        p_subtop = rt_list_entry(node, struct subtop_recv_handler, next_list);
-        if ((p_subtop->topicfilter)
-         && (topicname_is_matched(p_subtop->topicfilter, (char *)topic_name, len)))
-        {
-            if (p_subtop->callback != RT_NULL)
-            {
-                p_subtop->callback(client, msg);
-            }
-        }
+        umqtt_dispatch_post(client->dispatch, msg);
+        return;
     }
+#endif
+    umqtt_deliver_subscribers(client, topic_name, len, msg);
 }
 
 static int umqtt_readpacket(struct umqtt_client *client, unsigned char *buf, int len, int timeout)
@@ -602,7 +1590,7 @@ static int umqtt_readpacket(struct umqtt_client *client, unsigned char *buf, int
 
     while (bytes < len)
     {
-        _ret = umqtt_trans_recv(client->sock, &buf[bytes], (size_t)(len - bytes));
+        _ret = umqtt_trans_recv(&(client->trans), &buf[bytes], (size_t)(len - bytes));
         if (_ret == -1)
         {
             if (!(errno == EINTR || errno == EWOULDBLOCK || errno == EAGAIN))
@@ -636,6 +1624,83 @@ exit:
     return _ret;
 }
 
+#ifdef PKG_UMQTT_USING_MSG_RETAIN
+/* a retained message still lives in the receive buffer, read into a fresh one */
+static int umqtt_recv_buf_rotate(struct umqtt_client *client)
+{
+    struct umqtt_pkgs_publish *fresh = RT_NULL;
+
+    if (!umqtt_msg_is_shared(client->recv_msg))
+        return UMQTT_OK;
+
+    fresh = umqtt_msg_pool_get(client->recv_pool);
+    if (fresh == RT_NULL)
+    {
+        LOG_W(" receive buffer malloc failed! wait for retained messages to be released!");
+        rt_thread_mdelay(10);
+        return UMQTT_MEM_FULL;
+    }
+    umqtt_msg_release(client->recv_msg);
+    client->recv_msg = fresh;
+    client->recv_buf = (rt_uint8_t *)(fresh + 1);
+    return UMQTT_OK;
+}
+#endif
+
+#ifdef PKG_UMQTT_USING_BUF_POOL
+/* read and drop len bytes of a frame that has no buffer */
+static void umqtt_recv_discard(struct umqtt_client *client, int len)
+{
+    rt_uint8_t _chunk[32];
+    int _len = 0;
+
+    while (len > 0)
+    {
+        _len = (len > sizeof(_chunk)) ? sizeof(_chunk) : len;
+        if (umqtt_readpacket(client, _chunk, _len, client->mqtt_info.recv_time_ms) != UMQTT_OK)
+            break;
+        len -= _len;
+    }
+}
+
+/**
+ * borrow the receive buffer of one frame once its length is known, the fixed
+ * header read so far is moved into it; a frame over recv_size gets recv_size
+ * bytes, enough to read it through and drop it. Acks and PINGRESP fit in
+ * recv_hdr and never touch the pool, other frames borrow without waiting so
+ * a drained pool never stalls the receive thread.
+ *
+ * @param client the input, umqtt client
+ * @param hdr_len the input, fixed header bytes read
+ * @param pkt_len the input, remaining length
+ *
+ * @return UMQTT_MEM_FULL: over the pool budget, the frame was dropped
+ *         UMQTT_OK: client->recv_buf holds the header
+ */
+static int umqtt_recv_buf_borrow(struct umqtt_client *client, int hdr_len, int pkt_len)
+{
+    rt_uint8_t *buf = RT_NULL;
+    rt_uint32_t _len = hdr_len + pkt_len;
+
+    if (_len <= sizeof(client->recv_hdr))
+        return UMQTT_OK;
+    if (_len > client->mqtt_info.recv_size)
+        _len = client->mqtt_info.recv_size;
+    buf = umqtt_buf_get(&(client->buf_user), _len, 0);
+    if (buf == RT_NULL)
+    {
+        LOG_W(" receive buffer is over the pool budget! drop frame(%d)!", hdr_len + pkt_len);
+        umqtt_recv_discard(client, pkt_len);
+        UMQTT_STATS_INC(client, rx_drops);
+        return UMQTT_MEM_FULL;
+    }
+    UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_RECV_BUF, _len);
+    rt_memcpy(buf, client->recv_hdr, hdr_len);
+    client->recv_buf = buf;
+    return UMQTT_OK;
+}
+#endif
+
 static int umqtt_handle_readpacket(struct umqtt_client *client)
 {
     int _ret = 0, _onedata = 0, _cnt = 0, _loop_cnt = 0;// _remain_len = 0;
@@ -643,19 +1708,25 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
     int _pkt_len = 0;
     int _multiplier = 1;
     int _pkt_type = 0;
-    struct umqtt_msg decode_msg = { 0 };
-    struct umqtt_msg_ack msg_ack = { 0 };
-    struct umqtt_msg encode_msg = { 0 };
+    struct umqtt_msg decode_msg;
+    struct umqtt_msg_ack msg_ack;
+    rt_uint8_t _ack_type = 0;
     RT_ASSERT(client);
 
+#ifdef PKG_UMQTT_USING_MSG_RETAIN
+    if ((_ret = umqtt_recv_buf_rotate(client)) < 0)
+        goto exit;
+#endif
+
     /* 1. read the heade type */
-    _temp_ret = umqtt_trans_recv(client->sock, client->recv_buf, 1);
+    _temp_ret = umqtt_trans_recv(&(client->trans), client->recv_buf, 1);
     if (_temp_ret <= 0)
     {
         _ret = UMQTT_FIN_ACK;
         LOG_W(" server fin ack! connect failed! need to reconnect!");
         goto exit;
     }
+    UMQTT_TRACE(UMQTT_TRACE_READ_HEADER, client->recv_buf[0] >> 4, 0, 1);
 
     /* 2. read length */
     do {
@@ -681,6 +1752,11 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
         _multiplier *= 0x80;
     } while ((_onedata & 0x80) != 0);
 
+#ifdef PKG_UMQTT_USING_BUF_POOL
+    if ((_ret = umqtt_recv_buf_borrow(client, _cnt + 1, _pkt_len)) < 0)
+        goto exit;
+#endif
+
     /* read and delete if the data length is greater than the cache buff */
     if ((_pkt_len + 1 + _cnt) > client->mqtt_info.recv_size)
     {
@@ -693,6 +1769,7 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
             {
                 umqtt_readpacket(client, client->recv_buf, _pkt_len, client->mqtt_info.recv_time_ms);
                 _ret = UMQTT_BUFFER_TOO_SHORT;
+                UMQTT_STATS_INC(client, rx_drops);
                 LOG_W(" finish read and delete socket buff!");
                 goto exit;
             }
@@ -718,6 +1795,8 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
         LOG_E(" read remain datas error!");
         goto exit;
     }
+    umqtt_stats_count(client, 0, client->recv_buf[0], _pkt_len + _cnt + 1);
+    UMQTT_TRACE(UMQTT_TRACE_READ_BODY, client->recv_buf[0] >> 4, 0, _pkt_len + _cnt + 1);
 
     /* 4. encode packet datas */
     rt_memset(&decode_msg, 0, sizeof(decode_msg));
@@ -729,13 +1808,23 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
         goto exit;
     }
     _pkt_type = decode_msg.header.bits.type;
+    UMQTT_TRACE(UMQTT_TRACE_DECODE, _pkt_type,
+                (_pkt_type == UMQTT_TYPE_PUBLISH) ? decode_msg.msg.publish.packet_id :
+                (((_pkt_type >= UMQTT_TYPE_PUBACK) && (_pkt_type <= UMQTT_TYPE_UNSUBACK)) ? decode_msg.msg.puback.packet_id : 0),
+                _pkt_len + _cnt + 1);
     switch (_pkt_type)
     {
     case UMQTT_TYPE_CONNACK:
         {
             LOG_D(" read connack cmd information!");
+            umqtt_trans_fastopen_check(&(client->trans));
+            umqtt_atomic_store(&(client->ping_pending), 0);
             set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
             set_connect_status(client, UMQTT_CS_LINKED);
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+            umqtt_backlog_reset(client);
+            umqtt_backlog_check(client);
+#endif
         }
         break;
     case UMQTT_TYPE_PUBLISH:
@@ -746,54 +1835,58 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
             if (decode_msg.header.bits.qos != UMQTT_QOS2)
             {
                 LOG_D(" qos: %d, deliver message! topic nme: %s ", decode_msg.header.bits.qos, decode_msg.msg.publish.topic_name);
+                UMQTT_TRACE(UMQTT_TRACE_DISPATCH, UMQTT_TYPE_PUBLISH, decode_msg.msg.publish.packet_id,
+                            decode_msg.msg.publish.payload_len);
+#ifdef PKG_UMQTT_USING_MSG_RETAIN
+                *(client->recv_msg) = decode_msg.msg.publish;       /* retainable, lives with recv_buf */
+                umqtt_deliver_message(client, decode_msg.msg.publish.topic_name, decode_msg.msg.publish.topic_name_len,
+                                    client->recv_msg);
+#else
                 umqtt_deliver_message(client, decode_msg.msg.publish.topic_name, decode_msg.msg.publish.topic_name_len,
                                     &(decode_msg.msg.publish));
+#endif
             }
 
             if (decode_msg.header.bits.qos != UMQTT_QOS0)
             {
-                rt_memset(&encode_msg, 0, sizeof(encode_msg));
-                encode_msg.header.bits.qos = decode_msg.header.bits.qos;
-                encode_msg.header.bits.dup = decode_msg.header.bits.dup;
                 if (decode_msg.header.bits.qos == UMQTT_QOS1)
                 {
-                    encode_msg.header.bits.type = UMQTT_TYPE_PUBACK;
-                    encode_msg.msg.puback.packet_id = decode_msg.msg.publish.packet_id;
+                    _ack_type = UMQTT_TYPE_PUBACK;
                 }
-                else if (decode_msg.header.bits.qos == UMQTT_QOS2)
+                else
                 {
-                    encode_msg.header.bits.type = UMQTT_TYPE_PUBREC;
+                    _ack_type = UMQTT_TYPE_PUBREC;
                     add_one_qos2_msg(client, &(decode_msg.msg.publish));
-                    encode_msg.msg.pubrel.packet_id = decode_msg.msg.publish.packet_id;
-                    add_one_pubrec_msg(client, encode_msg.msg.pubrel.packet_id);        /* add pubrec message */
+                    add_one_pubrec_msg(client, decode_msg.msg.publish.packet_id);      /* add pubrec message */
                 }
 
-                _ret = umqtt_encode(encode_msg.header.bits.type, client->send_buf, client->mqtt_info.send_size,
-                                    &encode_msg);
-                if (_ret < 0)
+                _ret = umqtt_send_control(client, _ack_type, decode_msg.msg.publish.packet_id,
+                                          client->mqtt_info.send_timeout * 1000);
+                if (_ret == UMQTT_ENCODE_ERROR)
                 {
-                    _ret = UMQTT_ENCODE_ERROR;
                     LOG_E(" puback / pubrec failed!");
                     goto exit;
                 }
-                client->send_len = _ret;
-
-                _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len,
-                                        client->mqtt_info.send_timeout);
-                if (_ret < 0)
+                else if (_ret < 0)
                 {
-                    _ret = UMQTT_SEND_FAILED;
                     LOG_E(" trans send failed!");
                     goto exit;
                 }
-
+                UMQTT_TRACE(UMQTT_TRACE_ACK_SENT, _ack_type, decode_msg.msg.publish.packet_id, UMQTT_CTRL_FRAME_MAX);
             }
         }
         break;
     case UMQTT_TYPE_PUBACK:
         {
             LOG_D(" read puback cmd information!");
-            rt_memset(&msg_ack, 0, sizeof(msg_ack));
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+            if (umqtt_backlog_ack(client, decode_msg.msg.puback.packet_id))
+            {
+                set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
+                umqtt_backlog_check(client);
+                break;                                          /* async publish, nobody waits for it */
+            }
+#endif
             msg_ack.msg_type = UMQTT_TYPE_PUBACK;
             msg_ack.packet_id = decode_msg.msg.puback.packet_id;
             _ret = rt_mq_send(client->msg_queue, &msg_ack, sizeof(struct umqtt_msg_ack));
@@ -809,7 +1902,21 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
     case UMQTT_TYPE_PUBREC:
         {
             LOG_D(" read pubrec cmd information!");
-            rt_memset(&msg_ack, 0, sizeof(msg_ack));
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+            if (umqtt_backlog_rec(client, decode_msg.msg.pubrec.packet_id))
+            {
+                set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
+                umqtt_backlog_check(client);
+                _ret = umqtt_send_control(client, UMQTT_TYPE_PUBREL, decode_msg.msg.pubrec.packet_id,
+                                          client->mqtt_info.send_timeout * 1000);
+                if (_ret < 0)
+                {
+                    LOG_E(" async publish pubrel failed!");
+                    goto exit;
+                }
+                break;                                          /* async publish, done at PUBCOMP */
+            }
+#endif
             msg_ack.msg_type = UMQTT_TYPE_PUBREC;
             msg_ack.packet_id = decode_msg.msg.puback.packet_id;
             _ret = rt_mq_send(client->msg_queue, &msg_ack, sizeof(struct umqtt_msg_ack));
@@ -826,43 +1933,39 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
         {
             LOG_D(" read pubrel cmd information!");
 
-            rt_memset(&encode_msg, 0, sizeof(encode_msg));
-            encode_msg.header.bits.type = UMQTT_TYPE_PUBCOMP;
-            encode_msg.header.bits.qos = decode_msg.header.bits.qos;
-            encode_msg.header.bits.dup = decode_msg.header.bits.dup;
-            encode_msg.msg.pubrel.packet_id = decode_msg.msg.pubrec.packet_id;
-
             /* publish callback, and delete callback */
-            qos2_publish_delete(client, encode_msg.msg.pubrel.packet_id);
+            qos2_publish_delete(client, decode_msg.msg.pubrel.packet_id);
 
             /* delete array numbers! */
-            clear_one_pubrec_msg(client, encode_msg.msg.pubrel.packet_id);
+            clear_one_pubrec_msg(client, decode_msg.msg.pubrel.packet_id);
 
-            _ret = umqtt_encode(UMQTT_TYPE_PUBCOMP, client->send_buf, client->mqtt_info.send_size, &encode_msg);
-            if (_ret < 0)
+            _ret = umqtt_send_control(client, UMQTT_TYPE_PUBCOMP, decode_msg.msg.pubrel.packet_id,
+                                      client->mqtt_info.send_timeout * 1000);
+            if (_ret == UMQTT_ENCODE_ERROR)
             {
-                _ret = UMQTT_ENCODE_ERROR;
                 LOG_E(" pubcomp failed!");
                 goto exit;
             }
-            client->send_len = _ret;
-
-            _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len,
-                                    client->mqtt_info.send_timeout);
-            if (_ret < 0)
+            else if (_ret < 0)
             {
-                _ret = UMQTT_SEND_FAILED;
                 LOG_E(" trans send failed!");
                 goto exit;
             }
-
+            UMQTT_TRACE(UMQTT_TRACE_ACK_SENT, UMQTT_TYPE_PUBCOMP, decode_msg.msg.pubrel.packet_id, UMQTT_CTRL_FRAME_MAX);
         }
         break;
     case UMQTT_TYPE_PUBCOMP:
         {
             LOG_D(" read pubcomp cmd information!");
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+            if (umqtt_backlog_ack(client, decode_msg.msg.pubcomp.packet_id))
+            {
+                set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
+                umqtt_backlog_check(client);
+                break;                                          /* async publish, nobody waits for it */
+            }
+#endif
 
-            rt_memset(&msg_ack, 0, sizeof(msg_ack));
             msg_ack.msg_type = UMQTT_TYPE_PUBCOMP;
             msg_ack.packet_id = decode_msg.msg.pubcomp.packet_id;
             _ret = rt_mq_send(client->msg_queue, &msg_ack, sizeof(struct umqtt_msg_ack));
@@ -877,7 +1980,6 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
         {
             LOG_D(" read suback cmd information!");
 
-            rt_memset(&msg_ack, 0, sizeof(msg_ack));
             msg_ack.msg_type = UMQTT_TYPE_SUBACK;
             msg_ack.packet_id = decode_msg.msg.suback.packet_id;
 
@@ -895,7 +1997,6 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
         {
             LOG_D(" read unsuback cmd information!");
 
-            rt_memset(&msg_ack, 0, sizeof(msg_ack));
             msg_ack.msg_type = UMQTT_TYPE_UNSUBACK;
             msg_ack.packet_id = decode_msg.msg.unsuback.packet_id;
 
@@ -913,6 +2014,18 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
     case UMQTT_TYPE_PINGRESP:
         {
             LOG_I(" ping resp! broker -> client! now tick: %d ", rt_tick_get());
+#ifdef PKG_UMQTT_USING_STATS
+            if (umqtt_atomic_load(&(client->stats.ping_tick)) != 0)
+            {
+                umqtt_stats_rtt(client->stats.ping_rtt, umqtt_atomic_load(&(client->stats.ping_tick)));
+                umqtt_atomic_store(&(client->stats.ping_tick), 0);
+            }
+#endif
+#ifdef PKG_UMQTT_USING_KP_ADAPT
+            umqtt_kp_adapt_update(client, 1);
+#endif
+            umqtt_atomic_store(&(client->ping_pending), 0);
+            umqtt_atomic_store(&(client->keepalive_count), 0);
             set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
         }
         break;
@@ -924,10 +2037,98 @@ static int umqtt_handle_readpacket(struct umqtt_client *client)
     }
 
 exit:
+#ifdef PKG_UMQTT_USING_BUF_POOL
+    if (client->recv_buf != client->recv_hdr)                   /* the frame is dispatched, give the buffer back */
+    {
+        UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_RECV_BUF, -(int)client->mem.cur[UMQTT_MEM_TAG_RECV_BUF]);   /* one frame at a time */
+        umqtt_buf_put(&(client->buf_user), client->recv_buf);
+        client->recv_buf = client->recv_hdr;
+    }
+#endif
     return _ret;
 }
 
 
+#ifdef PKG_UMQTT_USING_PUB_RING
+/**
+ * send the publishes queued by umqtt_publish_enqueue, a batch of frames per
+ * transport write, gathered from the slots on a backend with a vectored send;
+ * runs on the receive thread, the only ring consumer, and holds the bulk lane
+ * so a batch never interleaves with a user packet. An unlinked client or a
+ * busy transport leaves them queued for the next pass, a write broken off mid
+ * batch drops the batch and the link.
+ *
+ * @param client the input, umqtt client
+ */
+static void umqtt_pub_ring_flush(struct umqtt_client *client)
+{
+    const rt_uint8_t *buf = RT_NULL;
+    struct umqtt_iovec iov[UMQTT_TRANS_IOV_MAX];
+    int _ret = 0, _len = 0, _frames = 0, _gather = 0;
+
+    if ((UMQTT_CLIENT_STA(client) != UMQTT_CS_LINKED) || umqtt_pub_ring_empty(client->pub_ring))
+        return;
+    if (umqtt_lane_enter(client, UMQTT_PRIO_BULK, 0) < 0)
+        return;
+
+    /* a vectored send takes the frames from their slots, otherwise they are copied into one write */
+    _gather = umqtt_trans_gathers(&(client->trans));
+    while (umqtt_trans_poll(&(client->trans), UMQTT_TRANS_POLLOUT, 0) > 0)
+    {
+        if (_gather)
+            _len = umqtt_pub_ring_gather(client->pub_ring, iov, &_frames);
+        else
+            _len = umqtt_pub_ring_batch(client->pub_ring, &buf, &_frames);
+        if (_len <= 0)
+            break;
+
+        if (_gather)
+            _ret = umqtt_trans_sendv(&(client->trans), iov, _frames, client->mqtt_info.send_timeout * 1000);
+        else
+            _ret = umqtt_trans_send(&(client->trans), buf, _len, client->mqtt_info.send_timeout * 1000);
+        if (_ret == UMQTT_SEND_TIMEOUT)
+            break;                                              /* nothing went out, the batch stays queued */
+        umqtt_pub_ring_consume(client->pub_ring, (_ret >= 0));
+        if (_ret < 0)
+        {
+            LOG_W(" publish ring write failed! drop %d messages!", _frames);
+            umqtt_send_broken(client);
+            break;
+        }
+        UMQTT_TICK_SET(client, tx_last_tick, rt_tick_get());
+        UMQTT_STATS_ADD(client, tx_pkts[UMQTT_TYPE_PUBLISH], _frames);
+        UMQTT_STATS_ADD(client, tx_bytes[UMQTT_TYPE_PUBLISH], _len);
+    }
+    UMQTT_LANE_RELEASE(client);
+}
+
+/* wake the receive thread once the ring turns non-empty under its wait, producer side */
+static void umqtt_pub_ring_signal(struct umqtt_client *client)
+{
+    if (umqtt_atomic_exchange(&(client->ring_idle), 0))
+        umqtt_trans_wake(&(client->trans));
+}
+
+/* drain the ring, then wait for the next frame until the receive timeout; a
+   commit into the drained ring ends the wait. A backend that cannot be woken,
+   or frames left queued by a busy link, fall back to PKG_UMQTT_PUB_RING_FLUSH_MS slices */
+static void umqtt_pub_ring_wait(struct umqtt_client *client)
+{
+    int _timeout = 0;
+
+    do
+    {
+        umqtt_pub_ring_flush(client);
+        umqtt_atomic_store(&(client->ring_idle), 1);            /* set before the check, a later commit sees it */
+        if (umqtt_pub_ring_empty(client->pub_ring) && umqtt_trans_wakeable(&(client->trans)))
+            _timeout = client->mqtt_info.recv_time_ms;
+        else
+            _timeout = PKG_UMQTT_PUB_RING_FLUSH_MS;
+    } while (umqtt_trans_poll(&(client->trans), UMQTT_TRANS_POLLIN, _timeout) == 0);
+    umqtt_atomic_store(&(client->ring_idle), 0);
+}
+#endif /* PKG_UMQTT_USING_PUB_RING */
+
 static void umqtt_thread(void *params)
 {
     int _ret = 0;
@@ -936,14 +2137,16 @@ static void umqtt_thread(void *params)
 
     while (1) {
 
+#ifdef PKG_UMQTT_USING_PUB_RING
+        umqtt_pub_ring_wait(client);                            /* returns once a frame or an error is readable */
+#endif
         _ret = umqtt_handle_readpacket(client);
         if (_ret == UMQTT_FIN_ACK)
         {
             LOG_W("reconnect start! stop timer -> trans disconnect delay 5000ms -> umqtt connect! ");
             rt_timer_stop(client->uplink_timer);
 
-            umqtt_trans_disconnect(client->sock);
-            client->sock = -1;
+            umqtt_trans_disconnect(&(client->trans));
             rt_thread_mdelay(5000);
 
             _ret = umqtt_connect(client, 1);
@@ -977,114 +2180,419 @@ static void umqtt_check_def_info(struct umqtt_info *info)
         if (info->send_timeout == 0) { info->send_timeout = PKG_UMQTT_INFO_DEF_SEND_TIMEOUT; }
         if (info->thread_stack_size == 0) { info->thread_stack_size = PKG_UMQTT_INFO_DEF_THREAD_STACK_SIZE; }
         if (info->thread_priority == 0) { info->thread_priority = PKG_UMQTT_INFO_DEF_THREAD_PRIORITY; }
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+        if (info->wm_high_bytes == 0) { info->wm_high_bytes = PKG_UMQTT_WM_HIGH_BYTES; }
+        if (info->wm_low_bytes == 0) { info->wm_low_bytes = PKG_UMQTT_WM_LOW_BYTES; }
+        if ((info->wm_high_msgs == 0) || (info->wm_high_msgs > PKG_UMQTT_INFLIGHT_MAX)) { info->wm_high_msgs = PKG_UMQTT_WM_HIGH_MSGS; }
+        if (info->wm_low_msgs == 0) { info->wm_low_msgs = PKG_UMQTT_WM_LOW_MSGS; }
+        if (info->inflight_expire_ms == 0) { info->inflight_expire_ms = PKG_UMQTT_INFLIGHT_EXPIRE_MS; }
+        if (info->wm_low_bytes >= info->wm_high_bytes) { info->wm_low_bytes = info->wm_high_bytes / 2; }
+        if (info->wm_low_msgs >= info->wm_high_msgs) { info->wm_low_msgs = info->wm_high_msgs / 2; }
+#endif
+#ifdef PKG_UMQTT_USING_BUF_POOL
+        if (info->buf_reserve == 0) { info->buf_reserve = PKG_UMQTT_BUF_POOL_RESERVE; }
+#endif
     }
 }
 
-static int umqtt_keepalive_callback(struct umqtt_client *client)
+/* PINGREQ from the timer context, a single non-blocking attempt */
+static void umqtt_send_pingreq(struct umqtt_client *client)
 {
-    int _ret = 0, _length = 0;
-    rt_uint32_t _connect_kp_time = 0;
-    RT_ASSERT(client);
+    if (umqtt_send_control(client, UMQTT_TYPE_PINGREQ, 0, 0) < 0)
+        return;
+
+#ifdef PKG_UMQTT_USING_STATS
+    umqtt_atomic_store(&(client->stats.ping_tick), (rt_tick_get() == 0) ? 1 : rt_tick_get());
+#endif
+}
+
+#ifdef PKG_UMQTT_USING_KP_ADAPT
+/**
+ * adapt the keepalive interval to the path: every answered PINGREQ sent after
+ * a kp_interval long idle proves the path keeps that much idle time, so the
+ * interval grows; the first unanswered one settles it on the longest answered
+ * interval, less a margin.
+ *
+ * @param client the input, umqtt client
+ * @param answered the input, 1: PINGRESP received, 0: keepalive failed
+ */
+static void umqtt_kp_adapt_update(struct umqtt_client *client, int answered)
+{
+    struct umqtt_kp_adapt *adapt = &(client->kp_adapt);
+    rt_uint32_t _limit = PKG_UMQTT_CONNECT_KEEPALIVE_DEF_TIME >> 1;   /* stay within the broker keepalive */
+    rt_uint32_t _kp = UMQTT_KP_INTERVAL(client);
+
+    if (adapt->probe == 0)
+        return;
+    adapt->probe = 0;
 
 #ifdef PKG_UMQTT_TEST_SHORT_KEEPALIVE_TIME
-    _connect_kp_time = (client->mqtt_info.connect_keepalive_sec == 0) ? (PKG_UMQTT_CONNECT_KEEPALIVE_DEF_TIME >> 1) : (client->mqtt_info.connect_keepalive_sec >> 1);
-#else
-    _connect_kp_time = PKG_UMQTT_CONNECT_KEEPALIVE_DEF_TIME >> 1;
+    if (client->mqtt_info.connect_keepalive_sec != 0)
+        _limit = client->mqtt_info.connect_keepalive_sec >> 1;
 #endif
+    if (_limit > PKG_UMQTT_KP_ADAPT_MAX)
+        _limit = PKG_UMQTT_KP_ADAPT_MAX;
 
-    if (client->connect_state == UMQTT_CS_LINKED)
+    if (answered)
     {
-        if (((client->uplink_next_tick <= rt_tick_get())
-          && (client->uplink_next_tick > client->uplink_last_tick))
-         || ((client->pingreq_last_tick + _connect_kp_time) < rt_tick_get()))
+        if (adapt->good < _kp)
+            adapt->good = _kp;
+        if ((adapt->settled == 0) && (_kp < _limit))
         {
-            _length = umqtt_encode(UMQTT_TYPE_PINGREQ, client->send_buf, 2, NULL);
-            if (_length == 2)
-                umqtt_trans_send(client->sock, client->send_buf, _length, 0);
+            _kp += PKG_UMQTT_KP_ADAPT_STEP;
+            if (_kp > _limit)
+                _kp = _limit;
+            umqtt_atomic_store(&(client->kp_interval), _kp);
+        }
+        return;
+    }
+
+    /* the path dropped the link while idle, settle below the failed interval */
+    if ((adapt->good != 0) && (adapt->good < _kp))
+        _kp = adapt->good;
+    _kp = _kp * (100 - PKG_UMQTT_KP_ADAPT_MARGIN) / 100;
+    if (_kp < client->mqtt_info.keepalive_interval)
+        _kp = client->mqtt_info.keepalive_interval;
+    umqtt_atomic_store(&(client->kp_interval), _kp);
+    adapt->good = 0;
+    adapt->settled = 1;
+    LOG_I(" keepalive interval settled: %d Sec", _kp);
+}
+#endif /* PKG_UMQTT_USING_KP_ADAPT */
+
+/* half the keepalive announced in CONNECT, the longest the client may stay silent, uint:tick */
+static rt_tick_t umqtt_connect_kp_tick(struct umqtt_client *client)
+{
+    rt_uint32_t _sec = PKG_UMQTT_CONNECT_KEEPALIVE_DEF_TIME;
+
+#ifdef PKG_UMQTT_TEST_SHORT_KEEPALIVE_TIME
+    if (client->mqtt_info.connect_keepalive_sec != 0)
+        _sec = client->mqtt_info.connect_keepalive_sec;
+#endif
+    return rt_tick_from_millisecond(_sec * 500);
+}
+
+/**
+ * send PINGREQ only after real idleness: when nothing was received nor sent
+ * for kp_interval, or when nothing was sent for half the keepalive announced
+ * in CONNECT, which the broker enforces; resend it while unanswered.
+ */
+static int umqtt_keepalive_callback(struct umqtt_client *client)
+{
+    int _ret = 0;
+    rt_tick_t _now = 0, _tx_idle = 0;
+    rt_tick_t _connect_kp_time = umqtt_connect_kp_tick(client);
+    RT_ASSERT(client);
+
+    if (UMQTT_CLIENT_STA(client) != UMQTT_CS_LINKED)
+        return _ret;
 
-            if (client->user_handler)
-                client->user_handler(client, UMQTT_EVT_HEARTBEAT);
+    _now = rt_tick_get();
+    _tx_idle = _now - UMQTT_TICK_GET(client, tx_last_tick);
+    if (umqtt_atomic_load(&(client->ping_pending)))
+    {
+        if ((_now - UMQTT_TICK_GET(client, pingreq_last_tick)) < rt_tick_from_millisecond(client->mqtt_info.send_timeout * 1000))
+            return _ret;
 
-            set_uplink_recon_tick(client, UPLINK_LAST_TICK);
-            client->pingreq_last_tick = rt_tick_get();
+        if (umqtt_atomic_add(&(client->keepalive_count), 1) + 1 >= client->mqtt_info.keepalive_max_num)
+        {
+#ifdef PKG_UMQTT_USING_KP_ADAPT
+            umqtt_kp_adapt_update(client, 0);
+#endif
+            umqtt_atomic_store(&(client->ping_pending), 0);
+            set_connect_status(client, UMQTT_CS_UNLINK);
+            return _ret;
         }
-        else if ((client->uplink_last_tick >= client->uplink_next_tick)
-              && ((client->uplink_last_tick + client->mqtt_info.send_timeout * 1000) < rt_tick_get()))
+    }
+    else if ((((rt_int32_t)(_now - UMQTT_TICK_GET(client, uplink_next_tick)) >= 0)
+           && (_tx_idle >= rt_tick_from_millisecond(UMQTT_KP_INTERVAL(client) * 1000)))
+          || (_tx_idle >= _connect_kp_time))
+    {
+#ifdef PKG_UMQTT_USING_KP_ADAPT
+        client->kp_adapt.probe = (_tx_idle < _connect_kp_time);
+#endif
+    }
+    else
+    {
+        return _ret;                                            /* traffic proves the link, no ping needed */
+    }
+
+    UMQTT_TICK_SET(client, pingreq_last_tick, _now);
+    umqtt_atomic_store(&(client->ping_pending), 1);             /* before the send, a fast PINGRESP clears it */
+    umqtt_send_pingreq(client);
+    set_uplink_recon_tick(client, UPLINK_LAST_TICK);
+
+    if (client->user_handler)
+        client->user_handler(client, UMQTT_EVT_HEARTBEAT);
+    return _ret;
+}
+
+static int umqtt_reconnect_callback(struct umqtt_client *client)
+{
+    int _ret = 0;
+    RT_ASSERT(client);
+
+    if (UMQTT_CLIENT_STA(client) == UMQTT_CS_UNLINK)
+    {
+        if (client->user_handler)
+            client->user_handler(client, UMQTT_EVT_OFFLINE);
+
+        set_connect_status(client, UMQTT_CS_UNLINK_LINKING);
+        umqtt_trans_disconnect(&(client->trans));
+
+    }
+    else if (UMQTT_CLIENT_STA(client) == UMQTT_CS_UNLINK_LINKING)
+    {
+        if (UMQTT_TICK_GET(client, reconnect_next_tick) <= rt_tick_get())
         {
-            if (++client->keepalive_count >=  client->mqtt_info.keepalive_max_num) {
-                set_connect_status(client, UMQTT_CS_UNLINK);
+            if (client->trans.sock < 0)
+            {
+                if (client->reconnect_count >= client->mqtt_info.reconnect_max_num)
+                {
+                    set_connect_status(client, UMQTT_CS_DISCONNECT);
+                    /* stop timer, delete task handle */
+                    if (client->task_handle)
+                    {
+                        UMQTT_OBJ_DELETE(thread, client->task_handle);
+                        client->task_handle = RT_NULL;
+                    }
+                    if (client->uplink_timer)
+                    {
+                        rt_timer_stop(client->uplink_timer);
+                    }
+                }
+                else
+                {
+                    umqtt_atomic_store(&(client->keepalive_count), 0);
+                    umqtt_atomic_store(&(client->ping_pending), 0);
+                    set_uplink_recon_tick(client, RECON_NEXT_TICK);
+                    umqtt_connect(client, 0);
+                    if (client->user_handler)
+                        client->user_handler(client, UMQTT_EVT_LINK);
+                }
             }
             else
             {
-                _length = umqtt_encode(UMQTT_TYPE_PINGREQ, client->send_buf, 2, NULL);
-                if (_length == 2)
-                    umqtt_trans_send(client->sock, client->send_buf, _length, 0);
-
-                if (client->user_handler)
-                    client->user_handler(client, UMQTT_EVT_HEARTBEAT);
-
-                set_uplink_recon_tick(client, UPLINK_LAST_TICK);
+                umqtt_trans_disconnect(&(client->trans));
             }
         }
+
     }
+
     return _ret;
 }
 
-static int umqtt_reconnect_callback(struct umqtt_client *client)
-{
-    int _ret = 0;
-    RT_ASSERT(client);
+#ifdef PKG_UMQTT_USING_HEALTH
+/* lay the PUBLISH variable header out once, right before the payload area */
+static int umqtt_health_init(struct umqtt_client *client)
+{
+    struct umqtt_health *health = &(client->health);
+    const char *topic = client->mqtt_info.health_topic;
+    rt_uint8_t *ptr = RT_NULL;
+    int _len = 0;
+
+    if (topic != RT_NULL)
+        _len = rt_strlen(topic);
+    else
+        _len = rt_strlen(PKG_UMQTT_HEALTH_DEF_TOPIC) + rt_strlen(client->mqtt_info.client_id);
+
+    health->buf = (rt_uint8_t *)UMQTT_MEM_ALLOC(UMQTT_ALLOCATOR(client), UMQTT_HEALTH_BUF_SIZE(_len), UMQTT_MEM_TAG_HEALTH);
+    if (health->buf == RT_NULL)
+        return UMQTT_MEM_FULL;
+    UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_HEALTH, UMQTT_HEALTH_BUF_SIZE(_len));
+
+    health->topic_len = _len;
+    health->last_tick = rt_tick_get();
+    ptr = health->buf + UMQTT_HEALTH_HDR_MAX;
+    umqtt_writeInt(&ptr, _len);
+    if (topic != RT_NULL)
+        rt_memcpy(ptr, topic, _len);
+    else
+        rt_snprintf((char *)ptr, _len + 1, "%s%s", PKG_UMQTT_HEALTH_DEF_TOPIC, client->mqtt_info.client_id);
+    return UMQTT_OK;
+}
+
+/* upper bound (mSec) of the bucket holding the pct percentile of a log2 histogram */
+static rt_uint32_t umqtt_health_percentile(const rt_uint32_t *hist, int pct)
+{
+    rt_uint32_t _total = 0, _sum = 0;
+    int _cnt = 0;
+
+    for (_cnt = 0; _cnt < UMQTT_STATS_RTT_BUCKETS; _cnt++)
+        _total += hist[_cnt];
+    if (_total == 0)
+        return 0;
+
+    for (_cnt = 0; _cnt < UMQTT_STATS_RTT_BUCKETS - 1; _cnt++)
+    {
+        _sum += hist[_cnt];
+        if (_sum * 100 >= _total * pct)
+            break;
+    }
+    return (1UL << _cnt);
+}
+
+/**
+ * publish the client counters as a QoS0 JSON message, from the timer context;
+ * the payload is formatted in place after the prebuilt topic, so a report
+ * costs no allocation and no copy. Like the PINGREQ it is a single
+ * non-blocking attempt on the bulk lane: the timer thread never waits, a
+ * report that finds the lane or the socket busy is dropped.
+ */
+static void umqtt_health_callback(struct umqtt_client *client)
+{
+    struct umqtt_health *health = &(client->health);
+    struct umqtt_stats *snap = &(health->snap);
+    rt_uint32_t _interval = client->mqtt_info.health_interval;
+    rt_uint32_t _tx = 0, _rx = 0, _sec = 0, _mem = 0, _mem_max = 0;
+    rt_tick_t _tick = rt_tick_get();
+    rt_uint8_t *payload = RT_NULL, *ptr = RT_NULL;
+    int _ret = 0, _cnt = 0, _len = 0, _rem_len = 0, _hdr_len = 0;
+
+    if ((UMQTT_CLIENT_STA(client) != UMQTT_CS_LINKED) || (health->buf == RT_NULL)
+     || ((rt_int32_t)(_tick - health->next_tick) < 0))
+        return;
+
+    if (_interval == 0)
+        _interval = PKG_UMQTT_HEALTH_DEF_INTERVAL;
+    health->next_tick = _tick + rt_tick_from_millisecond(_interval * 1000);
+
+    umqtt_stats_snapshot(client, snap);
+    for (_cnt = 0; _cnt < UMQTT_STATS_PKT_TYPES; _cnt++)
+    {
+        _tx += snap->tx_bytes[_cnt];
+        _rx += snap->rx_bytes[_cnt];
+    }
+    _sec = (_tick - health->last_tick) / RT_TICK_PER_SECOND;
+    if (_sec == 0)
+        _sec = 1;
+#ifdef PKG_UMQTT_USING_MEM_STATS
+    {
+        rt_base_t level = rt_hw_interrupt_disable();
+        _mem = client->mem.total;
+        _mem_max = client->mem.total_peak;
+        rt_hw_interrupt_enable(level);
+    }
+#endif
+
+    payload = health->buf + UMQTT_HEALTH_HDR_MAX + 2 + health->topic_len;
+    _len = rt_snprintf((char *)payload, PKG_UMQTT_HEALTH_PAYLOAD_SIZE,
+                       "{\"up\":%u,\"tx\":%u,\"rx\":%u,\"tx_bps\":%u,\"rx_bps\":%u,"
+                       "\"rtt\":[%u,%u,%u],\"ping\":[%u,%u],\"recon\":%u,\"retx\":%u,\"drop\":%u,"
+                       "\"mq\":%u,\"qos2\":%u,\"mem\":%u,\"mem_max\":%u}",
+                       _tick / RT_TICK_PER_SECOND, _tx, _rx,
+                       (_tx - health->last_tx) / _sec, (_rx - health->last_rx) / _sec,
+                       umqtt_health_percentile(snap->pub_rtt, 50), umqtt_health_percentile(snap->pub_rtt, 90),
+                       umqtt_health_percentile(snap->pub_rtt, 99),
+                       umqtt_health_percentile(snap->ping_rtt, 50), umqtt_health_percentile(snap->ping_rtt, 99),
+                       snap->reconnects, snap->retransmits, snap->rx_drops,
+                       client->msg_queue->entry, rt_list_len(&client->qos2_msg_list), _mem, _mem_max);
+    health->last_tick = _tick;
+    health->last_tx = _tx;
+    health->last_rx = _rx;
+    if ((_len <= 0) || (_len >= PKG_UMQTT_HEALTH_PAYLOAD_SIZE))
+    {
+        LOG_W(" health report truncated, payload size(%d) is not enough!", PKG_UMQTT_HEALTH_PAYLOAD_SIZE);
+        return;
+    }
+
+    /* fixed header grows backwards from the topic */
+    _rem_len = 2 + health->topic_len + _len;
+    _hdr_len = umqtt_pkgs_len(_rem_len) - _rem_len;
+    ptr = health->buf + UMQTT_HEALTH_HDR_MAX - _hdr_len;
+    ptr[0] = UMQTT_TYPE_PUBLISH << 4;
+    umqtt_pkgs_encode(ptr + 1, _rem_len);
+
+    if (UMQTT_LANE_TRY(client, UMQTT_PRIO_BULK) < 0)
+    {
+        LOG_D(" health report dropped, the bulk lane is busy!");
+        return;
+    }
+    _ret = umqtt_trans_send(&(client->trans), ptr, _hdr_len + _rem_len, 0);
+    if (_ret == UMQTT_SEND_TIMEOUT)
+        LOG_D(" health report dropped, the socket is full!");
+    else if (_ret < 0)
+        umqtt_send_broken(client);                              /* a torn frame drops the link */
+    else
+    {
+        UMQTT_TICK_SET(client, tx_last_tick, rt_tick_get());
+        umqtt_stats_count(client, 1, ptr[0], _hdr_len + _rem_len);
+    }
+    UMQTT_LANE_RELEASE(client);
+}
+#endif /* PKG_UMQTT_USING_HEALTH */
+
+#ifdef PKG_UMQTT_USING_TICKLESS
+/* ticks left until deadline, 0 once it is due */
+#define UMQTT_TICK_LEFT(DEADLINE, NOW)                      (((rt_int32_t)((rt_tick_t)(DEADLINE) - (NOW)) > 0) ? ((rt_tick_t)(DEADLINE) - (NOW)) : 0)
+#define UMQTT_TICK_MIN(LEFT, DEADLINE, NOW)                 do { rt_tick_t _l = UMQTT_TICK_LEFT(DEADLINE, NOW); if (_l < (LEFT)) (LEFT) = _l; } while (0)
 
-    if (client->connect_state == UMQTT_CS_UNLINK)
-    {
-        if (client->user_handler)
-            client->user_handler(client, UMQTT_EVT_OFFLINE);
+/**
+ * arm the one-shot uplink timer for the earliest work due: keepalive,
+ * reconnect, PUBREC retry, health report, or a blocked backlog poll; a
+ * client with nothing due does not wake the CPU. Called after the timer
+ * callback and whenever a deadline moves earlier.
+ *
+ * @param client the input, umqtt client
+ */
+static void umqtt_uplink_schedule(struct umqtt_client *client)
+{
+    rt_tick_t _now = rt_tick_get(), _left = RT_TICK_MAX / 2 - 1, _due = 0;
+    rt_tick_t _tx_last = UMQTT_TICK_GET(client, tx_last_tick), _uplink_next = UMQTT_TICK_GET(client, uplink_next_tick);
+    int _cnt = 0;
 
-        set_connect_status(client, UMQTT_CS_UNLINK_LINKING);
-        umqtt_trans_disconnect(client->sock);
-        client->sock = -1;
+    if (client->uplink_timer == RT_NULL)
+        return;
 
-    }
-    else if (client->connect_state == UMQTT_CS_UNLINK_LINKING)
+    switch (UMQTT_CLIENT_STA(client))
     {
-        if (client->reconnect_next_tick <= rt_tick_get())
+    case UMQTT_CS_LINKED:
+        if (umqtt_atomic_load(&(client->ping_pending)))
         {
-            if (client->sock < 0)
-            {
-                if (client->reconnect_count >= client->mqtt_info.reconnect_max_num)
-                {
-                    set_connect_status(client, UMQTT_CS_DISCONNECT);
-                    /* stop timer, delete task handle */
-                    if (client->task_handle)
-                    {
-                        rt_thread_delete(client->task_handle);
-                        client->task_handle = RT_NULL;
-                    }
-                    if (client->uplink_timer)
-                    {
-                        rt_timer_stop(client->uplink_timer);
-                    }
-                }
-                else
-                {
-                    client->keepalive_count = 0;
-                    set_uplink_recon_tick(client, RECON_NEXT_TICK);
-                    umqtt_connect(client, 0);
-                    if (client->user_handler)
-                        client->user_handler(client, UMQTT_EVT_LINK);
-                }
-            }
-            else
-            {
-                umqtt_trans_disconnect(client->sock);
-                client->sock = -1;
-            }
+            UMQTT_TICK_MIN(_left, UMQTT_TICK_GET(client, pingreq_last_tick) + rt_tick_from_millisecond(client->mqtt_info.send_timeout * 1000), _now);
+            break;
         }
+        _due = _tx_last + rt_tick_from_millisecond(UMQTT_KP_INTERVAL(client) * 1000);
+        if ((rt_int32_t)(_uplink_next - _due) > 0)
+            _due = _uplink_next;                                /* both directions must be idle */
+        UMQTT_TICK_MIN(_left, _due, _now);
+        UMQTT_TICK_MIN(_left, _tx_last + umqtt_connect_kp_tick(client), _now);
+#ifdef PKG_UMQTT_USING_HEALTH
+        if (client->health.buf != RT_NULL)
+            UMQTT_TICK_MIN(_left, client->health.next_tick, _now);
+#endif
+        break;
+    case UMQTT_CS_UNLINK:
+        _left = 0;
+        break;
+    case UMQTT_CS_UNLINK_LINKING:
+        UMQTT_TICK_MIN(_left, UMQTT_TICK_GET(client, reconnect_next_tick), _now);
+        break;
+    default:
+        return;                                                 /* idle, linking or given up, nothing timed */
+    }
 
+    for (_cnt = 0; _cnt < PKG_UMQTT_QOS2_QUE_MAX; _cnt++)
+    {
+        if (client->pubrec_msg[_cnt].cnt != -1)
+            UMQTT_TICK_MIN(_left, client->pubrec_msg[_cnt].next_tick, _now);
+    }
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+    if ((client->backlog.blocked) && (_left > UMQTT_INFO_DEF_UPLINK_TIMER_TICK))
+        _left = UMQTT_INFO_DEF_UPLINK_TIMER_TICK;
+    for (_cnt = 0; (_cnt < PKG_UMQTT_INFLIGHT_MAX) && (client->backlog.msgs > 0); _cnt++)
+    {
+        if (client->backlog.packet_id[_cnt] != 0)
+            UMQTT_TICK_MIN(_left, client->backlog.expire_tick[_cnt], _now);
     }
+#endif
 
-    return _ret;
+    if (_left == 0)
+        _left = 1;
+    rt_timer_control(client->uplink_timer, RT_TIMER_CTRL_SET_TIME, &_left);
+    rt_timer_start(client->uplink_timer);
 }
+#endif /* PKG_UMQTT_USING_TICKLESS */
 
 static void umqtt_uplink_timer_callback(void *params)
 {
@@ -1092,6 +2600,14 @@ static void umqtt_uplink_timer_callback(void *params)
     umqtt_keepalive_callback(client);
     umqtt_reconnect_callback(client);
     pubrec_cycle_callback(client);
+#ifdef PKG_UMQTT_USING_HEALTH
+    umqtt_health_callback(client);
+#endif
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+    umqtt_backlog_expire(client);
+    umqtt_backlog_check(client);                                /* qos0 backlog drains with the socket */
+#endif
+    UMQTT_UPLINK_SCHEDULE(client);
 }
 
 /**
@@ -1113,35 +2629,96 @@ int umqtt_delete(struct umqtt_client *client)
         return _ret;
     if (client->task_handle)
     {
-        rt_thread_delete(client->task_handle);
+        UMQTT_OBJ_DELETE(thread, client->task_handle);
         client->task_handle = RT_NULL;
         client->user_handler = RT_NULL;
     }
+#ifdef PKG_UMQTT_USING_DISPATCH
+    if (client->dispatch)
+    {
+        UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_DISPATCH, -(int)umqtt_dispatch_size(client->dispatch));
+        umqtt_dispatch_delete(client->dispatch, UMQTT_ALLOCATOR(client));
+        client->dispatch = RT_NULL;
+    }
+#endif
     if (client->uplink_timer)
     {
         rt_timer_stop(client->uplink_timer);
-        rt_timer_delete(client->uplink_timer);
+        UMQTT_OBJ_DELETE(timer, client->uplink_timer);
         client->uplink_timer = RT_NULL;
     }
     if (client->msg_queue)
     {
-        rt_mq_delete(client->msg_queue);
+        UMQTT_OBJ_DELETE(mq, client->msg_queue);
         client->msg_queue = RT_NULL;
     }
     client->send_len = client->recv_len = 0;
+    umqtt_trans_release(&(client->trans));
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+    if (client->lane)
+    {
+        UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_LANE, -(int)umqtt_lane_size());
+        umqtt_lane_delete(client->lane, UMQTT_ALLOCATOR(client));
+        client->lane = RT_NULL;
+    }
+#endif
+#ifdef PKG_UMQTT_USING_PUB_RING
+    if (client->pub_ring)
+    {
+        UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_PUB_RING, -(int)umqtt_pub_ring_size());
+        umqtt_pub_ring_delete(client->pub_ring, UMQTT_ALLOCATOR(client));
+        client->pub_ring = RT_NULL;
+    }
+    umqtt_trans_wake_close(&(client->trans));
+#endif
+#ifdef PKG_UMQTT_USING_HEALTH
+    if (client->health.buf)
+    {
+        UMQTT_MEM_FREE(UMQTT_ALLOCATOR(client), client->health.buf,
+                       UMQTT_HEALTH_BUF_SIZE(client->health.topic_len), UMQTT_MEM_TAG_HEALTH);
+        client->health.buf = RT_NULL;
+    }
+#endif
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+    if (client->topic_stats)
+    {
+        UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_TOPIC_STATS, -(int)umqtt_topic_table_size());
+        umqtt_topic_table_delete(client->topic_stats, UMQTT_ALLOCATOR(client));
+        client->topic_stats = RT_NULL;
+    }
+#endif
     if (client->lock_client)
     {
-        rt_mutex_delete(client->lock_client);
+        UMQTT_OBJ_DELETE(mutex, client->lock_client);
         client->lock_client = RT_NULL;
     }
+#ifdef PKG_UMQTT_USING_MSG_RETAIN
+    if (client->recv_msg)
+    {
+        umqtt_msg_release(client->recv_msg);
+        client->recv_msg = RT_NULL;
+        client->recv_buf = RT_NULL;
+    }
+    umqtt_msg_pool_delete(client->recv_pool);
+    client->recv_pool = RT_NULL;
+#elif defined(PKG_UMQTT_USING_BUF_POOL)
+    if (client->recv_buf)
+    {
+        if (client->recv_buf != client->recv_hdr)               /* receive thread deleted within a frame */
+            umqtt_buf_put(&(client->buf_user), client->recv_buf);
+        umqtt_buf_detach(&(client->buf_user));
+        client->recv_buf = RT_NULL;
+    }
+#else
     if (client->recv_buf)
     {
-        rt_free(client->recv_buf);
+        UMQTT_BUF_FREE(client, client->recv_buf, client->mqtt_info.recv_size, UMQTT_MEM_TAG_RECV_BUF);
         client->recv_buf = RT_NULL;
     }
+#endif
     if (client->send_buf)
     {
-        rt_free(client->send_buf);
+        UMQTT_BUF_FREE(client, client->send_buf, client->mqtt_info.send_size, UMQTT_MEM_TAG_SEND_BUF);
         client->send_buf = RT_NULL;
     }
     if ((_ret = rt_list_isempty(&client->sub_recv_list)) == 0)
@@ -1149,13 +2726,8 @@ int umqtt_delete(struct umqtt_client *client)
         rt_list_for_each_safe(node, node_tmp, &client->sub_recv_list)
         {
             p_subtop = rt_list_entry(node, struct subtop_recv_handler, next_list);
-            if (p_subtop->topicfilter) {        // const char *, cannot free!
-                rt_free(p_subtop->topicfilter);
-                p_subtop->topicfilter = RT_NULL;
-                p_subtop->callback = RT_NULL;
-            }
             rt_list_remove(&(p_subtop->next_list));
-            rt_free(p_subtop); p_subtop = RT_NULL;
+            umqtt_sub_free(client, p_subtop); p_subtop = RT_NULL;
         }
     }
 
@@ -1164,10 +2736,8 @@ int umqtt_delete(struct umqtt_client *client)
         rt_list_for_each_safe(node, node_tmp, &client->qos2_msg_list)
         {
             p_msg = rt_list_entry(node, struct umqtt_qos2_msg, next_list);
-            if (p_msg->topic_name) { rt_free(p_msg->topic_name); p_msg->topic_name = RT_NULL; }
-            if (p_msg->payload) { rt_free(p_msg->payload); p_msg->payload = RT_NULL; }
             rt_list_remove(&(p_msg->next_list));
-            rt_free(p_msg); p_msg = RT_NULL;
+            umqtt_qos2_free(client, p_msg); p_msg = RT_NULL;
         }
     }
 
@@ -1179,49 +2749,109 @@ int umqtt_delete(struct umqtt_client *client)
     }
 
     rt_list_remove(&(client->list));       /* delete this list  */
-    rt_free(client);
+#ifdef PKG_UMQTT_USING_STATIC
+    if (client->heap_storage)
+        UMQTT_MEM_FREE(UMQTT_ALLOCATOR(client), client, umqtt_static_size(&(client->mqtt_info)), UMQTT_MEM_TAG_CLIENT);
+#else
+    UMQTT_MEM_FREE(UMQTT_ALLOCATOR(client), client, sizeof(struct umqtt_client), UMQTT_MEM_TAG_CLIENT);
+#endif
     _ret = UMQTT_OK;
     return _ret;
 }
+#ifdef PKG_UMQTT_USING_STATIC
+/**
+ * storage bytes a client with this information needs: the client itself, the
+ * send and receive buffers (not with PKG_UMQTT_USING_BUF_POOL, frames borrow
+ * from the shared pool), the ack queue pool and the receive thread stack
+ *
+ * @param info the input, user config information
+ *
+ * @return storage size, uint:Byte
+ */
+rt_size_t umqtt_static_size(const struct umqtt_info *info)
+{
+    struct umqtt_info _info;
+    RT_ASSERT(info);
+
+    rt_memcpy(&_info, info, sizeof(struct umqtt_info));
+    umqtt_check_def_info(&_info);
+    return RT_ALIGN_SIZE                                        /* storage alignment */
+         + UMQTT_STATIC_ALIGN(sizeof(struct umqtt_client))
+         + UMQTT_STATIC_BUF_SIZE(&_info)
+         + UMQTT_STATIC_MQ_POOL_SIZE
+         + UMQTT_STATIC_ALIGN(_info.thread_stack_size);
+}
+#endif
+
 /**
- * create umqtt client according to user information
+ * create umqtt client according to user information; in static mode
+ * (PKG_UMQTT_USING_STATIC) every object the client needs is carved from
+ * storage and the kernel objects are initialized in place, so creating,
+ * subscribing and receiving make no heap call.
  *
  * @param info the input, user config information
+ * @param storage the input, static mode only, at least umqtt_static_size(info) bytes
+ * @param size the input, static mode only, storage size
  *
  * @return RT_NULL: create failed
  *         not RT_NULL: create success, client point
  */
+#ifdef PKG_UMQTT_USING_STATIC
+umqtt_client_t umqtt_create_static(const struct umqtt_info *info, void *storage, rt_size_t size)
+#else
 umqtt_client_t umqtt_create(const struct umqtt_info *info)
+#endif
 {
     RT_ASSERT(info);
     static rt_uint8_t lock_cnt = 0;
-    int _ret = 0, _length = 0, _cnt = 0;
+    int _ret = 0, _cnt = 0;
     umqtt_client_t mqtt_client = RT_NULL;
     struct subtop_recv_handler *p_subtop = RT_NULL;
     char _name[RT_NAME_MAX];
+#ifdef PKG_UMQTT_USING_STATIC
+    rt_uint8_t *_ptr = (rt_uint8_t *)RT_ALIGN((rt_ubase_t)storage, RT_ALIGN_SIZE);
 
-    mqtt_client = (umqtt_client_t)rt_calloc(1, sizeof(struct umqtt_client));
+    if ((storage == RT_NULL) || (size < umqtt_static_size(info)))
+    {
+        LOG_E(" static storage(%d) is not enough! need %d!", size, (storage == RT_NULL) ? 0 : umqtt_static_size(info));
+        return RT_NULL;
+    }
+    rt_memset(storage, 0, size);
+    mqtt_client = (umqtt_client_t)_ptr;
+    _ptr += UMQTT_STATIC_ALIGN(sizeof(struct umqtt_client));
+#else
+    mqtt_client = (umqtt_client_t)UMQTT_MEM_ALLOC(&(info->allocator), sizeof(struct umqtt_client), UMQTT_MEM_TAG_CLIENT);
     if (mqtt_client == RT_NULL)
     {
         LOG_E(" umqtt create failed!");
         _ret = UMQTT_MEM_FULL;
         goto exit;
     }
+#endif
     rt_memcpy(&(mqtt_client->mqtt_info), info, sizeof(struct umqtt_info));
     umqtt_check_def_info(&(mqtt_client->mqtt_info));
+#ifndef PKG_UMQTT_USING_STATIC
+    UMQTT_MEM_ACCOUNT(mqtt_client, UMQTT_MEM_TAG_CLIENT, sizeof(struct umqtt_client));
+#endif
+    mqtt_client->trans.sock = -1;
+    mqtt_client->trans.sockopt = &(mqtt_client->mqtt_info.sockopt);
+#ifdef PKG_UMQTT_USING_ALLOCATOR
+    mqtt_client->trans.allocator = UMQTT_ALLOCATOR(mqtt_client);
+#endif
+#ifdef PKG_UMQTT_USING_PUB_RING
+    mqtt_client->trans.wake_fd[0] = mqtt_client->trans.wake_fd[1] = -1;
+#endif
+    umqtt_atomic_store(&(mqtt_client->kp_interval), mqtt_client->mqtt_info.keepalive_interval);
 
     /* will topic/message send/recv*/
     mqtt_client->sub_recv_list_len = PKG_UMQTT_SUBRECV_DEF_LENGTH;
     rt_list_init(&mqtt_client->sub_recv_list);
     if (mqtt_client->mqtt_info.lwt_topic != RT_NULL)
     {
-        p_subtop = (struct subtop_recv_handler *)rt_calloc(1, sizeof(struct subtop_recv_handler));
+        p_subtop = umqtt_sub_alloc(mqtt_client, mqtt_client->mqtt_info.lwt_topic);
         if (p_subtop != RT_NULL)
         {
             p_subtop->qos = mqtt_client->mqtt_info.lwt_qos;
-            _length = strlen(mqtt_client->mqtt_info.lwt_topic) + 1;
-            p_subtop->topicfilter = (char *)rt_calloc(1, sizeof(char) * _length);
-            rt_strncpy(p_subtop->topicfilter, mqtt_client->mqtt_info.lwt_topic, _length);
             p_subtop->callback = (void (*)(void *, void *))(mqtt_client->mqtt_info.lwt_cb);
             rt_list_insert_after(&mqtt_client->sub_recv_list, &p_subtop->next_list);
         }
@@ -1237,7 +2867,23 @@ umqtt_client_t umqtt_create(const struct umqtt_info *info)
         mqtt_client->pubrec_msg[_cnt].next_tick = -1;
     }
 
-    mqtt_client->recv_buf = rt_calloc(1, sizeof(rt_uint8_t) * mqtt_client->mqtt_info.recv_size);
+#if defined(PKG_UMQTT_USING_BUF_POOL)
+    if (umqtt_buf_attach(&(mqtt_client->buf_user), mqtt_client->mqtt_info.buf_reserve) == UMQTT_OK)
+        mqtt_client->recv_buf = mqtt_client->recv_hdr;          /* frames are read into borrowed buffers */
+#elif defined(PKG_UMQTT_USING_STATIC)
+    mqtt_client->recv_buf = _ptr;
+    _ptr += UMQTT_STATIC_ALIGN(mqtt_client->mqtt_info.recv_size);
+#elif defined(PKG_UMQTT_USING_MSG_RETAIN)
+    mqtt_client->recv_pool = umqtt_msg_pool_create(mqtt_client->mqtt_info.recv_size, PKG_UMQTT_RECV_POOL_NUM);
+    if (mqtt_client->recv_pool != RT_NULL)
+        mqtt_client->recv_msg = umqtt_msg_pool_get(mqtt_client->recv_pool);
+    if (mqtt_client->recv_msg != RT_NULL)
+        mqtt_client->recv_buf = (rt_uint8_t *)(mqtt_client->recv_msg + 1);
+#else
+    mqtt_client->recv_buf = UMQTT_MEM_ALLOC(UMQTT_ALLOCATOR(mqtt_client), mqtt_client->mqtt_info.recv_size, UMQTT_MEM_TAG_RECV_BUF);
+    if (mqtt_client->recv_buf != RT_NULL)
+        UMQTT_MEM_ACCOUNT(mqtt_client, UMQTT_MEM_TAG_RECV_BUF, mqtt_client->mqtt_info.recv_size);
+#endif
     if (mqtt_client->recv_buf == RT_NULL)
     {
         LOG_E(" client receive buff calloc failed!");
@@ -1245,17 +2891,33 @@ umqtt_client_t umqtt_create(const struct umqtt_info *info)
         goto exit;
     }
 
-    mqtt_client->send_buf = rt_calloc(1, sizeof(rt_uint8_t) * mqtt_client->mqtt_info.send_size);
+#if defined(PKG_UMQTT_USING_BUF_POOL)
+    /* packets are encoded into borrowed buffers */
+#else
+#ifdef PKG_UMQTT_USING_STATIC
+    mqtt_client->send_buf = _ptr;
+    _ptr += UMQTT_STATIC_ALIGN(mqtt_client->mqtt_info.send_size);
+#else
+    mqtt_client->send_buf = UMQTT_MEM_ALLOC(UMQTT_ALLOCATOR(mqtt_client), mqtt_client->mqtt_info.send_size, UMQTT_MEM_TAG_SEND_BUF);
+    if (mqtt_client->send_buf != RT_NULL)
+        UMQTT_MEM_ACCOUNT(mqtt_client, UMQTT_MEM_TAG_SEND_BUF, mqtt_client->mqtt_info.send_size);
+#endif
     if (mqtt_client->send_buf == RT_NULL)
     {
         LOG_E(" client send buff calloc failed!");
         _ret = UMQTT_MEM_FULL;
         goto exit;
     }
+#endif
 
     rt_memset(_name, 0x00, sizeof(_name));
     rt_snprintf(_name, RT_NAME_MAX, "umqtt_l%d", lock_cnt);
+#ifdef PKG_UMQTT_USING_STATIC
+    if (rt_mutex_init(&(mqtt_client->lock_obj), _name, RT_IPC_FLAG_FIFO) == RT_EOK)
+        mqtt_client->lock_client = &(mqtt_client->lock_obj);
+#else
     mqtt_client->lock_client = rt_mutex_create(_name, RT_IPC_FLAG_FIFO);
+#endif
     if (mqtt_client->lock_client == RT_NULL)
     {
         LOG_E(" create lock_client failed!");
@@ -1265,10 +2927,22 @@ umqtt_client_t umqtt_create(const struct umqtt_info *info)
 
     rt_memset(_name, 0x00, sizeof(_name));
     rt_snprintf(_name, RT_NAME_MAX, "umqtt_q%d", lock_cnt);
+#ifdef PKG_UMQTT_USING_STATIC
+    if (rt_mq_init(&(mqtt_client->queue_obj), _name, _ptr,
+                   sizeof(struct umqtt_msg_ack),
+                   UMQTT_STATIC_MQ_POOL_SIZE,
+                   RT_IPC_FLAG_FIFO) == RT_EOK)
+        mqtt_client->msg_queue = &(mqtt_client->queue_obj);
+    _ptr += UMQTT_STATIC_MQ_POOL_SIZE;
+#else
     mqtt_client->msg_queue = rt_mq_create(_name,
                                             sizeof(struct umqtt_msg_ack),
                                             PKG_UMQTT_MSG_QUEUE_ACK_DEF_SIZE,
                                             RT_IPC_FLAG_FIFO);
+    if (mqtt_client->msg_queue != RT_NULL)
+        UMQTT_MEM_ACCOUNT(mqtt_client, UMQTT_MEM_TAG_QUEUE, sizeof(struct rt_messagequeue)
+                          + PKG_UMQTT_MSG_QUEUE_ACK_DEF_SIZE * (RT_ALIGN(sizeof(struct umqtt_msg_ack), RT_ALIGN_SIZE) + sizeof(void *)));
+#endif
     if (mqtt_client->msg_queue == RT_NULL)
     {
         LOG_E(" create msg_queue failed!");
@@ -1278,11 +2952,20 @@ umqtt_client_t umqtt_create(const struct umqtt_info *info)
 
     rt_memset(_name, 0x00, sizeof(_name));
     rt_snprintf(_name, RT_NAME_MAX, "umqtt_m%d", lock_cnt);
+#ifdef PKG_UMQTT_USING_STATIC
+    rt_timer_init(&(mqtt_client->timer_obj), _name,
+                  umqtt_uplink_timer_callback,
+                  mqtt_client,
+                  UMQTT_INFO_DEF_UPLINK_TIMER_TICK,
+                  UMQTT_UPLINK_TIMER_FLAG);
+    mqtt_client->uplink_timer = &(mqtt_client->timer_obj);
+#else
     mqtt_client->uplink_timer = rt_timer_create(_name,
                                                 umqtt_uplink_timer_callback,
                                                 mqtt_client,
                                                 UMQTT_INFO_DEF_UPLINK_TIMER_TICK,
-                                                RT_TIMER_FLAG_SOFT_TIMER | RT_TIMER_FLAG_PERIODIC);
+                                                UMQTT_UPLINK_TIMER_FLAG);
+#endif
     if (mqtt_client->uplink_timer == RT_NULL)
     {
         LOG_E(" create uplink timer failed!");
@@ -1290,17 +2973,93 @@ umqtt_client_t umqtt_create(const struct umqtt_info *info)
         goto exit;
     }
 
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+    mqtt_client->topic_stats = umqtt_topic_table_create(UMQTT_ALLOCATOR(mqtt_client));
+    if (mqtt_client->topic_stats == RT_NULL)
+    {
+        LOG_E(" create topic statistics failed!");
+        _ret = UMQTT_MEM_FULL;
+        goto exit;
+    }
+    UMQTT_MEM_ACCOUNT(mqtt_client, UMQTT_MEM_TAG_TOPIC_STATS, umqtt_topic_table_size());
+#endif
+
+#ifdef PKG_UMQTT_USING_DISPATCH
+    mqtt_client->dispatch = umqtt_dispatch_create((mqtt_client->mqtt_info.dispatch_workers == 0)
+                                                  ? PKG_UMQTT_DISPATCH_WORKERS : mqtt_client->mqtt_info.dispatch_workers,
+                                                  PKG_UMQTT_DISPATCH_STACK_SIZE,
+                                                  mqtt_client->mqtt_info.thread_priority,
+                                                  umqtt_dispatch_deliver_cb, mqtt_client,
+                                                  UMQTT_ALLOCATOR(mqtt_client));
+    if (mqtt_client->dispatch == RT_NULL)
+    {
+        LOG_E(" create dispatch workers failed!");
+        _ret = UMQTT_MEM_FULL;
+        goto exit;
+    }
+    UMQTT_MEM_ACCOUNT(mqtt_client, UMQTT_MEM_TAG_DISPATCH, umqtt_dispatch_size(mqtt_client->dispatch));
+#endif
+
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+    mqtt_client->lane = umqtt_lane_create(&(mqtt_client->trans), mqtt_client->mqtt_info.send_timeout * 1000,
+                                          UMQTT_ALLOCATOR(mqtt_client));
+    if (mqtt_client->lane == RT_NULL)
+    {
+        LOG_E(" create outbound lanes failed!");
+        _ret = UMQTT_MEM_FULL;
+        goto exit;
+    }
+    UMQTT_MEM_ACCOUNT(mqtt_client, UMQTT_MEM_TAG_LANE, umqtt_lane_size());
+#endif
+
+#ifdef PKG_UMQTT_USING_PUB_RING
+    mqtt_client->pub_ring = umqtt_pub_ring_create(UMQTT_ALLOCATOR(mqtt_client));
+    if (mqtt_client->pub_ring == RT_NULL)
+    {
+        LOG_E(" create publish ring failed!");
+        _ret = UMQTT_MEM_FULL;
+        goto exit;
+    }
+    UMQTT_MEM_ACCOUNT(mqtt_client, UMQTT_MEM_TAG_PUB_RING, umqtt_pub_ring_size());
+    if (umqtt_trans_wake_open(&(mqtt_client->trans)) < 0)
+    {
+        LOG_E(" create publish ring wake pipe failed!");
+        _ret = UMQTT_FAILED;
+        goto exit;
+    }
+#endif
+
+#ifdef PKG_UMQTT_USING_HEALTH
+    if (umqtt_health_init(mqtt_client) < 0)
+    {
+        LOG_E(" health report buff calloc failed!");
+        _ret = UMQTT_MEM_FULL;
+        goto exit;
+    }
+#endif
+
     rt_list_init(&mqtt_client->list);           /* objects, multi mqttclient */
 
     rt_memset(_name, 0x00, sizeof(_name));
     rt_snprintf(_name, RT_NAME_MAX, "umqtt_t%d", lock_cnt++);
 
+#ifdef PKG_UMQTT_USING_STATIC
+    if (rt_thread_init(&(mqtt_client->thread_obj), _name,
+                       umqtt_thread,
+                       (void *)mqtt_client,
+                       _ptr,
+                       mqtt_client->mqtt_info.thread_stack_size,
+                       mqtt_client->mqtt_info.thread_priority,
+                       UMQTT_INFO_DEF_THREAD_TICK) == RT_EOK)
+        mqtt_client->task_handle = &(mqtt_client->thread_obj);
+#else
     mqtt_client->task_handle = rt_thread_create(_name,
                                                 umqtt_thread,
                                                 (void *)mqtt_client,
                                                 mqtt_client->mqtt_info.thread_stack_size,
                                                 mqtt_client->mqtt_info.thread_priority,
                                                 UMQTT_INFO_DEF_THREAD_TICK);
+#endif
     if (mqtt_client->task_handle == RT_NULL)
     {
         LOG_E(" create thread failed!");
@@ -1317,6 +3076,76 @@ exit:
     return mqtt_client;
 }
 
+#ifdef PKG_UMQTT_USING_STATIC
+/* static mode, the storage is taken from the heap once and freed by umqtt_delete */
+umqtt_client_t umqtt_create(const struct umqtt_info *info)
+{
+    umqtt_client_t mqtt_client = RT_NULL;
+    rt_size_t _size = umqtt_static_size(info);
+    void *storage = UMQTT_MEM_ALLOC(&(info->allocator), _size, UMQTT_MEM_TAG_CLIENT);
+
+    if (storage == RT_NULL)
+    {
+        LOG_E(" umqtt create failed!");
+        return RT_NULL;
+    }
+    mqtt_client = umqtt_create_static(info, storage, _size);
+    if (mqtt_client == RT_NULL)
+    {
+        UMQTT_MEM_FREE(&(info->allocator), storage, _size, UMQTT_MEM_TAG_CLIENT);
+        return RT_NULL;
+    }
+    mqtt_client->heap_storage = 1;
+    UMQTT_MEM_ACCOUNT(mqtt_client, UMQTT_MEM_TAG_CLIENT, _size);
+    return mqtt_client;
+}
+#endif
+
+/* subscribe again after a connect, p_subtop is kept busy by the caller */
+static int umqtt_resubscribe(struct umqtt_client *client, struct subtop_recv_handler *p_subtop)
+{
+    int _ret = 0;
+    struct umqtt_msg encode_msg = { 0 };
+    struct umqtt_msg_ack msg_ack = { 0 };
+
+    encode_msg.header.bits.qos = UMQTT_QOS1;
+    encode_msg.msg.subscribe.packet_id = get_next_packetID(client);
+    encode_msg.msg.subscribe.topic_filter[0].topic_filter = p_subtop->topicfilter;
+    encode_msg.msg.subscribe.topic_filter[0].filter_len = strlen(p_subtop->topicfilter);
+    encode_msg.msg.subscribe.topic_filter[0].req_qos.request_qos = p_subtop->qos;
+    encode_msg.msg.subscribe.topic_count = 1;
+    _ret = umqtt_send_msg(client, UMQTT_PRIO_HIGH, UMQTT_TYPE_SUBSCRIBE, &encode_msg);
+    if (_ret == UMQTT_ENCODE_ERROR)
+    {
+        LOG_W(" subscribe encode failed! topic: %s", p_subtop->topicfilter);
+        return _ret;
+    }
+    else if (_ret < 0)
+    {
+        LOG_W(" subscribe trans send failed! ");
+        return _ret;
+    }
+
+    set_uplink_recon_tick(client, UPLINK_LAST_TICK);
+
+    if (RT_EOK != rt_mq_recv(client->msg_queue,
+                            &msg_ack, sizeof(struct umqtt_msg_ack),
+                            rt_tick_from_millisecond(client->mqtt_info.send_timeout * 1000)))
+    {
+        LOG_W(" subscribe recv message timeout! topic: %s ", p_subtop->topicfilter);
+        return UMQTT_READ_FAILED;
+    }
+    if (msg_ack.msg_type != UMQTT_TYPE_SUBACK)
+    {
+        LOG_W(" subscribe ack error! message type: %d ", msg_ack.msg_type);
+        return UMQTT_READ_ERROR;
+    }
+
+    set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
+    LOG_I(" subscribe ack ok! ");
+    return UMQTT_OK;
+}
+
 /**
  * start the umqtt client to work
  *
@@ -1327,11 +3156,10 @@ exit:
  */
 int umqtt_start(struct umqtt_client *client)
 {
-    int _ret = 0, _length = 0;
+    int _ret = 0;
     struct subtop_recv_handler *p_subtop = RT_NULL;
-    rt_list_t *node = RT_NULL;
-    struct umqtt_msg encode_msg = { 0 };
-    struct umqtt_msg_ack msg_ack = { 0 };
+    rt_list_t *node = RT_NULL, *next = RT_NULL;
+    rt_list_t dead;
     if (client == RT_NULL) {
         _ret = UMQTT_INPARAMS_NULL;
         LOG_E(" umqtt start, client is NULL!");
@@ -1360,65 +3188,25 @@ int umqtt_start(struct umqtt_client *client)
     }
 
     /* will message topic to send & recv */
-    if (0 == rt_list_isempty(&client->sub_recv_list))
+    rt_list_init(&dead);
+    UMQTT_CLIENT_LOCK(client);
+    for (node = client->sub_recv_list.next; node != &(client->sub_recv_list); node = next)
     {
-        rt_list_for_each(node, &client->sub_recv_list)
-        {
-            p_subtop = rt_list_entry(node, struct subtop_recv_handler, next_list);
-            rt_memset(&encode_msg, 0, sizeof(encode_msg));
-            encode_msg.header.bits.qos = UMQTT_QOS1;
-            encode_msg.msg.subscribe.packet_id = get_next_packetID(client);
-            encode_msg.msg.subscribe.topic_filter[0].topic_filter = p_subtop->topicfilter;
-            encode_msg.msg.subscribe.topic_filter[0].filter_len = strlen(p_subtop->topicfilter);
-            encode_msg.msg.subscribe.topic_filter[0].req_qos.request_qos = p_subtop->qos;
-            encode_msg.msg.subscribe.topic_count = 1;
-            rt_memset(client->send_buf, 0, sizeof(rt_uint8_t) * client->mqtt_info.send_size);
-            _length = umqtt_encode(UMQTT_TYPE_SUBSCRIBE, client->send_buf, client->mqtt_info.send_size, &encode_msg);
-            if (_length <= 0)
-            {
-                _ret = UMQTT_ENCODE_ERROR;
-                LOG_W(" subscribe encode failed! topic: %s", p_subtop->topicfilter);
-                continue;
-            }
-            client->send_len = _length;
-
-            _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len, client->mqtt_info.send_timeout);
-            if (_ret < 0)
-            {
-                _ret = UMQTT_SEND_FAILED;
-                LOG_W(" subscribe trans send failed! ");
-                continue;
-            }
-
-            set_uplink_recon_tick(client, UPLINK_LAST_TICK);
+        p_subtop = rt_list_entry(node, struct subtop_recv_handler, next_list);
+        next = node->next;
+        if (p_subtop->removed)
+            continue;
 
-            rt_memset(&msg_ack, 0, sizeof(msg_ack));
-            if (RT_EOK == rt_mq_recv(client->msg_queue,
-                                    &msg_ack, sizeof(struct umqtt_msg_ack),
-                                    rt_tick_from_millisecond(client->mqtt_info.send_timeout * 1000)))
-            {
-                if (msg_ack.msg_type == UMQTT_TYPE_SUBACK)
-                {
-                    set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
-                    _ret = UMQTT_OK;
-                    LOG_I(" subscribe ack ok! ");
-                    continue;
-                }
-                else
-                {
-                    _ret = UMQTT_READ_ERROR;
-                    LOG_W(" subscribe ack error! message type: %d ", msg_ack.msg_type);
-                    continue;
-                }
-            }
-            else
-            {
-                _ret = UMQTT_READ_FAILED;
-                LOG_W(" subscribe recv message timeout! topic: %s ", p_subtop->topicfilter);
-                continue;
-            }
-        }
+        p_subtop->busy++;                                       /* the receive thread reads the SUBACK, never wait for it locked */
+        UMQTT_CLIENT_UNLOCK(client);
+        _ret = umqtt_resubscribe(client, p_subtop);
+        UMQTT_CLIENT_LOCK(client);
+        next = node->next;
+        if (umqtt_sub_unpin(p_subtop))
+            rt_list_insert_after(&dead, node);
     }
+    UMQTT_CLIENT_UNLOCK(client);
+    umqtt_sub_free_list(client, &dead);
 
 exit:
     if (_ret == UMQTT_RECONNECT_FAILED)
@@ -1442,7 +3230,7 @@ void umqtt_stop(struct umqtt_client *client)
 
     if (client->task_handle)
     {
-        rt_thread_delete(client->task_handle);
+        UMQTT_OBJ_DELETE(thread, client->task_handle);
         client->task_handle = RT_NULL;
     }
 
@@ -1450,10 +3238,9 @@ void umqtt_stop(struct umqtt_client *client)
         rt_timer_stop(client->uplink_timer);
 
     umqtt_disconnect(client);
-    if (client->sock != -1)
+    if (client->trans.sock != -1)
     {
-        umqtt_trans_disconnect(client->sock);
-        client->sock = -1;
+        umqtt_trans_disconnect(&(client->trans));
     }
 }
 
@@ -1461,6 +3248,7 @@ void umqtt_stop(struct umqtt_client *client)
  * Client to send a publish message to the broker
  *
  * @param client the input, umqtt client
+ * @param prio the input, enum umqtt_prio, outbound class
  * @param qos the input, qos of publish message
  * @param topic the input, topic string
  * @param payload the input, mqtt message payload
@@ -1470,11 +3258,15 @@ void umqtt_stop(struct umqtt_client *client)
  * @return < 0: failed
  *         >= 0: success
  */
-int umqtt_publish(struct umqtt_client *client, enum umqtt_qos qos, const char *topic, void *payload, size_t length, int timeout)
+static int umqtt_publish_lane(struct umqtt_client *client, int prio, enum umqtt_qos qos, const char *topic,
+                              void *payload, size_t length, int timeout)
 {
-    int _ret = 0, _length = 0;
+    int _ret = 0;
     int _cnt = 0;
     rt_uint16_t packet_id = 0;
+#ifdef PKG_UMQTT_USING_STATS
+    rt_tick_t send_tick = 0;                                    /* publish round trip start */
+#endif
     struct umqtt_msg_ack msg_ack = { 0 };
     struct umqtt_msg encode_msg = { 0 };
 
@@ -1492,23 +3284,27 @@ int umqtt_publish(struct umqtt_client *client, enum umqtt_qos qos, const char *t
     encode_msg.msg.publish.payload_len = length;
     encode_msg.msg.publish.topic_name = topic;
     encode_msg.msg.publish.topic_name_len = strlen(topic);
-    _length = umqtt_encode(UMQTT_TYPE_PUBLISH, client->send_buf, client->mqtt_info.send_size, &encode_msg);
-    if (_length <= 0)
+
+_republish:
+    _ret = umqtt_send_msg(client, prio, UMQTT_TYPE_PUBLISH, &encode_msg);
+    if (_ret == UMQTT_ENCODE_ERROR)
     {
-        _ret = UMQTT_ENCODE_ERROR;
-        LOG_E(" publish encode failed! topic: %d", topic);
+        LOG_E(" publish encode failed! topic: %s", topic);
         goto exit;
     }
-    client->send_len = _length;
-
-_republish:
-    _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len, client->mqtt_info.send_timeout);
-    if (_ret < 0)
+    else if (_ret < 0)
     {
-        _ret = UMQTT_SEND_FAILED;
         LOG_E(" publish trans send failed!");
         goto exit;
     }
+#ifdef PKG_UMQTT_USING_STATS
+    send_tick = rt_tick_get();
+#endif
+    UMQTT_TRACE(UMQTT_TRACE_SEND_DONE, UMQTT_TYPE_PUBLISH, packet_id, umqtt_encode_len(UMQTT_TYPE_PUBLISH, &encode_msg));
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+    if (_cnt == 0)                                              /* retransmits are not new messages */
+        umqtt_topic_table_account(client->topic_stats, topic, encode_msg.msg.publish.topic_name_len, length, 1);
+#endif
     _ret = UMQTT_OK;
     if (qos == UMQTT_QOS1)
     {
@@ -1519,6 +3315,7 @@ _republish:
             if (msg_ack.msg_type == UMQTT_TYPE_PUBACK)
             {
                 _ret = UMQTT_OK;
+                umqtt_stats_rtt(client->stats.pub_rtt, send_tick);
                 LOG_I(" publish qos1 ack success!");
                 goto exit;
             }
@@ -1540,6 +3337,7 @@ _republish:
             else
             {
                 LOG_W(" qos1 publish failed! republish!");
+                UMQTT_STATS_INC(client, retransmits);
                 goto _republish;
             }
 
@@ -1553,6 +3351,7 @@ _republish:
         {
             if (msg_ack.msg_type == UMQTT_TYPE_PUBREC)
             {
+                umqtt_stats_rtt(client->stats.pub_rtt, send_tick);
                 LOG_D(" qos2 publish datas! success! then, pubrel msg! ");
             }
             else
@@ -1572,6 +3371,7 @@ _republish:
             }
             else
             {
+                UMQTT_STATS_INC(client, retransmits);
                 goto _republish;
             }
         }
@@ -1579,25 +3379,14 @@ _republish:
         /* send pubreal datas */
 _repubrel:
         _cnt = 0;
-        rt_memset(&encode_msg, 0, sizeof(encode_msg));
-        encode_msg.header.bits.type = UMQTT_TYPE_PUBREL;
-        encode_msg.header.bits.qos = qos;
-        encode_msg.header.bits.dup = 0;
-        encode_msg.msg.publish.packet_id = packet_id;
-        _length = umqtt_encode(encode_msg.header.bits.type, client->send_buf, client->mqtt_info.send_size, &encode_msg);
-        if (_length <= 0)
-        {
-            _ret = UMQTT_ENCODE_ERROR;
-            LOG_E(" pubrel encode failed! topic: %d", topic);
+        _ret = umqtt_send_control(client, UMQTT_TYPE_PUBREL, packet_id, client->mqtt_info.send_timeout * 1000);
+        if (_ret == UMQTT_ENCODE_ERROR)
+        {
+            LOG_E(" pubrel encode failed! topic: %s", topic);
             goto exit;
         }
-        client->send_len = _length;
-
-        _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len,
-                                client->mqtt_info.send_timeout);
-        if (_ret < 0)
+        else if (_ret < 0)
         {
-            _ret = UMQTT_SEND_FAILED;
             LOG_E(" publish trans send failed!");
             goto exit;
         }
@@ -1630,6 +3419,7 @@ _repubrel:
             }
             else
             {
+                UMQTT_STATS_INC(client, retransmits);
                 goto _repubrel;
             }
         }
@@ -1640,6 +3430,22 @@ exit:
     return _ret;
 }
 
+/* publish on the default outbound class, see umqtt_publish_lane */
+int umqtt_publish(struct umqtt_client *client, enum umqtt_qos qos, const char *topic, void *payload, size_t length, int timeout)
+{
+    return umqtt_publish_lane(client, UMQTT_PRIO_HIGH, qos, topic, payload, length, timeout);
+}
+
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+/* publish on the chosen outbound class, see umqtt_publish_lane */
+int umqtt_publish_prio(struct umqtt_client *client, enum umqtt_prio prio, enum umqtt_qos qos, const char *topic,
+                       void *payload, size_t length, int timeout)
+{
+    RT_ASSERT(prio != UMQTT_PRIO_CONTROL);
+    return umqtt_publish_lane(client, prio, qos, topic, payload, length, timeout);
+}
+#endif
+
 /**
  * Subscribe the client to defined topic with defined qos
  *
@@ -1655,31 +3461,21 @@ int umqtt_subscribe(struct umqtt_client *client, const char *topic, enum umqtt_q
 {
     int _ret = 0;
     int _length = 0;
-    int _cnt = 0;
     struct subtop_recv_handler *p_subtop = RT_NULL;
-    rt_list_t *node = RT_NULL;
     struct umqtt_msg encode_msg = { 0 };
     struct umqtt_msg_ack msg_ack = { 0 };
 
     RT_ASSERT(client);
-    RT_ASSERT(topic);
-
-    _cnt = rt_list_isempty(&client->sub_recv_list);
-
-    if (_cnt == 0)
-    {
-        _cnt = 0;
-        rt_list_for_each(node, &client->sub_recv_list)
-        {
-            p_subtop = rt_list_entry(node, struct subtop_recv_handler, next_list);
-            if (p_subtop->topicfilter
-            && (rt_strcmp(p_subtop->topicfilter, topic) == 0))
-            {
-                LOG_D(" subscribe topic(%s) is already subscribed.", topic);
-                goto exit;
-            }
-        }
-        _length = rt_list_len(&client->sub_recv_list);
+    RT_ASSERT(topic);
+
+    UMQTT_CLIENT_LOCK(client);
+    p_subtop = umqtt_sub_find(client, topic, 0);
+    _length = rt_list_len(&client->sub_recv_list);
+    UMQTT_CLIENT_UNLOCK(client);
+    if (p_subtop != RT_NULL)
+    {
+        LOG_D(" subscribe topic(%s) is already subscribed.", topic);
+        goto exit;
     }
 
     if (_length > client->sub_recv_list_len)
@@ -1697,20 +3493,14 @@ int umqtt_subscribe(struct umqtt_client *client, const char *topic, enum umqtt_q
         encode_msg.msg.subscribe.topic_filter[0].filter_len = strlen(topic);
         encode_msg.msg.subscribe.topic_filter[0].req_qos.request_qos = qos;
         encode_msg.msg.subscribe.topic_count = 1;
-        rt_memset(client->send_buf, 0, sizeof(rt_uint8_t) * client->mqtt_info.send_size);
-        _length = umqtt_encode(UMQTT_TYPE_SUBSCRIBE, client->send_buf, client->mqtt_info.send_size, &encode_msg);
-        if (_length <= 0)
+        _ret = umqtt_send_msg(client, UMQTT_PRIO_HIGH, UMQTT_TYPE_SUBSCRIBE, &encode_msg);
+        if (_ret == UMQTT_ENCODE_ERROR)
         {
-            _ret = UMQTT_ENCODE_ERROR;
             LOG_E(" subscribe encode failed! topic: %s", topic);
             goto exit;
         }
-        client->send_len = _length;
-
-        _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len, client->mqtt_info.send_timeout);
-        if (_ret < 0)
+        else if (_ret < 0)
         {
-            _ret = UMQTT_SEND_FAILED;
             LOG_E(" subscribe trans send failed!");
             goto exit;
         }
@@ -1724,17 +3514,28 @@ int umqtt_subscribe(struct umqtt_client *client, const char *topic, enum umqtt_q
         {
             if (msg_ack.msg_type == UMQTT_TYPE_SUBACK)
             {
-                p_subtop = RT_NULL;
-                p_subtop = (struct subtop_recv_handler *)rt_calloc(1, sizeof(struct subtop_recv_handler));
-                RT_ASSERT(p_subtop);
+                p_subtop = umqtt_sub_alloc(client, topic);
+                if (p_subtop == RT_NULL)
+                {
+                    _ret = UMQTT_MEM_FULL;
+                    LOG_E(" subscribe entry alloc failed! topic: %s", topic);
+                    goto exit;
+                }
                 LOG_D(" start assign datas !");
-                p_subtop->topicfilter = rt_strdup(topic);
                 p_subtop->qos = qos;
                 if (callback)
                 {
                     p_subtop->callback = (void (*)(void *, void *))callback;
                 }
-                rt_list_insert_after(&client->sub_recv_list, &p_subtop->next_list);
+                UMQTT_CLIENT_LOCK(client);
+                if (umqtt_sub_find(client, topic, 0) == RT_NULL)      /* a concurrent subscribe may have won */
+                {
+                    rt_list_insert_after(&client->sub_recv_list, &p_subtop->next_list);
+                    p_subtop = RT_NULL;
+                }
+                UMQTT_CLIENT_UNLOCK(client);
+                if (p_subtop != RT_NULL)
+                    umqtt_sub_free(client, p_subtop);
                 set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
 
                 _ret = UMQTT_OK;
@@ -1771,91 +3572,75 @@ exit:
  */
 int umqtt_unsubscribe(struct umqtt_client *client, const char *topic)
 {
-    int _ret = 0, _cnt = 0, _length = 0;
+    int _ret = 0, _free = 0;
     struct subtop_recv_handler *p_subtop = RT_NULL;
-    rt_list_t *node = RT_NULL;
-    rt_list_t *node_tmp = RT_NULL;
     struct umqtt_msg encode_msg = { 0 };
     struct umqtt_msg_ack msg_ack = { 0 };
 
     RT_ASSERT(client);
     RT_ASSERT(topic);
-    _cnt = rt_list_len(&client->sub_recv_list);
 
-    if (_cnt > 0)
+    UMQTT_CLIENT_LOCK(client);
+    p_subtop = umqtt_sub_find(client, topic, 1);
+    UMQTT_CLIENT_UNLOCK(client);
+    if (p_subtop == RT_NULL)
     {
-        rt_list_for_each_safe(node, node_tmp, &client->sub_recv_list)
-        {
-            p_subtop = rt_list_entry(node, struct subtop_recv_handler, next_list);
-            _cnt--;
-            if (p_subtop->topicfilter
-            && (rt_strncmp(p_subtop->topicfilter, topic, strlen(topic)) == 0))
-            {
-                rt_memset(&encode_msg, 0, sizeof(encode_msg));
-                encode_msg.header.bits.qos = UMQTT_QOS1;
-                encode_msg.msg.unsubscribe.packet_id = get_next_packetID(client);
-                encode_msg.msg.unsubscribe.topic_count = 1;
-                encode_msg.msg.unsubscribe.topic_filter[0].topic_filter = topic,
-                encode_msg.msg.unsubscribe.topic_filter[0].filter_len = strlen(topic);
-                _length = umqtt_encode(UMQTT_TYPE_UNSUBSCRIBE, client->send_buf, client->mqtt_info.send_size, &encode_msg);
-                if (_length <= 0)
-                {
-                    _ret = UMQTT_ENCODE_ERROR;
-                    LOG_E(" unsubscribe encode failed! topic: %s", topic);
-                    goto exit;
-                }
-                client->send_len = _length;
+        LOG_D(" unsubscribe topic(%s) is not exit!", topic);
+        goto exit;
+    }
 
-                _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len, client->mqtt_info.send_timeout);
-                if (_ret < 0)
-                {
-                    _ret = UMQTT_SEND_FAILED;
-                    LOG_E(" unsubscribe trans send failed!");
-                    goto exit;
-                }
+    rt_memset(&encode_msg, 0, sizeof(encode_msg));
+    encode_msg.header.bits.qos = UMQTT_QOS1;
+    encode_msg.msg.unsubscribe.packet_id = get_next_packetID(client);
+    encode_msg.msg.unsubscribe.topic_count = 1;
+    encode_msg.msg.unsubscribe.topic_filter[0].topic_filter = topic,
+    encode_msg.msg.unsubscribe.topic_filter[0].filter_len = strlen(topic);
+    _ret = umqtt_send_msg(client, UMQTT_PRIO_HIGH, UMQTT_TYPE_UNSUBSCRIBE, &encode_msg);
+    if (_ret == UMQTT_ENCODE_ERROR)
+    {
+        LOG_E(" unsubscribe encode failed! topic: %s", topic);
+        goto exit;
+    }
+    else if (_ret < 0)
+    {
+        LOG_E(" unsubscribe trans send failed!");
+        goto exit;
+    }
 
-                set_uplink_recon_tick(client, UPLINK_LAST_TICK);
+    set_uplink_recon_tick(client, UPLINK_LAST_TICK);
 
-                rt_memset(&msg_ack, 0, sizeof(msg_ack));
-                if (RT_EOK == rt_mq_recv(client->msg_queue,
-                                        &msg_ack, sizeof(struct umqtt_msg_ack),
-                                        rt_tick_from_millisecond(client->mqtt_info.send_timeout * 1000)))
-                {
-                    if (msg_ack.msg_type == UMQTT_TYPE_UNSUBACK)
-                    {
-                        if (p_subtop->topicfilter) {
-                            rt_free(p_subtop->topicfilter);
-                            p_subtop->topicfilter = RT_NULL;
-                        }
-                        p_subtop->callback = RT_NULL;
-                        rt_list_remove(&(p_subtop->next_list));
-                        rt_free(p_subtop); p_subtop = RT_NULL;
-                        set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
-
-                        _ret = UMQTT_OK;
-                        LOG_I(" unsubscribe ack ok! ");
-                        goto exit;
-                    }
-                    else
-                    {
-                        _ret = UMQTT_READ_ERROR;
-                        LOG_E(" unsubscribe ack error!");
-                        goto exit;
-                    }
-                }
-                else
-                {
-                    _ret = UMQTT_TIMEOUT;
-                    LOG_E(" unsubscribe recv message timeout! topic: %s", topic);
-                    goto exit;
-                }
-            }
-        }
+    rt_memset(&msg_ack, 0, sizeof(msg_ack));
+    if (RT_EOK == rt_mq_recv(client->msg_queue,
+                            &msg_ack, sizeof(struct umqtt_msg_ack),
+                            rt_tick_from_millisecond(client->mqtt_info.send_timeout * 1000)))
+    {
+        if (msg_ack.msg_type == UMQTT_TYPE_UNSUBACK)
+        {
+            /* looked up again, a concurrent unsubscribe may have taken it meanwhile */
+            UMQTT_CLIENT_LOCK(client);
+            p_subtop = umqtt_sub_find(client, topic, 1);
+            _free = (p_subtop != RT_NULL) && umqtt_sub_unlink(p_subtop);
+            UMQTT_CLIENT_UNLOCK(client);
+            if (_free)
+                umqtt_sub_free(client, p_subtop);
+            set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
 
+            _ret = UMQTT_OK;
+            LOG_I(" unsubscribe ack ok! ");
+            goto exit;
+        }
+        else
+        {
+            _ret = UMQTT_READ_ERROR;
+            LOG_E(" unsubscribe ack error!");
+            goto exit;
+        }
     }
     else
     {
-        LOG_D(" unsubscribe topic(%s) is not exit!", topic);
+        _ret = UMQTT_TIMEOUT;
+        LOG_E(" unsubscribe recv message timeout! topic: %s", topic);
+        goto exit;
     }
 
 exit:
@@ -1866,18 +3651,21 @@ exit:
  * umqtt client publish nonblocking datas
  *
  * @param client the input, umqtt client
+ * @param prio the input, enum umqtt_prio, outbound class
  * @param qos the input, qos of publish message
  * @param topic the input, topic string
  * @param payload the input, mqtt message payload
  * @param length the input, mqtt message payload length
  *
- * @return < 0: failed
- *         >= 0: success
+ * @return < 0: failed, UMQTT_WOULD_BLOCK: outbound backlog over the high watermark,
+ *              try again once info.on_writable is called,
+ *              UMQTT_MEM_FULL: every qos1/qos2 tracking slot is in use
+ *         >= 0: success, the packet id of a qos1/qos2 publish, 0: qos0
  */
-int umqtt_publish_async(struct umqtt_client *client, enum umqtt_qos qos, const char *topic,
-                        void *payload, size_t length)
+static int umqtt_publish_async_lane(struct umqtt_client *client, int prio, enum umqtt_qos qos, const char *topic,
+                                    void *payload, size_t length)
 {
-    int _ret = 0, _length = 0;
+    int _ret = 0;
     rt_uint16_t packet_id = 0;
     struct umqtt_msg encode_msg = { 0 };
 
@@ -1895,28 +3683,214 @@ int umqtt_publish_async(struct umqtt_client *client, enum umqtt_qos qos, const c
     encode_msg.msg.publish.payload_len = length;
     encode_msg.msg.publish.topic_name = topic;
     encode_msg.msg.publish.topic_name_len = strlen(topic);
-    _length = umqtt_encode(UMQTT_TYPE_PUBLISH, client->send_buf, client->mqtt_info.send_size, &encode_msg);
-    if (_length <= 0)
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+    _ret = umqtt_backlog_reserve(client, packet_id,            /* before the send, the ack may beat its return */
+                                 umqtt_encode_len(UMQTT_TYPE_PUBLISH, &encode_msg));
+    if (_ret < 0)
     {
-        _ret = UMQTT_ENCODE_ERROR;
-        LOG_E(" publish encode failed! topic: %d", topic);
+        LOG_D(" publish would block! topic: %s", topic);
+        return _ret;
+    }
+#endif
+    _ret = umqtt_send_msg(client, prio, UMQTT_TYPE_PUBLISH, &encode_msg);
+    if (_ret == UMQTT_ENCODE_ERROR)
+    {
+        LOG_E(" publish encode failed! topic: %s", topic);
         goto exit;
     }
-    client->send_len = _length;
-
-    _ret = umqtt_trans_send(client->sock, client->send_buf, client->send_len, client->mqtt_info.send_timeout);
-    if (_ret < 0)
+    else if (_ret < 0)
     {
-        _ret = UMQTT_SEND_FAILED;
         LOG_E(" publish trans send failed!");
         goto exit;
     }
+    UMQTT_TRACE(UMQTT_TRACE_SEND_DONE, UMQTT_TYPE_PUBLISH, packet_id, umqtt_encode_len(UMQTT_TYPE_PUBLISH, &encode_msg));
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+    umqtt_topic_table_account(client->topic_stats, topic, encode_msg.msg.publish.topic_name_len, length, 1);
+#endif
 
     set_uplink_recon_tick(client, UPLINK_LAST_TICK);
     set_uplink_recon_tick(client, UPLINK_NEXT_TICK);
+    _ret = packet_id;                                           /* matches a later info.on_pub_expired */
 exit:
+#ifdef PKG_UMQTT_USING_BACKPRESSURE
+    if ((_ret < 0) && (packet_id != 0))
+        umqtt_backlog_ack(client, packet_id);
+#endif
+    return _ret;
+}
+
+/* publish nonblocking on the default outbound class, see umqtt_publish_async_lane */
+int umqtt_publish_async(struct umqtt_client *client, enum umqtt_qos qos, const char *topic,
+                        void *payload, size_t length)
+{
+    return umqtt_publish_async_lane(client, UMQTT_PRIO_HIGH, qos, topic, payload, length);
+}
+
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+/* publish nonblocking on the chosen outbound class, see umqtt_publish_async_lane */
+int umqtt_publish_async_prio(struct umqtt_client *client, enum umqtt_prio prio, enum umqtt_qos qos, const char *topic,
+                             void *payload, size_t length)
+{
+    RT_ASSERT(prio != UMQTT_PRIO_CONTROL);
+    return umqtt_publish_async_lane(client, prio, qos, topic, payload, length);
+}
+#endif
+
+#ifdef PKG_UMQTT_USING_PUB_RING
+/**
+ * reserve the payload area of the next publish ring slot, to build a qos0
+ * payload in place; only one thread may produce into a client's ring. No
+ * lock and bounded time, the receive thread sends it; the commit makes one
+ * non-blocking wake call when it finds the receive thread waiting.
+ *
+ * @param client the input, umqtt client
+ * @param topic the input, topic name, copied into the slot
+ * @param size the output, payload bytes the slot holds
+ *
+ * @return RT_NULL: ring full or topic name over the slot size
+ *         not RT_NULL: payload area, queue it with umqtt_publish_commit
+ */
+rt_uint8_t *umqtt_publish_reserve(struct umqtt_client *client, const char *topic, size_t *size)
+{
+    rt_uint8_t *payload = RT_NULL;
+    rt_size_t _size = 0;
+
+    RT_ASSERT(client);
+    RT_ASSERT(topic);
+    RT_ASSERT(size);
+
+    if (umqtt_pub_ring_reserve(client->pub_ring, topic, &payload, &_size) != UMQTT_OK)
+        return RT_NULL;
+    *size = _size;
+    return payload;
+}
+
+/**
+ * queue the publish reserved by umqtt_publish_reserve
+ *
+ * @param client the input, umqtt client
+ * @param length the input, payload bytes written
+ *
+ * @return UMQTT_FAILED: nothing reserved
+ *         UMQTT_BUFFER_TOO_SHORT: length over the reserved size, nothing queued
+ *         UMQTT_OK: queued
+ */
+int umqtt_publish_commit(struct umqtt_client *client, size_t length)
+{
+    int _ret = 0;
+
+    RT_ASSERT(client);
+    _ret = umqtt_pub_ring_commit(client->pub_ring, length);
+    if (_ret == UMQTT_OK)
+        umqtt_pub_ring_signal(client);
+    return _ret;
+}
+
+/**
+ * copy a qos0 publish into the publish ring, for producers that must not
+ * block: sampling threads or code next to an interrupt. Only one thread may
+ * produce into a client's ring; the receive thread sends the queued frames in
+ * batches. A commit into a drained ring wakes it, so a frame waits at most
+ * PKG_UMQTT_PUB_RING_FLUSH_MS on a backend that cannot be woken.
+ *
+ * @param client the input, umqtt client
+ * @param topic the input, topic name
+ * @param payload the input, payload, copied
+ * @param length the input, payload length
+ *
+ * @return UMQTT_MEM_FULL: ring full, dropped, see UMQTT_CMD_GET_RING_DROPS
+ *         UMQTT_BUFFER_TOO_SHORT: topic name and payload over PKG_UMQTT_PUB_RING_SLOT_SIZE
+ *         UMQTT_OK: queued
+ */
+int umqtt_publish_enqueue(struct umqtt_client *client, const char *topic, const void *payload, size_t length)
+{
+    rt_uint8_t *data = RT_NULL;
+    rt_size_t _size = 0;
+    int _ret = 0;
+
+    RT_ASSERT(client);
+    RT_ASSERT(topic);
+
+    _ret = umqtt_pub_ring_reserve(client->pub_ring, topic, &data, &_size);
+    if (_ret < 0)
+        return _ret;
+    if (length <= _size)
+        rt_memcpy(data, payload, length);
+    _ret = umqtt_pub_ring_commit(client->pub_ring, length);     /* refuses an oversize length and gives the slot up */
+    if (_ret == UMQTT_OK)
+        umqtt_pub_ring_signal(client);
+    return _ret;
+}
+#endif
+
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+/* attach, replace or (depth 0) remove the delivery queue of one subscription */
+/* the queue is swapped once no delivery uses the subscription, a callback of that subscription gets UMQTT_TIMEOUT */
+static int umqtt_set_sub_queue(struct umqtt_client *client, const struct umqtt_sub_queue_cfg *cfg)
+{
+    struct subtop_recv_handler *p_subtop = RT_NULL;
+    struct umqtt_sub_queue *queue = RT_NULL, *old = RT_NULL;
+    rt_tick_t _end = 0;
+    int _ret = UMQTT_TIMEOUT, _free = 0;
+
+    if ((cfg->topicfilter == RT_NULL) || (cfg->policy > UMQTT_SUB_CONFLATE))
+        return UMQTT_INPARAMS_NULL;
+
+    UMQTT_CLIENT_LOCK(client);
+    p_subtop = umqtt_sub_find(client, cfg->topicfilter, 0);
+    if (p_subtop != RT_NULL)
+        p_subtop->busy++;                                       /* kept while the queue thread starts unlocked */
+    UMQTT_CLIENT_UNLOCK(client);
+    if (p_subtop == RT_NULL)
+    {
+        LOG_E(" set subscription queue failed! not subscribed: %s", cfg->topicfilter);
+        return UMQTT_FAILED;
+    }
+
+    if (cfg->depth != 0)
+    {
+        queue = umqtt_sub_queue_create(client, p_subtop, cfg, PKG_UMQTT_SUB_QUEUE_STACK_SIZE,
+                                       client->mqtt_info.thread_priority, umqtt_sub_queue_deliver_cb,
+                                       UMQTT_ALLOCATOR(client));
+        if (queue == RT_NULL)
+            _ret = UMQTT_MEM_FULL;
+        else
+            UMQTT_MEM_ACCOUNT(client, UMQTT_MEM_TAG_SUB_QUEUE, umqtt_sub_queue_size(queue));
+    }
+
+    _end = rt_tick_get() + rt_tick_from_millisecond(client->mqtt_info.send_timeout * 1000);
+    while (1)
+    {
+        UMQTT_CLIENT_LOCK(client);
+        if ((_ret == UMQTT_TIMEOUT) && p_subtop->removed)
+        {
+            _ret = UMQTT_FAILED;                                /* unsubscribed meanwhile */
+        }
+        else if ((_ret == UMQTT_TIMEOUT) && (p_subtop->busy == 1))
+        {
+            old = p_subtop->queue;                              /* no delivery posts to it any more */
+            p_subtop->queue = queue;
+            queue = old;
+            _ret = UMQTT_OK;
+        }
+        if ((_ret != UMQTT_TIMEOUT) || ((rt_int32_t)(rt_tick_get() - _end) >= 0))
+        {
+            _free = umqtt_sub_unpin(p_subtop);
+            UMQTT_CLIENT_UNLOCK(client);
+            break;
+        }
+        UMQTT_CLIENT_UNLOCK(client);
+        rt_thread_mdelay(1);
+    }
+
+    umqtt_sub_queue_release(client, queue);                     /* the replaced one, or the new one on failure */
+    if (_free)
+        umqtt_sub_free(client, p_subtop);
+    if (_ret == UMQTT_TIMEOUT)
+        LOG_W(" set subscription queue timeout! the subscription stays busy: %s", cfg->topicfilter);
     return _ret;
 }
+#endif
 
 /**
  * umqtt client publish nonblocking datas
@@ -1929,8 +3903,9 @@ exit:
 int umqtt_control(struct umqtt_client *client, enum umqtt_cmd cmd, void *params)
 {
     struct subtop_recv_handler *p_subtop = RT_NULL;
-    rt_list_t *node = RT_NULL;
-    char *topic = RT_NULL;
+#ifdef PKG_UMQTT_USING_MEM_STATS
+    rt_base_t level;
+#endif
     //int _ret = 0;
     RT_ASSERT(client);
     switch(cmd)
@@ -1938,20 +3913,13 @@ int umqtt_control(struct umqtt_client *client, enum umqtt_cmd cmd, void *params)
     case UMQTT_CMD_SUB_CB:
         {
             RT_ASSERT(params);
-            if (0 == rt_list_isempty(&client->sub_recv_list))       /* has list item */
-            {
-                rt_list_for_each(node, &client->sub_recv_list)
-                {
-                    p_subtop = rt_list_entry(node, struct subtop_recv_handler, next_list);
-                    topic = ((struct subtop_recv_handler *)params)->topicfilter;
-                    if ((p_subtop->topicfilter != RT_NULL)
-                     && (rt_strncmp(p_subtop->topicfilter, topic, rt_strlen(topic)) == 0))
-                    {
-                        goto _exit;
-                    }
-                }
-            }
-            rt_list_insert_after(&client->sub_recv_list, &((struct subtop_recv_handler *)params)->next_list);
+            p_subtop = (struct subtop_recv_handler *)params;
+            p_subtop->busy = 0;
+            p_subtop->removed = 0;
+            UMQTT_CLIENT_LOCK(client);
+            if (umqtt_sub_find(client, p_subtop->topicfilter, 1) == RT_NULL)
+                rt_list_insert_after(&client->sub_recv_list, &(p_subtop->next_list));
+            UMQTT_CLIENT_UNLOCK(client);
         }
         break;
     case UMQTT_CMD_EVT_CB:
@@ -1962,16 +3930,95 @@ int umqtt_control(struct umqtt_client *client, enum umqtt_cmd cmd, void *params)
     case UMQTT_CMD_SET_HB:
         {
             client->mqtt_info.keepalive_interval = *(rt_uint32_t *)params;
+            umqtt_atomic_store(&(client->kp_interval), client->mqtt_info.keepalive_interval);
+            UMQTT_UPLINK_SCHEDULE(client);
+#ifdef PKG_UMQTT_USING_KP_ADAPT
+            rt_memset(&(client->kp_adapt), 0, sizeof(client->kp_adapt));     /* probe again from the new interval */
+#endif
+        }
+        break;
+    case UMQTT_CMD_GET_KP_INTERVAL:
+        {
+            RT_ASSERT(params);
+            *(rt_uint32_t *)params = UMQTT_KP_INTERVAL(client);
         }
         break;
     case UMQTT_CMD_GET_CLIENT_STA:
         {
-            return ((int)(client->connect_state));
+            return ((int)UMQTT_CLIENT_STA(client));
+        }
+        break;
+    case UMQTT_CMD_SET_SOCKOPT:
+        {
+            RT_ASSERT(params);
+            rt_memcpy(&(client->mqtt_info.sockopt), params, sizeof(struct umqtt_sockopt));
+        }
+        break;
+    case UMQTT_CMD_GET_TFO_STA:
+        {
+            return ((int)(client->trans.tfo_sta));
+        }
+        break;
+#ifdef PKG_UMQTT_USING_STATS
+    case UMQTT_CMD_GET_STATS:
+        {
+            RT_ASSERT(params);
+            umqtt_stats_snapshot(client, (struct umqtt_stats *)params);
+        }
+        break;
+    case UMQTT_CMD_CLR_STATS:
+        {
+            rt_memset(&(client->stats), 0, sizeof(struct umqtt_client_stats));
+        }
+        break;
+#endif
+#ifdef PKG_UMQTT_USING_MEM_STATS
+    case UMQTT_CMD_GET_MEM:
+        {
+            RT_ASSERT(params);
+            level = rt_hw_interrupt_disable();
+            rt_memcpy(params, &(client->mem), sizeof(struct umqtt_mem_usage));
+            rt_hw_interrupt_enable(level);
+            ((struct umqtt_mem_usage *)params)->stack_size = client->mqtt_info.thread_stack_size;
+            ((struct umqtt_mem_usage *)params)->stack_peak = umqtt_mem_stack_peak(client->task_handle);
+        }
+        break;
+    case UMQTT_CMD_CLR_MEM_PEAK:
+        {
+            level = rt_hw_interrupt_disable();
+            rt_memcpy(client->mem.peak, client->mem.cur, sizeof(client->mem.peak));
+            client->mem.total_peak = client->mem.total;
+            rt_hw_interrupt_enable(level);
+        }
+        break;
+#endif
+#ifdef PKG_UMQTT_USING_PUB_RING
+    case UMQTT_CMD_GET_RING_DROPS:
+        {
+            RT_ASSERT(params);
+            *(rt_uint32_t *)params = umqtt_pub_ring_drops(client->pub_ring);
+        }
+        break;
+#endif
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+    case UMQTT_CMD_SET_SUB_QUEUE:
+        {
+            RT_ASSERT(params);
+            return umqtt_set_sub_queue(client, (const struct umqtt_sub_queue_cfg *)params);
+        }
+        break;
+#endif
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+    case UMQTT_CMD_SET_TOPIC_DEPTH:
+        {
+            RT_ASSERT(params);
+            umqtt_topic_table_set_depth(client->topic_stats, *(int *)params);
         }
         break;
+#endif
     case UMQTT_CMD_DEL_HANDLE:
         {
-            if (RT_EOK == rt_thread_delete(client->task_handle))
+            if (RT_EOK == UMQTT_OBJ_DELETE(thread, client->task_handle))
             {
                 client->task_handle = RT_NULL;
                 LOG_D(" delete thread success! ");
@@ -1998,7 +4045,80 @@ int umqtt_control(struct umqtt_client *client, enum umqtt_cmd cmd, void *params)
         LOG_W(" control cmd:%d", cmd);
         break;
     }
-_exit:
     return UMQTT_OK;
 }
 
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+/**
+ * get the traffic of the most active topic prefixes, the depth of a prefix
+ * is set by UMQTT_CMD_SET_TOPIC_DEPTH
+ *
+ * @param client the input, umqtt client
+ * @param stats the output, topic statistics array
+ * @param max the input, topic statistics array length
+ *
+ * @return copied entries count
+ */
+int umqtt_topic_stats(struct umqtt_client *client, struct umqtt_topic_stat *stats, int max)
+{
+    RT_ASSERT(client);
+
+    return umqtt_topic_table_query(client->topic_stats, stats, max);
+}
+#endif
+
+#ifdef UMQTT_USING_SUB_STATS
+
+/**
+ * get the delivered messages count and the callback run time of each subscription;
+ * the topic filter is copied under the client lock, an unsubscribe does not
+ * invalidate the result.
+ *
+ * @param client the input, umqtt client
+ * @param stats the output, subscription statistics array
+ * @param max the input, subscription statistics array length
+ *
+ * @return copied entries count
+ */
+int umqtt_sub_stats(struct umqtt_client *client, struct umqtt_sub_stat *stats, int max)
+{
+    int _num = 0;
+#ifdef PKG_UMQTT_USING_CB_WATCHDOG
+    rt_uint64_t _total = 0;
+    rt_base_t level;
+#endif
+    rt_list_t *node = RT_NULL;
+    struct subtop_recv_handler *p_subtop = RT_NULL;
+
+    RT_ASSERT(client);
+    RT_ASSERT(stats);
+
+    UMQTT_CLIENT_LOCK(client);
+    rt_list_for_each(node, &client->sub_recv_list)
+    {
+        if (_num >= max)
+            break;
+        p_subtop = rt_list_entry(node, struct subtop_recv_handler, next_list);
+        rt_strncpy(stats[_num].topicfilter, p_subtop->topicfilter, PKG_UMQTT_SUB_STATS_FILTER_LEN - 1);
+        stats[_num].topicfilter[PKG_UMQTT_SUB_STATS_FILTER_LEN - 1] = '\0';
+        stats[_num].deliver_cnt = (rt_uint32_t)umqtt_atomic_load(&(p_subtop->deliver_cnt));
+#ifdef PKG_UMQTT_USING_CB_WATCHDOG
+        level = rt_hw_interrupt_disable();
+        _total = p_subtop->cb_total_us;
+        rt_hw_interrupt_enable(level);
+        stats[_num].cb_max_us = (rt_uint32_t)umqtt_atomic_load(&(p_subtop->cb_max_us));
+        stats[_num].cb_avg_us = (stats[_num].deliver_cnt == 0) ? 0
+                              : (rt_uint32_t)(_total / stats[_num].deliver_cnt);
+        stats[_num].cb_overruns = (rt_uint32_t)umqtt_atomic_load(&(p_subtop->cb_overruns));
+#endif
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+        stats[_num].drops = umqtt_sub_queue_drops(p_subtop->queue);
+#endif
+        _num++;
+    }
+    UMQTT_CLIENT_UNLOCK(client);
+
+    return _num;
+}
+#endif
+
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_BUF_POOL
+
+#define DBG_TAG             "umqtt.buf"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#define UMQTT_BUF_CLASS_SIZE(CLS)       ((rt_uint32_t)PKG_UMQTT_BUF_POOL_MIN_SIZE << (CLS))
+#define UMQTT_BUF_UNCLASSED             0xFF                    /* over the largest class, freed on put */
+
+struct umqtt_buf_hdr
+{
+    struct umqtt_buf_hdr *next;                                 /* class free list */
+    rt_uint32_t cap;                                            /* data bytes */
+    rt_uint8_t cls;                                             /* size class, UMQTT_BUF_UNCLASSED */
+};
+
+#define UMQTT_BUF_HDR_SIZE              RT_ALIGN(sizeof(struct umqtt_buf_hdr), RT_ALIGN_SIZE)
+
+struct umqtt_buf_pool                                           /* one per process, shared by all clients */
+{
+    struct rt_mutex lock;
+    struct rt_semaphore space;                                  /* released when a buffer comes back for a waiting borrower */
+    rt_uint8_t inited;
+    rt_uint16_t waiting;                                        /* borrowers blocked on space */
+    rt_uint32_t budget;                                         /* buffer bytes the pool may hold */
+    rt_uint32_t held;                                           /* buffer bytes held, borrowed and cached */
+    rt_uint32_t reserved;                                       /* sum of the client reservations */
+    rt_uint32_t overflow;                                       /* borrowed bytes beyond the reservations */
+    struct umqtt_buf_hdr *free[PKG_UMQTT_BUF_POOL_CLASSES];
+};
+
+static struct umqtt_buf_pool buf_pool = { .budget = PKG_UMQTT_BUF_POOL_BUDGET };
+
+static void umqtt_buf_pool_init(void)
+{
+    rt_enter_critical();
+    if (buf_pool.inited == 0)
+    {
+        rt_mutex_init(&(buf_pool.lock), "umqtt_bp", RT_IPC_FLAG_PRIO);
+        rt_sem_init(&(buf_pool.space), "umqtt_bp", 0, RT_IPC_FLAG_FIFO);
+        buf_pool.inited = 1;
+    }
+    rt_exit_critical();
+}
+
+/* bytes of a client's borrowing not covered by its reservation */
+static rt_uint32_t umqtt_buf_over(struct umqtt_buf_user *user, rt_uint32_t used)
+{
+    return (used > user->reserve) ? (used - user->reserve) : 0;
+}
+
+/* let every blocked borrower try again, called locked */
+static void umqtt_buf_wake(void)
+{
+    while (buf_pool.waiting > 0)
+    {
+        buf_pool.waiting--;
+        rt_sem_release(&(buf_pool.space));
+    }
+}
+
+/* drop cached buffers until need more bytes fit the budget, called locked */
+static void umqtt_buf_trim(rt_uint32_t need)
+{
+    struct umqtt_buf_hdr *hdr = RT_NULL;
+    int _cls = PKG_UMQTT_BUF_POOL_CLASSES - 1;
+
+    while ((buf_pool.held + need > buf_pool.budget) && (_cls >= 0))
+    {
+        hdr = buf_pool.free[_cls];
+        if (hdr == RT_NULL)
+        {
+            _cls--;
+            continue;
+        }
+        buf_pool.free[_cls] = hdr->next;
+        buf_pool.held -= hdr->cap;
+        rt_free(hdr);
+    }
+}
+
+/**
+ * join the shared buffer pool with a guaranteed share of its budget
+ *
+ * @param user the input, client account
+ * @param reserve the input, bytes this client may always borrow
+ *
+ * @return UMQTT_MEM_FULL: the reservations would exceed the budget
+ *         UMQTT_OK: success
+ */
+int umqtt_buf_attach(struct umqtt_buf_user *user, rt_uint32_t reserve)
+{
+    int _ret = UMQTT_OK;
+
+    umqtt_buf_pool_init();
+    rt_mutex_take(&(buf_pool.lock), RT_WAITING_FOREVER);
+    if (buf_pool.reserved + buf_pool.overflow + reserve > buf_pool.budget)
+    {
+        LOG_E(" buffer pool reservation(%d) is over the budget(%d)!", reserve, buf_pool.budget);
+        _ret = UMQTT_MEM_FULL;
+    }
+    else
+    {
+        user->reserve = reserve;
+        user->used = 0;
+        buf_pool.reserved += reserve;
+    }
+    rt_mutex_release(&(buf_pool.lock));
+    return _ret;
+}
+
+/* leave the shared buffer pool, every borrowed buffer must be back */
+void umqtt_buf_detach(struct umqtt_buf_user *user)
+{
+    if (buf_pool.inited == 0)
+        return;
+
+    rt_mutex_take(&(buf_pool.lock), RT_WAITING_FOREVER);
+    RT_ASSERT(user->used == 0);
+    buf_pool.reserved -= user->reserve;
+    user->reserve = 0;
+    rt_mutex_release(&(buf_pool.lock));
+}
+
+/**
+ * borrow a buffer of the smallest class holding size bytes; a client always
+ * gets its reservation, beyond it the clients share what the reservations
+ * leave of the budget.
+ *
+ * @param user the input, client account
+ * @param size the input, bytes needed
+ * @param timeout the input, wait timeout for other clients to return buffers, uint:mSec, 0: no wait
+ *
+ * @return RT_NULL: over the budget or out of memory
+ *         not RT_NULL: buffer, return it with umqtt_buf_put
+ */
+rt_uint8_t *umqtt_buf_get(struct umqtt_buf_user *user, rt_uint32_t size, int timeout)
+{
+    struct umqtt_buf_hdr *hdr = RT_NULL;
+    rt_tick_t _start = rt_tick_get();
+    rt_uint32_t _cap = 0, _over = 0;
+    rt_uint8_t _cls = 0;
+    int _left = 0;
+
+    while ((_cls < PKG_UMQTT_BUF_POOL_CLASSES) && (UMQTT_BUF_CLASS_SIZE(_cls) < size))
+        _cls++;
+    if (_cls < PKG_UMQTT_BUF_POOL_CLASSES)
+        _cap = UMQTT_BUF_CLASS_SIZE(_cls);
+    else
+    {
+        _cls = UMQTT_BUF_UNCLASSED;
+        _cap = RT_ALIGN(size, RT_ALIGN_SIZE);
+    }
+
+    while (1)
+    {
+        rt_mutex_take(&(buf_pool.lock), RT_WAITING_FOREVER);
+        _over = umqtt_buf_over(user, user->used + _cap) - umqtt_buf_over(user, user->used);
+        if (buf_pool.reserved + buf_pool.overflow + _over <= buf_pool.budget)
+        {
+            if ((_cls != UMQTT_BUF_UNCLASSED) && (buf_pool.free[_cls] != RT_NULL))
+            {
+                hdr = buf_pool.free[_cls];
+                buf_pool.free[_cls] = hdr->next;
+            }
+            else
+            {
+                umqtt_buf_trim(_cap);
+                hdr = (struct umqtt_buf_hdr *)rt_malloc(UMQTT_BUF_HDR_SIZE + _cap);
+                if (hdr != RT_NULL)
+                {
+                    hdr->cap = _cap;
+                    hdr->cls = _cls;
+                    buf_pool.held += _cap;
+                }
+            }
+            if (hdr != RT_NULL)
+            {
+                user->used += _cap;
+                buf_pool.overflow += _over;
+            }
+        }
+        if (hdr != RT_NULL)
+        {
+            rt_mutex_release(&(buf_pool.lock));
+            break;
+        }
+        _left = umqtt_trans_time_left(_start, timeout);
+        if (_left > 0)
+            buf_pool.waiting++;                                 /* umqtt_buf_put releases space once per waiter */
+        rt_mutex_release(&(buf_pool.lock));
+
+        if (_left <= 0)
+            break;
+        rt_sem_take(&(buf_pool.space), rt_tick_from_millisecond(_left));    /* a stale release only costs one more try */
+    }
+
+    if (hdr == RT_NULL)
+    {
+        LOG_D(" buffer pool is over the budget! (%d bytes)", size);
+        return RT_NULL;
+    }
+    hdr->next = RT_NULL;
+    return (rt_uint8_t *)hdr + UMQTT_BUF_HDR_SIZE;
+}
+
+/* return a borrowed buffer, it is cached for reuse by any client */
+void umqtt_buf_put(struct umqtt_buf_user *user, rt_uint8_t *buf)
+{
+    struct umqtt_buf_hdr *hdr = RT_NULL;
+
+    if (buf == RT_NULL)
+        return;
+
+    hdr = (struct umqtt_buf_hdr *)(buf - UMQTT_BUF_HDR_SIZE);
+    rt_mutex_take(&(buf_pool.lock), RT_WAITING_FOREVER);
+    buf_pool.overflow -= umqtt_buf_over(user, user->used) - umqtt_buf_over(user, user->used - hdr->cap);
+    user->used -= hdr->cap;
+    if (hdr->cls != UMQTT_BUF_UNCLASSED)
+    {
+        hdr->next = buf_pool.free[hdr->cls];
+        buf_pool.free[hdr->cls] = hdr;
+        hdr = RT_NULL;
+    }
+    else
+    {
+        buf_pool.held -= hdr->cap;
+    }
+    umqtt_buf_wake();
+    rt_mutex_release(&(buf_pool.lock));
+
+    if (hdr != RT_NULL)
+        rt_free(hdr);
+}
+
+/**
+ * change the shared buffer pool budget, cached buffers over it are released
+ *
+ * @param budget the input, heap bytes the pool may hold
+ *
+ * @return UMQTT_FAILED: below the reservations and the bytes borrowed beyond them
+ *         UMQTT_OK: success
+ */
+int umqtt_buf_pool_set_budget(rt_uint32_t budget)
+{
+    int _ret = UMQTT_OK;
+
+    umqtt_buf_pool_init();
+    rt_mutex_take(&(buf_pool.lock), RT_WAITING_FOREVER);
+    if (budget < buf_pool.reserved + buf_pool.overflow)
+    {
+        _ret = UMQTT_FAILED;
+    }
+    else
+    {
+        buf_pool.budget = budget;
+        umqtt_buf_trim(0);
+        umqtt_buf_wake();
+    }
+    rt_mutex_release(&(buf_pool.lock));
+    return _ret;
+}
+
+#endif /* PKG_UMQTT_USING_BUF_POOL */
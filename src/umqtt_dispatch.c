@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_DISPATCH
+
+#define DBG_TAG             "umqtt.dispatch"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#define UMQTT_DISPATCH_MASK             (PKG_UMQTT_DISPATCH_QUEUE_SIZE - 1)
+#define UMQTT_DISPATCH_SIZE(WORKERS)    (sizeof(struct umqtt_dispatch) + ((WORKERS) - 1) * sizeof(struct umqtt_dispatch_worker))
+
+#if (PKG_UMQTT_DISPATCH_QUEUE_SIZE & UMQTT_DISPATCH_MASK) != 0
+#error "PKG_UMQTT_DISPATCH_QUEUE_SIZE must be a power of 2"
+#endif
+
+struct umqtt_dispatch_worker                                    /* one shard, single producer single consumer */
+{
+    struct umqtt_dispatch *dispatch;
+    rt_thread_t thread;
+    struct rt_semaphore wake;                                   /* one count per queued item */
+    struct rt_semaphore space;                                  /* released when a blocked receive thread may go on */
+    umqtt_atomic_t waiting;                                     /* the receive thread found the ring full */
+    umqtt_atomic_t head;                                        /* written by the receive thread only */
+    umqtt_atomic_t tail;                                        /* written by the worker only */
+    struct umqtt_pkgs_publish *ring[PKG_UMQTT_DISPATCH_QUEUE_SIZE];   /* umqtt_publish_hold messages */
+};
+
+struct umqtt_dispatch
+{
+    umqtt_dispatch_deliver deliver;
+    void *ctx;
+    volatile rt_uint8_t stop;
+    rt_uint8_t worker_num;
+    rt_uint8_t worker_max;                                      /* entries allocated */
+    struct rt_semaphore exit;                                   /* one count per exited worker */
+    struct umqtt_dispatch_worker worker[1];                     /* worker_num entries */
+};
+
+static struct umqtt_pkgs_publish *umqtt_dispatch_pop(struct umqtt_dispatch_worker *worker)
+{
+    struct umqtt_pkgs_publish *item = RT_NULL;
+    rt_uint32_t _tail = (rt_uint32_t)umqtt_atomic_load(&(worker->tail));
+
+    if (_tail == (rt_uint32_t)umqtt_atomic_load(&(worker->head)))
+        return RT_NULL;
+
+    item = worker->ring[_tail & UMQTT_DISPATCH_MASK];
+    umqtt_atomic_store(&(worker->tail), _tail + 1);
+    if (umqtt_atomic_exchange(&(worker->waiting), 0))           /* after the tail, the producer checks it again */
+        rt_sem_release(&(worker->space));
+    return item;
+}
+
+static void umqtt_dispatch_entry(void *params)
+{
+    struct umqtt_dispatch_worker *worker = (struct umqtt_dispatch_worker *)params;
+    struct umqtt_dispatch *dispatch = worker->dispatch;
+    struct umqtt_pkgs_publish *item = RT_NULL;
+
+    while (1)
+    {
+        rt_sem_take(&(worker->wake), RT_WAITING_FOREVER);
+        if (dispatch->stop)
+            break;
+
+        item = umqtt_dispatch_pop(worker);
+        if (item != RT_NULL)
+        {
+            dispatch->deliver(dispatch->ctx, item);
+            umqtt_publish_free(item);
+        }
+    }
+
+    while ((item = umqtt_dispatch_pop(worker)) != RT_NULL)
+        umqtt_publish_free(item);
+    rt_sem_release(&(dispatch->exit));
+}
+
+/**
+ * create the subscribe callback worker pool
+ *
+ * @param workers the input, worker threads count
+ * @param stack_size the input, worker thread stack size
+ * @param priority the input, worker thread priority
+ * @param deliver the input, runs the subscribe callbacks of one message, on a worker thread
+ * @param ctx the input, deliver context
+ * @param allocator the input, client allocator, the pool is tagged UMQTT_MEM_TAG_DISPATCH
+ *
+ * @return RT_NULL: create failed
+ *         not RT_NULL: worker pool
+ */
+struct umqtt_dispatch *umqtt_dispatch_create(int workers, rt_uint32_t stack_size, rt_uint8_t priority,
+                                             umqtt_dispatch_deliver deliver, void *ctx,
+                                             const struct umqtt_allocator *allocator)
+{
+    static rt_uint8_t dispatch_cnt = 0;
+    struct umqtt_dispatch *dispatch = RT_NULL;
+    struct umqtt_dispatch_worker *worker = RT_NULL;
+    char _name[RT_NAME_MAX];
+    int _cnt = 0;
+
+    if (workers < 1)
+        workers = 1;
+
+    dispatch = (struct umqtt_dispatch *)UMQTT_MEM_ALLOC(allocator, UMQTT_DISPATCH_SIZE(workers), UMQTT_MEM_TAG_DISPATCH);
+    if (dispatch == RT_NULL)
+    {
+        LOG_E(" dispatch calloc failed!");
+        return RT_NULL;
+    }
+    dispatch->worker_max = workers;
+    dispatch->deliver = deliver;
+    dispatch->ctx = ctx;
+    rt_snprintf(_name, RT_NAME_MAX, "umqtt_x%d", dispatch_cnt);
+    rt_sem_init(&(dispatch->exit), _name, 0, RT_IPC_FLAG_FIFO);
+
+    for (_cnt = 0; _cnt < workers; _cnt++)
+    {
+        worker = &(dispatch->worker[_cnt]);
+        worker->dispatch = dispatch;
+        rt_snprintf(_name, RT_NAME_MAX, "umqtt_w%d%d", dispatch_cnt, _cnt);
+        rt_sem_init(&(worker->wake), _name, 0, RT_IPC_FLAG_FIFO);
+        rt_sem_init(&(worker->space), _name, 0, RT_IPC_FLAG_FIFO);
+        worker->thread = rt_thread_create(_name, umqtt_dispatch_entry, worker, stack_size, priority, UMQTT_INFO_DEF_THREAD_TICK);
+        if (worker->thread == RT_NULL)
+        {
+            LOG_E(" create dispatch worker %d failed!", _cnt);
+            rt_sem_detach(&(worker->wake));
+            rt_sem_detach(&(worker->space));
+            break;
+        }
+#ifdef RT_USING_SMP
+        rt_thread_control(worker->thread, RT_THREAD_CTRL_BIND_CPU, (void *)(rt_ubase_t)(_cnt % RT_CPUS_NR));
+#endif
+        dispatch->worker_num++;
+        rt_thread_startup(worker->thread);
+    }
+    dispatch_cnt++;
+
+    if (dispatch->worker_num != workers)
+    {
+        umqtt_dispatch_delete(dispatch, allocator);
+        return RT_NULL;
+    }
+    return dispatch;
+}
+
+/* bytes of the pool, for the client memory account */
+rt_uint32_t umqtt_dispatch_size(struct umqtt_dispatch *dispatch)
+{
+    return UMQTT_DISPATCH_SIZE(dispatch->worker_max);
+}
+
+/* stop the workers, the messages still queued are dropped */
+void umqtt_dispatch_delete(struct umqtt_dispatch *dispatch, const struct umqtt_allocator *allocator)
+{
+    int _cnt = 0;
+
+    if (dispatch == RT_NULL)
+        return;
+
+    dispatch->stop = 1;
+    for (_cnt = 0; _cnt < dispatch->worker_num; _cnt++)
+    {
+        rt_sem_release(&(dispatch->worker[_cnt].wake));
+        rt_sem_release(&(dispatch->worker[_cnt].space));
+    }
+    for (_cnt = 0; _cnt < dispatch->worker_num; _cnt++)
+        rt_sem_take(&(dispatch->exit), RT_WAITING_FOREVER);
+
+    for (_cnt = 0; _cnt < dispatch->worker_num; _cnt++)
+    {
+        rt_sem_detach(&(dispatch->worker[_cnt].wake));
+        rt_sem_detach(&(dispatch->worker[_cnt].space));
+    }
+    rt_sem_detach(&(dispatch->exit));
+    UMQTT_MEM_FREE(allocator, dispatch, UMQTT_DISPATCH_SIZE(dispatch->worker_max), UMQTT_MEM_TAG_DISPATCH);
+}
+
+/**
+ * hold one received message and queue it to the worker owning its topic;
+ * messages of one topic always go to the same worker, so their order is
+ * kept. A full queue blocks the receive thread until the worker pops one.
+ *
+ * @param dispatch the input, worker pool
+ * @param msg the input, decoded publish message, points into the receive buffer
+ *
+ * @return <0: failed or other error
+ *         =0: success
+ */
+int umqtt_dispatch_post(struct umqtt_dispatch *dispatch, const struct umqtt_pkgs_publish *msg)
+{
+    struct umqtt_dispatch_worker *worker = RT_NULL;
+    struct umqtt_pkgs_publish *item = RT_NULL;
+    rt_uint32_t _hash = 2166136261U, _head = 0;
+    int _cnt = 0;
+
+    for (_cnt = 0; _cnt < msg->topic_name_len; _cnt++)
+        _hash = (_hash ^ (rt_uint8_t)msg->topic_name[_cnt]) * 16777619U;
+    worker = &(dispatch->worker[_hash % dispatch->worker_num]);
+
+    item = umqtt_publish_hold(msg);
+    if (item == RT_NULL)
+    {
+        LOG_E(" dispatch item malloc failed! drop message!");
+        return UMQTT_MEM_FULL;
+    }
+
+    _head = (rt_uint32_t)umqtt_atomic_load(&(worker->head));
+    while ((_head - (rt_uint32_t)umqtt_atomic_load(&(worker->tail))) >= PKG_UMQTT_DISPATCH_QUEUE_SIZE)
+    {
+        if (dispatch->stop)
+        {
+            umqtt_publish_free(item);
+            return UMQTT_FAILED;
+        }
+        umqtt_atomic_store(&(worker->waiting), 1);
+        if ((_head - (rt_uint32_t)umqtt_atomic_load(&(worker->tail))) < PKG_UMQTT_DISPATCH_QUEUE_SIZE)
+            break;                                              /* popped before the flag was seen, a stale release only costs one more check */
+        rt_sem_take(&(worker->space), RT_WAITING_FOREVER);     /* backpressure, the socket stops being read */
+    }
+    worker->ring[_head & UMQTT_DISPATCH_MASK] = item;
+    umqtt_atomic_store(&(worker->head), _head + 1);
+    rt_sem_release(&(worker->wake));
+    return UMQTT_OK;
+}
+
+#endif /* PKG_UMQTT_USING_DISPATCH */
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_PRIO_LANES
+
+#define DBG_TAG             "umqtt.lane"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+struct umqtt_lane
+{
+    struct umqtt_trans *trans;
+    int timeout;                                                /* control frames flush timeout, uint:mSec */
+    struct rt_mutex lock;
+    rt_uint8_t busy;                                            /* a writer owns the transport */
+    volatile rt_uint8_t broken;                                 /* a control write failed, cleared by umqtt_lane_discard */
+    rt_uint8_t waiting[UMQTT_PRIO_NUM];                         /* writers waiting, by class */
+    struct rt_semaphore wake[UMQTT_PRIO_NUM];                   /* released when the transport is handed over */
+    rt_uint16_t ctrl_len;                                       /* queued control bytes */
+    rt_uint8_t ctrl[PKG_UMQTT_LANE_CTRL_SIZE];                  /* whole control frames, sent before any user frame */
+};
+
+/* a control write failed, the acks in it are lost and the stream may be torn */
+static void umqtt_lane_break(struct umqtt_lane *lane, rt_uint32_t len)
+{
+    LOG_W(" control frames send failed! (%d bytes) the link must be dropped!", len);
+    rt_mutex_take(&(lane->lock), RT_WAITING_FOREVER);
+    lane->broken = 1;
+    rt_mutex_release(&(lane->lock));
+}
+
+/* send the queued control frames, the caller owns the transport; once broken they are dropped */
+static void umqtt_lane_flush(struct umqtt_lane *lane, int timeout)
+{
+    rt_uint8_t _buf[PKG_UMQTT_LANE_CTRL_SIZE];
+    rt_uint16_t _len = 0;
+
+    while (1)
+    {
+        rt_mutex_take(&(lane->lock), RT_WAITING_FOREVER);
+        _len = lane->ctrl_len;
+        rt_memcpy(_buf, lane->ctrl, _len);
+        lane->ctrl_len = 0;
+        rt_mutex_release(&(lane->lock));
+
+        if (_len == 0)
+            break;
+        if ((lane->broken == 0) && (umqtt_trans_send(lane->trans, _buf, _len, timeout) < 0))
+            umqtt_lane_break(lane, _len);
+    }
+}
+
+/* bytes of one arbiter, for the client memory account */
+rt_uint32_t umqtt_lane_size(void)
+{
+    return sizeof(struct umqtt_lane);
+}
+
+/**
+ * create the outbound arbiter of one transport
+ *
+ * @param trans the input, transport written through the lanes
+ * @param timeout the input, control frames flush timeout, uint:mSec
+ * @param allocator the input, client allocator, the arbiter is tagged UMQTT_MEM_TAG_LANE
+ *
+ * @return RT_NULL: create failed
+ *         not RT_NULL: outbound arbiter
+ */
+struct umqtt_lane *umqtt_lane_create(struct umqtt_trans *trans, int timeout, const struct umqtt_allocator *allocator)
+{
+    struct umqtt_lane *lane = RT_NULL;
+    int _cnt = 0;
+
+    lane = (struct umqtt_lane *)UMQTT_MEM_ALLOC(allocator, sizeof(struct umqtt_lane), UMQTT_MEM_TAG_LANE);
+    if (lane == RT_NULL)
+    {
+        LOG_E(" lane calloc failed!");
+        return RT_NULL;
+    }
+    lane->trans = trans;
+    lane->timeout = timeout;
+    rt_mutex_init(&(lane->lock), "umqtt_ln", RT_IPC_FLAG_PRIO);
+    for (_cnt = 0; _cnt < UMQTT_PRIO_NUM; _cnt++)
+        rt_sem_init(&(lane->wake[_cnt]), "umqtt_ln", 0, RT_IPC_FLAG_FIFO);
+    return lane;
+}
+
+void umqtt_lane_delete(struct umqtt_lane *lane, const struct umqtt_allocator *allocator)
+{
+    int _cnt = 0;
+
+    if (lane == RT_NULL)
+        return;
+
+    for (_cnt = 0; _cnt < UMQTT_PRIO_NUM; _cnt++)
+        rt_sem_detach(&(lane->wake[_cnt]));
+    rt_mutex_detach(&(lane->lock));
+    UMQTT_MEM_FREE(allocator, lane, sizeof(struct umqtt_lane), UMQTT_MEM_TAG_LANE);
+}
+
+/**
+ * take the transport for one user frame; the queued control frames are sent
+ * first, then the frame is written whole, nothing is interleaved into it.
+ *
+ * @param lane the input, outbound arbiter
+ * @param prio the input, enum umqtt_prio, writers of a lower value go first
+ * @param timeout the input, wait timeout, uint:mSec, 0: do not wait
+ *
+ * @return UMQTT_SEND_TIMEOUT: the transport stayed busy
+ *         UMQTT_SEND_FAILED: a queued control write failed, the link must be
+ *                            dropped; the transport is not owned
+ *         UMQTT_OK: the caller owns the transport until umqtt_lane_release
+ */
+int umqtt_lane_take(struct umqtt_lane *lane, int prio, int timeout)
+{
+    rt_err_t _ret = RT_EOK;
+
+    rt_mutex_take(&(lane->lock), RT_WAITING_FOREVER);
+    if (lane->busy == 0)
+    {
+        lane->busy = 1;
+        rt_mutex_release(&(lane->lock));
+        goto _owned;
+    }
+    if (timeout == 0)
+    {
+        rt_mutex_release(&(lane->lock));
+        return UMQTT_SEND_TIMEOUT;
+    }
+    lane->waiting[prio]++;
+    rt_mutex_release(&(lane->lock));
+
+    _ret = rt_sem_take(&(lane->wake[prio]), (timeout < 0) ? RT_WAITING_FOREVER : rt_tick_from_millisecond(timeout));
+    if (_ret != RT_EOK)
+    {
+        rt_mutex_take(&(lane->lock), RT_WAITING_FOREVER);
+        _ret = rt_sem_take(&(lane->wake[prio]), 0);             /* handed over while timing out */
+        if (_ret != RT_EOK)
+            lane->waiting[prio]--;
+        rt_mutex_release(&(lane->lock));
+        if (_ret != RT_EOK)
+            return UMQTT_SEND_TIMEOUT;
+    }
+
+_owned:
+    umqtt_lane_flush(lane, lane->timeout);
+    if (lane->broken)
+    {
+        umqtt_lane_release(lane);
+        return UMQTT_SEND_FAILED;
+    }
+    return UMQTT_OK;
+}
+
+/**
+ * send the control frames queued meanwhile, then hand the transport to the
+ * highest waiting class
+ *
+ * @param lane the input, outbound arbiter
+ *
+ * @return UMQTT_SEND_FAILED: a control write failed, the link must be dropped
+ *         UMQTT_OK: success
+ */
+int umqtt_lane_release(struct umqtt_lane *lane)
+{
+    int _cnt = 0;
+
+    umqtt_lane_flush(lane, lane->timeout);
+
+    rt_mutex_take(&(lane->lock), RT_WAITING_FOREVER);
+    for (_cnt = 0; _cnt < UMQTT_PRIO_NUM; _cnt++)
+    {
+        if (lane->waiting[_cnt] > 0)
+        {
+            lane->waiting[_cnt]--;
+            rt_sem_release(&(lane->wake[_cnt]));
+            break;
+        }
+    }
+    if (_cnt == UMQTT_PRIO_NUM)
+        lane->busy = 0;
+    rt_mutex_release(&(lane->lock));
+
+    if ((_cnt == UMQTT_PRIO_NUM) && (lane->ctrl_len > 0))       /* queued after the flush */
+    {
+        if (umqtt_lane_take(lane, UMQTT_PRIO_CONTROL, 0) == UMQTT_OK)
+            umqtt_lane_release(lane);
+    }
+    return (lane->broken) ? UMQTT_SEND_FAILED : UMQTT_OK;
+}
+
+/**
+ * send one control frame (ack, PINGREQ) without waiting behind user frames:
+ * it is sent now when the transport is free, or queued and sent by the
+ * current writer as soon as its frame is out. When the queue is full the
+ * caller waits for the transport like a writer of the control class, at most
+ * the flush timeout, and writes the frame itself.
+ *
+ * @param lane the input, outbound arbiter
+ * @param buf the input, whole encoded frame
+ * @param len the input, frame length
+ *
+ * @return UMQTT_SEND_TIMEOUT: control queue full and the transport stayed busy, frame dropped
+ *         UMQTT_SEND_FAILED: a control write failed, the link must be dropped
+ *         UMQTT_OK: sent or queued
+ */
+int umqtt_lane_control(struct umqtt_lane *lane, const rt_uint8_t *buf, rt_uint32_t len)
+{
+    int _ret = UMQTT_OK;
+
+    rt_mutex_take(&(lane->lock), RT_WAITING_FOREVER);
+    if (lane->broken)
+    {
+        rt_mutex_release(&(lane->lock));
+        return UMQTT_SEND_FAILED;
+    }
+    if (lane->ctrl_len + len <= PKG_UMQTT_LANE_CTRL_SIZE)
+    {
+        rt_memcpy(lane->ctrl + lane->ctrl_len, buf, len);
+        lane->ctrl_len += len;
+        rt_mutex_release(&(lane->lock));
+
+        _ret = umqtt_lane_take(lane, UMQTT_PRIO_CONTROL, 0);
+        if (_ret == UMQTT_OK)
+            _ret = umqtt_lane_release(lane);
+        return (_ret == UMQTT_SEND_TIMEOUT) ? UMQTT_OK : _ret;  /* busy: the writer sends it */
+    }
+    rt_mutex_release(&(lane->lock));
+
+    /* queue full: the take sends the queued frames first, this one follows them */
+    _ret = umqtt_lane_take(lane, UMQTT_PRIO_CONTROL, lane->timeout);
+    if (_ret == UMQTT_SEND_TIMEOUT)
+        LOG_W(" control queue full and the transport stays busy! drop frame!");
+    if (_ret < 0)
+        return _ret;
+    if (umqtt_trans_send(lane->trans, buf, len, lane->timeout) < 0)
+        umqtt_lane_break(lane, len);
+    return umqtt_lane_release(lane);
+}
+
+/* drop the control frames of a lost link and clear its write error, called by the owner before CONNECT */
+void umqtt_lane_discard(struct umqtt_lane *lane)
+{
+    rt_mutex_take(&(lane->lock), RT_WAITING_FOREVER);
+    lane->ctrl_len = 0;
+    lane->broken = 0;
+    rt_mutex_release(&(lane->lock));
+}
+
+#endif /* PKG_UMQTT_USING_PRIO_LANES */
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_ALLOCATOR
+
+/**
+ * allocate client memory from the user allocator, or the system heap when
+ * none is set; the memory is zeroed
+ *
+ * @param allocator the input, client allocator, RT_NULL: the system heap
+ * @param size the input, bytes needed
+ * @param tag the input, what the memory is for
+ *
+ * @return RT_NULL: out of memory
+ *         not RT_NULL: zeroed memory, release it with umqtt_mem_free
+ */
+void *umqtt_mem_alloc(const struct umqtt_allocator *allocator, rt_size_t size, enum umqtt_mem_tag tag)
+{
+    void *ptr = RT_NULL;
+
+    if ((allocator == RT_NULL) || (allocator->alloc == RT_NULL))
+        return rt_calloc(1, size);
+
+    ptr = allocator->alloc(allocator->ctx, size, tag);
+    if (ptr != RT_NULL)
+        rt_memset(ptr, 0, size);
+    return ptr;
+}
+
+/**
+ * give client memory back, with the size and tag it was allocated with
+ *
+ * @param allocator the input, client allocator, RT_NULL: the system heap
+ * @param ptr the input, memory from umqtt_mem_alloc, RT_NULL is ignored
+ * @param size the input, bytes allocated
+ * @param tag the input, what the memory was for
+ */
+void umqtt_mem_free(const struct umqtt_allocator *allocator, void *ptr, rt_size_t size, enum umqtt_mem_tag tag)
+{
+    if (ptr == RT_NULL)
+        return;
+
+    if ((allocator == RT_NULL) || (allocator->alloc == RT_NULL))
+        rt_free(ptr);
+    else if (allocator->free != RT_NULL)
+        allocator->free(allocator->ctx, ptr, size, tag);
+}
+
+#endif /* PKG_UMQTT_USING_ALLOCATOR */
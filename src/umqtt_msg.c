@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_MSG_RETAIN
+
+#define DBG_TAG             "umqtt.msg"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+struct umqtt_msg_buf
+{
+    umqtt_atomic_t ref;                                         /* holders, the buffer is recycled at 0 */
+    struct umqtt_msg_pool *pool;                                /* RT_NULL: single message, freed at 0 */
+    struct umqtt_msg_buf *next;                                 /* pool free list */
+    struct umqtt_pkgs_publish msg;                              /* must be last, the data follows it */
+};
+
+struct umqtt_msg_pool
+{
+    rt_mutex_t lock;                                            /* free list lock */
+    umqtt_atomic_t ref;                                         /* owner and buffers handed out */
+    rt_uint32_t size;                                           /* data bytes of each buffer */
+    rt_uint16_t max, cached;                                    /* free list limit and length */
+    struct umqtt_msg_buf *free;
+};
+
+#define UMQTT_MSG_BUF(MSG)              rt_container_of((MSG), struct umqtt_msg_buf, msg)
+
+static void umqtt_msg_pool_unref(struct umqtt_msg_pool *pool)
+{
+    struct umqtt_msg_buf *buf = RT_NULL;
+
+    if (umqtt_atomic_add(&(pool->ref), -1) != 1)
+        return;
+
+    while ((buf = pool->free) != RT_NULL)
+    {
+        pool->free = buf->next;
+        rt_free(buf);
+    }
+    rt_mutex_delete(pool->lock);
+    rt_free(pool);
+}
+
+/**
+ * create a receive buffer pool, buffers are allocated on demand and up to
+ * max of them are kept for reuse once released
+ *
+ * @param size the input, data bytes of each buffer
+ * @param max the input, released buffers kept for reuse
+ *
+ * @return RT_NULL: create failed
+ *         not RT_NULL: buffer pool
+ */
+struct umqtt_msg_pool *umqtt_msg_pool_create(rt_uint32_t size, rt_uint16_t max)
+{
+    struct umqtt_msg_pool *pool = RT_NULL;
+
+    pool = (struct umqtt_msg_pool *)rt_calloc(1, sizeof(struct umqtt_msg_pool));
+    if (pool == RT_NULL)
+        return RT_NULL;
+
+    pool->lock = rt_mutex_create("umqtt_mp", RT_IPC_FLAG_PRIO);
+    if (pool->lock == RT_NULL)
+    {
+        rt_free(pool);
+        return RT_NULL;
+    }
+    pool->ref = 1;
+    pool->size = size;
+    pool->max = max;
+    return pool;
+}
+
+/* drop the owner reference, the pool goes away with the last retained buffer */
+void umqtt_msg_pool_delete(struct umqtt_msg_pool *pool)
+{
+    if (pool != RT_NULL)
+        umqtt_msg_pool_unref(pool);
+}
+
+/**
+ * take a buffer from the pool, held once by the caller
+ *
+ * @param pool the input, buffer pool
+ *
+ * @return RT_NULL: out of memory
+ *         not RT_NULL: message header, pool->size data bytes follow it
+ */
+struct umqtt_pkgs_publish *umqtt_msg_pool_get(struct umqtt_msg_pool *pool)
+{
+    struct umqtt_msg_buf *buf = RT_NULL;
+
+    rt_mutex_take(pool->lock, RT_WAITING_FOREVER);
+    buf = pool->free;
+    if (buf != RT_NULL)
+    {
+        pool->free = buf->next;
+        pool->cached--;
+    }
+    rt_mutex_release(pool->lock);
+
+    if (buf == RT_NULL)
+    {
+        buf = (struct umqtt_msg_buf *)rt_malloc(sizeof(struct umqtt_msg_buf) + pool->size);
+        if (buf == RT_NULL)
+            return RT_NULL;
+        buf->pool = pool;
+    }
+    buf->ref = 1;
+    buf->next = RT_NULL;
+    rt_memset(&(buf->msg), 0, sizeof(buf->msg));
+    umqtt_atomic_add(&(pool->ref), 1);
+    return &(buf->msg);
+}
+
+/**
+ * allocate a single message outside any pool, held once by the caller
+ *
+ * @param size the input, data bytes following the message header
+ *
+ * @return RT_NULL: out of memory
+ *         not RT_NULL: message header
+ */
+struct umqtt_pkgs_publish *umqtt_msg_alloc(rt_uint32_t size)
+{
+    struct umqtt_msg_buf *buf = RT_NULL;
+
+    buf = (struct umqtt_msg_buf *)rt_malloc(sizeof(struct umqtt_msg_buf) + size);
+    if (buf == RT_NULL)
+        return RT_NULL;
+
+    buf->ref = 1;
+    buf->pool = RT_NULL;
+    buf->next = RT_NULL;
+    return &(buf->msg);
+}
+
+/* more than one holder: someone retained the message */
+int umqtt_msg_is_shared(struct umqtt_pkgs_publish *msg)
+{
+    return (umqtt_atomic_load(&(UMQTT_MSG_BUF(msg)->ref)) > 1);
+}
+
+/**
+ * keep a message passed to a subscribe callback valid after the callback
+ * returns; topic name and payload stay in place, nothing is copied.
+ *
+ * @param msg the input, message passed to the subscribe callback
+ *
+ * @return msg, release it with umqtt_msg_release
+ */
+void *umqtt_msg_retain(void *msg)
+{
+    RT_ASSERT(msg);
+
+    umqtt_atomic_add(&(UMQTT_MSG_BUF(msg)->ref), 1);
+    return msg;
+}
+
+/**
+ * drop one hold of a message, the last one recycles its buffer
+ *
+ * @param msg the input, retained message
+ */
+void umqtt_msg_release(void *msg)
+{
+    struct umqtt_msg_buf *buf = RT_NULL;
+    struct umqtt_msg_pool *pool = RT_NULL;
+
+    if (msg == RT_NULL)
+        return;
+
+    buf = UMQTT_MSG_BUF(msg);
+    if (umqtt_atomic_add(&(buf->ref), -1) != 1)
+        return;
+
+    pool = buf->pool;
+    if (pool == RT_NULL)
+    {
+        rt_free(buf);
+        return;
+    }
+
+    rt_mutex_take(pool->lock, RT_WAITING_FOREVER);
+    if ((pool->cached < pool->max) && (umqtt_atomic_load(&(pool->ref)) > 1))
+    {
+        buf->next = pool->free;
+        pool->free = buf;
+        pool->cached++;
+        buf = RT_NULL;
+    }
+    rt_mutex_release(pool->lock);
+
+    if (buf != RT_NULL)
+        rt_free(buf);
+    umqtt_msg_pool_unref(pool);
+}
+
+#endif /* PKG_UMQTT_USING_MSG_RETAIN */
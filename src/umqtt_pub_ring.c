@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_PUB_RING
+
+#define DBG_TAG             "umqtt.ring"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#define UMQTT_PUB_RING_MASK             (PKG_UMQTT_PUB_RING_SLOTS - 1)
+#define UMQTT_PUB_HDR_MAX               5                       /* fixed header byte, remaining length */
+#define UMQTT_PUB_FRAME_MAX             (UMQTT_PUB_HDR_MAX + 2 + PKG_UMQTT_PUB_RING_SLOT_SIZE)
+
+#if (PKG_UMQTT_PUB_RING_SLOTS & UMQTT_PUB_RING_MASK) != 0
+#error "PKG_UMQTT_PUB_RING_SLOTS must be a power of 2"
+#endif
+#if PKG_UMQTT_PUB_RING_BATCH_SIZE < UMQTT_PUB_FRAME_MAX
+#error "PKG_UMQTT_PUB_RING_BATCH_SIZE must hold the largest frame of a slot"
+#endif
+
+struct umqtt_pub_slot                                           /* one encoded qos0 publish */
+{
+    rt_uint16_t off;                                            /* frame start, the fixed header grows backwards */
+    rt_uint16_t len;                                            /* frame length */
+    rt_uint8_t data[UMQTT_PUB_FRAME_MAX];                       /* fixed header, topic length, topic name, payload */
+};
+
+struct umqtt_pub_ring                                           /* single producer single consumer */
+{
+    umqtt_atomic_t head;                                        /* written by the producer only */
+    rt_uint16_t topic_len;                                      /* topic name of the reserved slot, producer side */
+    rt_uint8_t reserved;                                        /* a slot is reserved, producer side */
+    struct umqtt_pub_slot slot[PKG_UMQTT_PUB_RING_SLOTS];       /* keeps head and tail on different cache lines */
+    umqtt_atomic_t tail;                                        /* written by the consumer only */
+    umqtt_atomic_t drops;                                       /* publishes refused by a full ring or lost in a failed write */
+    rt_uint16_t batch_frames;                                   /* frames copied to batch, consumer side */
+    rt_uint8_t batch[PKG_UMQTT_PUB_RING_BATCH_SIZE];            /* frames of one transport write */
+};
+
+/* bytes of one ring, for the client memory account */
+rt_uint32_t umqtt_pub_ring_size(void)
+{
+    return sizeof(struct umqtt_pub_ring);
+}
+
+/* the ring comes from the client allocator, tagged UMQTT_MEM_TAG_PUB_RING */
+struct umqtt_pub_ring *umqtt_pub_ring_create(const struct umqtt_allocator *allocator)
+{
+    struct umqtt_pub_ring *ring = RT_NULL;
+
+    ring = (struct umqtt_pub_ring *)UMQTT_MEM_ALLOC(allocator, sizeof(struct umqtt_pub_ring), UMQTT_MEM_TAG_PUB_RING);
+    if (ring == RT_NULL)
+    {
+        LOG_E(" publish ring calloc failed!");
+        return RT_NULL;
+    }
+    return ring;
+}
+
+/* the producer and the consumer must both be gone */
+void umqtt_pub_ring_delete(struct umqtt_pub_ring *ring, const struct umqtt_allocator *allocator)
+{
+    if (ring == RT_NULL)
+        return;
+
+    UMQTT_MEM_FREE(allocator, ring, sizeof(struct umqtt_pub_ring), UMQTT_MEM_TAG_PUB_RING);
+}
+
+/* no committed publish waits, consumer side */
+int umqtt_pub_ring_empty(struct umqtt_pub_ring *ring)
+{
+    return (umqtt_atomic_load(&(ring->head)) == umqtt_atomic_load(&(ring->tail)));
+}
+
+/**
+ * reserve the next free slot and copy the topic name into it; no lock, no
+ * kernel call, the topic scan is bounded by the slot size.
+ *
+ * @param ring the input, publish ring
+ * @param topic the input, topic name
+ * @param payload the output, payload area of the slot
+ * @param size the output, payload bytes the slot holds
+ *
+ * @return UMQTT_MEM_FULL: ring full, the publish is counted as dropped
+ *         UMQTT_BUFFER_TOO_SHORT: topic name over the slot size
+ *         UMQTT_OK: the slot is the producer's until umqtt_pub_ring_commit
+ */
+int umqtt_pub_ring_reserve(struct umqtt_pub_ring *ring, const char *topic, rt_uint8_t **payload, rt_size_t *size)
+{
+    struct umqtt_pub_slot *slot = RT_NULL;
+    rt_uint32_t _head = (rt_uint32_t)umqtt_atomic_load(&(ring->head));
+    rt_uint16_t _len = 0;
+
+    if ((_head - (rt_uint32_t)umqtt_atomic_load(&(ring->tail))) >= PKG_UMQTT_PUB_RING_SLOTS)
+    {
+        umqtt_atomic_add(&(ring->drops), 1);
+        return UMQTT_MEM_FULL;
+    }
+
+    while ((_len < PKG_UMQTT_PUB_RING_SLOT_SIZE) && (topic[_len] != '\0'))
+        _len++;
+    if ((_len == 0) || (_len >= PKG_UMQTT_PUB_RING_SLOT_SIZE))
+        return UMQTT_BUFFER_TOO_SHORT;
+
+    slot = &(ring->slot[_head & UMQTT_PUB_RING_MASK]);
+    slot->data[UMQTT_PUB_HDR_MAX] = (rt_uint8_t)(_len >> 8);
+    slot->data[UMQTT_PUB_HDR_MAX + 1] = (rt_uint8_t)(_len & 0xFF);
+    rt_memcpy(slot->data + UMQTT_PUB_HDR_MAX + 2, topic, _len);
+
+    ring->topic_len = _len;
+    ring->reserved = 1;
+    *payload = slot->data + UMQTT_PUB_HDR_MAX + 2 + _len;
+    *size = PKG_UMQTT_PUB_RING_SLOT_SIZE - _len;
+    return UMQTT_OK;
+}
+
+/**
+ * finish the fixed header of the reserved slot and hand it to the consumer;
+ * the head store orders the slot contents before it.
+ *
+ * @param ring the input, publish ring
+ * @param length the input, payload bytes written into the slot
+ *
+ * @return UMQTT_FAILED: no slot reserved
+ *         UMQTT_BUFFER_TOO_SHORT: length over the payload area, the slot is given up
+ *         UMQTT_OK: queued
+ */
+int umqtt_pub_ring_commit(struct umqtt_pub_ring *ring, rt_size_t length)
+{
+    struct umqtt_pub_slot *slot = RT_NULL;
+    rt_uint32_t _head = (rt_uint32_t)umqtt_atomic_load(&(ring->head));
+    int _rem_len = 0, _hdr_len = 0;
+
+    if (ring->reserved == 0)
+        return UMQTT_FAILED;
+    ring->reserved = 0;
+    if (length > (rt_size_t)(PKG_UMQTT_PUB_RING_SLOT_SIZE - ring->topic_len))
+        return UMQTT_BUFFER_TOO_SHORT;
+
+    slot = &(ring->slot[_head & UMQTT_PUB_RING_MASK]);
+    _rem_len = 2 + ring->topic_len + (int)length;
+    _hdr_len = umqtt_pkgs_len(_rem_len) - _rem_len;
+    slot->off = UMQTT_PUB_HDR_MAX - _hdr_len;
+    slot->len = _hdr_len + _rem_len;
+    slot->data[slot->off] = UMQTT_TYPE_PUBLISH << 4;
+    umqtt_pkgs_encode(slot->data + slot->off + 1, _rem_len);
+
+    umqtt_atomic_store(&(ring->head), _head + 1);
+    return UMQTT_OK;
+}
+
+/**
+ * copy the queued frames, oldest first, into the batch buffer for one
+ * transport write; the slots stay queued until umqtt_pub_ring_consume.
+ *
+ * @param ring the input, publish ring
+ * @param buf the output, batch buffer
+ * @param frames the output, frames in the batch
+ *
+ * @return 0: ring empty
+ *         >0: batch bytes
+ */
+int umqtt_pub_ring_batch(struct umqtt_pub_ring *ring, const rt_uint8_t **buf, int *frames)
+{
+    struct umqtt_pub_slot *slot = RT_NULL;
+    rt_uint32_t _tail = (rt_uint32_t)umqtt_atomic_load(&(ring->tail));
+    rt_uint32_t _head = (rt_uint32_t)umqtt_atomic_load(&(ring->head));
+    int _len = 0;
+
+    ring->batch_frames = 0;
+    while (_tail != _head)
+    {
+        slot = &(ring->slot[_tail & UMQTT_PUB_RING_MASK]);
+        if (_len + slot->len > PKG_UMQTT_PUB_RING_BATCH_SIZE)
+            break;
+        rt_memcpy(ring->batch + _len, slot->data + slot->off, slot->len);
+        _len += slot->len;
+        ring->batch_frames++;
+        _tail++;
+    }
+    *buf = ring->batch;
+    *frames = ring->batch_frames;
+    return _len;
+}
+
+/**
+ * point iov at the queued frames, oldest first, for one vectored transport
+ * write without copying them; the slots stay queued until umqtt_pub_ring_consume.
+ *
+ * @param ring the input, publish ring
+ * @param iov the output, UMQTT_TRANS_IOV_MAX frames at most
+ * @param frames the output, frames in the batch
+ *
+ * @return 0: ring empty
+ *         >0: batch bytes
+ */
+int umqtt_pub_ring_gather(struct umqtt_pub_ring *ring, struct umqtt_iovec *iov, int *frames)
+{
+    struct umqtt_pub_slot *slot = RT_NULL;
+    rt_uint32_t _tail = (rt_uint32_t)umqtt_atomic_load(&(ring->tail));
+    rt_uint32_t _head = (rt_uint32_t)umqtt_atomic_load(&(ring->head));
+    int _len = 0;
+
+    ring->batch_frames = 0;
+    while ((_tail != _head) && (ring->batch_frames < UMQTT_TRANS_IOV_MAX))
+    {
+        slot = &(ring->slot[_tail & UMQTT_PUB_RING_MASK]);
+        if (_len + slot->len > PKG_UMQTT_PUB_RING_BATCH_SIZE)
+            break;
+        iov[ring->batch_frames].iov_base = slot->data + slot->off;
+        iov[ring->batch_frames].iov_len = slot->len;
+        _len += slot->len;
+        ring->batch_frames++;
+        _tail++;
+    }
+    *frames = ring->batch_frames;
+    return _len;
+}
+
+/* give the slots of the last batch back to the producer, a failed write counts them as dropped;
+   a batch that timed out before any byte left is simply not consumed and goes out next pass */
+void umqtt_pub_ring_consume(struct umqtt_pub_ring *ring, int sent)
+{
+    if (ring->batch_frames == 0)
+        return;
+
+    if (!sent)
+        umqtt_atomic_add(&(ring->drops), ring->batch_frames);
+    umqtt_atomic_store(&(ring->tail), (rt_uint32_t)umqtt_atomic_load(&(ring->tail)) + ring->batch_frames);
+    ring->batch_frames = 0;
+}
+
+/* publishes dropped so far */
+rt_uint32_t umqtt_pub_ring_drops(struct umqtt_pub_ring *ring)
+{
+    return (ring == RT_NULL) ? 0 : (rt_uint32_t)umqtt_atomic_load(&(ring->drops));
+}
+
+#endif /* PKG_UMQTT_USING_PUB_RING */
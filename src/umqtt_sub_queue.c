@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_SUB_QUEUE
+
+#define DBG_TAG             "umqtt.subq"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+struct umqtt_sub_queue
+{
+    void *client, *sub;                                         /* deliver context */
+    umqtt_sub_queue_deliver deliver;
+    rt_thread_t thread;                                         /* consumer, runs the subscribe callback */
+    rt_mutex_t lock;
+    struct rt_semaphore wake;                                   /* released when the ring turns non-empty */
+    struct rt_semaphore space;                                  /* released when a blocked producer may go on */
+    struct rt_semaphore exit;                                   /* released when the consumer stopped */
+    volatile rt_uint8_t stop;
+    rt_uint8_t detached;                                        /* deleted by its own consumer, which frees it on exit */
+    rt_uint8_t policy;                                          /* enum umqtt_sub_policy */
+    rt_uint8_t waiting;                                         /* producer blocked on space */
+    rt_uint16_t depth, head, count;
+    rt_uint32_t drops;                                          /* messages dropped or conflated */
+    const struct umqtt_allocator *allocator;                    /* frees a detached queue */
+    struct umqtt_pkgs_publish **ring;                           /* umqtt_publish_hold messages, right after the queue */
+};
+
+#define UMQTT_SUB_QUEUE_SIZE(DEPTH)     (sizeof(struct umqtt_sub_queue) + (DEPTH) * sizeof(struct umqtt_pkgs_publish *))
+
+static struct umqtt_pkgs_publish *umqtt_sub_queue_pop(struct umqtt_sub_queue *queue)
+{
+    struct umqtt_pkgs_publish *item = RT_NULL;
+
+    if (queue->count == 0)
+        return RT_NULL;
+
+    item = queue->ring[queue->head];
+    queue->head = (queue->head + 1) % queue->depth;
+    queue->count--;
+    return item;
+}
+
+/* drop the messages still queued and free the queue, the consumer has stopped */
+static void umqtt_sub_queue_destroy(struct umqtt_sub_queue *queue, const struct umqtt_allocator *allocator)
+{
+    struct umqtt_pkgs_publish *item = RT_NULL;
+
+    while ((item = umqtt_sub_queue_pop(queue)) != RT_NULL)
+        umqtt_publish_free(item);
+    rt_sem_detach(&(queue->wake));
+    rt_sem_detach(&(queue->space));
+    rt_sem_detach(&(queue->exit));
+    rt_mutex_delete(queue->lock);
+    UMQTT_MEM_FREE(allocator, queue, UMQTT_SUB_QUEUE_SIZE(queue->depth), UMQTT_MEM_TAG_SUB_QUEUE);
+}
+
+static void umqtt_sub_queue_entry(void *params)
+{
+    struct umqtt_sub_queue *queue = (struct umqtt_sub_queue *)params;
+    struct umqtt_pkgs_publish *item = RT_NULL;
+
+    while (!queue->stop)
+    {
+        rt_mutex_take(queue->lock, RT_WAITING_FOREVER);
+        item = umqtt_sub_queue_pop(queue);
+        if ((item != RT_NULL) && (queue->waiting))
+        {
+            queue->waiting = 0;
+            rt_sem_release(&(queue->space));
+        }
+        rt_mutex_release(queue->lock);
+
+        if (item == RT_NULL)
+        {
+            rt_sem_take(&(queue->wake), RT_WAITING_FOREVER);
+            continue;
+        }
+        queue->deliver(queue->client, queue->sub, item);
+        umqtt_publish_free(item);
+    }
+    if (queue->detached)
+        umqtt_sub_queue_destroy(queue, queue->allocator);
+    else
+        rt_sem_release(&(queue->exit));
+}
+
+/**
+ * create a bounded delivery queue for one subscription, with its own
+ * consumer thread, so a slow callback only delays its own messages
+ *
+ * @param client the input, deliver context, umqtt client
+ * @param sub the input, deliver context, subscription
+ * @param cfg the input, queue depth and overflow policy
+ * @param stack_size the input, consumer thread stack size
+ * @param priority the input, consumer thread priority
+ * @param deliver the input, runs the subscribe callback, on the consumer thread
+ * @param allocator the input, client allocator, the queue is tagged UMQTT_MEM_TAG_SUB_QUEUE
+ *
+ * @return RT_NULL: create failed
+ *         not RT_NULL: subscription queue
+ */
+struct umqtt_sub_queue *umqtt_sub_queue_create(void *client, void *sub, const struct umqtt_sub_queue_cfg *cfg,
+                                               rt_uint32_t stack_size, rt_uint8_t priority,
+                                               umqtt_sub_queue_deliver deliver,
+                                               const struct umqtt_allocator *allocator)
+{
+    static rt_uint8_t queue_cnt = 0;
+    struct umqtt_sub_queue *queue = RT_NULL;
+    char _name[RT_NAME_MAX];
+
+    queue = (struct umqtt_sub_queue *)UMQTT_MEM_ALLOC(allocator, UMQTT_SUB_QUEUE_SIZE(cfg->depth), UMQTT_MEM_TAG_SUB_QUEUE);
+    if (queue == RT_NULL)
+        goto _fail;
+    queue->ring = (struct umqtt_pkgs_publish **)(queue + 1);
+
+    queue->client = client;
+    queue->sub = sub;
+    queue->deliver = deliver;
+    queue->depth = cfg->depth;
+    queue->policy = cfg->policy;
+
+    rt_snprintf(_name, RT_NAME_MAX, "umqtt_s%d", queue_cnt++);
+    queue->lock = rt_mutex_create(_name, RT_IPC_FLAG_PRIO);
+    if (queue->lock == RT_NULL)
+        goto _fail;
+    rt_sem_init(&(queue->wake), _name, 0, RT_IPC_FLAG_FIFO);
+    rt_sem_init(&(queue->space), _name, 0, RT_IPC_FLAG_FIFO);
+    rt_sem_init(&(queue->exit), _name, 0, RT_IPC_FLAG_FIFO);
+
+    queue->thread = rt_thread_create(_name, umqtt_sub_queue_entry, queue, stack_size, priority, UMQTT_INFO_DEF_THREAD_TICK);
+    if (queue->thread == RT_NULL)
+    {
+        rt_sem_detach(&(queue->wake));
+        rt_sem_detach(&(queue->space));
+        rt_sem_detach(&(queue->exit));
+        rt_mutex_delete(queue->lock);
+        goto _fail;
+    }
+    rt_thread_startup(queue->thread);
+    return queue;
+
+_fail:
+    LOG_E(" create subscription queue failed!");
+    if (queue)
+        UMQTT_MEM_FREE(allocator, queue, UMQTT_SUB_QUEUE_SIZE(cfg->depth), UMQTT_MEM_TAG_SUB_QUEUE);
+    return RT_NULL;
+}
+
+/* bytes of the queue with its ring, for the client memory account */
+rt_uint32_t umqtt_sub_queue_size(struct umqtt_sub_queue *queue)
+{
+    return UMQTT_SUB_QUEUE_SIZE(queue->depth);
+}
+
+/*
+ * stop the consumer, the messages still queued are dropped; called from the
+ * consumer itself (a callback unsubscribing its own topic) it cannot wait for
+ * its own exit, the queue is detached and freed by the consumer on its way out
+ */
+void umqtt_sub_queue_delete(struct umqtt_sub_queue *queue, const struct umqtt_allocator *allocator)
+{
+    if (queue == RT_NULL)
+        return;
+
+    if (rt_thread_self() == queue->thread)
+    {
+        queue->allocator = allocator;
+        queue->detached = 1;
+        queue->stop = 1;
+        return;
+    }
+
+    queue->stop = 1;
+    rt_sem_release(&(queue->wake));
+    rt_sem_release(&(queue->space));
+    rt_sem_take(&(queue->exit), RT_WAITING_FOREVER);
+    umqtt_sub_queue_destroy(queue, allocator);
+}
+
+/**
+ * hold one message in the subscription queue, applying the overflow policy
+ * once the queue is full:
+ *   UMQTT_SUB_BLOCK: wait for the consumer, the receive thread stops reading
+ *   UMQTT_SUB_DROP_OLDEST: drop the oldest queued message
+ *   UMQTT_SUB_DROP_NEWEST: drop this message
+ *   UMQTT_SUB_CONFLATE: replace the queued message of the same topic, or drop
+ *                       the oldest one when no message of this topic is queued
+ *
+ * @param queue the input, subscription queue
+ * @param msg the input, decoded publish message, points into the receive buffer
+ *
+ * @return <0: failed or other error
+ *         =0: queued
+ *         >0: a message was dropped or conflated
+ */
+int umqtt_sub_queue_post(struct umqtt_sub_queue *queue, const struct umqtt_pkgs_publish *msg)
+{
+    struct umqtt_pkgs_publish *item = RT_NULL, *drop = RT_NULL;
+    int _cnt = 0, _idx = 0, _ret = 0;
+
+    item = umqtt_publish_hold(msg);
+    if (item == RT_NULL)
+    {
+        LOG_E(" subscription queue item malloc failed! drop message!");
+        return UMQTT_MEM_FULL;
+    }
+
+    rt_mutex_take(queue->lock, RT_WAITING_FOREVER);
+    if (queue->policy == UMQTT_SUB_CONFLATE)
+    {
+        for (_cnt = 0; _cnt < queue->count; _cnt++)
+        {
+            _idx = (queue->head + _cnt) % queue->depth;
+            if ((queue->ring[_idx]->topic_name_len == item->topic_name_len)
+             && (rt_memcmp(queue->ring[_idx]->topic_name, item->topic_name, item->topic_name_len) == 0))
+            {
+                drop = queue->ring[_idx];
+                queue->ring[_idx] = item;
+                item = RT_NULL;
+                break;
+            }
+        }
+    }
+
+    while ((item != RT_NULL) && (queue->count >= queue->depth))
+    {
+        if (queue->policy == UMQTT_SUB_BLOCK)
+        {
+            queue->waiting = 1;
+            rt_mutex_release(queue->lock);
+            rt_sem_take(&(queue->space), RT_WAITING_FOREVER);
+            rt_mutex_take(queue->lock, RT_WAITING_FOREVER);
+            if (queue->stop)
+            {
+                drop = item;
+                item = RT_NULL;
+            }
+        }
+        else if (queue->policy == UMQTT_SUB_DROP_NEWEST)
+        {
+            drop = item;
+            item = RT_NULL;
+        }
+        else
+        {
+            drop = umqtt_sub_queue_pop(queue);
+        }
+    }
+
+    if (item != RT_NULL)
+    {
+        queue->ring[(queue->head + queue->count) % queue->depth] = item;
+        if (queue->count++ == 0)
+            rt_sem_release(&(queue->wake));
+    }
+    if (drop != RT_NULL)
+    {
+        queue->drops++;
+        _ret = 1;
+    }
+    rt_mutex_release(queue->lock);
+
+    if (drop != RT_NULL)
+        umqtt_publish_free(drop);
+    return _ret;
+}
+
+/* messages dropped or conflated so far */
+rt_uint32_t umqtt_sub_queue_drops(struct umqtt_sub_queue *queue)
+{
+    return (queue == RT_NULL) ? 0 : queue->drops;
+}
+
+#endif /* PKG_UMQTT_USING_SUB_QUEUE */
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_TOPIC_STATS
+
+#define DBG_TAG             "umqtt.topic"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#define UMQTT_TOPIC_MASK                (PKG_UMQTT_TOPIC_STATS_NUM - 1)
+
+#if (PKG_UMQTT_TOPIC_STATS_NUM & UMQTT_TOPIC_MASK) != 0
+#error "PKG_UMQTT_TOPIC_STATS_NUM must be a power of 2"
+#endif
+
+struct umqtt_topic_entry
+{
+    struct umqtt_topic_stat stat;                               /* counters reported to the user */
+    rt_uint32_t hash;                                           /* prefix hash, 0: free slot */
+    rt_tick_t last_tick;                                        /* last update, the coldest probed slot is evicted */
+};
+
+struct umqtt_topic_table
+{
+    rt_mutex_t lock;
+    rt_uint8_t depth;                                           /* topic levels kept in the prefix */
+    struct umqtt_topic_entry entry[PKG_UMQTT_TOPIC_STATS_NUM];
+};
+
+/* length of the first depth levels of topic, and its FNV-1a hash */
+static int umqtt_topic_prefix(const char *topic, int len, int depth, rt_uint32_t *hash)
+{
+    int _cnt = 0, _level = 0;
+    rt_uint32_t _hash = 2166136261U;
+
+    for (_cnt = 0; _cnt < len; _cnt++)
+    {
+        if ((topic[_cnt] == '/') && (++_level >= depth))
+            break;
+        if (_cnt < PKG_UMQTT_TOPIC_STATS_PREFIX_LEN - 1)       /* prefixes sharing a long head fold together */
+            _hash = (_hash ^ (rt_uint8_t)topic[_cnt]) * 16777619U;
+    }
+    if (_cnt >= PKG_UMQTT_TOPIC_STATS_PREFIX_LEN)
+        _cnt = PKG_UMQTT_TOPIC_STATS_PREFIX_LEN - 1;
+
+    *hash = (_hash == 0) ? 1 : _hash;
+    return _cnt;
+}
+
+/* bytes of one table, for the client memory account */
+rt_uint32_t umqtt_topic_table_size(void)
+{
+    return sizeof(struct umqtt_topic_table);
+}
+
+/**
+ * create a topic statistics table
+ *
+ * @param allocator the input, client allocator, the table is tagged UMQTT_MEM_TAG_TOPIC_STATS
+ *
+ * @return RT_NULL: create failed
+ *         not RT_NULL: topic statistics table
+ */
+struct umqtt_topic_table *umqtt_topic_table_create(const struct umqtt_allocator *allocator)
+{
+    struct umqtt_topic_table *table = RT_NULL;
+
+    table = (struct umqtt_topic_table *)UMQTT_MEM_ALLOC(allocator, sizeof(struct umqtt_topic_table), UMQTT_MEM_TAG_TOPIC_STATS);
+    if (table == RT_NULL)
+    {
+        LOG_E(" topic statistics table calloc failed!");
+        return RT_NULL;
+    }
+
+    table->lock = rt_mutex_create("umqtt_tp", RT_IPC_FLAG_PRIO);
+    if (table->lock == RT_NULL)
+    {
+        UMQTT_MEM_FREE(allocator, table, sizeof(struct umqtt_topic_table), UMQTT_MEM_TAG_TOPIC_STATS);
+        return RT_NULL;
+    }
+    table->depth = PKG_UMQTT_TOPIC_STATS_DEPTH;
+    return table;
+}
+
+void umqtt_topic_table_delete(struct umqtt_topic_table *table, const struct umqtt_allocator *allocator)
+{
+    if (table == RT_NULL)
+        return;
+
+    rt_mutex_delete(table->lock);
+    UMQTT_MEM_FREE(allocator, table, sizeof(struct umqtt_topic_table), UMQTT_MEM_TAG_TOPIC_STATS);
+}
+
+/**
+ * account one message to its topic prefix; at most PKG_UMQTT_TOPIC_STATS_PROBE
+ * slots are probed, a miss replaces the coldest of them, so the cost does not
+ * grow with the number of distinct topics.
+ *
+ * @param table the input, topic statistics table
+ * @param topic the input, topic name, need not be terminated
+ * @param len the input, topic name length
+ * @param bytes the input, payload length
+ * @param is_tx the input, 1: published by the client, 0: received from the broker
+ */
+void umqtt_topic_table_account(struct umqtt_topic_table *table, const char *topic, int len,
+                               rt_uint32_t bytes, int is_tx)
+{
+    int _cnt = 0, _plen = 0;
+    rt_uint32_t hash = 0;
+    struct umqtt_topic_entry *entry = RT_NULL, *victim = RT_NULL;
+
+    if ((table == RT_NULL) || (topic == RT_NULL))
+        return;
+
+    _plen = umqtt_topic_prefix(topic, len, table->depth, &hash);
+
+    rt_mutex_take(table->lock, RT_WAITING_FOREVER);
+    for (_cnt = 0; _cnt < PKG_UMQTT_TOPIC_STATS_PROBE; _cnt++)
+    {
+        entry = &table->entry[(hash + _cnt) & UMQTT_TOPIC_MASK];
+        if ((entry->hash == hash) && (rt_strncmp(entry->stat.prefix, topic, _plen) == 0)
+         && (entry->stat.prefix[_plen] == '\0'))
+            goto found;
+
+        if ((victim == RT_NULL) || (entry->hash == 0)
+         || ((victim->hash != 0) && ((entry->last_tick - victim->last_tick) > (RT_TICK_MAX >> 1))))
+            victim = entry;
+    }
+
+    entry = victim;
+    rt_memset(entry, 0, sizeof(struct umqtt_topic_entry));
+    entry->hash = hash;
+    rt_memcpy(entry->stat.prefix, topic, _plen);
+    entry->stat.prefix[_plen] = '\0';
+
+found:
+    if (is_tx)
+    {
+        entry->stat.tx_msgs++;
+        entry->stat.tx_bytes += bytes;
+    }
+    else
+    {
+        entry->stat.rx_msgs++;
+        entry->stat.rx_bytes += bytes;
+    }
+    entry->last_tick = rt_tick_get();
+    rt_mutex_release(table->lock);
+}
+
+/**
+ * copy out the live entries of the table
+ *
+ * @param table the input, topic statistics table
+ * @param stats the output, statistics array
+ * @param max the input, statistics array length
+ *
+ * @return copied entries count
+ */
+int umqtt_topic_table_query(struct umqtt_topic_table *table, struct umqtt_topic_stat *stats, int max)
+{
+    int _cnt = 0, _num = 0;
+
+    if ((table == RT_NULL) || (stats == RT_NULL))
+        return 0;
+
+    rt_mutex_take(table->lock, RT_WAITING_FOREVER);
+    for (_cnt = 0; (_cnt < PKG_UMQTT_TOPIC_STATS_NUM) && (_num < max); _cnt++)
+    {
+        if (table->entry[_cnt].hash != 0)
+            rt_memcpy(&stats[_num++], &table->entry[_cnt].stat, sizeof(struct umqtt_topic_stat));
+    }
+    rt_mutex_release(table->lock);
+    return _num;
+}
+
+/* change the aggregation depth, the collected entries are cleared */
+void umqtt_topic_table_set_depth(struct umqtt_topic_table *table, int depth)
+{
+    if (table == RT_NULL)
+        return;
+
+    rt_mutex_take(table->lock, RT_WAITING_FOREVER);
+    table->depth = (depth < 1) ? 1 : depth;
+    rt_memset(table->entry, 0, sizeof(table->entry));
+    rt_mutex_release(table->lock);
+}
+
+#endif /* PKG_UMQTT_USING_TOPIC_STATS */
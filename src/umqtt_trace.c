@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2006-2022, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-19    RT-Thread       the first version
+ */
+
+#include <string.h>
+
+#include "umqtt_cfg.h"
+#include "umqtt_internal.h"
+#include "umqtt.h"
+
+#include <rtthread.h>
+
+#ifdef PKG_UMQTT_USING_TRACE
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/errno.h>
+
+#define DBG_TAG             "umqtt.trace"
+
+#ifdef PKG_UMQTT_USING_DEBUG
+#define DBG_LVL             DBG_LOG
+#else
+#define DBG_LVL             DBG_INFO
+#endif                      /* MQTT_DEBUG */
+#include <rtdbg.h>
+
+#define UMQTT_TRACE_MAGIC               0x54514D55      /* "UMQT" */
+#define UMQTT_TRACE_VERSION             1
+#define UMQTT_TRACE_MASK                (PKG_UMQTT_TRACE_RING_SIZE - 1)
+
+#if (PKG_UMQTT_TRACE_RING_SIZE & UMQTT_TRACE_MASK) != 0
+#error "PKG_UMQTT_TRACE_RING_SIZE must be a power of 2"
+#endif
+
+static struct umqtt_trace_evt umqtt_trace_ring[PKG_UMQTT_TRACE_RING_SIZE];
+static umqtt_atomic_t umqtt_trace_head = 0;                     /* next sequence number to claim */
+
+/**
+ * record one trace event, callable from any thread; a writer claims its slot
+ * with one atomic add, invalidates the slot sequence number first and
+ * publishes it by writing the sequence number last (a seqlock per slot).
+ *
+ * @param evt the input, enum umqtt_trace_id
+ * @param type the input, mqtt packet type
+ * @param packet_id the input, mqtt packet id, 0: none
+ * @param len the input, packet length
+ */
+void umqtt_trace_record(rt_uint8_t evt, rt_uint8_t type, rt_uint16_t packet_id, rt_uint32_t len)
+{
+    rt_uint32_t seq = (rt_uint32_t)umqtt_atomic_add(&umqtt_trace_head, 1);
+    volatile struct umqtt_trace_evt *slot = &umqtt_trace_ring[seq & UMQTT_TRACE_MASK];
+
+    slot->seq = 0;                                              /* torn while being rewritten */
+    umqtt_atomic_fence();
+    slot->stamp = PKG_UMQTT_TRACE_CLOCK();
+    slot->len = len;
+    slot->packet_id = packet_id;
+    slot->evt = evt;
+    slot->type = type;
+    umqtt_atomic_fence();
+    slot->seq = seq + 1;
+}
+
+/**
+ * dump the trace ring to a file, oldest event first.
+ *
+ * file layout: struct umqtt_trace_file header, then header.count records of
+ * struct umqtt_trace_evt in host byte order.
+ *
+ * @param path the input, output file path
+ *
+ * @return <0: failed or other error
+ *         >=0: dumped events count
+ */
+int umqtt_trace_dump(const char *path)
+{
+    int fd = -1, _ret = 0, _cnt = 0;
+    rt_uint32_t head = 0, first = 0, seq = 0;
+    struct umqtt_trace_file hdr;
+    struct umqtt_trace_evt evt;
+    volatile struct umqtt_trace_evt *slot = RT_NULL;
+
+    if (path == RT_NULL)
+        return UMQTT_INPARAMS_NULL;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        LOG_E(" open trace file %s failed! errno(%d)", path, errno);
+        return UMQTT_FAILED;
+    }
+
+    head = (rt_uint32_t)umqtt_atomic_load(&umqtt_trace_head);
+    first = (head > PKG_UMQTT_TRACE_RING_SIZE) ? (head - PKG_UMQTT_TRACE_RING_SIZE) : 0;
+
+    rt_memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = UMQTT_TRACE_MAGIC;
+    hdr.version = UMQTT_TRACE_VERSION;
+    hdr.evt_size = sizeof(struct umqtt_trace_evt);
+    hdr.clock_hz = PKG_UMQTT_TRACE_CLOCK_HZ;
+    hdr.count = 0;                                              /* patched once the records are written */
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+    {
+        _ret = UMQTT_FAILED;
+        goto exit;
+    }
+
+    for (seq = first; seq != head; seq++)
+    {
+        slot = &umqtt_trace_ring[seq & UMQTT_TRACE_MASK];
+        if (slot->seq != seq + 1)                               /* overwritten or still being written */
+            continue;
+        umqtt_atomic_fence();
+        rt_memcpy(&evt, (const void *)slot, sizeof(evt));
+        umqtt_atomic_fence();
+        if (slot->seq != seq + 1)                               /* rewritten during the copy */
+            continue;
+        if (write(fd, &evt, sizeof(evt)) != sizeof(evt))
+        {
+            _ret = UMQTT_FAILED;
+            goto exit;
+        }
+        _cnt++;
+    }
+
+    hdr.count = _cnt;
+    if ((lseek(fd, 0, SEEK_SET) < 0) || (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)))
+    {
+        _ret = UMQTT_FAILED;
+        goto exit;
+    }
+    _ret = _cnt;
+
+exit:
+    if (_ret < 0)
+        LOG_E(" write trace file %s failed! errno(%d)", path, errno);
+    close(fd);
+    return _ret;
+}
+
+#ifdef FINSH_USING_MSH
+static int umqtt_trace(int argc, char **argv)
+{
+    int _ret = 0;
+
+    if (argc != 2)
+    {
+        rt_kprintf("Usage: umqtt_trace <file>\n");
+        return -1;
+    }
+
+    _ret = umqtt_trace_dump(argv[1]);
+    if (_ret >= 0)
+        rt_kprintf("umqtt trace: %d events -> %s\n", _ret, argv[1]);
+    return _ret;
+}
+MSH_CMD_EXPORT(umqtt_trace, dump umqtt binary trace ring to file);
+#endif
+
+#endif /* PKG_UMQTT_USING_TRACE */